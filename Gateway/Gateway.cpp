@@ -0,0 +1,346 @@
+/*
+*  Title          :  Gateway
+*  Desc           :  Linux daemon that reads the hub's telemetry stream off its USB serial port
+*                 :  and hands it on as newline delimited JSON, one object per record, on
+*                 :  stdout and to every client of a local Unix socket.
+*                 :
+*                 :  alarm_gateway --device /dev/ttyACM0
+*                 :  alarm_gateway --device /dev/ttyACM0 --socket /run/lora-alarm.sock --quiet
+*                 :  socat - UNIX-CONNECT:/run/lora-alarm.sock
+*                 :
+*                 :  Batches the hub could not send, or that arrived damaged, show up as a
+*                 :  {"type":"lost"} line with the number of batches missing.  A client that
+*                 :  cannot keep up is disconnected rather than allowed to hold up the rest.
+*                 :  If the port goes away, as when the hub is unplugged, the daemon keeps
+*                 :  trying to open it again every second.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.0
+*
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <vector>
+
+#include <Telemetry.h>
+#include "TelemetryJson.h"
+
+#define GATEWAY_MAX_CLIENTS                         16
+#define GATEWAY_LINE_SIZE                           512
+
+typedef struct
+{
+    const char* device;
+    unsigned long baud;
+    const char* socketPath;
+    bool quiet;                 // No JSON on stdout
+    unsigned int statsSeconds;  // Decoder counters to stderr this often, 0 never
+} GatewayOptions;
+
+static volatile sig_atomic_t running = 1;
+
+static void onSignal(int)
+{
+    running = 0;
+}
+
+static double wallTime(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static speed_t baudConstant(unsigned long baud)
+{
+    switch (baud)
+    {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+    default: return 0;
+    }
+}
+
+// Raw mode, the stream is binary.  The USB CDC port on the hub ignores the baud rate
+// but a USB to UART bridge does not
+static int openPort(const char* device, unsigned long baud)
+{
+    int fd = open(device, O_RDONLY | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    struct termios tty;
+    if (tcgetattr(fd, &tty) == 0)
+    {
+        cfmakeraw(&tty);
+        cfsetispeed(&tty, baudConstant(baud));
+        cfsetospeed(&tty, baudConstant(baud));
+        tty.c_cflag |= CLOCAL | CREAD;
+        tty.c_cc[VMIN] = 1;
+        tty.c_cc[VTIME] = 0;
+        tcsetattr(fd, TCSANOW, &tty);
+    }
+    return fd;
+}
+
+static int openSocket(const char* path)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(fd, 4) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Writes every line to stdout and the socket clients
+class JsonOutput : public TelemetryHandler
+{
+public:
+    explicit JsonOutput(bool quiet) : _quiet(quiet) {}
+
+    void onBatch(const TelemetryBatch& batch, uint16_t lost) override
+    {
+        _time = wallTime();
+        if (lost > 0)
+        {
+            char line[GATEWAY_LINE_SIZE];
+            int len = snprintf(line, sizeof(line), "{\"type\":\"lost\",\"time\":%.3f,\"batch\":%u,\"batches\":%u}\n",
+                _time, batch.sequence, lost);
+            emit(line, (size_t)len);
+        }
+    }
+
+    void onRecord(const TelemetryBatch& batch, const TelemetryRecord& record) override
+    {
+        char line[GATEWAY_LINE_SIZE];
+        size_t len = telemetryJson(batch, record, _time, line, sizeof(line));
+        if (len > 0)
+        {
+            emit(line, len);
+        }
+    }
+
+    void addClient(int fd)
+    {
+        if (_clients.size() >= GATEWAY_MAX_CLIENTS)
+        {
+            close(fd);
+            return;
+        }
+        _clients.push_back(fd);
+    }
+
+    void closeClients(void)
+    {
+        for (int fd : _clients)
+        {
+            close(fd);
+        }
+        _clients.clear();
+    }
+
+    unsigned long clientsDropped(void) const { return _clientsDropped; }
+
+private:
+    void emit(const char* line, size_t len)
+    {
+        if (!_quiet)
+        {
+            fwrite(line, 1, len, stdout);
+            fflush(stdout);
+        }
+        for (size_t i = 0; i < _clients.size();)
+        {
+            // A short write would leave a torn line, so any client that is not keeping up goes
+            ssize_t sent = send(_clients[i], line, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (sent != (ssize_t)len)
+            {
+                close(_clients[i]);
+                _clients.erase(_clients.begin() + i);
+                _clientsDropped++;
+                continue;
+            }
+            i++;
+        }
+    }
+
+    bool _quiet;
+    double _time = 0.0;
+    std::vector<int> _clients;
+    unsigned long _clientsDropped = 0;
+};
+
+static void usage(void)
+{
+    printf("usage: alarm_gateway --device path [--baud rate] [--socket path] [--quiet] [--stats s]\n");
+}
+
+static bool parseOptions(int argc, char** argv, GatewayOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (strcmp(arg, "--quiet") == 0)
+        {
+            options.quiet = true;
+            continue;
+        }
+        if (value == nullptr)
+        {
+            return false;
+        }
+        i++;
+        if (strcmp(arg, "--device") == 0) options.device = value;
+        else if (strcmp(arg, "--baud") == 0) options.baud = strtoul(value, nullptr, 10);
+        else if (strcmp(arg, "--socket") == 0) options.socketPath = value;
+        else if (strcmp(arg, "--stats") == 0) options.statsSeconds = (unsigned int)atoi(value);
+        else return false;
+    }
+    return options.device != nullptr && baudConstant(options.baud) != 0;
+}
+
+int main(int argc, char** argv)
+{
+    GatewayOptions options;
+    options.device = nullptr;
+    options.baud = 115200;
+    options.socketPath = nullptr;
+    options.quiet = false;
+    options.statsSeconds = 0;
+
+    if (!parseOptions(argc, argv, options))
+    {
+        usage();
+        return 1;
+    }
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    int listener = -1;
+    if (options.socketPath != nullptr)
+    {
+        listener = openSocket(options.socketPath);
+        if (listener < 0)
+        {
+            fprintf(stderr, "cannot listen on %s: %s\n", options.socketPath, strerror(errno));
+            return 1;
+        }
+    }
+
+    JsonOutput output(options.quiet);
+    TelemetryDecoder decoder(output);
+    int port = -1;
+    double nextOpen = 0.0;
+    double nextStats = wallTime() + options.statsSeconds;
+
+    while (running)
+    {
+        double now = wallTime();
+        if (port < 0 && now >= nextOpen)
+        {
+            port = openPort(options.device, options.baud);
+            if (port < 0)
+            {
+                fprintf(stderr, "cannot open %s: %s, retrying\n", options.device, strerror(errno));
+                nextOpen = now + 1.0;
+            }
+        }
+        if (options.statsSeconds > 0 && now >= nextStats)
+        {
+            fprintf(stderr, "gateway: %lu bytes, %lu batches, %lu records, %lu bad frames, %lu batches lost, %lu clients dropped\n",
+                decoder.bytes(), decoder.batches(), decoder.records(), decoder.badFrames(), decoder.lostBatches(),
+                output.clientsDropped());
+            nextStats = now + options.statsSeconds;
+        }
+
+        struct pollfd fds[2];
+        nfds_t count = 0;
+        if (port >= 0)
+        {
+            fds[count].fd = port;
+            fds[count].events = POLLIN;
+            count++;
+        }
+        if (listener >= 0)
+        {
+            fds[count].fd = listener;
+            fds[count].events = POLLIN;
+            count++;
+        }
+        if (poll(fds, count, 250) < 0)
+        {
+            continue;       // Interrupted by a signal
+        }
+
+        for (nfds_t i = 0; i < count; i++)
+        {
+            if (fds[i].fd == listener && (fds[i].revents & POLLIN))
+            {
+                int client = accept(listener, nullptr, nullptr);
+                if (client >= 0)
+                {
+                    output.addClient(client);
+                }
+            }
+            else if (fds[i].fd == port && (fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+            {
+                uint8_t buffer[4096];
+                ssize_t len = read(port, buffer, sizeof(buffer));
+                if (len > 0)
+                {
+                    decoder.feed(buffer, (size_t)len);
+                }
+                else if (len == 0 || (errno != EAGAIN && errno != EINTR))
+                {
+                    fprintf(stderr, "%s closed, reopening\n", options.device);
+                    close(port);
+                    port = -1;
+                    nextOpen = wallTime() + 1.0;
+                }
+            }
+        }
+    }
+
+    if (port >= 0)
+    {
+        close(port);
+    }
+    output.closeClients();
+    if (listener >= 0)
+    {
+        close(listener);
+        unlink(options.socketPath);
+    }
+    return 0;
+}
@@ -0,0 +1,101 @@
+/*
+*  Title          :  TelemetryJson
+*  Desc           :  One line of JSON for each telemetry record, the format the gateway daemon
+*                 :  writes.  Host only, the hub never builds JSON.
+*                 :
+*                 :  {"type":"node","time":1760000000.123,"hub_ms":81234,"batch":17,"address":1,
+*                 :   "state":"SET","relay1":true,"relay2":false,"inputs":1,"rssi":-71,"snr":9,
+*                 :   "rx":212,"missed":0,"sf":7,"tx_power":14}
+*                 :
+*                 :  time is the host's clock when the batch arrived, hub_ms the hub's millis()
+*                 :  of the event.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.1
+*  History        : 1.0 2026-10-17 Node, command, hub and lost records
+*                 : 1.1 2026-10-17 Settings the node refused
+*
+*/
+
+#ifndef LORA_ALARM_TELEMETRY_JSON_H
+#define LORA_ALARM_TELEMETRY_JSON_H
+
+#include <stdio.h>
+
+#include <AlarmTypes.h>
+#include <Telemetry.h>
+
+inline const char* telemetryAlarmState(uint8_t state)
+{
+    switch (state)
+    {
+    case IDLE: return "IDLE";
+    case CLEAR: return "CLEAR";
+    case SET: return "SET";
+    case TEST: return "TEST";
+    default: return "UNKNOWN";
+    }
+}
+
+inline const char* telemetryCommandState(uint8_t state)
+{
+    switch (state)
+    {
+    case COMMAND_NONE: return "NONE";
+    case COMMAND_QUEUED: return "QUEUED";
+    case COMMAND_IN_FLIGHT: return "IN_FLIGHT";
+    case COMMAND_DELIVERED: return "DELIVERED";
+    case COMMAND_FAILED: return "FAILED";
+    case COMMAND_REJECTED: return "REJECTED";
+    default: return "UNKNOWN";
+    }
+}
+
+// Writes the line with its newline into out, returns its length, 0 if it did not fit
+inline size_t telemetryJson(const TelemetryBatch& batch, const TelemetryRecord& record, double time, char* out, size_t size)
+{
+    int len = 0;
+    switch (record.type)
+    {
+    case TELEMETRY_NODE:
+    {
+        const TelemetryNode& node = record.node;
+        len = snprintf(out, size,
+            "{\"type\":\"node\",\"time\":%.3f,\"hub_ms\":%lu,\"batch\":%u,\"address\":%u,\"state\":\"%s\","
+            "\"relay1\":%s,\"relay2\":%s,\"inputs\":%u,\"rssi\":%d,\"snr\":%d,\"rx\":%lu,\"missed\":%lu,"
+            "\"sf\":%u,\"tx_power\":%d}\n",
+            time, (unsigned long)record.ms, batch.sequence, node.address, telemetryAlarmState(node.alarmState),
+            (node.relays & 0x01) ? "true" : "false", (node.relays & 0x02) ? "true" : "false", node.inputs,
+            node.rssi, node.snr, (unsigned long)node.rxCount, (unsigned long)node.missedPolls,
+            node.spreadingFactor, node.txPower);
+        break;
+    }
+    case TELEMETRY_COMMAND:
+    {
+        const TelemetryCommand& command = record.command;
+        len = snprintf(out, size,
+            "{\"type\":\"command\",\"time\":%.3f,\"hub_ms\":%lu,\"batch\":%u,\"address\":%u,\"sequence\":%u,"
+            "\"state\":\"%s\",\"latency_ms\":%u}\n",
+            time, (unsigned long)record.ms, batch.sequence, command.address, command.sequence,
+            telemetryCommandState(command.state), command.latencyMs);
+        break;
+    }
+    case TELEMETRY_HUB:
+    {
+        const TelemetryHub& hub = record.hub;
+        len = snprintf(out, size,
+            "{\"type\":\"hub\",\"time\":%.3f,\"hub_ms\":%lu,\"batch\":%u,\"nodes\":%u,\"rejected_frames\":%lu,"
+            "\"commands_queued\":%lu,\"commands_dropped\":%lu,\"ui_dropped\":%lu,\"telemetry_dropped\":%lu}\n",
+            time, (unsigned long)record.ms, batch.sequence, hub.nodes, (unsigned long)hub.rejectedFrames,
+            (unsigned long)hub.commandsQueued, (unsigned long)hub.commandsDropped, (unsigned long)hub.uiDropped,
+            (unsigned long)hub.telemetryDropped);
+        break;
+    }
+    default:
+        return 0;
+    }
+    return (len > 0 && (size_t)len < size) ? (size_t)len : 0;
+}
+
+#endif // LORA_ALARM_TELEMETRY_JSON_H
@@ -7,14 +7,62 @@
 *                 :
 *  Author         :  Shaun Stewart
 *  Created        :  2025-04-21
-*  Version        :  1.0  Integration Test
+*  Version        :  3.2
 *                 :  2025-04-21  A.1  alpha test
 *                 :  2025-04-24  1.0  made variable naming and function naming more consistent.  End to end testing complete
+*                 :  2026-10-17  1.1  JSON radio payload replaced with the binary AlarmFrame codec
+*                 :  2026-10-17  1.2  node table and time slotted poll scheduler, the hub now watches many nodes
+*                 :  2026-10-17  1.3  listens between polls and acknowledges unsolicited alarm frames
+*                 :  2026-10-17  1.4  answers check ins from low power nodes with any pending command
+*                 :  2026-10-17  1.5  radio state machine moved to HubProtocol in the shared library so it
+*                 :                   also builds on the host against the simulator.  This file is the glue
+*                 :  2026-10-17  1.6  UI commands are sequenced, acknowledged by the node and retried with
+*                 :                   backoff.  The reply to the UI carries the command's progress
+*                 :  2026-10-17  1.7  adaptive data rate, each node is polled at the fastest spreading factor
+*                 :                   and lowest power its link allows.  LORA_SPREADING_FACTOR is the base rate
+*                 :                   every node can be heard at, the hub listens there between polls
+*                 :  2026-10-17  1.8  the UI is no longer answered every 500 ms.  The hub pushes the state of the
+*                 :                   node the UI shows when it changes, plus a heartbeat, to the UI's MAC only
+*                 :  2026-10-17  1.9  every change of a node's alarm state is logged to flash with its RSSI and SNR
+*                 :  2026-10-17  2.0  LoRa frames and ESP-NOW messages are AES-128 CCM sealed with a frame counter
+*                 :                   against replay.  Each node has its own key, derived from networkKey.  Frame
+*                 :                   counters are kept in NVS
+*                 :  2026-10-17  2.1  periodic work runs on a TimerWheel from loop(), hub.loop() still runs every
+*                 :                   pass.  task_trace prints task runs, overruns and lateness every minute
+*                 :  2026-10-17  2.2  UI requests are handed from the Wi-Fi task through a lock free queue and
+*                 :                   all of them are acted on.  A command for a node with one already on its way
+*                 :                   waits in the hub's per node command queue, alarm commands first.
+*                 :                   queue_trace prints the queue depth, wait and drops every minute
+*                 :  2026-10-17  2.3  serial_gateway streams node, command and hub records over USB serial in
+*                 :                   CRC checked COBS batches for the alarm_gateway daemon on a Linux host
+*                 :  2026-10-17  2.4  node settings are sent over LoRa from the UI.  A node given a new address is
+*                 :                   followed there and the node list is kept in NVS from then on.  A node at
+*                 :                   provisioningAddress that moves leaves that address free for the next one
+*                 :  2026-10-17  2.5  the radio settings come from AlarmRadio in AlarmProfile.h, shared with every
+*                 :                   node, and the buzzer pin from a board profile checked at compile time
+*                 :  2026-10-17  2.6  the radio runs in its own FreeRTOS task, woken by the SX1262's DIO1
+*                 :                   interrupt rather than loop() calling Radio.IrqProcess() every pass.
+*                 :                   loop() sleeps until its next task is due.  radio_trace prints the
+*                 :                   wakes, IRQ to handler latency and how busy the core is every minute
+*                 :  2026-10-17  2.7  every frame is charged to the sub-band's hourly duty cycle.  Polls and
+*                 :                   commands wait when it is spent, alarm ACKs never do.  radio_trace
+*                 :                   also prints the airtime of the last hour
+*                 :  2026-10-17  2.8  nodes are spread over the AlarmChannels channel plan.  Each is polled on
+*                 :                   its own channel and the hub scans them all with CAD between polls
+*                 :  2026-10-17  2.9  nodes out of range are reached through AlarmRelay repeaters.  The hub
+*                 :                   learns each node's route from the frames it hears and waits the extra hops
+*                 :  2026-10-17  3.0  with an AlarmSuperframe period the hub sends a beacon on every channel each
+*                 :                   period and gives low power nodes a check in slot after it
+*                 :  2026-10-17  3.1  TX and RX timeouts from the driver's timer are only flagged, the radio task
+*                 :                   hands them to the hub with hubLock held
+*                 :  2026-10-17  3.2  the radio task no longer wakes every 10 ms to poll the hub.  It sleeps until
+*                 :                   DIO1, a UI command or the next poll, retry or beacon hub.idle() gives
+*                 :  2026-10-17  3.3  loop() takes hubLock only in the tasks that touch the hub, and only around
+*                 :                   that.  Alarm state changes reach the event log through eventQueue, so its
+*                 :                   flash erases and writes run in loop() with the lock free
 *
 */
 
-#include <ArduinoJson.h>
-#include <ArduinoJson.hpp>
 #include <ESP32_NOW.h>
 //#include <WiFiAP.h>
 //#include <WiFiClient.h>
@@ -26,10 +74,32 @@
 //#include <WiFiType.h>
 //#include <WiFiUdp.h>
 #include <WiFi.h>
+#include <Preferences.h>
 #include "LoRaWan_APP.h"
+#include <AlarmTypes.h>
+#include <AlarmProfile.h>
+#include <HubProtocol.h>
+#include <HeltecRadio.h>
+#include <ConsoleLink.h>
+#include <FrameSecurity.h>
+#include <EspFlash.h>
+#include <EventLog.h>
+#include <TimerWheel.h>
+#include <SpscQueue.h>
+#include <Telemetry.h>
+#include <atomic>
 
 // debug stuff
 //#define debug_print  // manages most of the print and println debug
+//#define latency_trace  // prints alarm frame received to buzzer time
+//#define task_trace  // prints the runs, overruns and worst lateness of every loop() task each minute
+//#define queue_trace  // prints the command queue depth, wait and drops each minute
+//#define serial_gateway  // streams binary telemetry to alarm_gateway, the serial port carries nothing else
+//#define radio_trace  // prints the radio task's wakes, DIO1 to handler latency and the core's busy time each minute
+
+#if defined serial_gateway && (defined debug_print || defined latency_trace || defined task_trace || defined queue_trace)
+#error "serial_gateway needs the serial port to itself, turn the traces off"
+#endif
 
 #if defined debug_print
 #define debug_begin(x)        Serial.begin(x)
@@ -41,99 +111,321 @@
 #define debugln(x)
 #endif
 
-// LoRa stuff
-#define RF_FREQUENCY                                868000000 // Hz
+// LoRa stuff.  Frequency, bandwidth, spreading factor, coding rate and power are AlarmRadio in
+// AlarmProfile.h, the nodes are built with the same
+#define RX_TIMEOUT_VALUE                            100      // ms
+#define LORA_SYMBOL_TIMEOUT                         0         // Symbols
 
-#define TX_OUTPUT_POWER                             14       // dBm
+#define BUFFER_SIZE                                 RELAY_FRAME_MAX_SIZE // Define the payload size here, relayed frames arrive wrapped
+// GPIO pin assignments, a pin the board already uses fails the build
+typedef HeltecV3HubPins<7> BoardPins;       // buzzer
+
+#define MAX_NODES                                   64 // Size of the node table
+
+#define EVENT_LOG_PARTITION                         "spiffs" // Data partition the event log takes over
+#define EVENT_LOG_SECTORS                           16 // 4 KB each, about 3800 to 4000 events
+#define TASK_WHEEL_SLOTS                            64 // 1 ms each, a power of two
+#define TASK_POOL_SIZE                              8  // Periodic tasks loop() can run
+#define UI_QUEUE_SIZE                               8  // Requests from the UI waiting for loop(), a power of two
+#define EVENT_QUEUE_SIZE                            64 // Alarm state changes waiting for the event log, a power of two
+#define GATEWAY_BAUD                                115200 // Ignored by the USB CDC port, used by a UART bridge
+#define RADIO_TASK_STACK                            6144   // bytes
+#define RADIO_TASK_PRIORITY                         2      // Above loop(), below the Wi-Fi task
+
+constexpr long watchdogInterval = 120000;  // interval at which every node is sent a watchdog signal
+constexpr long minSlotInterval = 250;      // shortest poll slot, long enough for one TX + RX exchange
+constexpr uint8_t commandWindow = 4;       // UI commands being sent at once, the rest queue
+constexpr uint8_t commandMaxAttempts = 6;  // transmissions before a command is reported failed to the UI
+constexpr long commandBackoff = 500;       // first command retry delay, doubles on every failed attempt
+constexpr bool adaptiveDataRate = true;    // move nodes with a good link to a faster SF and lower power
+constexpr int8_t minTxPower = 2;           // dBm, lowest power ADR will ask a node for
+constexpr uint8_t txPowerStep = 2;         // dB
+constexpr int8_t linkMargin = 10;          // dB of SNR kept above the demodulator floor for fading
+constexpr uint8_t linkHistory = 10;        // frames heard at a rate before ADR changes it
+constexpr uint8_t linkMissLimit = 3;       // missed polls before a node is polled at the base rate again
+constexpr long uiHeartbeatInterval = 5000; // the UI is sent the node state at least this often
+constexpr long uiTimeout = 30000;          // stop pushing to a UI that has been silent this long
+constexpr long eventLogMaxAge = 10000;     // longest an event waits in RAM for the rest of its flash batch
+constexpr uint32_t uiServiceInterval = 5;  // UI requests are answered and changes pushed this often
+constexpr uint32_t eventLogServiceInterval = 500; // a part batch past eventLogMaxAge is written within this
+constexpr uint32_t taskReportInterval = 60000;
+constexpr uint32_t telemetryMaxAge = 100;  // longest a record waits for the rest of its batch
+constexpr uint32_t telemetryHeartbeat = 5000; // an empty batch at least this often, so the gateway sees the hub
+constexpr uint32_t telemetryServiceInterval = 20;
+constexpr uint32_t telemetryHubInterval = 10000; // hub counters this often
+constexpr uint32_t radioTaskGuard = 1000;  // longest the radio task sleeps, in case an interrupt is lost
+
+/******************************************************************************************
+LIST THE ADDRESSES OF THE REMOTE NODES THIS HUB WATCHES.  Once the UI has moved a node to a new
+address the list kept in NVS is used instead.  New nodes built with provisioningAddress, 0 for
+none, are given an address of their own from the UI one at a time */
+constexpr unsigned short nodeAddresses[] = { 1 };
+constexpr unsigned short provisioningAddress = 0;
+/*******************************************************************************************/
+
+/******************************************************************************************
+SET THE KEYS BEFORE COMPILING.  Every node's key is derived from networkKey, run
+frame_bench --derive <address> --network-key <networkKey in hex> for the one each RemoteNode needs.
+consoleKey is shared with the UI */
+const uint8_t networkKey[FRAME_KEY_SIZE] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+                                             0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+const uint8_t consoleKey[FRAME_KEY_SIZE] = { 0xf0, 0xe1, 0xd2, 0xc3, 0xb4, 0xa5, 0x96, 0x87,
+                                             0x78, 0x69, 0x5a, 0x4b, 0x3c, 0x2d, 0x1e, 0x0f };
+/*******************************************************************************************/
+
+// Sends the buzzer and trace output of the portable hub state machine to the board
+class HubBoard : public HubPlatform
+{
+public:
+    uint32_t millis(void) override { return ::millis(); }
+    void setBuzzer(bool on) override
+    {
+        debugln(on ? "Alarm on" : "Alarm off");
+        digitalWrite(BoardPins::buzzer, on ? HIGH : LOW);
+#ifdef latency_trace
+        Serial.printf("Frame received to buzzer %lu us\r\n", micros() - rxMicros);
+#endif
+    }
+    void nodeUpdated(size_t index) override;
+    void commandUpdated(size_t index) override;
+    void trace(const char* msg) override { debugln(msg); }
+    bool loadCounters(uint16_t address, FrameCounters& counters) override;
+    void storeCounters(uint16_t address, const FrameCounters& counters) override;
+    void nodeMoved(size_t index, uint16_t oldAddress) override;
 
-#define RX_TIMEOUT_VALUE                            100      // ms
+    uint32_t rxMicros = 0;
+};
 
-#define LORA_BANDWIDTH                              0         // [0: 125 kHz,
-                                                              //  1: 250 kHz,
-                                                              //  2: 500 kHz,
-                                                              //  3: Reserved]
-#define LORA_SPREADING_FACTOR                       7         // [SF7..SF12]
-#define LORA_CODINGRATE                             1         // [1: 4/5,
-                                                              //  2: 4/6,
-                                                              //  3: 4/7,
-                                                              //  4: 4/8]
-#define LORA_PREAMBLE_LENGTH                        8         // Same for Tx and Rx
-#define LORA_SYMBOL_TIMEOUT                         0         // Symbols
-#define LORA_FIX_LENGTH_PAYLOAD_ON                  false
-#define LORA_IQ_INVERSION_ON                        false
+static RadioEvents_t RadioEvents;
+HeltecRadio radio;
+HubBoard board;
+HubProtocol<MAX_NODES> hub(radio, board);
+int16_t Rssi, rxSize;
 
-#define BUFFER_SIZE                                 50 // Define the payload size here
-// Sensor GPIO pin assignments
-#define BUZZERPIN                                    7
+// The radio task owns the radio, loop() runs everything else.  hubLock is held by either one while
+// it touches the hub or anything the hub's callbacks change, never across flash erases or the
+// ESP-NOW send
+TaskHandle_t radioTaskHandle = NULL;
+SemaphoreHandle_t hubLock = NULL;
 
-typedef enum
-{
-    IDLING,
-    LOWPOWER,
-    STATE_RX,
-    STATE_TX
-} States_t;
+// Timeouts the driver reported, for the radio task to hand to the hub under hubLock
+#define RADIO_TIMEOUT_TX                            0x01
+#define RADIO_TIMEOUT_RX                            0x02
+std::atomic<uint8_t> radioTimeouts{0};
 
-typedef enum
+// Where the core's time goes, reset by every radio_trace report
+typedef struct
 {
-    IDLE,
-    CLEAR,
-    SET,
-    TEST
-} DeviceStates_t;
-
-typedef enum
+    unsigned long wakes;                // Radio task runs
+    unsigned long irqs;                 // Runs for a DIO1 interrupt
+    uint32_t irqLatencyTotal;           // us from the interrupt to the task holding hubLock
+    uint32_t irqLatencyMax;
+    uint64_t radioBusyUs;               // In hub.loop()
+    uint64_t loopBusyUs;                // In the loop() tasks
+    uint32_t sinceUs;
+} CoreLoad;
+
+CoreLoad coreLoad;
+
+// ESP-NOW link to the UI.  Requests are handed from the Wi-Fi task to loop() through uiQueue,
+// still sealed.  loop() checks them
+typedef struct
 {
-    INACTIVE,
-    ACTIVE
-} RelayStates_t;
-
+    uint8_t mac[CONSOLE_LINK_MAC_SIZE];
+    uint8_t data[CONSOLE_LINK_MESSAGE_SIZE];
+} UiRequest;
+
+ConsoleLink uiLink;
+SpscQueue<UiRequest, UI_QUEUE_SIZE> uiQueue;
+int uiNode = -1;                        // Table index of the node the UI is showing
+bool uiDirty = false;                   // That node reported in since the last push
+LoRaPacket uiLastPushed;
+
+// Alarm state history, survives a reboot.  The radio task queues each change, loop() appends it
+// and owns the log and its flash
 typedef struct
 {
-    unsigned short nodeAddress;
-    DeviceStates_t alarmState;
-    RelayStates_t relay1Enabled;
-    RelayStates_t relay2Enabled;
-    unsigned long rxTimeoutCount;
-    int16_t signalStrength;
-} LoRaPacket;
+    uint32_t timeMs;
+    uint16_t nodeAddress;
+    uint8_t state;
+    int8_t snr;
+    int16_t rssi;
+} LoggedEvent;
+
+EspFlash eventFlash;
+EventLog<MAX_NODES, EVENT_LOG_SECTORS> eventLog(eventFlash);
+SpscQueue<LoggedEvent, EVENT_QUEUE_SIZE> eventQueue;
+bool eventLogReady = false;
+uint8_t loggedState[MAX_NODES];         // Last alarm state queued for each node, 0xFF before the first
+
+// Frame counters of every link, so a reboot neither reuses a counter nor accepts an old frame
+Preferences counterStore;
+// Addresses of the nodes watched, once one has moved
+Preferences nodeStore;
+
+// Everything periodic in loop()
+TimerWheel<TASK_WHEEL_SLOTS, TASK_POOL_SIZE> tasks;
+
+#ifdef serial_gateway
+// Telemetry to the Linux gateway.  A batch the serial buffer has no room for is dropped
+// rather than blocking loop(), the gateway sees the gap in the batch numbers
+class SerialTelemetry : public TelemetryPort
+{
+public:
+    size_t writable(void) override { return (size_t)Serial.availableForWrite(); }
+    size_t write(const uint8_t* data, size_t len) override { return Serial.write(data, len); }
+};
+
+SerialTelemetry telemetryPort;
+TelemetryWriter telemetry(telemetryPort);
+uint8_t streamedState[MAX_NODES];       // Last alarm state streamed for each node, 0xFF before the first
+#endif
 
-constexpr long watchdogInterval = 120000;  // interval at which to send watchdog signal
+const HeltecRadioConfig radioConfig =
+{
+    AlarmRadio::frequency,
+    AlarmRadio::bandwidth,
+    AlarmRadio::codingRate,
+    AlarmRadio::preambleLength,
+    LORA_SYMBOL_TIMEOUT,
+    AlarmRadio::fixLengthPayload,
+    AlarmRadio::iqInversion,
+    false,
+    3000
+};
+
+void HubBoard::nodeUpdated(size_t index)
+{
+    uiDirty |= (int)index == uiNode;
 
-static RadioEvents_t RadioEvents;
-States_t state;
-bool sleepMode = false;
-int16_t Rssi, rxSize;
+    const LoRaPacket& status = hub.nodeState(index);
+    if (eventLogReady && status.alarmState != loggedState[index])
+    {
+        loggedState[index] = status.alarmState;
+        LoggedEvent event = { ::millis(), status.nodeAddress, status.alarmState, status.snr, status.signalStrength };
+        eventQueue.push(event);
+    }
+
+#ifdef serial_gateway
+    // A change of alarm state goes out at once, routine reports wait for the batch
+    TelemetryNode node;
+    node.address = status.nodeAddress;
+    node.alarmState = status.alarmState;
+    node.relays = (status.relay1Enabled == ACTIVE ? 0x01 : 0) | (status.relay2Enabled == ACTIVE ? 0x02 : 0);
+    node.inputs = status.inputs;
+    node.rssi = status.signalStrength;
+    node.snr = status.snr;
+    node.rxCount = status.rxCount;
+    node.missedPolls = status.rxTimeoutCount;
+    node.spreadingFactor = hub.link(index).rate().spreadingFactor;
+    node.txPower = hub.link(index).rate().txPower;
+    telemetry.node(::millis(), node, status.alarmState != streamedState[index]);
+    streamedState[index] = status.alarmState;
+#endif
+}
 
+// NVS keys are "n" and the node address, "ui" for the console link
+bool HubBoard::loadCounters(uint16_t address, FrameCounters& counters)
+{
+    char key[8];
+    sprintf(key, "n%u", address);
+    return counterStore.getBytes(key, &counters, sizeof(counters)) == sizeof(counters);
+}
 
-bool alarmActive = false;
-JsonDocument inDoc;
-JsonDocument outDoc;
-LoRaPacket packetData;
-LoRaPacket selectedState;
+void HubBoard::storeCounters(uint16_t address, const FrameCounters& counters)
+{
+    char key[8];
+    sprintf(key, "n%u", address);
+    counterStore.putBytes(key, &counters, sizeof(counters));
+}
+
+void HubBoard::nodeMoved(size_t index, uint16_t oldAddress)
+{
+    uiDirty |= (int)index == uiNode;
+#ifdef debug_print
+    Serial.printf("Node %u moved to %u\r\n", oldAddress, hub.nodeState(index).nodeAddress);
+#endif
+    if (oldAddress == provisioningAddress)
+    {
+        // The next new node starts its counters from 0 again
+        char key[8];
+        sprintf(key, "n%u", oldAddress);
+        counterStore.remove(key);
+        if (hub.addNode(oldAddress) < 0)
+        {
+            debugln("Node table full");
+        }
+    }
+    uint16_t addresses[MAX_NODES];
+    for (size_t i = 0; i < hub.nodeCount(); i++)
+    {
+        addresses[i] = hub.nodeState(i).nodeAddress;
+    }
+    nodeStore.putBytes("list", addresses, hub.nodeCount() * sizeof(uint16_t));
+}
 
-// REPLACE WITH THE MAC Address of your receiver 
-uint8_t broadcastAddress[] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+void HubBoard::commandUpdated(size_t index)
+{
+    uiDirty |= (int)index == uiNode;
+#ifdef debug_print
+    const LoRaPacket& status = hub.nodeState(index);
+    Serial.printf("Command %u for node %u: state %d, attempts %u, latency %u ms\r\n", status.commandSequence,
+        status.nodeAddress, status.commandState, hub.command(index).attempts, status.commandLatency);
+#endif
+#ifdef serial_gateway
+    const LoRaPacket& progress = hub.nodeState(index);
+    TelemetryCommand command = { progress.nodeAddress, progress.commandSequence, (uint8_t)progress.commandState,
+        progress.commandLatency };
+    telemetry.command(::millis(), command);
+#endif
+}
 
 esp_now_peer_info_t peerInfo;
 
 // Function prototypes
-// Radio
+// Radio, forwarded to the hub state machine
 void onTxDone(void);
 void onTxTimeout(void);
 void onRxDone(uint8_t* payload, uint16_t size, int16_t rssi, int8_t snr);
-void txPacket(void);
+void onRxTimeout(void);
 // Operation
-void handshake(void);
 void OnNowDataSent(const uint8_t* mac_addr, esp_now_send_status_t status);
 void OnNowDataRecv(const uint8_t* mac, const uint8_t* incomingData, int len);
+void serviceUi(void* context, uint32_t now);
+void pushToUi(uint32_t now);
+bool openUiRequest(UiRequest& message, uint32_t now);
+void serviceEventLog(void* context, uint32_t now);
+#ifdef task_trace
+void reportTasks(void* context, uint32_t now);
+#endif
+#ifdef queue_trace
+void reportQueues(void* context, uint32_t now);
+#endif
+#ifdef radio_trace
+void reportRadio(void* context, uint32_t now);
+#endif
+void radioTask(void* context);
+void wakeRadioTask(void);
+void takeRadioTimeouts(void);
+#ifdef serial_gateway
+void serviceTelemetry(void* context, uint32_t now);
+void streamHubStats(void* context, uint32_t now);
+#endif
 
 void setup()
 {
     debug_begin(9600);      // Start up the serial port if in debug mode
+    hubLock = xSemaphoreCreateMutex();
+#ifdef serial_gateway
+    Serial.begin(GATEWAY_BAUD);
+    memset(streamedState, 0xFF, sizeof(streamedState));
+#endif
+
+    pinMode(BoardPins::buzzer, OUTPUT);
+    digitalWrite(BoardPins::buzzer, LOW);
 
-    pinMode(BUZZERPIN, OUTPUT);
-    digitalWrite(BUZZERPIN, LOW);
+    counterStore.begin("counters", false);
+    nodeStore.begin("nodes", false);
 
     // Set device as a Wi-Fi Station
     WiFi.mode(WIFI_STA);
@@ -148,22 +440,83 @@ void setup()
     // get the status of Transmitted packet
     esp_now_register_send_cb(OnNowDataSent);
 
-    // Register peer
-    memcpy(peerInfo.peer_addr, broadcastAddress, 6);
+    // The UI is added as a peer when it is first heard, its discovery broadcasts need no peer.
+    // Messages are sealed by ConsoleLink, which also covers the broadcasts ESP-NOW encryption cannot
     peerInfo.channel = 0;
     peerInfo.encrypt = false;
-
-    // Add peer        
-    if (esp_now_add_peer(&peerInfo) != ESP_OK) {
-        debugln("Failed to add peer");
-        return;
+    uiLink.begin(uiHeartbeatInterval, uiTimeout);
+    uiLink.setKey(consoleKey, FRAME_HUB_TO_UI, FRAME_UI_TO_HUB);
+    if (counterStore.getBytes("ui", &uiLink.counters(), sizeof(FrameCounters)) == sizeof(FrameCounters))
+    {
+        frameCountersRestore(uiLink.counters());
     }
+
     // Register the data received callback function
     esp_now_register_recv_cb(esp_now_recv_cb_t(OnNowDataRecv));
 
-    selectedState.nodeAddress = 1;          // This is the address of the remote node you wish to control
-    selectedState.relay1Enabled = ACTIVE;
-    selectedState.relay2Enabled = ACTIVE;
+    memset(loggedState, 0xFF, sizeof(loggedState));
+    eventLogReady = eventFlash.begin(EVENT_LOG_PARTITION) && eventLog.begin(eventLogMaxAge);
+#ifdef debug_print
+    if (eventLogReady)
+    {
+        Serial.printf("Event log: %lu events in %u sectors, boot %u, %lu torn, most erased sector %lu times\r\n",
+            eventLog.count(), eventLog.sectors(), eventLog.boot(), eventLog.torn(), eventLog.maxEraseCount());
+    }
+    else
+    {
+        Serial.println("Event log unavailable");
+    }
+#endif
+
+    HubConfig config;
+    config.pollInterval = watchdogInterval;
+    config.minSlot = minSlotInterval;
+    config.rxTimeout = RX_TIMEOUT_VALUE;
+    config.commandWindow = commandWindow;
+    config.commandMaxAttempts = commandMaxAttempts;
+    config.commandBackoff = commandBackoff;
+    config.txPower = AlarmRadio::txPower;
+    config.bandwidth = AlarmRadio::bandwidth;
+    config.codingRate = AlarmRadio::codingRate;
+    config.channels = channelPlanMake(AlarmChannels::frequency, AlarmChannels::spacing, AlarmChannels::count,
+        AlarmRadio::preambleLength, AlarmRadio::spreadingFactor, AlarmRadio::bandwidth);
+    config.relay = relayPlanMake(AlarmRelay::hops, AlarmRadio::spreadingFactor, AlarmRadio::bandwidth,
+        AlarmRadio::codingRate, AlarmRadio::preambleLength, config.channels.scanPreamble);
+    config.superframe = superframePlanMake(AlarmSuperframe::period, AlarmSuperframe::slots, config.channels.count,
+        AlarmRadio::spreadingFactor, AlarmRadio::bandwidth, AlarmRadio::codingRate, config.channels.preambleLength,
+        config.channels.scanPreamble);
+    config.adr = adaptiveDataRate;
+    config.link.fallback.spreadingFactor = AlarmRadio::spreadingFactor;
+    config.link.fallback.txPower = AlarmRadio::txPower;
+    config.link.minSpreadingFactor = 7;
+    config.link.minTxPower = minTxPower;
+    config.link.powerStep = txPowerStep;
+    config.link.margin = linkMargin;
+    config.link.history = linkHistory;
+    config.link.missLimit = linkMissLimit;
+    config.networkKey = networkKey;
+    hub.begin(config);
+    uint16_t storedAddresses[MAX_NODES];
+    size_t storedCount = nodeStore.getBytes("list", storedAddresses, sizeof(storedAddresses)) / sizeof(uint16_t);
+    for (size_t i = 0; i < storedCount; i++)
+    {
+        hub.addNode(storedAddresses[i]);
+    }
+    if (storedCount == 0)
+    {
+        for (unsigned short address : nodeAddresses)
+        {
+            if (hub.addNode(address) < 0)
+            {
+                debugln("Node table full");
+                break;
+            }
+        }
+    }
+    if (provisioningAddress != 0)
+    {
+        hub.addNode(provisioningAddress);
+    }
 
     Mcu.begin(HELTEC_BOARD, SLOW_CLK_TPYE);
     Rssi = 0;
@@ -172,168 +525,348 @@ void setup()
     RadioEvents.TxTimeout = onTxTimeout;
     RadioEvents.RxDone = onRxDone;
 	RadioEvents.RxTimeout = onRxTimeout;
+    RadioEvents.CadDone = onCadDone;
+
+    radio.begin(&RadioEvents, radioConfig, AlarmRadio::spreadingFactor, AlarmRadio::txPower);
+    xTaskCreatePinnedToCore(radioTask, "radio", RADIO_TASK_STACK, NULL, RADIO_TASK_PRIORITY, &radioTaskHandle,
+        ARDUINO_RUNNING_CORE);
+    radio.notifyOnIrq(radioTaskHandle);
+    coreLoad.sinceUs = (uint32_t)esp_timer_get_time();
 
-    Radio.Init(&RadioEvents);
-    Radio.SetChannel(RF_FREQUENCY);
-    Radio.SetTxConfig(MODEM_LORA, TX_OUTPUT_POWER, 0, LORA_BANDWIDTH,
-        LORA_SPREADING_FACTOR, LORA_CODINGRATE,
-        LORA_PREAMBLE_LENGTH, LORA_FIX_LENGTH_PAYLOAD_ON,
-        true, 0, 0, LORA_IQ_INVERSION_ON, 3000);
-
-    Radio.SetRxConfig(MODEM_LORA, LORA_BANDWIDTH, LORA_SPREADING_FACTOR,
-        LORA_CODINGRATE, 0, LORA_PREAMBLE_LENGTH,
-        LORA_SYMBOL_TIMEOUT, LORA_FIX_LENGTH_PAYLOAD_ON,
-        0, true, 0, 0, LORA_IQ_INVERSION_ON, false);
-    state = IDLING;
+    tasks.begin(millis());
+    tasks.every(uiServiceInterval, serviceUi);
+    if (eventLogReady)
+    {
+        tasks.every(eventLogServiceInterval, serviceEventLog);
+    }
+#ifdef task_trace
+    tasks.every(taskReportInterval, reportTasks, NULL, taskReportInterval);
+#endif
+#ifdef queue_trace
+    tasks.every(taskReportInterval, reportQueues, NULL, taskReportInterval);
+#endif
+#ifdef radio_trace
+    tasks.every(taskReportInterval, reportRadio, NULL, taskReportInterval);
+#endif
+#ifdef serial_gateway
+    telemetry.begin(telemetryMaxAge, telemetryHeartbeat, millis());
+    tasks.every(telemetryServiceInterval, serviceTelemetry);
+    tasks.every(telemetryHubInterval, streamHubStats);
+#endif
 }
 
+// Each task takes hubLock itself, only around what it reads or changes of the hub's
 void loop()
 {
-    switch (state)
+    uint32_t start = (uint32_t)esp_timer_get_time();
+    tasks.run(millis());
+    coreLoad.loopBusyUs += (uint32_t)esp_timer_get_time() - start;
+    delay(tasks.idle(millis()));    // Sleep until the next task is due, the radio task wakes by itself
+}
+
+// Sleeps until DIO1 fires, loop() has a command for it or the hub's next poll, command retry or
+// beacon is due.  hub.idle() is read with hubLock held, radioTaskGuard caps the sleep
+void radioTask(void* context)
+{
+    uint32_t idle = 0;
+    for (;;)
     {
-        case IDLING:
-			handshake();
-			break;
-        case STATE_TX:
-            txPacket();
-            break;
-        case STATE_RX:
-            debugln("into RX mode");
-            Radio.Rx(RX_TIMEOUT_VALUE);
-            state = LOWPOWER;
-            break;
-        case LOWPOWER:
-            Radio.IrqProcess();
-            break;
-        default:
-            break;
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(idle < radioTaskGuard ? idle : radioTaskGuard));
+        xSemaphoreTake(hubLock, portMAX_DELAY);
+        uint32_t start = (uint32_t)esp_timer_get_time();
+        uint32_t irqMicros;
+        if (radio.takeIrq(irqMicros))
+        {
+            uint32_t latency = start - irqMicros;
+            coreLoad.irqs++;
+            coreLoad.irqLatencyTotal += latency;
+            coreLoad.irqLatencyMax = (latency > coreLoad.irqLatencyMax) ? latency : coreLoad.irqLatencyMax;
+        }
+        coreLoad.wakes++;
+        do
+        {
+            takeRadioTimeouts();
+            hub.loop();     // A frame to send or a window to open goes straight on
+        } while (hub.state() == STATE_TX || hub.state() == STATE_RX || radioTimeouts.load() != 0);
+        idle = hub.idle();
+        coreLoad.radioBusyUs += (uint32_t)esp_timer_get_time() - start;
+        xSemaphoreGive(hubLock);
     }
 }
 
-// Callback when data is sent
-void OnNowDataSent(const uint8_t* mac_addr, esp_now_send_status_t status) 
+// The hub's timeout handlers run here, in the radio task with hubLock held, never in the driver's
+// timer callback
+void takeRadioTimeouts(void)
 {
-    //debug("\r\nLast Packet Send Status:\t");
-    //debugln(status == ESP_NOW_SEND_SUCCESS ? "Delivery Success" : "Delivery Fail");
+    uint8_t timeouts = radioTimeouts.exchange(0);
+    if (timeouts & RADIO_TIMEOUT_TX)
+    {
+        hub.onTxTimeout();
+    }
+    if (timeouts & RADIO_TIMEOUT_RX)
+    {
+        hub.onRxTimeout();
+    }
 }
 
-// Callback when data is received
-void OnNowDataRecv(const uint8_t* mac, const uint8_t* incomingData, int len)
+void wakeRadioTask(void)
+{
+    if (radioTaskHandle != NULL)
+    {
+        xTaskNotifyGive(radioTaskHandle);
+    }
+}
+
+// Answer UI requests, push changes and the heartbeat, forget a UI that has gone quiet
+void serviceUi(void* context, uint32_t now)
 {
-    memcpy(&selectedState, incomingData, sizeof(selectedState));
+    // Every request that arrived since the last pass, in order, so no command is lost
+    bool answer = false;
+    UiRequest message;
+    while (uiQueue.pop(message))
+    {
+        answer |= openUiRequest(message, now);
+    }
+
+    if (answer)
+    {
+        pushToUi(now);
+    }
+    else if (uiLink.lost(now))
+    {
+        debugln("UI lost");
+        esp_now_del_peer(uiLink.peer());
+    }
+    else if (uiLink.paired() && uiNode >= 0)
+    {
+        xSemaphoreTake(hubLock, portMAX_DELAY);
+        bool changed = uiDirty && consolePacketChanged(hub.nodeState(uiNode), uiLastPushed);
+        uiDirty = false;
+        xSemaphoreGive(hubLock);
+        if (changed || uiLink.heartbeatDue(now))
+        {
+            pushToUi(now);
+        }
+    }
+
+#ifdef debug_print
+    float rate, saved;
+    if (uiLink.rateUpdate(now, rate, saved))
+    {
+        Serial.printf("UI link %.2f msg/s, %.2f msg/s saved\r\n", rate, saved);
+    }
+#endif
+}
+
+// Nothing that fails to authenticate gets to pair or send a command.  True if it should be answered
+bool openUiRequest(UiRequest& message, uint32_t now)
+{
+    LoRaPacket request;
+    bool store;
+    AlarmFrameResult_t result = uiLink.open(message.data, sizeof(message.data), request, store);
+    if (result != FRAME_OK)
+    {
+        debug("UI message rejected: ");
+        debugln(alarmFrameResultString(result));
+        return false;
+    }
+    if (store)
+    {
+        counterStore.putBytes("ui", &uiLink.counters(), sizeof(FrameCounters));
+    }
+
+    if (uiLink.paired() && memcmp(message.mac, uiLink.peer(), sizeof(message.mac)) != 0)
+    {
+        esp_now_del_peer(uiLink.peer());
+    }
+    if (uiLink.heard(message.mac, now))
+    {
+        debugln("UI paired");
+        memcpy(peerInfo.peer_addr, message.mac, sizeof(message.mac));
+        esp_now_add_peer(&peerInfo);
+    }
+
+    // Show the node the UI is looking at, the first node if it is not one of ours.
+    // The UI repeats a command until the reply shows it delivered or failed
+    xSemaphoreTake(hubLock, portMAX_DELAY);
+    int index = hub.setCommand(request);
+    uiNode = (index < 0) ? 0 : index;
+    xSemaphoreGive(hubLock);
+    wakeRadioTask();        // A new command can go on air now, the task was asleep until the next poll
+    return true;
+}
+
+// A full batch or one past eventLogMaxAge is written here, a sector may be erased first
+void serviceEventLog(void* context, uint32_t now)
+{
+    LoggedEvent event;
+    while (eventQueue.pop(event))
+    {
+        eventLog.append(event.timeMs, event.nodeAddress, event.state, event.rssi, event.snr);
+#ifdef debug_print
+        Serial.printf("Event %lu: node %u state %d rssi %d snr %d\r\n", eventLog.count(), event.nodeAddress,
+            event.state, event.rssi, event.snr);
+#endif
+    }
+    eventLog.service(now);
+}
 
-    if (selectedState.relay1Enabled != packetData.relay1Enabled || selectedState.relay2Enabled != packetData.relay2Enabled || selectedState.alarmState != packetData.alarmState)
+#ifdef task_trace
+void reportTasks(void* context, uint32_t now)
+{
+    for (int id = 0; id < TASK_POOL_SIZE; id++)
     {
-        debugln("State chenge requested");
-        state = STATE_TX;
+        const TimerTask& task = tasks.task(id);
+        if (task.fn != NULL)
+        {
+            Serial.printf("Task %d every %lu ms: %lu runs, %lu overruns, %lu ms late at worst\r\n",
+                id, task.interval, task.runs, task.overruns, task.maxLate);
+        }
     }
+    tasks.resetStats();
+}
+#endif
 
-    esp_err_t result = esp_now_send(broadcastAddress, (uint8_t*)&packetData, sizeof(packetData));
-
-#ifdef debug_print    
-    //if (result == ESP_OK)
-    //{
-    //    Serial.println("Sent with success");
-    //}
-    //else
-    //{
-    //    Serial.println("Error sending the data");
-    //}
+#ifdef queue_trace
+void reportQueues(void* context, uint32_t now)
+{
+    xSemaphoreTake(hubLock, portMAX_DELAY);
+    CommandQueueStats stats = hub.commandStats();
+    hub.resetCommandStats();
+    xSemaphoreGive(hubLock);
+    Serial.printf("Commands: %lu queued, %lu sent, %lu dropped, %u waiting, %u at most, wait %lu ms mean %lu ms max\r\n",
+        stats.queued, stats.started, stats.dropped, (unsigned int)stats.depth, (unsigned int)stats.maxDepth,
+        stats.started ? (unsigned long)(stats.totalWaitMs / stats.started) : 0UL, (unsigned long)stats.maxWaitMs);
+    Serial.printf("UI requests dropped by a full queue: %lu, events: %lu\r\n", (unsigned long)uiQueue.dropped(),
+        (unsigned long)eventQueue.dropped());
+}
 #endif
 
+#ifdef radio_trace
+void reportRadio(void* context, uint32_t now)
+{
+    xSemaphoreTake(hubLock, portMAX_DELAY);
+    CoreLoad load = coreLoad;
+    CoreLoad reset = {};
+    reset.sinceUs = (uint32_t)esp_timer_get_time();
+    coreLoad = reset;
+    DutyCycleStats airtime = hub.airtimeStats();
+    uint32_t airtimeUsed = hub.airtimeUsed();
+    xSemaphoreGive(hubLock);
+
+    uint32_t elapsed = reset.sinceUs - load.sinceUs;
+    float radioBusy = 100.0f * (float)load.radioBusyUs / (float)elapsed;
+    float loopBusy = 100.0f * (float)load.loopBusyUs / (float)elapsed;
+    Serial.printf("Radio task: %.1f wakes/s, %lu IRQs, IRQ to handler %lu us mean %lu us max\r\n",
+        1e6f * (float)load.wakes / (float)elapsed, load.irqs,
+        load.irqs ? (unsigned long)(load.irqLatencyTotal / load.irqs) : 0UL, (unsigned long)load.irqLatencyMax);
+    Serial.printf("Core %d: radio %.2f%%, loop %.2f%%, idle %.2f%% before other tasks\r\n",
+        xPortGetCoreID(), radioBusy, loopBusy, 100.0f - radioBusy - loopBusy);
+    int band = dutyCycleBandOf(AlarmRadio::frequency);
+    Serial.printf("Airtime: %lu ms in the last hour of %lu, %lu frames held back, %lu past the limit\r\n",
+        (unsigned long)airtimeUsed, band < 0 ? 0UL : (unsigned long)dutyCycleLimit(band), airtime.deferred, airtime.overLimit);
 }
+#endif
 
-void handshake(void)
+#ifdef serial_gateway
+// The hub's callbacks add records from the radio task, so the writer is only used under hubLock
+void serviceTelemetry(void* context, uint32_t now)
 {
-    static unsigned long previousMillis = 0;
-    unsigned long currentMillis = millis();
-    if (currentMillis - previousMillis >= watchdogInterval)
+    xSemaphoreTake(hubLock, portMAX_DELAY);
+    telemetry.service(now);
+    xSemaphoreGive(hubLock);
+}
+
+void streamHubStats(void* context, uint32_t now)
+{
+    xSemaphoreTake(hubLock, portMAX_DELAY);
+    const CommandQueueStats& stats = hub.commandStats();
+    TelemetryHub counters;
+    counters.nodes = (uint16_t)hub.nodeCount();
+    counters.rejectedFrames = hub.rejectedFrames();
+    counters.commandsQueued = stats.queued;
+    counters.commandsDropped = stats.dropped;
+    counters.uiDropped = uiQueue.dropped();
+    counters.telemetryDropped = telemetry.dropped();
+    telemetry.hub(now, counters);
+    xSemaphoreGive(hubLock);
+}
+#endif
+
+void pushToUi(uint32_t now)
+{
+    uint8_t sealed[CONSOLE_LINK_MESSAGE_SIZE];
+    bool store;
+    xSemaphoreTake(hubLock, portMAX_DELAY);
+    uiLastPushed = hub.nodeState(uiNode);
+    uiDirty = false;
+    xSemaphoreGive(hubLock);
+    size_t len = uiLink.seal(uiLastPushed, sealed, store);
+    if (store)
     {
-        previousMillis = currentMillis;
-		state = STATE_TX;  // Set state to TX to send a watchdog signal
+        counterStore.putBytes("ui", &uiLink.counters(), sizeof(FrameCounters));
     }
+    esp_now_send(uiLink.peer(), sealed, len);
+    uiLink.onSent(now);
 }
 
-void txPacket(void)
-{
-    char outBuffer[BUFFER_SIZE];
-    outDoc["g"] = selectedState.nodeAddress;
-    outDoc["m"] = selectedState.alarmState;
-    outDoc["r1"] = selectedState.relay1Enabled;
-    outDoc["r2"] = selectedState.relay2Enabled;
-    serializeJson(outDoc, outBuffer);
-    debug("Transmitting via radio: ");
-    debugln(outBuffer);
-    Radio.Send((uint8_t*)outBuffer, strlen(outBuffer));
-    state = LOWPOWER;
+// Callback when data is sent
+void OnNowDataSent(const uint8_t* mac_addr, esp_now_send_status_t status) 
+{
+    //debug("\r\nLast Packet Send Status:\t");
+    //debugln(status == ESP_NOW_SEND_SUCCESS ? "Delivery Success" : "Delivery Fail");
+}
+
+// Callback when data is received.  Runs in the Wi-Fi task, it only queues the request for loop().
+// A full queue drops it and counts the drop, the UI repeats anything it is waiting on
+void OnNowDataRecv(const uint8_t* mac, const uint8_t* incomingData, int len)
+{
+    if (len != CONSOLE_LINK_MESSAGE_SIZE)
+    {
+        return;
+    }
+    UiRequest message;
+    memcpy(message.mac, mac, sizeof(message.mac));
+    memcpy(message.data, incomingData, sizeof(message.data));
+    uiQueue.push(message);
 }
 
 void onTxDone(void)
 {
     debugln("TX done...");
-    state = STATE_RX;
+    hub.onTxDone();
 }
 
+// The driver may report a timeout from its own timer rather than from IrqProcess(), where
+// hubLock is not held.  Only note it, the radio task hands it to the hub
 void onTxTimeout(void)
 {
-    debugln("TX timeout...");
-    Radio.Sleep();
-    state = STATE_TX;
+    radioTimeouts.fetch_or(RADIO_TIMEOUT_TX);
+    wakeRadioTask();
 }
 
 void onRxTimeout(void)
 {
-    debugln("RX timeout...");
-	packetData.rxTimeoutCount++;
-    Radio.Sleep();
-    state = STATE_TX;
+    radioTimeouts.fetch_or(RADIO_TIMEOUT_RX);
+    wakeRadioTask();
+}
+
+// The channel scan between polls
+void onCadDone(bool channelActivityDetected)
+{
+    hub.onCadDone(channelActivityDetected);
 }
 
 void onRxDone(uint8_t* payload, uint16_t size, int16_t rssi, int8_t snr)
 {
-    static LoRaPacket oBuffer;
-    bool updateDisplay = false;
-    static char rxpacket[BUFFER_SIZE];
+#ifdef latency_trace
+    board.rxMicros = micros();
+#endif
     Rssi = rssi;
     rxSize = size;
-    memcpy(rxpacket, payload, size);
-    rxpacket[size] = '\0';
-    Radio.Sleep();
-
-    DeserializationError error = deserializeJson(inDoc, rxpacket);
-
-    if (error) 
-    {
-        debugln(F("deserializeJson() failed: "));
-        debugln(error.c_str());
-    }
-    else
-    {
-        // Extract the values
-        packetData.nodeAddress = inDoc["g"];
-        packetData.alarmState = static_cast<DeviceStates_t>(inDoc["m"]);
-        packetData.relay1Enabled = static_cast<RelayStates_t>(inDoc["r1"]);
-        packetData.relay2Enabled = static_cast<RelayStates_t>(inDoc["r2"]);
-		packetData.signalStrength = rssi;
-
-        switch (packetData.alarmState)
-        {
-        case SET:
-            debugln("Alarm on");
-            digitalWrite(BUZZERPIN, HIGH);
-            break;
-        case CLEAR:
-            debugln("Alarm off");
-            digitalWrite(BUZZERPIN, LOW);
-        case IDLE:
-        default:
-            break;
-        }
-    }
+    hub.onRxDone(payload, size, rssi, snr);
 
 #ifdef debug_print
-    Serial.printf("\r\nReceived packet \"%s\" with Rssi %d , length %d\r\n", rxpacket, Rssi, rxSize);
+    Serial.printf("\r\nReceived packet with Rssi %d , length %d\r\n", Rssi, rxSize);
 #endif
-
-    state = IDLING;
-}
\ No newline at end of file
+}
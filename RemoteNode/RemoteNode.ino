@@ -1,26 +1,83 @@
 /*
 *  Title          :  RemoteNode
-*  Desc           :  This firmware monitors the status of a PIR sensor.
+*  Desc           :  This firmware monitors the status of a PIR sensor and up to 7 more inputs.
 *                 :  If movement is detected, a message to that effect is trnasmitted to the
 *                 :  monitoring base station.  Two relays are made available to enable
 *                 :  other external devices if required.
 *                 :
 *  Author         :  Shaun Stewart
 *  Date           :  2025-04-23
-*  Version        :  1.1
+*  Version        :  2.5
 *  History        : A.0 2025-04-21 Creation
 *                 : 1.0 2025-04-23 Integration Test complete
 *                 : 1.1 2025-04-24 Watchdog function and sensor scan consolidated and moved
 *                 :     relay activation out of the timed loop.  Activation now instant(ish)
+*                 : 1.2 2026-10-17 JSON radio payload replaced with the binary AlarmFrame codec
+*                 :     Alarm edges are sent straight away (listen before talk, backoff, ACK and
+*                 :     retry) rather than waiting for the next hub poll
+*                 : 1.3 2026-10-17 Optional low power mode.  Deep sleep between timed check ins,
+*                 :     woken early by the sensor, with a short receive window for hub commands
+*                 : 1.4 2026-10-17 Sensor and radio state machine moved to NodeProtocol in the shared
+*                 :     library so it also builds on the host against the simulator
+*                 : 1.5 2026-10-17 Polls are heard and answered at the spreading factor and TX power
+*                 :     the hub's adaptive data rate picks, falling back to the base rate on link loss
+*                 : 1.6 2026-10-17 Frames are AES-128 CCM sealed with this node's key.  The frame counters
+*                 :     are kept in NVS so a power cut never reuses one
+*                 : 1.7 2026-10-17 The sensor is scanned every sensorScanInterval by a TimerWheel task,
+*                 :     the radio still runs every pass of loop()
+*                 : 1.8 2026-10-17 Several inputs, digital or analog, listed in inputConfigs and debounced
+*                 :     by SensorPipeline.  Alarm frames carry the mask of the active inputs
+*                 : 1.9 2026-10-17 Address, key, radio, intervals and pins are read from NVS at boot, the
+*                 :     values below are only the defaults.  The hub changes them over LoRa and the
+*                 :     node restarts with them once they are committed
+*                 : 2.0 2026-10-17 Radio defaults from AlarmRadio, shared with the hub.  Pins and relay count
+*                 :     from a board profile checked at compile time, settings naming a pin the board
+*                 :     uses are refused
+*                 : 2.1 2026-10-17 Frames are charged to the sub-band's hourly duty cycle, kept through deep
+*                 :     sleep.  Replies and check ins are dropped when it is spent, alarms never are
+*                 : 2.2 2026-10-17 Works on the AlarmChannels channel its address picks.  Alarms and check
+*                 :     ins carry a longer preamble when the hub has several channels to scan
+*                 : 2.3 2026-10-17 repeater_mode, a mains powered node passes frames on between the hub
+*                 :     and nodes on its channel that cannot hear it, see Repeater.h
+*                 : 2.4 2026-10-17 With an AlarmSuperframe a low power node checks in in the slot the hub
+*                 :     gives it, timed on the RTC which keeps counting through deep sleep
+*                 : 2.5 2026-10-17 alarmUplink set in nodeConfig, edges still go at once
 *
 */
 
-#include <ArduinoJson.hpp>
-#include <ArduinoJson.h>
 #include "LoRaWan_APP.h"
+#include <Preferences.h>
+#include <sys/time.h>
+#include <AlarmTypes.h>
+#include <AlarmProfile.h>
+#include <NodeProtocol.h>
+#include <NodeSettings.h>
+#include <HeltecRadio.h>
+#include <TimerWheel.h>
+#include <SensorPipeline.h>
+
+// Power
+//#define low_power_mode  // battery nodes: deep sleep between check ins, woken by the sensor or a timer
+//#define repeater_mode  // mains nodes: also pass frames on for nodes out of the hub's range
+
+#if defined low_power_mode && defined repeater_mode
+#error "A repeater has to keep listening, it cannot be a low power node"
+#endif
+#if defined repeater_mode
+static_assert(AlarmRelay::hops > 0, "Set the hops of AlarmRelay in AlarmProfile.h, the hub and the nodes wait for them");
+#endif
+
+#if defined low_power_mode
+#include "esp_sleep.h"
+#include "driver/rtc_io.h"
+#include <EnergyModel.h>
+#include <LoRaAirtime.h>
+#endif
 
 // debug stuff
 //#define debug_print  // manages most of the print and println debug, not all but most
+//#define latency_trace  // prints sensor edge to hub ACK time, an upper bound on edge to hub buzzer
+//#define task_trace  // prints the runs, overruns and worst lateness of every loop() task each minute
 
 #if defined debug_print
 #define debug_begin(x)        Serial.begin(x)
@@ -32,99 +89,316 @@
 #define debugln(x)
 #endif
 
-// LoRa stuff
-#define RF_FREQUENCY                                868000000 // Hz
-
-#define TX_OUTPUT_POWER                             14        // dBm
-
+// LoRa stuff, the defaults of the node settings.  Frequency, bandwidth, spreading factor, coding
+// rate and power are AlarmRadio in AlarmProfile.h, the hub is built with the same
 #define RX_TIMEOUT_VALUE                            1000      // ms
+#define ACK_TIMEOUT_VALUE                           200       // ms to wait for the hub to acknowledge an alarm
+#define RX_WINDOW_VALUE                             200       // ms, low power mode receive window after a check in
 
-#define LORA_BANDWIDTH                              0         // [0: 125 kHz,
-                                                              //  1: 250 kHz,
-                                                              //  2: 500 kHz,
-                                                              //  3: Reserved]
-#define LORA_SPREADING_FACTOR                       7         // [SF7..SF12]
-#define LORA_CODINGRATE                             1         // [1: 4/5,
-                                                              //  2: 4/6,
-                                                              //  3: 4/7,
-                                                              //  4: 4/8]
-#define LORA_PREAMBLE_LENGTH                        8         // Same for Tx and Rx
 #define LORA_SYMBOL_TIMEOUT                         0         // Symbols
-#define LORA_FIX_LENGTH_PAYLOAD_ON                  false
-#define LORA_IQ_INVERSION_ON                        false
 
-#define BUFFER_SIZE                                 50 // Define the payload size here
+#define BUFFER_SIZE                                 RELAY_FRAME_MAX_SIZE // Define the payload size here, frames for other nodes arrive wrapped
 
-// Sensor GPIO pin assignments
-#define SENSORPIN                                   7
-#define RELAYPIN1                                   6
-#define RELAYPIN2                                   5
+#define ALARM_MAX_ATTEMPTS                          6         // Give up and leave it to the next poll after this
+#define ALARM_BACKOFF_SLOT                          20        // ms, the backoff window doubles on every attempt
 
-typedef enum
-{
-    IDLING,
-    LOWPOWER,
-    STATE_RX,
-    STATE_TX
-} States_t;
+#define LINK_TIMEOUT_VALUE                          300000    // ms, back to the base rate after this long without a poll
+#define LINK_CHECK_INTERVAL                         10        // low power check ins between link checks on a reduced rate
+#define LINK_MISS_LIMIT                             2         // unanswered link checks before going back to the base rate
 
-typedef enum
-{
-    IDLE,
-    CLEAR,
-    SET,
-    TEST
-} DeviceStates_t;
-
-typedef enum
-{
-    INACTIVE,
-    ACTIVE
-} RelayStates_t;
+#define TASK_WHEEL_SLOTS                            16        // 1 ms each, a power of two
+#define TASK_POOL_SIZE                              4         // Periodic tasks loop() can run
 
-typedef struct
-{
-    unsigned short nodeAddress;
-    DeviceStates_t alarmState;
-    RelayStates_t relay1Enabled;
-    RelayStates_t relay2Enabled;
-} LoRaPacket;
+// GPIO pin assignments, the defaults of the node settings.  A pin the board already uses fails
+// the build.  relay count, sensor, relay 1, relay 2 (BOARD_NO_PIN for a single relay)
+typedef HeltecV3NodePins<2, 7, 6, 5> BoardPins;
 
-constexpr long watchdogInterval = 5000;   // interval at which to scan alarm sensor
+constexpr uint32_t sensorScanInterval = 5; // interval at which to scan the inputs, a node setting
+constexpr uint32_t taskReportInterval = 60000;
 constexpr uint32_t settlingTime = 60000;  // Time to allow the PIR sensor to stabilise
+constexpr uint32_t checkInInterval = 60000; // low power mode, time between check ins, a node setting.  Keep it below the hub's watchdogInterval
+
+// Low power mode battery estimate, printed at cold start when debugging
+constexpr float expectedAlarmsPerDay = 20.0f;
+constexpr float batteryCapacity = 3000.0f;  // mAh
+constexpr float batteryUsable = 0.8f;       // fraction of rated capacity
+
+/******************************************************************************************
+LIST THE INPUTS BEFORE COMPILING.  Bit n of the mask the hub sees is input n, at most 8.
+Input 0 is the one that wakes a node in low power mode, the rest are read at the timed wakes.
+The pins are defaults, each can be changed by a node setting.
+   kind, pin, activeHigh, setLevel, clearLevel, debounce ms, min hold ms, rate limit ms */
+const InputConfig inputConfigs[] =
+{
+    { INPUT_DIGITAL, BoardPins::sensor, true, 0, 0, 30, 2000, 1000 },       // PIR, held through short dropouts
+//  { INPUT_DIGITAL, 4, false, 0, 0, 50, 0, 500 },                  // Door contact to ground, bounces
+//  { INPUT_ANALOG, 1, true, 2600, 2200, 100, 1000, 1000 },         // Glass break or level sensor on the ADC
+};
+constexpr size_t inputCount = sizeof(inputConfigs) / sizeof(inputConfigs[0]);
+static_assert(inputCount <= NODE_SETTINGS_MAX_INPUTS, "At most 8 inputs");
+/*******************************************************************************************/
 
 /******************************************************************************************
-SET THE NODE ADDRESS BEFORE COMPILING */
+THE ADDRESS A NEW NODE STARTS WITH.  Either a build per node, or every node built with the
+hub's provisioningAddress and given its own address from the UI once it is up */
 constexpr unsigned short thisNodeAddress = 1;
 /*******************************************************************************************/
 
-LoRaPacket packetData;
+/******************************************************************************************
+THE KEY A NEW NODE STARTS WITH.  It is derived from the hub's networkKey and the address above,
+print it with frame_bench --derive <address> --network-key <networkKey in hex>.  A new address
+from the hub comes with its key.  This one is for address 1 and the example network key */
+const uint8_t nodeKey[FRAME_KEY_SIZE] = { 0x72, 0xbc, 0x78, 0x06, 0x89, 0xd3, 0xdd, 0x07,
+                                          0x88, 0x07, 0x3a, 0x6f, 0xcb, 0xa3, 0x1c, 0xc1 };
+/*******************************************************************************************/
+
+// Frame counters, so a reboot never reuses one
+Preferences counterStore;
+
+// Node settings, read at every boot.  Missing or damaged ones are replaced by the defaults above
+Preferences settingsPrefs;
+
+class PreferencesSettings : public SettingsPort
+{
+public:
+    size_t read(const char* name, void* buf, size_t size) override { return settingsPrefs.getBytes(name, buf, size); }
+    void write(const char* name, const void* data, size_t len) override { settingsPrefs.putBytes(name, data, len); }
+};
+
+PreferencesSettings settingsPort;
+NodeSettingsStore settings(settingsPort, BoardPins::reservedPins);
+
+// The inputs and relays on the pins the settings give
+InputConfig inputPinConfigs[inputCount];
+uint8_t relayPins[2];
+
+// RTC_DATA_ATTR keeps the debounced inputs through deep sleep in low power mode
+RTC_DATA_ATTR SensorPipeline<inputCount> inputs;
+
+// Sends the sensor, relay and sleep calls of the portable node state machine to the board
+class NodeBoard : public NodePlatform
+{
+public:
+    uint32_t millis(void) override { return ::millis(); }
+    // The RTC timer keeps counting through deep sleep, millis() starts again at every wake
+    uint32_t rtcMillis(void) override
+    {
+        struct timeval now;
+        gettimeofday(&now, nullptr);
+        return (uint32_t)((uint64_t)now.tv_sec * 1000 + now.tv_usec / 1000);
+    }
+    long random(long min, long max) override { return ::random(min, max); }
+    uint8_t readInputs(void) override { return inputs.mask(); }
+    bool inputsSettling(void) override { return inputs.settling(); }
+
+    void setRelays(bool relay1, bool relay2) override
+    {
+        debugln(relay1 || relay2 ? "Relays set" : "Relays cleared");
+        const bool on[2] = { relay1, relay2 };
+        for (uint8_t i = 0; i < BoardPins::relayCount; i++)
+        {
+            digitalWrite(relayPins[i], on[i] ? HIGH : LOW);
+        }
+    }
+
+    void deepSleep(uint32_t wakeAfterMs, bool wakeOnSensor, bool wakeLevel) override
+    {
+#if defined low_power_mode
+        debugln("Deep sleep");
+
+        // Keep the relays where they are while asleep
+        for (uint8_t i = 0; i < BoardPins::relayCount; i++)
+        {
+            gpio_hold_en((gpio_num_t)relayPins[i]);
+        }
+        gpio_deep_sleep_hold_en();
+
+        esp_sleep_enable_timer_wakeup((uint64_t)wakeAfterMs * 1000ULL);
+        if (wakeOnSensor)
+        {
+            // wakeLevel is input 0 active or not, turn it into the pin level
+            const InputConfig& input = inputPinConfigs[0];
+            bool pinLevel = (wakeLevel == input.activeHigh);
+            if (input.activeHigh)
+            {
+                rtc_gpio_pullup_dis((gpio_num_t)input.pin);
+                rtc_gpio_pulldown_en((gpio_num_t)input.pin);
+            }
+            else
+            {
+                rtc_gpio_pulldown_dis((gpio_num_t)input.pin);
+                rtc_gpio_pullup_en((gpio_num_t)input.pin);
+            }
+            esp_sleep_enable_ext0_wakeup((gpio_num_t)input.pin, pinLevel ? 1 : 0);
+        }
+        esp_deep_sleep_start();
+#endif
+    }
+
+    void alarmAcknowledged(uint8_t sequence, uint32_t edgeToAckMs, uint8_t attempts) override
+    {
+#ifdef latency_trace
+        Serial.printf("Alarm %u acknowledged %lu ms after the sensor edge, attempts %u\r\n",
+            sequence, edgeToAckMs, attempts);
+#endif
+    }
+
+    void trace(const char* msg) override { debugln(msg); }
+
+    // Raised to the counter floor that came with a new address
+    bool loadCounters(FrameCounters& counters) override
+    {
+        bool found = counterStore.getBytes("node", &counters, sizeof(counters)) == sizeof(counters);
+        return settings.applyCounterFloor(counters) || found;
+    }
+
+    void storeCounters(const FrameCounters& counters) override
+    {
+        counterStore.putBytes("node", &counters, sizeof(counters));
+    }
+
+    uint8_t configure(uint8_t key, uint32_t value) override
+    {
+#ifdef debug_print
+        Serial.printf("Setting %s = %lu\r\n", nodeConfigKeyName(key), (unsigned long)value);
+#endif
+        return settings.configure(key, value);
+    }
+
+    void restart(void) override { ESP.restart(); }
+};
+
+// The defaults, applySettings() fills in the stored settings before anything reads them
+NodeConfig nodeConfig =
+{
+    thisNodeAddress,
+#if defined low_power_mode
+    true,
+#else
+    false,
+#endif
+#if defined repeater_mode
+    true,
+#else
+    false,
+#endif
+    ACK_TIMEOUT_VALUE,
+    RX_WINDOW_VALUE,
+    checkInInterval,
+    ALARM_MAX_ATTEMPTS,
+    ALARM_BACKOFF_SLOT,
+    true,                                                     // Alarm edges go at once
+    channelPlanMake(AlarmChannels::frequency, AlarmChannels::spacing, AlarmChannels::count,
+        AlarmRadio::preambleLength, AlarmRadio::spreadingFactor, AlarmRadio::bandwidth),
+    relayPlanMake(AlarmRelay::hops, AlarmRadio::spreadingFactor, AlarmRadio::bandwidth, AlarmRadio::codingRate,
+        AlarmRadio::preambleLength, channelPlanMake(AlarmChannels::frequency, AlarmChannels::spacing,
+        AlarmChannels::count, AlarmRadio::preambleLength, AlarmRadio::spreadingFactor,
+        AlarmRadio::bandwidth).scanPreamble),
+    {},                                                       // applySettings() works out the superframe
+    { AlarmRadio::spreadingFactor, AlarmRadio::txPower },     // The hub's base rate
+    LINK_TIMEOUT_VALUE,
+    LINK_CHECK_INTERVAL,
+    LINK_MISS_LIMIT,
+    nodeKey
+};
+
+HeltecRadioConfig radioConfig =
+{
+    AlarmRadio::frequency,
+    AlarmRadio::bandwidth,
+    AlarmRadio::codingRate,
+    AlarmRadio::preambleLength,
+    LORA_SYMBOL_TIMEOUT,
+    AlarmRadio::fixLengthPayload,
+    AlarmRadio::iqInversion,
+    true,
+    3000
+};
+
+// RTC_DATA_ATTR keeps the retained state through deep sleep in low power mode
+RTC_DATA_ATTR NodeRetained retained;
 static RadioEvents_t RadioEvents;
-States_t state;
+HeltecRadio radio;
+NodeBoard board;
+NodeProtocol node(radio, board, nodeConfig, retained);
+TimerWheel<TASK_WHEEL_SLOTS, TASK_POOL_SIZE> tasks;
 int16_t Rssi, rxSize;
-JsonDocument inDoc;
-JsonDocument outDoc;
-DeviceStates_t alarmState = IDLE;
 
 // Function prototypes
+// Radio, forwarded to the node state machine
 void onTxDone(void);
 void onTxTimeout(void);
 void onRxDone(uint8_t* payload, uint16_t size, int16_t rssi, int8_t snr);
-void txPacket(DeviceStates_t msg);
-void sensorScanner(void);
+void onRxTimeout(void);
+void onCadDone(bool channelActivityDetected);
+void scanSensor(void* context, uint32_t now);
+void applySettings(void);
+#ifdef task_trace
+void reportTasks(void* context, uint32_t now);
+#endif
+#if defined low_power_mode
+void reportEnergyEstimate(void);
+#endif
 
 void setup()
 {
     debug_begin(9600);      // Start up the serial port if in debug mode
 
-    pinMode(SENSORPIN, INPUT_PULLDOWN);
-    pinMode(RELAYPIN1, OUTPUT);
-    pinMode(RELAYPIN2, OUTPUT);
-    digitalWrite(RELAYPIN1, LOW);
-    digitalWrite(RELAYPIN2, LOW);
+    counterStore.begin("counters", false);
+    settingsPrefs.begin("settings", false);
+    applySettings();
 
-    packetData.relay1Enabled = ACTIVE;
-    packetData.relay2Enabled = ACTIVE;
+    NodeWake_t wake = WAKE_COLD_START;
+#if defined low_power_mode
+    esp_sleep_wakeup_cause_t wakeCause = esp_sleep_get_wakeup_cause();
+    if (wakeCause == ESP_SLEEP_WAKEUP_EXT0)
+    {
+        wake = WAKE_SENSOR;
+    }
+    else if (wakeCause != ESP_SLEEP_WAKEUP_UNDEFINED)
+    {
+        wake = WAKE_TIMER;
+    }
+    rtc_gpio_deinit((gpio_num_t)inputPinConfigs[0].pin);  // Hand the wake pin back to the digital GPIO
+#endif
+
+    for (size_t i = 0; i < inputCount; i++)
+    {
+        const InputConfig& input = inputPinConfigs[i];
+        if (input.kind == INPUT_DIGITAL)
+        {
+            pinMode(input.pin, input.activeHigh ? INPUT_PULLDOWN : INPUT_PULLUP);
+        }
+    }
+    if (wake == WAKE_COLD_START)
+    {
+        inputs.begin(inputPinConfigs, millis());
+    }
+    else
+    {
+        inputs.resume(millis());
+    }
+    for (uint8_t i = 0; i < BoardPins::relayCount; i++)
+    {
+        pinMode(relayPins[i], OUTPUT);
+    }
+
+#if defined low_power_mode
+    if (wake != WAKE_COLD_START)
+    {
+        // The relays were held through deep sleep, drive the same level before releasing them
+        const LoRaPacket& packetData = retained.packetData;
+        const bool on[2] = { packetData.relay1Enabled == ACTIVE, packetData.relay2Enabled == ACTIVE };
+        for (uint8_t i = 0; i < BoardPins::relayCount; i++)
+        {
+            digitalWrite(relayPins[i], (retained.alarmActive && on[i]) ? HIGH : LOW);
+        }
+    }
+    for (uint8_t i = 0; i < BoardPins::relayCount; i++)
+    {
+        gpio_hold_dis((gpio_num_t)relayPins[i]);
+    }
+#endif
 
     Mcu.begin(HELTEC_BOARD, SLOW_CLK_TPYE);
     Rssi = 0;
@@ -132,157 +406,177 @@ void setup()
     RadioEvents.TxDone = onTxDone;
     RadioEvents.TxTimeout = onTxTimeout;
     RadioEvents.RxDone = onRxDone;
+    RadioEvents.RxTimeout = onRxTimeout;
+    RadioEvents.CadDone = onCadDone;
+
+    randomSeed(esp_random());
+
+    radio.begin(&RadioEvents, radioConfig, nodeConfig.fallbackRate.spreadingFactor, nodeConfig.fallbackRate.txPower);
+    node.begin(wake);       // Sets the rate retained through deep sleep, so after the radio
 
-    Radio.Init(&RadioEvents);
-    Radio.SetChannel(RF_FREQUENCY);
-    Radio.SetTxConfig(MODEM_LORA, TX_OUTPUT_POWER, 0, LORA_BANDWIDTH,
-        LORA_SPREADING_FACTOR, LORA_CODINGRATE,
-        LORA_PREAMBLE_LENGTH, LORA_FIX_LENGTH_PAYLOAD_ON,
-        true, 0, 0, LORA_IQ_INVERSION_ON, 3000);
+    // The first scan is on the first pass, a node woken by the sensor sends its alarm before it sleeps
+    tasks.begin(millis());
+    tasks.every(settings.settings().scanInterval, scanSensor);
+#ifdef task_trace
+    tasks.every(taskReportInterval, reportTasks, NULL, taskReportInterval);
+#endif
 
-    Radio.SetRxConfig(MODEM_LORA, LORA_BANDWIDTH, LORA_SPREADING_FACTOR,
-        LORA_CODINGRATE, 0, LORA_PREAMBLE_LENGTH,
-        LORA_SYMBOL_TIMEOUT, LORA_FIX_LENGTH_PAYLOAD_ON,
-        0, true, 0, 0, LORA_IQ_INVERSION_ON, true);
-    state = STATE_TX;
+#if defined low_power_mode
+    if (wake == WAKE_COLD_START)
+    {
+        reportEnergyEstimate();
+    }
+#endif
 
     //delay(settlingTime);   // Allow the PIR sensor to stabilise before proceeding
 }
 
 void loop()
 {
-    sensorScanner();
-    switch (state)
-    {
-    case STATE_TX:
-        txPacket(alarmState);
-        break;
-    case STATE_RX:
-        debugln("into RX mode");
-        Radio.Rx(0);
-        state = LOWPOWER;
-        break;
-    case LOWPOWER:
-        Radio.IrqProcess();
-        break;
-    default:
-        break;
-    }
+    tasks.run(millis());
+    node.service();         // The radio state machine runs every pass
 }
 
-void sensorScanner(void)
+// The stored settings over the defaults, into the node, radio and pin configuration
+void applySettings(void)
 {
-    static bool alarmActive = false;
-    bool trigger;
-    
-    if (packetData.alarmState == TEST)
+    NodeSettings defaults = {};
+    defaults.address = thisNodeAddress;
+    memcpy(defaults.key, nodeKey, sizeof(defaults.key));
+    defaults.frequency = AlarmRadio::frequency;
+    defaults.bandwidth = AlarmRadio::bandwidth;
+    defaults.codingRate = AlarmRadio::codingRate;
+    defaults.spreadingFactor = AlarmRadio::spreadingFactor;
+    defaults.txPower = AlarmRadio::txPower;
+    defaults.checkInInterval = checkInInterval;
+    defaults.scanInterval = sensorScanInterval;
+    defaults.ackTimeout = ACK_TIMEOUT_VALUE;
+    defaults.rxWindow = RX_WINDOW_VALUE;
+    defaults.relayPins[0] = BoardPins::relay1;
+    defaults.relayPins[1] = BoardPins::relay2;
+    for (size_t i = 0; i < inputCount; i++)
     {
-        trigger = true;
-	}
-    else
+        defaults.inputPins[i] = inputConfigs[i].pin;
+    }
+    if (!settings.begin(defaults))
     {
-        // Read the PIR sensor state
-        trigger = (digitalRead(SENSORPIN) == HIGH) ? true : false;
-	}
+        debugln("No stored settings, using the defaults");
+    }
 
-    if (trigger == true)
+    const NodeSettings& active = settings.settings();
+    nodeConfig.address = active.address;
+    nodeConfig.key = active.key;
+    nodeConfig.ackTimeout = active.ackTimeout;
+    nodeConfig.rxWindow = active.rxWindow;
+    nodeConfig.checkInInterval = active.checkInInterval;
+    nodeConfig.channels = channelPlanMake(active.frequency, AlarmChannels::spacing, AlarmChannels::count,
+        AlarmRadio::preambleLength, active.spreadingFactor, active.bandwidth);
+    nodeConfig.relay = relayPlanMake(AlarmRelay::hops, active.spreadingFactor, active.bandwidth, active.codingRate,
+        AlarmRadio::preambleLength, nodeConfig.channels.scanPreamble);
+    nodeConfig.superframe = superframePlanMake(AlarmSuperframe::period, AlarmSuperframe::slots, AlarmChannels::count,
+        active.spreadingFactor, active.bandwidth, active.codingRate, AlarmRadio::preambleLength,
+        nodeConfig.channels.scanPreamble);
+    nodeConfig.fallbackRate.spreadingFactor = active.spreadingFactor;
+    nodeConfig.fallbackRate.txPower = active.txPower;
+    node.configure(nodeConfig);
+
+    radioConfig.frequency = active.frequency;
+    radioConfig.bandwidth = active.bandwidth;
+    radioConfig.codingRate = active.codingRate;
+    relayPins[0] = active.relayPins[0];
+    relayPins[1] = active.relayPins[1];
+    for (size_t i = 0; i < inputCount; i++)
     {
-        if (alarmActive == false)
-        {
-            alarmActive = true;
-            alarmState = SET;
-            debugln("Alarm activated");
-            if (packetData.relay1Enabled == ACTIVE)
-            {
-                debugln("Relay 1 set");
-                digitalWrite(RELAYPIN1, HIGH);
-            }
-            if (packetData.relay2Enabled == ACTIVE)
-            {
-                debugln("Relay 2 set");
-                digitalWrite(RELAYPIN2, HIGH);
-            }
-        }
+        inputPinConfigs[i] = inputConfigs[i];
+        inputPinConfigs[i].pin = active.inputPins[i];
     }
-    else
+#ifdef debug_print
+    uint8_t channel = channelPlanChannel(nodeConfig.channels, active.address);
+    Serial.printf("Node %u, channel %u at %lu Hz SF%u %d dBm\r\n", active.address, channel,
+        (unsigned long)channelPlanFrequency(nodeConfig.channels, channel), active.spreadingFactor, active.txPower);
+#endif
+}
+
+void scanSensor(void* context, uint32_t now)
+{
+    uint16_t readings[inputCount];
+    for (size_t i = 0; i < inputCount; i++)
     {
-        if (alarmActive == true)
+        const InputConfig& input = inputPinConfigs[i];
+        readings[i] = (input.kind == INPUT_ANALOG) ? analogRead(input.pin) : digitalRead(input.pin);
+    }
+    inputs.update(readings, now);
+    node.scanSensor();
+}
+
+#ifdef task_trace
+void reportTasks(void* context, uint32_t now)
+{
+    for (int id = 0; id < TASK_POOL_SIZE; id++)
+    {
+        const TimerTask& task = tasks.task(id);
+        if (task.fn != NULL)
         {
-            alarmActive = false;
-            alarmState = CLEAR;
-            debugln("Alarm reset, relays cleared");
-            digitalWrite(RELAYPIN1, LOW);
-            digitalWrite(RELAYPIN2, LOW);
+            Serial.printf("Task %d every %lu ms: %lu runs, %lu overruns, %lu ms late at worst\r\n",
+                id, task.interval, task.runs, task.overruns, task.maxLate);
         }
     }
+    tasks.resetStats();
 }
+#endif
 
-void onTxDone(void)
+void onCadDone(bool channelActivityDetected)
 {
-    debugln("TX done ...");
-    state = STATE_RX;
+    node.onCadDone(channelActivityDetected);
 }
 
-void onTxTimeout(void)
+void onRxTimeout(void)
+{
+    node.onRxTimeout();
+}
+
+void onTxDone(void)
 {
-    debugln("TX timeout ...");
-    Radio.Sleep();
-    state = STATE_TX;
+    debugln("TX done ...");
+    node.onTxDone();
 }
 
-void txPacket(DeviceStates_t msg)
+void onTxTimeout(void)
 {
-    char outBuffer[BUFFER_SIZE];
-    outDoc["g"] = thisNodeAddress;
-    outDoc["m"] = msg;
-    outDoc["r1"] = packetData.relay1Enabled;
-    outDoc["r2"] = packetData.relay2Enabled;
-    serializeJson(outDoc, outBuffer);
-    debug("Transmitting: ");
-    debugln(outBuffer);
-    Radio.Send((uint8_t*)outBuffer, strlen(outBuffer));
-    state = LOWPOWER;
+    node.onTxTimeout();
 }
 
 void onRxDone(uint8_t* payload, uint16_t size, int16_t rssi, int8_t snr)
 {
-    static char rxPacket[BUFFER_SIZE];
     Rssi = rssi;
     rxSize = size;
-    memcpy(rxPacket, payload, size);
-    rxPacket[size] = '\0';
-    Radio.Sleep();
-
-    DeserializationError error = deserializeJson(inDoc, rxPacket);
-
-    if (error) {
-        debugln(F("deserializeJson() failed: "));
-        debugln(error.c_str());
-    }
-    else
-    {
-        // Extract the values
-        packetData.nodeAddress = inDoc["g"];
-        if (packetData.nodeAddress == thisNodeAddress)
-        {
-            packetData.alarmState = static_cast<DeviceStates_t>(inDoc["m"]);
-            packetData.relay1Enabled = static_cast<RelayStates_t>(inDoc["r1"]);
-            packetData.relay2Enabled = static_cast<RelayStates_t>(inDoc["r2"]);
-            debug("Relay 1 state: ");
-            debug(packetData.relay1Enabled);
-            debug(", Relay 2 state: ");
-            debugln(packetData.relay2Enabled);
-        }
-        else
-        {
-            debugln("Not for this node");
-        }
-    }
+    node.onRxDone(payload, size, rssi, snr);
 
 #ifdef debug_print
-    Serial.printf("\r\nReceived packet \"%s\" with Rssi %d , length %d\r\n", rxPacket, Rssi, rxSize);
-    Serial.println("Waiting to send next packet");
+    Serial.printf("\r\nReceived packet with Rssi %d , length %d\r\n", Rssi, rxSize);
 #endif
+}
 
-    state = STATE_TX;
-}
\ No newline at end of file
+#if defined low_power_mode
+void reportEnergyEstimate(void)
+{
+#ifdef debug_print
+    EnergyUsage usage;
+    const NodeSettings& active = settings.settings();
+    usage.checkInInterval_ms = active.checkInInterval;
+    usage.alarmsPerDay = expectedAlarmsPerDay;
+    usage.uplinkAirtime_ms = loraTimeOnAirMillis(active.spreadingFactor, active.bandwidth, active.codingRate,
+        nodeConfig.channels.scanPreamble, alarmFrameSize(FRAME_ALARM));
+    usage.rxWindow_ms = active.rxWindow;
+    // CAD plus the hub turnaround and ACK airtime
+    usage.ackWait_ms = 20 + loraTimeOnAirMillis(active.spreadingFactor, active.bandwidth, active.codingRate,
+        AlarmRadio::preambleLength, alarmFrameSize(FRAME_ACK));
+    usage.batteryCapacity_mAh = batteryCapacity;
+    usage.batteryUsable = batteryUsable;
+
+    EnergyEstimate estimate = energyEstimate(energyProfileHeltecV3(), usage);
+    Serial.printf("Low power mode: average %.1f uA, awake %.3f%%, battery life %.0f days\r\n",
+        estimate.averageCurrent_uA, estimate.awakeFraction * 100.0f, estimate.batteryLife_days);
+#endif
+}
+#endif
@@ -0,0 +1,267 @@
+/*
+*  Title          :  CodecTest
+*  Desc           :  Unit test of the AlarmFrame.h codec on the host.  Every frame type is
+*                 :  encoded and decoded back, then frames are damaged: a changed byte anywhere
+*                 :  fails the MIC that replaced the CRC-8 on air, and the CRC-8 the event log
+*                 :  still uses is checked against its known answer.  Frames a byte short or
+*                 :  long, read at another type's length, cut to the header, or from any other
+*                 :  codec version are refused before the key is used, and so are relay
+*                 :  envelopes and beacons of the wrong length or version.
+*                 :
+*                 :  codec_test
+*                 :
+*                 :  Every type alarmFrameSize() knows is tested, a new one is picked up without
+*                 :  changing the test.  Exits 1 if any check fails.  ctest runs it.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.3
+*  History        : 1.0 2026-10-17 Round trip, CRC failure, wrong length and version
+*                 : 1.1 2026-10-17 Sealed frames, the MIC in place of the CRC-8, counter in the header
+*                 : 1.2 2026-10-17 Relay envelope
+*                 : 1.3 2026-10-17 Superframe beacon
+*
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <AlarmFrame.h>
+#include <FrameSecurity.h>
+
+#define FRAME_TYPES                                 16  // The type nibble
+
+static const uint8_t patterns[] = { 0x5a, 0xa5 };      // Between them every bit of every field set
+
+static unsigned long checks = 0;
+static unsigned long failures = 0;
+
+static void check(bool ok, const char* what, uint8_t type = 0)
+{
+    checks++;
+    if (!ok)
+    {
+        printf("  FAILED: %s, frame type %u\n", what, type);
+        failures++;
+    }
+}
+
+// Every field set to the pattern, the codec keeps the bits each type carries
+static AlarmFrame sampleFrame(uint8_t type, uint16_t address, uint8_t pattern = patterns[0])
+{
+    AlarmFrame frame;
+    memset(&frame, pattern, sizeof(frame));
+    frame.type = type;
+    frame.nodeAddress = address;
+    return frame;
+}
+
+static bool sealed(uint8_t type)
+{
+    return alarmFrameSize(type) != 0;
+}
+
+// Decoded and encoded again with the same counter a frame is the same bytes, so nothing the
+// type carries was lost on the way
+static void roundTrips(const AesCcm& cipher)
+{
+    uint8_t buf[ALARM_FRAME_MAX_SIZE];
+    uint8_t again[ALARM_FRAME_MAX_SIZE];
+    AlarmFrame decoded;
+    for (uint8_t type = 0; type < FRAME_TYPES; type++)
+    {
+        if (!sealed(type))
+        {
+            check(alarmFrameEncode(sampleFrame(type, 1), cipher, FRAME_UPLINK, 1, buf, sizeof(buf)) == 0,
+                "a type the codec does not know was encoded", type);
+            continue;
+        }
+        for (uint8_t pattern : patterns)
+        {
+            for (uint8_t direction = FRAME_UPLINK; direction <= FRAME_DOWNLINK; direction++)
+            {
+                AlarmFrame frame = sampleFrame(type, 0xbeef, pattern);
+                size_t len = alarmFrameEncode(frame, cipher, direction, 0x10203, buf, sizeof(buf));
+                check(len == alarmFrameSize(type) && len <= ALARM_FRAME_MAX_SIZE, "encoded size", type);
+                check(alarmFrameEncode(frame, cipher, direction, 0x10203, buf, len - 1) == 0,
+                    "encoded into a buffer too small", type);
+
+                decoded = AlarmFrame();
+                check(alarmFramePeek(buf, len, decoded) == FRAME_OK && decoded.type == type
+                    && decoded.nodeAddress == 0xbeef && decoded.counter == 0x0203, "clear header", type);
+                decoded = AlarmFrame();
+                bool ok = alarmFrameDecode(buf, len, cipher, direction, 0x10000, decoded) == FRAME_OK
+                    && decoded.type == type && decoded.nodeAddress == 0xbeef && decoded.counter == 0x10203;
+                check(ok && alarmFrameEncode(decoded, cipher, direction, decoded.counter, again, sizeof(again)) == len
+                    && memcmp(buf, again, len) == 0, "round trip", type);
+            }
+        }
+    }
+
+    AlarmFrame frame = sampleFrame(FRAME_RELAY, 1);
+    check(alarmFrameEncode(frame, cipher, FRAME_UPLINK, 1, buf, sizeof(buf)) == 0, "a relay envelope is not sealed");
+    frame.type = FRAME_BEACON;
+    check(alarmFrameEncode(frame, cipher, FRAME_UPLINK, 1, buf, sizeof(buf)) == 0, "a beacon is not sealed");
+}
+
+// The MIC took over from the CRC-8 on air, any changed byte fails it
+static void damagedFrames(const AesCcm& cipher)
+{
+    static const uint8_t check123456789[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+    check(alarmFrameCrc8(check123456789, sizeof(check123456789)) == 0xf4, "CRC-8 check value");
+    uint8_t data[] = { 0x31, 0x01, 0x00, 0x05 };
+    uint8_t crc = alarmFrameCrc8(data, sizeof(data));
+    unsigned long missed = 0;
+    for (size_t bit = 0; bit < sizeof(data) * 8; bit++)
+    {
+        data[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+        missed += alarmFrameCrc8(data, sizeof(data)) == crc ? 1 : 0;
+        data[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+    }
+    check(missed == 0, "CRC-8 misses a single bit error");
+
+    uint8_t buf[ALARM_FRAME_MAX_SIZE];
+    AlarmFrame decoded;
+    for (uint8_t type = 0; type < FRAME_TYPES; type++)
+    {
+        size_t len = alarmFrameEncode(sampleFrame(type, 7), cipher, FRAME_UPLINK, 100, buf, sizeof(buf));
+        if (len == 0)
+        {
+            continue;
+        }
+        unsigned long accepted = 0;
+        for (size_t bit = 0; bit < len * 8; bit++)
+        {
+            buf[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+            accepted += alarmFrameDecode(buf, len, cipher, FRAME_UPLINK, 99, decoded) == FRAME_OK ? 1 : 0;
+            buf[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+        }
+        check(accepted == 0, "a frame with a bit flipped was accepted", type);
+        buf[len - 1] ^= 0x01;
+        check(alarmFrameDecode(buf, len, cipher, FRAME_UPLINK, 99, decoded) == FRAME_BAD_MIC, "damaged MIC", type);
+        buf[len - 1] ^= 0x01;
+        buf[ALARM_FRAME_HEADER_SIZE] ^= 0x01;
+        check(alarmFrameDecode(buf, len, cipher, FRAME_UPLINK, 99, decoded) == FRAME_BAD_MIC, "damaged payload", type);
+    }
+}
+
+static void wrongLengths(const AesCcm& cipher)
+{
+    uint8_t buf[ALARM_FRAME_MAX_SIZE + 1] = {};
+    AlarmFrame decoded;
+    for (uint8_t type = 0; type < FRAME_TYPES; type++)
+    {
+        size_t len = alarmFrameEncode(sampleFrame(type, 7), cipher, FRAME_UPLINK, 100, buf, sizeof(buf));
+        if (len == 0)
+        {
+            continue;
+        }
+        check(alarmFrameDecode(buf, len - 1, cipher, FRAME_UPLINK, 99, decoded) == FRAME_BAD_LENGTH, "a byte short", type);
+        check(alarmFrameDecode(buf, len + 1, cipher, FRAME_UPLINK, 99, decoded) == FRAME_BAD_LENGTH, "a byte long", type);
+        check(alarmFramePeek(buf, ALARM_FRAME_HEADER_SIZE, decoded) == FRAME_TOO_SHORT, "header only", type);
+        check(alarmFramePeek(buf, 0, decoded) == FRAME_TOO_SHORT, "empty", type);
+
+        // A frame cut or padded to another type's length is still refused
+        unsigned long accepted = 0;
+        for (uint8_t other = 0; other < FRAME_TYPES; other++)
+        {
+            size_t otherLen = alarmFrameSize(other);
+            if (otherLen != 0 && otherLen != len)
+            {
+                accepted += alarmFramePeek(buf, otherLen, decoded) != FRAME_BAD_LENGTH ? 1 : 0;
+            }
+        }
+        check(accepted == 0, "read at the length of another type", type);
+    }
+
+    uint8_t beacon[BEACON_FRAME_SIZE + 1];
+    beaconFrameWrite(1, 2, beacon);
+    check(beaconFramePeek(beacon, BEACON_FRAME_SIZE - 1, decoded) != FRAME_OK, "beacon a byte short");
+    check(beaconFramePeek(beacon, BEACON_FRAME_SIZE + 1, decoded) == FRAME_BAD_LENGTH, "beacon a byte long");
+
+    uint8_t relayed[RELAY_FRAME_MAX_SIZE];
+    size_t len = alarmFrameEncode(sampleFrame(FRAME_ALARM, 7), cipher, FRAME_UPLINK, 100,
+        &relayed[RELAY_FRAME_HEADER_SIZE], ALARM_FRAME_MAX_SIZE);
+    RelayHeader relay = { 9, 1, false, &relayed[RELAY_FRAME_HEADER_SIZE], (uint8_t)len };
+    relayFrameWrap(relay, relayed);
+    RelayHeader got = {};
+    check(relayFramePeek(relayed, RELAY_FRAME_HEADER_SIZE, got) != FRAME_OK, "relay envelope with nothing in it");
+    check(relayFramePeek(relayed, RELAY_FRAME_HEADER_SIZE + len, got) == FRAME_OK
+        && alarmFrameDecode(got.frame, got.length - 1, cipher, FRAME_UPLINK, 99, decoded) == FRAME_BAD_LENGTH,
+        "relayed frame a byte short");
+}
+
+// A frame from any other version of the codec is refused on its first byte
+static void wrongVersions(const AesCcm& cipher)
+{
+    uint8_t buf[RELAY_FRAME_MAX_SIZE];
+    AlarmFrame decoded;
+    for (uint8_t type = 0; type < FRAME_TYPES; type++)
+    {
+        size_t len = alarmFrameEncode(sampleFrame(type, 7), cipher, FRAME_UPLINK, 100, buf, sizeof(buf));
+        if (len == 0)
+        {
+            continue;
+        }
+        unsigned long accepted = 0;
+        for (uint8_t version = 0; version < 16; version++)
+        {
+            if (version == ALARM_FRAME_VERSION)
+            {
+                continue;
+            }
+            buf[0] = (uint8_t)((version << 4) | type);
+            accepted += alarmFrameDecode(buf, len, cipher, FRAME_UPLINK, 99, decoded) != FRAME_BAD_VERSION ? 1 : 0;
+            accepted += alarmFramePeek(buf, len, decoded) != FRAME_BAD_VERSION ? 1 : 0;
+        }
+        check(accepted == 0, "another version was not refused", type);
+    }
+
+    beaconFrameWrite(1, 2, buf);
+    buf[0] = (uint8_t)(((ALARM_FRAME_VERSION - 1) << 4) | FRAME_BEACON);
+    check(beaconFramePeek(buf, BEACON_FRAME_SIZE, decoded) == FRAME_BAD_VERSION, "beacon of another version");
+
+    size_t len = alarmFrameEncode(sampleFrame(FRAME_STATUS, 7), cipher, FRAME_UPLINK, 100, &buf[RELAY_FRAME_HEADER_SIZE],
+        ALARM_FRAME_MAX_SIZE);
+    RelayHeader relay = { 9, 1, false, &buf[RELAY_FRAME_HEADER_SIZE], (uint8_t)len };
+    relayFrameWrap(relay, buf);
+    buf[0] = (uint8_t)(((ALARM_FRAME_VERSION + 1) << 4) | FRAME_RELAY);
+    check(relayFramePeek(buf, RELAY_FRAME_HEADER_SIZE + len, relay) == FRAME_BAD_VERSION, "relay envelope of another version");
+
+    // Version 1 frames had no counter or MIC, a 5 byte status with a CRC-8
+    uint8_t v1[5] = { (uint8_t)((1 << 4) | FRAME_STATUS), 0x07, 0x00, 0x05, 0x00 };
+    v1[4] = alarmFrameCrc8(v1, 4);
+    check(alarmFramePeek(v1, sizeof(v1), decoded) == FRAME_TOO_SHORT, "version 1 status frame");
+}
+
+int main(void)
+{
+    uint8_t networkKey[FRAME_KEY_SIZE];
+    uint8_t key[FRAME_KEY_SIZE];
+    for (uint8_t i = 0; i < FRAME_KEY_SIZE; i++)
+    {
+        networkKey[i] = (uint8_t)(0xa0 + i);
+    }
+    frameKeyDerive(networkKey, 7, key);
+    AesCcm cipher;
+    cipher.setKey(key);
+
+    unsigned int types = 0;
+    for (uint8_t type = 0; type < FRAME_TYPES; type++)
+    {
+        types += sealed(type) ? 1 : 0;
+    }
+    printf("AlarmFrame codec test, version %u, %u frame types, %u byte header, %u byte MIC\n",
+        ALARM_FRAME_VERSION, types, ALARM_FRAME_HEADER_SIZE, ALARM_FRAME_MIC_SIZE);
+    roundTrips(cipher);
+    damagedFrames(cipher);
+    wrongLengths(cipher);
+    wrongVersions(cipher);
+
+    printf("  checks %lu, failed %lu\n", checks, failures);
+    if (failures > 0)
+    {
+        printf("FAILED\n");
+    }
+    return failures == 0 ? 0 : 1;
+}
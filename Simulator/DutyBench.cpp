@@ -0,0 +1,517 @@
+/*
+*  Title          :  DutyBench
+*  Desc           :  Checks the time on air of LoRaAirtime.h against the Semtech formula and runs
+*                 :  hours of hub traffic through the duty cycle governor of DutyCycle.h.
+*                 :
+*                 :  The airtime of every spreading factor, bandwidth, coding rate, preamble and
+*                 :  payload length is compared with the SX1261-2 datasheet formula worked in
+*                 :  floating point, and with published values.  The sliding hour is checked for
+*                 :  what it forgets and when, its sub-bands, pacing and a node's deep sleep.
+*                 :
+*                 :  The traffic is a hub polling nodes, sending UI commands and acknowledging
+*                 :  alarms, with interference losing a share of the exchanges so they go again
+*                 :  straight away as the firmware used to.  It runs once as it is and once
+*                 :  governed.  Every frame the governed hub sends is checked against the hour
+*                 :  before it and every alarm ACK has to go.  An alarm storm in the second hour
+*                 :  takes it past the limit, which only alarms past their reserve may do, and
+*                 :  polls and commands have to keep going through it.
+*                 :
+*                 :  duty_bench --hours 3 --nodes 50 --loss 0.3 --sf 7
+*                 :
+*                 :  Exits 1 if any check fails.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.1
+*  History        : 1.0 2026-10-17 Airtime against the Semtech formula, hours of governed traffic
+*                 : 1.1 2026-10-17 Alarm storms leave the shares alone, a command a slice, busiest hour checked
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <AlarmFrame.h>
+#include <AlarmProfile.h>
+#include <DutyCycle.h>
+#include <LoRaAirtime.h>
+
+#define BENCH_FREQUENCY                             868100000   // In the 1 % sub-band
+#define BENCH_RX_WINDOW                             100         // ms, as the hub's rxTimeout
+#define BENCH_COMMAND_BACKOFF                       500         // ms, first retry of a command
+#define BENCH_COMMAND_ATTEMPTS                      6
+#define BENCH_STORM_ALARMS                          400         // In ten minutes of the second hour
+
+typedef struct
+{
+    double hours;
+    unsigned int nodes;
+    uint32_t pollInterval;      // ms
+    double commandsPerHour;
+    double alarmsPerHour;       // Whole system
+    double loss;                // Share of exchanges interference spoils
+    uint8_t spreadingFactor;
+    uint32_t seed;
+} BenchOptions;
+
+typedef struct
+{
+    uint32_t at;                // ms
+    uint32_t airtime;
+    uint8_t priority;           // AirtimePriority_t
+} SentFrame;
+
+typedef struct
+{
+    unsigned long polls;
+    unsigned long commandsIssued;
+    unsigned long commandsDelivered;
+    unsigned long commandsFailed;
+    unsigned long acksOffered;
+    unsigned long acksSent;
+    DutyCycleStats duty;
+} TrafficResult;
+
+static unsigned long failures = 0;
+
+static void check(bool ok, const char* what)
+{
+    if (!ok)
+    {
+        printf("  FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+// SX1261-2 datasheet section 6.1.4, in floating point
+static double semtechMicros(uint8_t sf, uint8_t bandwidth, uint8_t codingRate, uint16_t preamble, uint8_t length,
+    bool crcOn, bool implicitHeader)
+{
+    double symbol = ldexp(1.0, sf) / (double)loraBandwidthHz(bandwidth);
+    int de = symbol >= 0.016 ? 1 : 0;
+    double blocks = ceil((8.0 * length - 4.0 * sf + 28.0 + (crcOn ? 16.0 : 0.0) - (implicitHeader ? 20.0 : 0.0))
+        / (4.0 * (sf - 2 * de)));
+    double payload = 8.0 + std::max(blocks * (codingRate + 4), 0.0);
+    return ((double)preamble + 4.25 + payload) * symbol * 1e6;
+}
+
+static void airtimeChecks(void)
+{
+    // Published values: a 13 byte LoRaWAN frame at SF7 and SF12, and a 64 byte one at SF12
+    check(loraTimeOnAirMicros(7, 0, 1, 8, 13) == 46336, "SF7 125 kHz 13 bytes is 46.336 ms");
+    check(loraTimeOnAirMicros(12, 0, 1, 8, 13) == 1155072, "SF12 125 kHz 13 bytes is 1155.072 ms");
+    check(loraTimeOnAirMicros(12, 0, 1, 8, 64) == 2793472, "SF12 125 kHz 64 bytes is 2793.472 ms");
+
+    static const uint16_t preambles[] = { 6, 8, 12 };
+    unsigned long cases = 0;
+    unsigned long wrong = 0;
+    for (uint8_t sf = 7; sf <= 12; sf++)
+    {
+        for (uint8_t bandwidth = 0; bandwidth <= 2; bandwidth++)
+        {
+            for (uint8_t codingRate = 1; codingRate <= 4; codingRate++)
+            {
+                for (uint16_t preamble : preambles)
+                {
+                    for (unsigned int length = 0; length <= 255; length++)
+                    {
+                        for (int flags = 0; flags < 4; flags++)
+                        {
+                            bool crcOn = (flags & 1) != 0;
+                            bool fixLength = (flags & 2) != 0;
+                            double expected = semtechMicros(sf, bandwidth, codingRate, preamble, (uint8_t)length, crcOn, fixLength);
+                            uint32_t micros = loraTimeOnAirMicros(sf, bandwidth, codingRate, preamble, (uint8_t)length, crcOn, fixLength);
+                            uint32_t millis = loraTimeOnAirMillis(sf, bandwidth, codingRate, preamble, (uint8_t)length, crcOn, fixLength);
+                            wrong += (fabs((double)micros - expected) > 1.0 || millis != (uint32_t)ceil(expected / 1000.0 - 1e-9)) ? 1 : 0;
+                            cases++;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    printf("  airtime: %lu cases against the Semtech formula, %lu differ\n", cases, wrong);
+    check(wrong == 0, "airtime matches the Semtech formula");
+}
+
+static void windowChecks(void)
+{
+    uint32_t limit = dutyCycleLimit(dutyCycleBandOf(BENCH_FREQUENCY));
+    uint32_t low = limit / 100 * DUTY_CYCLE_LOW_SHARE;
+    check(limit == 36000, "1 % of an hour is 36 s");
+    check(dutyCycleBandOf(869525000) >= 0 && dutyCycleLimit(dutyCycleBandOf(869525000)) == 360000, "869.525 MHz is in the 10 % sub-band");
+    check(dutyCycleBandOf(868650000) >= 0 && dutyCycleLimit(dutyCycleBandOf(868650000)) == 3600, "a gap between sub-bands gets 0.1 %");
+    check(dutyCycleBandOf(915000000) < 0, "no limit outside 863 to 870 MHz");
+
+    // A whole low share at once, it stays until all of its slice is an hour old
+    DutyCycle<> duty;
+    duty.begin(0);
+    duty.charge(0, BENCH_FREQUENCY, low, AIRTIME_LOW);
+    check(duty.wait(1000, BENCH_FREQUENCY, 42, AIRTIME_LOW) == DUTY_CYCLE_WINDOW_MS + DUTY_CYCLE_WINDOW_MS / DUTY_CYCLE_BUCKETS - 1000,
+        "a full hour waits for its first slice to leave");
+    check(duty.wait(1000, BENCH_FREQUENCY, 42, AIRTIME_NORMAL) == 0, "commands have room above the low share");
+    check(duty.wait(1000, BENCH_FREQUENCY, limit, AIRTIME_ALARM) == 0, "alarms always go");
+    check(duty.wait(1000, 915000000, limit, AIRTIME_LOW) == 0, "another band is not limited");
+    check(duty.stats().deferred == 1 && duty.stats().overLimit == 0, "deferred and over limit counts");
+    duty.charge(1000, BENCH_FREQUENCY, limit, AIRTIME_ALARM);
+    check(duty.stats().overLimit == 1, "an alarm past the limit is counted");
+    check(duty.used(DUTY_CYCLE_WINDOW_MS, BENCH_FREQUENCY) == low + limit, "nothing forgotten inside the hour");
+    check(duty.used(DUTY_CYCLE_WINDOW_MS + DUTY_CYCLE_WINDOW_MS / DUTY_CYCLE_BUCKETS, BENCH_FREQUENCY) == 0, "forgotten after it");
+
+    // Low priority frames at once, a slice takes its share
+    duty.begin(0);
+    unsigned long paced = 0;
+    while (duty.wait(5, BENCH_FREQUENCY, 42, AIRTIME_LOW) == 0 && paced < 1000)
+    {
+        duty.charge(5, BENCH_FREQUENCY, 42, AIRTIME_LOW);
+        paced++;
+    }
+    check(paced == low * DUTY_CYCLE_PACE / DUTY_CYCLE_BUCKETS / 42, "a slice takes its pace of low priority frames");
+    check(duty.wait(5, BENCH_FREQUENCY, 42, AIRTIME_LOW) == DUTY_CYCLE_WINDOW_MS / DUTY_CYCLE_BUCKETS - 5, "the next waits for the next slice");
+    check(duty.wait(5, BENCH_FREQUENCY, 2000, AIRTIME_NORMAL) == 0, "commands are not paced");
+
+    // Twice the limit in alarms, only their reserve counts against the shares
+    uint32_t slice = DUTY_CYCLE_WINDOW_MS / DUTY_CYCLE_BUCKETS;
+    uint32_t normal = limit / 100 * DUTY_CYCLE_NORMAL_SHARE;
+    duty.begin(0);
+    duty.charge(0, BENCH_FREQUENCY, 2 * limit, AIRTIME_ALARM);
+    check(duty.wait(slice, BENCH_FREQUENCY, 42, AIRTIME_LOW) == 0, "an alarm storm leaves polls their share");
+    duty.charge(slice, BENCH_FREQUENCY, low - (limit - normal), AIRTIME_LOW);
+    check(duty.wait(2 * slice, BENCH_FREQUENCY, 42, AIRTIME_LOW) > 0, "and no more than it");
+    check(duty.wait(2 * slice, BENCH_FREQUENCY, 42, AIRTIME_NORMAL) == 0, "an alarm storm leaves commands their share");
+
+    // The normal share spent, a slice still takes one command
+    duty.begin(0);
+    duty.charge(0, BENCH_FREQUENCY, normal, AIRTIME_NORMAL);
+    check(duty.wait(slice, BENCH_FREQUENCY, 42, AIRTIME_NORMAL) == 0 && duty.stats().floorFrames == 1, "a slice takes one command");
+    duty.charge(slice, BENCH_FREQUENCY, 42, AIRTIME_NORMAL);
+    check(duty.wait(slice + 5, BENCH_FREQUENCY, 42, AIRTIME_NORMAL) == slice - 5, "the next waits for the next slice");
+    check(duty.wait(slice + 5, BENCH_FREQUENCY, 42, AIRTIME_LOW) > slice, "polls wait for their share");
+    duty.charge(slice, BENCH_FREQUENCY, limit - normal, AIRTIME_NORMAL);
+    check(duty.wait(2 * slice, BENCH_FREQUENCY, 42, AIRTIME_NORMAL) > slice, "but not past the limit");
+
+    // A node keeps it through deep sleep, millis() starts again on every wake
+    DutyCycle<12> node;
+    node.begin(0);
+    node.charge(30000, BENCH_FREQUENCY, 1000, AIRTIME_LOW);
+    node.resume(5, 60000);
+    check(node.used(5, BENCH_FREQUENCY) == 1000, "kept through a short sleep");
+    node.resume(5, 0);
+    check(node.used(3000000, BENCH_FREQUENCY) == 1000, "a sensor wake counts no time asleep");
+    node.resume(5, DUTY_CYCLE_WINDOW_MS);
+    check(node.used(5, BENCH_FREQUENCY) == 0, "forgotten after an hour asleep");
+}
+
+static uint32_t frameAirtime(uint8_t sf, uint8_t type)
+{
+    return loraTimeOnAirMillis(sf, AlarmRadio::bandwidth, AlarmRadio::codingRate, AlarmRadio::preambleLength,
+        (uint8_t)alarmFrameSize(type));
+}
+
+// One ms at a time.  Alarm ACKs go first, then commands, then polls.  An exchange the
+// interference spoils goes again as soon as the radio is free, a command after its backoff
+static void runTraffic(const BenchOptions& options, bool governed, std::vector<SentFrame>& sent, TrafficResult& result)
+{
+    std::mt19937 random(options.seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::exponential_distribution<double> alarmGap(options.alarmsPerHour / 3600000.0);
+    std::exponential_distribution<double> commandGap(options.commandsPerHour / 3600000.0);
+    uint32_t end = (uint32_t)(options.hours * 3600000.0);
+    uint32_t poll = frameAirtime(options.spreadingFactor, FRAME_STATUS);
+    uint32_t command = frameAirtime(options.spreadingFactor, FRAME_COMMAND);
+    uint32_t ack = frameAirtime(options.spreadingFactor, FRAME_ACK);
+    uint32_t reply = frameAirtime(options.spreadingFactor, FRAME_COMMAND_ACK);
+
+    std::vector<uint32_t> pollDue(options.nodes);
+    for (unsigned int i = 0; i < options.nodes; i++)
+    {
+        pollDue[i] = (uint32_t)(unit(random) * options.pollInterval);
+    }
+    std::vector<uint32_t> acksDue;         // Alarms heard, sorted
+    for (double t = alarmGap(random); t < end; t += alarmGap(random))
+    {
+        acksDue.push_back((uint32_t)t);
+    }
+    if (options.hours > 1.0)
+    {
+        uint32_t storm = (uint32_t)(1.5 * 3600000.0);
+        for (unsigned int i = 0; i < BENCH_STORM_ALARMS; i++)
+        {
+            acksDue.push_back(storm + (uint32_t)(unit(random) * 600000.0));
+        }
+    }
+    std::sort(acksDue.begin(), acksDue.end());
+    uint32_t nextCommand = (uint32_t)commandGap(random);
+    uint32_t commandRetryAt = 0;
+    unsigned int commandAttempts = 0;
+    unsigned int commandsWaiting = 0;
+
+    DutyCycle<> duty;
+    duty.begin(0);
+    uint32_t holdUntil[AIRTIME_ALARM] = {};
+    uint32_t busyUntil = 0;
+    size_t nextAck = 0;
+    TrafficResult none = {};
+    result = none;
+    result.acksOffered = (unsigned long)acksDue.size();
+    sent.clear();
+
+    // True if the frame went, otherwise the hub holds back its priority and below
+    auto send = [&](uint32_t now, uint32_t airtime, uint8_t priority, uint32_t exchange) -> bool
+    {
+        if (governed)
+        {
+            uint32_t wait = duty.wait(now, BENCH_FREQUENCY, airtime, priority);
+            if (wait > 0)
+            {
+                for (uint8_t p = AIRTIME_LOW; p <= priority; p++)
+                {
+                    holdUntil[p] = now + wait;
+                }
+                return false;
+            }
+        }
+        duty.charge(now, BENCH_FREQUENCY, airtime, priority);
+        SentFrame frame = { now, airtime, priority };
+        sent.push_back(frame);
+        busyUntil = now + exchange;
+        return true;
+    };
+
+    for (uint32_t now = 0; now < end; now++)
+    {
+        if (now >= nextCommand)
+        {
+            commandsWaiting++;
+            result.commandsIssued++;
+            nextCommand = now + 1 + (uint32_t)commandGap(random);
+        }
+        if (now < busyUntil)
+        {
+            continue;
+        }
+        if (nextAck < acksDue.size() && acksDue[nextAck] <= now)
+        {
+            if (send(now, ack, AIRTIME_ALARM, ack))
+            {
+                result.acksSent++;
+                nextAck++;
+                if (unit(random) < options.loss)
+                {
+                    // The node missed the ACK and sends the alarm again
+                    acksDue.insert(std::upper_bound(acksDue.begin() + nextAck, acksDue.end(), now + 300), now + 300);
+                    result.acksOffered++;
+                }
+            }
+            continue;
+        }
+        if (commandsWaiting > 0 && now >= commandRetryAt && now >= holdUntil[AIRTIME_NORMAL])
+        {
+            if (send(now, command, AIRTIME_NORMAL, command + BENCH_RX_WINDOW + reply))
+            {
+                commandAttempts++;
+                if (unit(random) >= options.loss)
+                {
+                    result.commandsDelivered++;
+                    commandsWaiting--;
+                    commandAttempts = 0;
+                }
+                else if (commandAttempts >= BENCH_COMMAND_ATTEMPTS)
+                {
+                    result.commandsFailed++;
+                    commandsWaiting--;
+                    commandAttempts = 0;
+                }
+                else
+                {
+                    commandRetryAt = now + (BENCH_COMMAND_BACKOFF << (commandAttempts - 1));
+                }
+            }
+            continue;
+        }
+        if (now < holdUntil[AIRTIME_LOW])
+        {
+            continue;
+        }
+        for (unsigned int i = 0; i < options.nodes; i++)
+        {
+            if (pollDue[i] <= now)
+            {
+                if (send(now, poll, AIRTIME_LOW, poll + BENCH_RX_WINDOW + reply))
+                {
+                    result.polls++;
+                    // A missed reply is polled again straight away
+                    pollDue[i] = (unit(random) < options.loss) ? now : now + options.pollInterval;
+                }
+                break;
+            }
+        }
+    }
+    result.duty = duty.stats();
+}
+
+// Most airtime in any hour, and for each frame sent the hour up to and including it and the
+// alarms in that hour
+static uint32_t busiestHour(const std::vector<SentFrame>& sent, std::vector<uint32_t>& hourBefore,
+    std::vector<uint32_t>& alarmsBefore)
+{
+    uint32_t busiest = 0;
+    uint32_t sum = 0;
+    uint32_t alarms = 0;
+    size_t first = 0;
+    hourBefore.assign(sent.size(), 0);
+    alarmsBefore.assign(sent.size(), 0);
+    for (size_t i = 0; i < sent.size(); i++)
+    {
+        sum += sent[i].airtime;
+        alarms += (sent[i].priority == AIRTIME_ALARM) ? sent[i].airtime : 0;
+        while (sent[first].at + DUTY_CYCLE_WINDOW_MS <= sent[i].at)
+        {
+            sum -= sent[first].airtime;
+            alarms -= (sent[first].priority == AIRTIME_ALARM) ? sent[first].airtime : 0;
+            first++;
+        }
+        hourBefore[i] = sum;
+        alarmsBefore[i] = alarms;
+        busiest = std::max(busiest, sum);
+    }
+    return busiest;
+}
+
+static void usage(void)
+{
+    printf("usage: duty_bench [--hours h] [--nodes n] [--poll-interval ms] [--commands-per-hour c]\n"
+           "                  [--alarms-per-hour a] [--loss p] [--sf 7..12] [--seed s]\n");
+}
+
+static bool parseOptions(int argc, char** argv, BenchOptions& options)
+{
+    for (int i = 1; i < argc; i += 2)
+    {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (value == nullptr)
+        {
+            return false;
+        }
+        if (strcmp(arg, "--hours") == 0) options.hours = atof(value);
+        else if (strcmp(arg, "--nodes") == 0) options.nodes = (unsigned int)atoi(value);
+        else if (strcmp(arg, "--poll-interval") == 0) options.pollInterval = (uint32_t)atol(value);
+        else if (strcmp(arg, "--commands-per-hour") == 0) options.commandsPerHour = atof(value);
+        else if (strcmp(arg, "--alarms-per-hour") == 0) options.alarmsPerHour = atof(value);
+        else if (strcmp(arg, "--loss") == 0) options.loss = atof(value);
+        else if (strcmp(arg, "--sf") == 0) options.spreadingFactor = (uint8_t)atoi(value);
+        else if (strcmp(arg, "--seed") == 0) options.seed = (uint32_t)atol(value);
+        else return false;
+    }
+    return options.hours > 0.0 && options.hours <= 24.0 && options.nodes > 0 && options.pollInterval > 0
+        && options.commandsPerHour > 0.0 && options.alarmsPerHour > 0.0 && options.loss >= 0.0 && options.loss < 1.0
+        && radioSpreadingFactorValid(options.spreadingFactor);
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions options;
+    options.hours = 3.0;
+    options.nodes = 50;
+    options.pollInterval = 120000;      // Hub.ino watchdogInterval
+    options.commandsPerHour = 60.0;
+    options.alarmsPerHour = 100.0;
+    options.loss = 0.3;
+    options.spreadingFactor = AlarmRadio::spreadingFactor;
+    options.seed = 1;
+    if (!parseOptions(argc, argv, options))
+    {
+        usage();
+        return 1;
+    }
+
+    printf("Duty cycle benchmark: %.1f hours, %u nodes polled every %lu ms, SF%u, %.0f%% of exchanges lost\n",
+        options.hours, options.nodes, (unsigned long)options.pollInterval, options.spreadingFactor, 100.0 * options.loss);
+    airtimeChecks();
+    windowChecks();
+
+    uint32_t limit = dutyCycleLimit(dutyCycleBandOf(BENCH_FREQUENCY));
+    printf("  frames at SF%u: status %u ms, command %u ms, ACK %u ms, 1%% of an hour is %u status frames\n",
+        options.spreadingFactor, frameAirtime(options.spreadingFactor, FRAME_STATUS),
+        frameAirtime(options.spreadingFactor, FRAME_COMMAND), frameAirtime(options.spreadingFactor, FRAME_ACK),
+        limit / frameAirtime(options.spreadingFactor, FRAME_STATUS));
+
+    std::vector<SentFrame> sent;
+    std::vector<uint32_t> hourBefore;
+    std::vector<uint32_t> alarmsBefore;
+    for (int governed = 0; governed <= 1; governed++)
+    {
+        TrafficResult result;
+        runTraffic(options, governed != 0, sent, result);
+        uint32_t busiest = busiestHour(sent, hourBefore, alarmsBefore);
+        std::vector<uint32_t> pollHours((size_t)ceil(options.hours), 0);
+        for (const SentFrame& frame : sent)
+        {
+            pollHours[frame.at / DUTY_CYCLE_WINDOW_MS] += (frame.priority == AIRTIME_LOW) ? frame.airtime : 0;
+        }
+        printf("  %s: busiest hour %.1f s, %.0f%% of the limit, polls %lu, poll airtime each hour s",
+            governed ? "governed" : "as it was", busiest / 1000.0, 100.0 * busiest / limit, result.polls);
+        for (uint32_t hour : pollHours)
+        {
+            printf(" %.1f", hour / 1000.0);
+        }
+        printf("\n");
+        printf("    commands: issued %lu, delivered %lu, failed %lu, alarm ACKs %lu of %lu, held back %lu, past the limit %lu,\n"
+               "    a slice's one command %lu\n",
+            result.commandsIssued, result.commandsDelivered, result.commandsFailed, result.acksSent, result.acksOffered,
+            result.duty.deferred, result.duty.overLimit, result.duty.floorFrames);
+        if (!governed)
+        {
+            check(busiest > limit, "the traffic needs a governor");
+            continue;
+        }
+
+        // Alarm airtime past the reserve above the normal share is not held against the rest
+        uint32_t reserve = limit - limit / 100 * DUTY_CYCLE_NORMAL_SHARE;
+        unsigned long over = 0;
+        uint32_t countedBusiest = 0;
+        for (size_t i = 0; i < sent.size(); i++)
+        {
+            uint32_t counted = hourBefore[i] - ((alarmsBefore[i] > reserve) ? alarmsBefore[i] - reserve : 0);
+            countedBusiest = std::max(countedBusiest, counted);
+            if (sent[i].priority == AIRTIME_LOW)
+            {
+                over += (counted > limit / 100 * DUTY_CYCLE_LOW_SHARE) ? 1 : 0;
+            }
+            else if (sent[i].priority == AIRTIME_NORMAL)
+            {
+                // Past its share only as a slice's one command
+                over += (counted > limit) ? 1 : 0;
+            }
+        }
+        printf("    busiest hour less the alarms past their reserve %.1f s, %.0f%% of the limit\n",
+            countedBusiest / 1000.0, 100.0 * countedBusiest / limit);
+        check(over == 0, "no poll or command goes past its share of the hour");
+        check(countedBusiest <= limit, "only alarms past their reserve take the busiest hour past the limit");
+        check(result.acksSent == result.acksOffered, "every alarm ACK goes");
+        // Only while the commands, retries included, fit between the low and normal shares.  At
+        // slow spreading factors they may not
+        double commandDemand = options.commandsPerHour * frameAirtime(options.spreadingFactor, FRAME_COMMAND)
+            / (1.0 - options.loss);
+        if (commandDemand <= limit / 100 * (DUTY_CYCLE_NORMAL_SHARE - DUTY_CYCLE_LOW_SHARE))
+        {
+            check(result.commandsDelivered + result.commandsFailed + 1 >= result.commandsIssued, "commands keep going");
+            // Every whole hour, the storm's too, gets at least half of what the commands and the
+            // alarms' reserve leave of the low share
+            double pollRoom = (double)(limit / 100 * DUTY_CYCLE_LOW_SHARE) - (double)reserve - commandDemand;
+            for (size_t hour = 0; hour < (size_t)options.hours; hour++)
+            {
+                check(pollHours[hour] >= pollRoom / 2, "polls are paced, not stopped");
+            }
+        }
+    }
+
+    printf("  checks failed: %lu\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,522 @@
+/*
+*  Title          :  FrameBench
+*  Desc           :  Checks and times the frame security of FrameSecurity.h, AlarmFrame.h and
+*                 :  ConsoleLink.h on the host.  AES-128 and CCM are checked against the FIPS-197
+*                 :  and RFC 3610 test vectors, then every frame type is sealed and opened, every
+*                 :  bit of a frame is flipped, frames are replayed, reflected back the other
+*                 :  way and opened with the wrong node's key, and the counters are taken across
+*                 :  a 16 bit wrap and a power cut.  A frame is passed through a repeater's
+*                 :  envelope and still opens at the far end.  Superframe beacons read back and
+*                 :  nothing sealed reads as one.  Node settings are checked against the board
+*                 :  profile of AlarmProfile.h.  Reports the time to seal and open a frame
+*                 :  and the airtime the counter and MIC add at each spreading factor.
+*                 :
+*                 :  frame_bench --iterations 200000
+*                 :  frame_bench --derive 1 --network-key 000102030405060708090a0b0c0d0e0f
+*                 :
+*                 :  --derive prints the key RemoteNode.ino needs for a node address.  The host
+*                 :  times use the software AES, the ESP32 does the block cipher in hardware.
+*                 :  Exits 1 if any check fails.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.3
+*  History        : 1.0 2026-10-17 Frame and console message security checks and timings
+*                 : 1.1 2026-10-17 Node settings against the Heltec V3 node profile
+*                 : 1.2 2026-10-17 Relay envelope
+*                 : 1.3 2026-10-17 Superframe beacon and slot frames
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include <AlarmFrame.h>
+#include <AlarmProfile.h>
+#include <ConsoleLink.h>
+#include <FrameSecurity.h>
+#include <LoRaAirtime.h>
+#include <NodeSettings.h>
+
+#define V1_STATUS_SIZE                              5   // Version 1 frames: 3 byte header, payload and a CRC-8
+#define V1_ALARM_SIZE                               6
+
+typedef std::chrono::steady_clock BenchClock;
+
+typedef struct
+{
+    unsigned long iterations;
+    bool derive;
+    uint16_t address;
+    uint8_t networkKey[FRAME_KEY_SIZE];
+} BenchOptions;
+
+static const uint8_t frameTypes[] =
+{
+    FRAME_STATUS, FRAME_ALARM, FRAME_ACK, FRAME_COMMAND, FRAME_COMMAND_ACK, FRAME_LINK, FRAME_LINK_ACK,
+    FRAME_CONFIG, FRAME_CONFIG_ACK, FRAME_SLOT
+};
+
+static unsigned long failures = 0;
+
+static void check(bool ok, const char* what)
+{
+    if (!ok)
+    {
+        printf("  FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+static double secondsSince(BenchClock::time_point start)
+{
+    return std::chrono::duration<double>(BenchClock::now() - start).count();
+}
+
+static bool parseHex(const char* text, uint8_t* out, size_t len)
+{
+    if (strlen(text) != len * 2)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++)
+    {
+        char byte[3] = { text[i * 2], text[i * 2 + 1], 0 };
+        char* end;
+        out[i] = (uint8_t)strtoul(byte, &end, 16);
+        if (*end != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void knownAnswers(void)
+{
+    // FIPS-197 appendix C.1
+    uint8_t key[FRAME_KEY_SIZE];
+    uint8_t plain[FRAME_BLOCK_SIZE];
+    uint8_t out[FRAME_BLOCK_SIZE];
+    static const uint8_t aesExpected[FRAME_BLOCK_SIZE] =
+    {
+        0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+    };
+    for (uint8_t i = 0; i < FRAME_BLOCK_SIZE; i++)
+    {
+        key[i] = i;
+        plain[i] = (uint8_t)(i * 0x11);
+    }
+    AesCcm cipher;
+    cipher.setKey(key);
+    cipher.encryptBlock(plain, out);
+    check(memcmp(out, aesExpected, sizeof(out)) == 0, "AES-128 FIPS-197 C.1");
+
+    // RFC 3610 packet vector #1, 8 byte MIC
+    static const uint8_t nonce[FRAME_NONCE_SIZE] = { 0x00, 0x00, 0x00, 0x03, 0x02, 0x01, 0x00, 0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5 };
+    static const uint8_t ccmExpected[23 + 8] =
+    {
+        0x58, 0x8c, 0x97, 0x9a, 0x61, 0xc6, 0x63, 0xd2, 0xf0, 0x66, 0xd0, 0xc2, 0xc0, 0xf9, 0x89, 0x80,
+        0x6d, 0x5f, 0x6b, 0x61, 0xda, 0xc3, 0x84, 0x17, 0xe8, 0xd1, 0x2c, 0xfd, 0xf9, 0x26, 0xe0
+    };
+    uint8_t aad[8];
+    uint8_t message[23];
+    uint8_t sealed[23 + 8];
+    uint8_t opened[23];
+    for (uint8_t i = 0; i < FRAME_KEY_SIZE; i++)
+    {
+        key[i] = (uint8_t)(0xc0 + i);
+    }
+    for (uint8_t i = 0; i < sizeof(aad); i++)
+    {
+        aad[i] = i;
+    }
+    for (uint8_t i = 0; i < sizeof(message); i++)
+    {
+        message[i] = (uint8_t)(sizeof(aad) + i);
+    }
+    cipher.setKey(key);
+    cipher.seal(nonce, aad, sizeof(aad), message, sizeof(message), sealed, &sealed[sizeof(message)], 8);
+    check(memcmp(sealed, ccmExpected, sizeof(sealed)) == 0, "AES-CCM RFC 3610 packet vector #1");
+    check(cipher.open(nonce, aad, sizeof(aad), sealed, sizeof(message), opened, &sealed[sizeof(message)], 8)
+        && memcmp(opened, message, sizeof(message)) == 0, "AES-CCM RFC 3610 packet vector #1 opens");
+}
+
+static AlarmFrame sampleFrame(uint8_t type, uint16_t address)
+{
+    AlarmFrame frame = {};
+    frame.type = type;
+    frame.nodeAddress = address;
+    frame.alarmState = SET;
+    frame.relay1Enabled = 1;
+    frame.checkIn = 1;
+    frame.linkCheck = 1;
+    frame.repeater = 1;
+    frame.sequence = 0xa5;
+    frame.inputs = 0x81;
+    frame.spreadingFactor = 9;
+    frame.txPower = -3;
+    frame.configKey = 7;
+    frame.configValue = 868100000;
+    frame.configResult = 2;
+    frame.slot = 0x0123;
+    frame.superframe = 0xfe;
+    frame.phase = 0xabcdef;
+    return frame;
+}
+
+static bool sameFrame(const AlarmFrame& a, const AlarmFrame& b)
+{
+    bool same = a.type == b.type && a.nodeAddress == b.nodeAddress;
+    switch (a.type)
+    {
+    case FRAME_ALARM:
+        same = same && a.inputs == b.inputs;
+        // fall through
+    case FRAME_COMMAND:
+    case FRAME_COMMAND_ACK:
+        same = same && a.sequence == b.sequence;
+        // fall through
+    case FRAME_STATUS:
+        return same && a.alarmState == b.alarmState && a.relay1Enabled == b.relay1Enabled
+            && a.relay2Enabled == b.relay2Enabled && a.checkIn == b.checkIn && a.linkCheck == b.linkCheck
+            && a.repeater == b.repeater;
+    case FRAME_ACK:
+        return same && a.sequence == b.sequence;
+    case FRAME_CONFIG:
+        return same && a.sequence == b.sequence && a.configKey == b.configKey && a.configValue == b.configValue;
+    case FRAME_CONFIG_ACK:
+        return same && a.sequence == b.sequence && a.configKey == b.configKey && a.configResult == b.configResult;
+    case FRAME_SLOT:
+        return same && a.slot == b.slot && a.superframe == b.superframe && a.phase == b.phase;
+    default:
+        return same && a.spreadingFactor == b.spreadingFactor && a.txPower == b.txPower;
+    }
+}
+
+static void frameChecks(const uint8_t* networkKey)
+{
+    uint8_t key[FRAME_KEY_SIZE];
+    AesCcm node;
+    AesCcm other;
+    frameKeyDerive(networkKey, 7, key);
+    node.setKey(key);
+    frameKeyDerive(networkKey, 8, key);
+    other.setKey(key);
+
+    FrameCounters sender = {};
+    FrameCounters receiver = {};
+    bool store;
+    uint8_t buf[ALARM_FRAME_MAX_SIZE];
+    AlarmFrame decoded;
+    for (uint8_t type : frameTypes)
+    {
+        AlarmFrame frame = sampleFrame(type, 7);
+        size_t len = alarmFrameEncode(frame, node, FRAME_UPLINK, frameCounterNext(sender, store), buf, sizeof(buf));
+        check(len == alarmFrameSize(type) && len <= ALARM_FRAME_MAX_SIZE, "frame size");
+
+        // Every single bit flip is caught
+        unsigned long accepted = 0;
+        for (size_t bit = 0; bit < len * 8; bit++)
+        {
+            buf[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+            accepted += alarmFrameDecode(buf, len, node, FRAME_UPLINK, receiver.rx, decoded) == FRAME_OK ? 1 : 0;
+            buf[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+        }
+        check(accepted == 0, "a frame with a flipped bit was accepted");
+        check(alarmFrameDecode(buf, len, other, FRAME_UPLINK, receiver.rx, decoded) == FRAME_BAD_MIC, "another node's key");
+        check(alarmFrameDecode(buf, len, node, FRAME_DOWNLINK, receiver.rx, decoded) == FRAME_BAD_MIC, "reflected frame");
+
+        decoded = AlarmFrame();
+        check(alarmFrameDecode(buf, len, node, FRAME_UPLINK, receiver.rx, decoded) == FRAME_OK && sameFrame(frame, decoded),
+            "round trip");
+        frameCounterAccept(receiver, decoded.counter, store);
+        check(alarmFrameDecode(buf, len, node, FRAME_UPLINK, receiver.rx, decoded) == FRAME_REPLAY, "replay");
+    }
+
+    // Across the 16 bit wrap, and after a long silence
+    sender.tx = 0xfff0;
+    for (int i = 0; i < 32; i++)
+    {
+        size_t len = alarmFrameEncode(sampleFrame(FRAME_STATUS, 7), node, FRAME_UPLINK, frameCounterNext(sender, store), buf, sizeof(buf));
+        bool ok = alarmFrameDecode(buf, len, node, FRAME_UPLINK, receiver.rx, decoded) == FRAME_OK && decoded.counter == sender.tx;
+        check(ok, "counter across the 16 bit wrap");
+        frameCounterAccept(receiver, decoded.counter, store);
+    }
+    sender.tx += 60000;
+    size_t len = alarmFrameEncode(sampleFrame(FRAME_STATUS, 7), node, FRAME_UPLINK, frameCounterNext(sender, store), buf, sizeof(buf));
+    check(alarmFrameDecode(buf, len, node, FRAME_UPLINK, receiver.rx, decoded) == FRAME_OK && decoded.counter == sender.tx,
+        "60000 frames missed");
+
+    // Power cut at both ends.  The sender never reuses a counter, the receiver only accepts the
+    // frames since its last write
+    FrameCounters a = {};
+    FrameCounters stored = {};
+    uint32_t highest = 0;
+    for (int i = 0; i < 1000; i++)
+    {
+        highest = frameCounterNext(a, store);
+        if (store)
+        {
+            stored = a;
+        }
+    }
+    frameCountersRestore(stored);
+    check(frameCounterNext(stored, store) > highest && store, "sender restarts after every counter it used");
+
+    FrameCounters r = {};
+    stored = r;
+    for (uint32_t c = 1; c <= 1000; c++)
+    {
+        frameCounterAccept(r, c, store);
+        if (store)
+        {
+            stored = r;
+        }
+    }
+    frameCountersRestore(stored);
+    check(stored.rx > 1000 - FRAME_COUNTER_RESERVE && stored.rx <= 1000, "receiver keeps all but the last reserve");
+}
+
+// A repeater changes nothing inside the envelope, and cannot change anything that still opens
+static void relayChecks(const uint8_t* networkKey)
+{
+    uint8_t key[FRAME_KEY_SIZE];
+    AesCcm node;
+    frameKeyDerive(networkKey, 7, key);
+    node.setKey(key);
+
+    FrameCounters sender = {};
+    FrameCounters receiver = {};
+    bool store;
+    uint8_t buf[RELAY_FRAME_MAX_SIZE];
+    AlarmFrame frame = sampleFrame(FRAME_ALARM, 7);
+    AlarmFrame decoded = {};
+    size_t len = alarmFrameEncode(frame, node, FRAME_UPLINK, frameCounterNext(sender, store),
+        &buf[RELAY_FRAME_HEADER_SIZE], ALARM_FRAME_MAX_SIZE);
+    RelayHeader relay = { 0x1234, 2, false, &buf[RELAY_FRAME_HEADER_SIZE], (uint8_t)len };
+    relayFrameWrap(relay, buf);
+    len += RELAY_FRAME_HEADER_SIZE;
+    check(len <= RELAY_FRAME_MAX_SIZE, "relay frame size");
+    check(alarmFramePeek(buf, len, decoded) == FRAME_BAD_TYPE, "a receiver without repeaters ignores the envelope");
+
+    RelayHeader got = {};
+    check(relayFramePeek(buf, len, got) == FRAME_OK && got.via == 0x1234 && got.hops == 2 && !got.downlink
+        && got.length == len - RELAY_FRAME_HEADER_SIZE, "relay header round trip");
+    check(alarmFrameDecode(got.frame, got.length, node, FRAME_UPLINK, receiver.rx, decoded) == FRAME_OK
+        && sameFrame(frame, decoded), "relayed frame opens");
+    unsigned long accepted = 0;
+    for (size_t bit = RELAY_FRAME_HEADER_SIZE * 8; bit < len * 8; bit++)
+    {
+        buf[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+        accepted += alarmFrameDecode(got.frame, got.length, node, FRAME_UPLINK, receiver.rx, decoded) == FRAME_OK ? 1 : 0;
+        buf[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+    }
+    check(accepted == 0, "a relayed frame with a flipped bit was accepted");
+    check(relayFramePeek(got.frame, got.length, got) != FRAME_OK, "a plain frame is not an envelope");
+}
+
+// A beacon is clear, anyone can read it and nothing sealed can pass for one
+static void beaconChecks(const uint8_t* networkKey)
+{
+    uint8_t buf[ALARM_FRAME_MAX_SIZE];
+    AlarmFrame frame = {};
+    beaconFrameWrite(0xfe, 0xabcdef, buf);
+    check(beaconFramePeek(buf, BEACON_FRAME_SIZE, frame) == FRAME_OK && frame.type == FRAME_BEACON
+        && frame.superframe == 0xfe && frame.phase == 0xabcdef, "beacon round trip");
+    check(beaconFramePeek(buf, BEACON_FRAME_SIZE + 1, frame) == FRAME_BAD_LENGTH, "beacon length");
+    check(alarmFramePeek(buf, BEACON_FRAME_SIZE, frame) != FRAME_OK, "a beacon is not a sealed frame");
+
+    uint8_t key[FRAME_KEY_SIZE];
+    AesCcm node;
+    frameKeyDerive(networkKey, 7, key);
+    node.setKey(key);
+    bool any = false;
+    for (size_t i = 0; i < sizeof(frameTypes); i++)
+    {
+        size_t len = alarmFrameEncode(sampleFrame(frameTypes[i], 7), node, FRAME_DOWNLINK, 1, buf, sizeof(buf));
+        any = any || beaconFramePeek(buf, len, frame) == FRAME_OK;
+    }
+    check(!any, "a sealed frame read as a beacon");
+}
+
+static void consoleChecks(const uint8_t* consoleKey)
+{
+    ConsoleLink hub;
+    ConsoleLink ui;
+    hub.setKey(consoleKey, FRAME_HUB_TO_UI, FRAME_UI_TO_HUB);
+    ui.setKey(consoleKey, FRAME_UI_TO_HUB, FRAME_HUB_TO_UI);
+    LoRaPacket packet = {};
+    packet.nodeAddress = 3;
+    packet.alarmState = SET;
+    packet.rxCount = 12345;
+    LoRaPacket got = {};
+    uint8_t buf[CONSOLE_LINK_MESSAGE_SIZE];
+    bool store;
+
+    size_t len = hub.seal(packet, buf, store);
+    check(len <= 250, "ESP-NOW message size");
+    check(hub.open(buf, len, got, store) == FRAME_BAD_MIC, "console message reflected");
+    buf[len - 1] ^= 1;
+    check(ui.open(buf, len, got, store) == FRAME_BAD_MIC, "console message tampered");
+    buf[len - 1] ^= 1;
+    check(ui.open(buf, len, got, store) == FRAME_OK && got.nodeAddress == 3 && got.alarmState == SET && got.rxCount == 12345,
+        "console round trip");
+    check(ui.open(buf, len, got, store) == FRAME_REPLAY, "console replay");
+}
+
+// The same profile RemoteNode.ino is built with
+static void settingsChecks(void)
+{
+    typedef HeltecV3NodePins<2, 7, 6, 5> NodePins;
+    NodeSettings settings = {};
+    check(nodeSettingsSet(settings, CONFIG_SPREADING_FACTOR, AlarmRadio::spreadingFactor, NodePins::reservedPins) == CONFIG_ACCEPTED
+        && nodeSettingsSet(settings, CONFIG_FREQUENCY, AlarmRadio::frequency, NodePins::reservedPins) == CONFIG_ACCEPTED,
+        "the network's radio profile is a valid node setting");
+    check(nodeSettingsSet(settings, CONFIG_SPREADING_FACTOR, 13, NodePins::reservedPins) == CONFIG_REJECTED
+        && settings.spreadingFactor == AlarmRadio::spreadingFactor, "SF13 refused");
+    check(nodeSettingsSet(settings, CONFIG_RELAY_PIN_1, NodePins::relay2, NodePins::reservedPins) == CONFIG_ACCEPTED,
+        "free relay pin");
+    check(nodeSettingsSet(settings, CONFIG_RELAY_PIN_1, 8, NodePins::reservedPins) == CONFIG_REJECTED
+        && nodeSettingsSet(settings, CONFIG_INPUT_PIN, (1 << 8) | 14, NodePins::reservedPins) == CONFIG_REJECTED
+        && settings.relayPins[0] == NodePins::relay2, "the radio's pins refused");
+    check(nodeSettingsSet(settings, CONFIG_INPUT_PIN, 49, NodePins::reservedPins) == CONFIG_REJECTED, "no GPIO 49");
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions options;
+    options.iterations = 200000;
+    options.derive = false;
+    options.address = 0;
+    for (uint8_t i = 0; i < FRAME_KEY_SIZE; i++)
+    {
+        options.networkKey[i] = i;
+    }
+
+    bool ok = true;
+    for (int i = 1; i < argc && ok; i += 2)
+    {
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        ok = value != nullptr;
+        if (!ok) break;
+        if (strcmp(argv[i], "--iterations") == 0) options.iterations = strtoul(value, nullptr, 10);
+        else if (strcmp(argv[i], "--derive") == 0) { options.derive = true; options.address = (uint16_t)atoi(value); }
+        else if (strcmp(argv[i], "--network-key") == 0) ok = parseHex(value, options.networkKey, FRAME_KEY_SIZE);
+        else ok = false;
+    }
+    if (!ok || options.iterations == 0)
+    {
+        printf("usage: frame_bench [--iterations n] [--derive address] [--network-key 32 hex digits]\n");
+        return 1;
+    }
+
+    if (options.derive)
+    {
+        uint8_t key[FRAME_KEY_SIZE];
+        frameKeyDerive(options.networkKey, options.address, key);
+        printf("const uint8_t nodeKey[FRAME_KEY_SIZE] = { ");
+        for (uint8_t i = 0; i < FRAME_KEY_SIZE; i++)
+        {
+            printf("0x%02x%s", key[i], i + 1 < FRAME_KEY_SIZE ? ", " : " };\n");
+        }
+        return 0;
+    }
+
+    printf("Frame security benchmark: AES-128 CCM, %u byte LoRa MIC, %u byte ESP-NOW MIC, %lu iterations\n",
+        ALARM_FRAME_MIC_SIZE, CONSOLE_LINK_MIC_SIZE, options.iterations);
+    knownAnswers();
+    frameChecks(options.networkKey);
+    relayChecks(options.networkKey);
+    beaconChecks(options.networkKey);
+    consoleChecks(options.networkKey);
+    settingsChecks();
+
+    // Cost per frame
+    uint8_t key[FRAME_KEY_SIZE];
+    AesCcm cipher;
+    frameKeyDerive(options.networkKey, 1, key);
+    cipher.setKey(key);
+    uint8_t block[FRAME_BLOCK_SIZE] = {};
+    BenchClock::time_point start = BenchClock::now();
+    for (unsigned long i = 0; i < options.iterations; i++)
+    {
+        // Each block is the last one's output, so none can be skipped
+        cipher.encryptBlock(block, block);
+    }
+    double blockNs = secondsSince(start) * 1e9 / (double)options.iterations;
+    volatile uint8_t sink = block[0];
+    (void)sink;
+
+    FrameCounters sender = {};
+    FrameCounters receiver = {};
+    bool store;
+    uint8_t buf[ALARM_FRAME_MAX_SIZE];
+    AlarmFrame frame = sampleFrame(FRAME_COMMAND, 1);
+    AlarmFrame decoded;
+    unsigned long opened = 0;
+    start = BenchClock::now();
+    for (unsigned long i = 0; i < options.iterations; i++)
+    {
+        frame.sequence = (uint8_t)i;
+        alarmFrameEncode(frame, cipher, FRAME_DOWNLINK, frameCounterNext(sender, store), buf, sizeof(buf));
+    }
+    double sealNs = secondsSince(start) * 1e9 / (double)options.iterations;
+    size_t len = alarmFrameSize(FRAME_COMMAND);
+    start = BenchClock::now();
+    for (unsigned long i = 0; i < options.iterations; i++)
+    {
+        // The same frame every time, the receiver forgets it so it is not a replay
+        receiver.rx = sender.tx - 1;
+        opened += alarmFrameDecode(buf, len, cipher, FRAME_DOWNLINK, receiver.rx, decoded) == FRAME_OK ? 1 : 0;
+    }
+    double openNs = secondsSince(start) * 1e9 / (double)options.iterations;
+    check(opened == options.iterations, "timed frames open");
+
+    ConsoleLink hub;
+    ConsoleLink ui;
+    hub.setKey(options.networkKey, FRAME_HUB_TO_UI, FRAME_UI_TO_HUB);
+    ui.setKey(options.networkKey, FRAME_UI_TO_HUB, FRAME_HUB_TO_UI);
+    LoRaPacket packet = {};
+    LoRaPacket got;
+    uint8_t message[CONSOLE_LINK_MESSAGE_SIZE];
+    opened = 0;
+    start = BenchClock::now();
+    for (unsigned long i = 0; i < options.iterations; i++)
+    {
+        packet.rxCount = i;
+        hub.seal(packet, message, store);
+        opened += ui.open(message, sizeof(message), got, store) == FRAME_OK ? 1 : 0;
+    }
+    double consoleNs = secondsSince(start) * 1e9 / (double)options.iterations;
+    check(opened == options.iterations, "timed console messages open");
+
+    printf("  AES block %.0f ns, LoRa frame seal %.0f ns, open %.0f ns, ESP-NOW message seal and open %.0f ns\n",
+        blockNs, sealNs, openNs, consoleNs);
+    printf("  ESP-NOW message %u bytes for a %u byte LoRaPacket\n",
+        (unsigned int)CONSOLE_LINK_MESSAGE_SIZE, (unsigned int)sizeof(LoRaPacket));
+
+    // Airtime, BW 125 kHz, CR 4/5, 8 symbol preamble as the sketches use
+    printf("  airtime ms, version 1 -> sealed (bytes %zu -> %zu status, %zu -> %zu alarm):\n",
+        (size_t)V1_STATUS_SIZE, alarmFrameSize(FRAME_STATUS),
+        (size_t)V1_ALARM_SIZE, alarmFrameSize(FRAME_ALARM));
+    for (uint8_t sf = 7; sf <= 12; sf++)
+    {
+        uint32_t status1 = loraTimeOnAirMicros(sf, 0, 1, 8, V1_STATUS_SIZE);
+        uint32_t status2 = loraTimeOnAirMicros(sf, 0, 1, 8, (uint8_t)alarmFrameSize(FRAME_STATUS));
+        uint32_t alarm1 = loraTimeOnAirMicros(sf, 0, 1, 8, V1_ALARM_SIZE);
+        uint32_t alarm2 = loraTimeOnAirMicros(sf, 0, 1, 8, (uint8_t)alarmFrameSize(FRAME_ALARM));
+        printf("    SF%-2u status %7.1f -> %7.1f (+%4.1f%%), alarm %7.1f -> %7.1f (+%4.1f%%)\n", sf,
+            status1 / 1000.0, status2 / 1000.0, 100.0 * (double)(status2 - status1) / (double)status1,
+            alarm1 / 1000.0, alarm2 / 1000.0, 100.0 * (double)(alarm2 - alarm1) / (double)alarm1);
+    }
+
+    printf("  checks failed: %lu\n", failures);
+    if (failures > 0)
+    {
+        printf("FAILED\n");
+    }
+    return failures == 0 ? 0 : 1;
+}
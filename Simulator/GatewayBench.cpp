@@ -0,0 +1,344 @@
+/*
+*  Title          :  GatewayBench
+*  Desc           :  Throughput and integrity test of the hub to gateway telemetry stream, with
+*                 :  no hardware.  A pseudo terminal stands in for the USB serial port: one
+*                 :  thread plays the hub and writes batches through TelemetryWriter into the
+*                 :  master side, the main thread reads the slave side, decodes the batches and
+*                 :  formats each record as the JSON line alarm_gateway prints.
+*                 :
+*                 :  Every record is numbered, so the reader checks that each one arrives once,
+*                 :  in order and intact.  --corrupt flips a byte in that fraction of batches
+*                 :  to check the reader drops them and picks the stream up at the next one.
+*                 :  --rate paces the writer, which also measures latency from the event to
+*                 :  its JSON line.
+*                 :
+*                 :  gateway_bench --records 200000
+*                 :  gateway_bench --records 20000 --rate 2000 --max-age 20
+*                 :  gateway_bench --records 200000 --corrupt 0.01
+*                 :
+*                 :  Exits 1 if a record is lost on a clean stream, or a damaged one is accepted.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.0
+*
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <Telemetry.h>
+#include <TelemetryJson.h>
+
+typedef std::chrono::steady_clock BenchClock;
+
+typedef struct
+{
+    unsigned long records;
+    unsigned int nodes;
+    double rate;                // Records per second, 0 as fast as the pty takes them
+    uint32_t maxAge;            // ms a batch waits to fill
+    double corrupt;             // Fraction of batches with a byte flipped
+    uint32_t seed;
+} BenchOptions;
+
+// The fields each numbered record must arrive with
+static void expectedNode(unsigned long index, unsigned int nodes, TelemetryNode& node)
+{
+    node.address = (uint16_t)(index % nodes + 1);
+    node.alarmState = (uint8_t)(index % 4);
+    node.relays = (uint8_t)(index % 3);
+    node.inputs = (uint8_t)(index * 7);
+    node.rssi = (int16_t)(-40 - (int)(index % 90));
+    node.snr = (int8_t)(10 - (int)(index % 30));
+    node.rxCount = (uint32_t)index;
+    node.missedPolls = (uint32_t)(index / 3);
+    node.spreadingFactor = (uint8_t)(7 + index % 6);
+    node.txPower = (int8_t)(2 + index % 13);
+}
+
+static bool sameNode(const TelemetryNode& a, const TelemetryNode& b)
+{
+    return a.address == b.address && a.alarmState == b.alarmState && a.relays == b.relays && a.inputs == b.inputs
+        && a.rssi == b.rssi && a.snr == b.snr && a.rxCount == b.rxCount && a.missedPolls == b.missedPolls
+        && a.spreadingFactor == b.spreadingFactor && a.txPower == b.txPower;
+}
+
+// The master side of the pty, writes block when the pty buffer is full as a USB port would
+class PtyPort : public TelemetryPort
+{
+public:
+    PtyPort(int fd, double corrupt, uint32_t seed) : _fd(fd), _corrupt(corrupt), _random(seed) {}
+
+    size_t writable(void) override { return TELEMETRY_MAX_FRAME; }
+
+    size_t write(const uint8_t* data, size_t len) override
+    {
+        uint8_t frame[TELEMETRY_MAX_FRAME];
+        memcpy(frame, data, len);
+        if (_corrupt > 0.0 && std::uniform_real_distribution<double>(0.0, 1.0)(_random) < _corrupt)
+        {
+            // Any byte but the delimiter, to a value that is not a delimiter either
+            size_t at = std::uniform_int_distribution<size_t>(0, len - 2)(_random);
+            frame[at] = (uint8_t)(frame[at] ^ (uint8_t)std::uniform_int_distribution<int>(1, 255)(_random));
+            if (frame[at] == 0)
+            {
+                frame[at] = 0x55;
+            }
+            _corrupted++;
+        }
+        size_t done = 0;
+        while (done < len)
+        {
+            ssize_t n = ::write(_fd, frame + done, len - done);
+            if (n > 0)
+            {
+                done += (size_t)n;
+            }
+            else if (n < 0 && errno != EAGAIN && errno != EINTR)
+            {
+                break;
+            }
+            else
+            {
+                struct pollfd fd = { _fd, POLLOUT, 0 };
+                poll(&fd, 1, 10);
+            }
+        }
+        return done;
+    }
+
+    unsigned long corrupted(void) const { return _corrupted; }
+
+private:
+    int _fd;
+    double _corrupt;
+    std::mt19937 _random;
+    unsigned long _corrupted = 0;
+};
+
+class BenchReader : public TelemetryHandler
+{
+public:
+    BenchReader(const BenchOptions& options, const std::vector<BenchClock::time_point>& created)
+        : _options(options), _created(created) {}
+
+    void onRecord(const TelemetryBatch& batch, const TelemetryRecord& record) override
+    {
+        char line[512];
+        size_t len = telemetryJson(batch, record, 0.0, line, sizeof(line));
+        _jsonBytes += len;
+        if (record.type != TELEMETRY_NODE)
+        {
+            _other++;
+            return;
+        }
+        unsigned long index = record.node.rxCount;
+        TelemetryNode expected;
+        expectedNode(index, _options.nodes, expected);
+        if (index >= _options.records || !sameNode(record.node, expected) || (_seen > 0 && index <= _last))
+        {
+            _wrong++;
+            return;
+        }
+        _missing += (_seen > 0) ? index - _last - 1 : index;
+        _last = index;
+        _seen++;
+        if (_options.rate > 0.0)
+        {
+            _latency.push_back(std::chrono::duration<double, std::micro>(BenchClock::now() - _created[index]).count());
+        }
+    }
+
+    unsigned long seen(void) const { return _seen; }
+    unsigned long last(void) const { return _last; }
+    unsigned long missing(void) const { return _missing; }
+    unsigned long wrong(void) const { return _wrong; }
+    unsigned long other(void) const { return _other; }
+    unsigned long jsonBytes(void) const { return _jsonBytes; }
+    std::vector<double>& latency(void) { return _latency; }
+
+private:
+    const BenchOptions& _options;
+    const std::vector<BenchClock::time_point>& _created;
+    unsigned long _seen = 0;
+    unsigned long _last = 0;
+    unsigned long _missing = 0;
+    unsigned long _wrong = 0;
+    unsigned long _other = 0;
+    unsigned long _jsonBytes = 0;
+    std::vector<double> _latency;
+};
+
+static uint32_t msSince(BenchClock::time_point start)
+{
+    return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(BenchClock::now() - start).count();
+}
+
+// The hub: node records, with a command every 8 and hub counters every 64
+static void writer(int master, const BenchOptions& options, std::vector<BenchClock::time_point>& created,
+    std::atomic<bool>& done, unsigned long& corrupted, unsigned long& wireBytes)
+{
+    PtyPort port(master, options.corrupt, options.seed);
+    TelemetryWriter telemetry(port);
+    BenchClock::time_point start = BenchClock::now();
+    telemetry.begin(options.maxAge, 1000, 0);
+    for (unsigned long i = 0; i < options.records; i++)
+    {
+        if (options.rate > 0.0)
+        {
+            std::this_thread::sleep_until(start + std::chrono::duration<double>((double)i / options.rate));
+        }
+        uint32_t now = msSince(start);
+        created[i] = BenchClock::now();
+        TelemetryNode node;
+        expectedNode(i, options.nodes, node);
+        telemetry.node(now, node, false);
+        if (i % 8 == 0)
+        {
+            TelemetryCommand command = { node.address, (uint8_t)i, COMMAND_DELIVERED, 84 };
+            telemetry.command(now, command);
+        }
+        if (i % 64 == 0)
+        {
+            TelemetryHub hub = { (uint16_t)options.nodes, 0, (uint32_t)(i / 8), 0, 0, (uint32_t)telemetry.dropped() };
+            telemetry.hub(now, hub);
+        }
+        telemetry.service(now);
+    }
+    telemetry.flush(msSince(start));
+    corrupted = port.corrupted();
+    wireBytes = telemetry.bytes();
+    done = true;
+}
+
+static void usage(void)
+{
+    printf("usage: gateway_bench [--records n] [--nodes n] [--rate r] [--max-age ms] [--corrupt fraction] [--seed s]\n");
+}
+
+static bool parseOptions(int argc, char** argv, BenchOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (value == nullptr)
+        {
+            return false;
+        }
+        i++;
+        if (strcmp(arg, "--records") == 0) options.records = strtoul(value, nullptr, 10);
+        else if (strcmp(arg, "--nodes") == 0) options.nodes = (unsigned int)atoi(value);
+        else if (strcmp(arg, "--rate") == 0) options.rate = atof(value);
+        else if (strcmp(arg, "--max-age") == 0) options.maxAge = (uint32_t)atol(value);
+        else if (strcmp(arg, "--corrupt") == 0) options.corrupt = atof(value);
+        else if (strcmp(arg, "--seed") == 0) options.seed = (uint32_t)atol(value);
+        else return false;
+    }
+    return options.records > 0 && options.nodes > 0 && options.nodes < 65535 && options.corrupt >= 0.0 && options.corrupt < 1.0;
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions options;
+    options.records = 200000;
+    options.nodes = 50;
+    options.rate = 0.0;
+    options.maxAge = 50;
+    options.corrupt = 0.0;
+    options.seed = 1;
+
+    if (!parseOptions(argc, argv, options))
+    {
+        usage();
+        return 1;
+    }
+
+    int master, slave;
+    if (openpty(&master, &slave, nullptr, nullptr, nullptr) != 0)
+    {
+        printf("openpty failed: %s\n", strerror(errno));
+        return 1;
+    }
+    // Raw both ways, the line discipline would otherwise rewrite the binary stream
+    struct termios tty;
+    tcgetattr(slave, &tty);
+    cfmakeraw(&tty);
+    tcsetattr(slave, TCSANOW, &tty);
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+    std::vector<BenchClock::time_point> created(options.records);
+    BenchReader reader(options, created);
+    TelemetryDecoder decoder(reader);
+    std::atomic<bool> done(false);
+    unsigned long corrupted = 0;
+    unsigned long wireBytes = 0;
+
+    BenchClock::time_point start = BenchClock::now();
+    std::thread hub(writer, master, std::cref(options), std::ref(created), std::ref(done), std::ref(corrupted), std::ref(wireBytes));
+    uint8_t buffer[4096];
+    int idle = 0;
+    while (idle < 20)
+    {
+        struct pollfd fd = { slave, POLLIN, 0 };
+        if (poll(&fd, 1, 10) > 0)
+        {
+            ssize_t len = read(slave, buffer, sizeof(buffer));
+            if (len > 0)
+            {
+                decoder.feed(buffer, (size_t)len);
+                idle = 0;
+                continue;
+            }
+        }
+        idle += done ? 1 : 0;   // Drained once the writer is done and nothing came for 200 ms
+    }
+    hub.join();
+    double seconds = std::chrono::duration<double>(BenchClock::now() - start).count() - 0.2;
+    close(master);
+    close(slave);
+
+    unsigned long tail = (reader.seen() > 0) ? options.records - 1 - reader.last() : options.records;
+    unsigned long missing = reader.missing() + tail;
+    unsigned long records = decoder.records();
+    double perRecord = records ? (double)wireBytes / (double)records : 0.0;
+    double jsonPerRecord = records ? (double)reader.jsonBytes() / (double)records : 0.0;
+
+    printf("Telemetry over a pty: %lu node records, %u nodes, batches of up to %u bytes, max age %lu ms\n",
+        options.records, options.nodes, TELEMETRY_MAX_PAYLOAD, (unsigned long)options.maxAge);
+    printf("  %.2f s, %.0f records/s, %.2f MB/s on the wire\n", seconds, (double)records / seconds,
+        (double)wireBytes / seconds / 1e6);
+    printf("  batches %lu, bad frames %lu, lost batches %lu, corrupted by the bench %lu\n",
+        decoder.batches(), decoder.badFrames(), decoder.lostBatches(), corrupted);
+    printf("  node records arrived %lu, missing %lu, arrived damaged %lu, other records %lu\n",
+        reader.seen(), missing, reader.wrong(), reader.other());
+    printf("  wire %.1f bytes a record, the same record as JSON %.1f bytes (%.1fx)\n",
+        perRecord, jsonPerRecord, perRecord > 0.0 ? jsonPerRecord / perRecord : 0.0);
+    printf("  a serial port carries records/s: 115200 baud %.0f (JSON %.0f), 921600 baud %.0f (JSON %.0f)\n",
+        11520.0 / perRecord, 11520.0 / jsonPerRecord, 92160.0 / perRecord, 92160.0 / jsonPerRecord);
+    std::vector<double>& latency = reader.latency();
+    if (!latency.empty())
+    {
+        std::sort(latency.begin(), latency.end());
+        printf("  event to JSON us: p50 %.0f, p99 %.0f, max %.0f\n", latency[latency.size() / 2],
+            latency[latency.size() * 99 / 100], latency.back());
+    }
+
+    bool failed = reader.wrong() > 0 || (corrupted == 0 && (missing > 0 || decoder.badFrames() > 0));
+    printf("%s\n", failed ? "FAILED" : "ok");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,547 @@
+/*
+*  Title          :  InputBench
+*  Desc           :  Runs noisy input traces through the SensorPipeline the RemoteNode uses and
+*                 :  counts the alarm frames it saves.
+*                 :
+*                 :  The synthetic trace is one ms per sample for three inputs: a PIR that
+*                 :  chatters, drops out and glitches, a door contact that bounces on every
+*                 :  edge and an analog sensor with noise and spikes around its thresholds.
+*                 :  Each has genuine events, the ground truth.  The inputs are scanned every
+*                 :  scan ms as the firmware does, once raw (a pin level or one threshold, a
+*                 :  frame per change as the node used to send) and once through the pipeline.
+*                 :  Both go through the node's alarm merging, a change while a frame is in
+*                 :  flight rides on the next one.
+*                 :
+*                 :  Reports frames on air each way, the genuine events missed, the false
+*                 :  alarms and the latency the pipeline adds to the set and clear edges.
+*                 :
+*                 :  input_bench --seconds 3600 --scan 5 --flight 250
+*                 :  input_bench --trace recorded.csv
+*                 :  input_bench --record trace.csv
+*                 :
+*                 :  A trace file has lines of ms,input,value, a value holds until the next
+*                 :  line for its input.  Lines of #event,input,start,end are the ground truth.
+*                 :  --record writes the synthetic trace in the same format.
+*                 :
+*                 :  Exits 1 if any genuine event is missed.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.0
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <SensorPipeline.h>
+
+#define BENCH_INPUTS                                3
+
+// The inputs as RemoteNode lists them
+static const InputConfig benchConfigs[BENCH_INPUTS] =
+{
+    { INPUT_DIGITAL, 7, true, 0, 0, 30, 2000, 1000 },       // PIR
+    { INPUT_DIGITAL, 4, false, 0, 0, 50, 0, 500 },          // Door contact to ground
+    { INPUT_ANALOG, 1, true, 2600, 2200, 100, 1000, 1000 }  // Analog sensor on the ADC
+};
+
+static const char* inputNames[BENCH_INPUTS] = { "PIR", "contact", "analog" };
+
+typedef struct
+{
+    unsigned int seconds;
+    uint32_t scan;              // ms between scans
+    uint32_t flight;            // ms an alarm frame is in flight, changes meanwhile merge
+    uint32_t eventGap;          // ms, mean quiet time between genuine events
+    uint32_t seed;
+    const char* tracePath;
+    const char* recordPath;
+} BenchOptions;
+
+typedef struct
+{
+    size_t input;
+    uint32_t start;
+    uint32_t end;
+} Event;
+
+typedef struct
+{
+    std::vector<uint16_t> samples[BENCH_INPUTS];    // One per ms
+    std::vector<Event> events;
+} Trace;
+
+// Alarm frames on air, one at a time, changes while one is in flight merged into the next
+class FrameCounter
+{
+public:
+    explicit FrameCounter(uint32_t flight) : _flight(flight) {}
+
+    void change(uint32_t now)
+    {
+        _changes++;
+        if (now - _sentAt >= _flight || _frames == 0)
+        {
+            send(now);
+        }
+        else
+        {
+            _pending = true;
+        }
+    }
+
+    void tick(uint32_t now)
+    {
+        if (_pending && now - _sentAt >= _flight)
+        {
+            send(now);
+        }
+    }
+
+    unsigned long changes(void) const { return _changes; }
+    unsigned long frames(void) const { return _frames; }
+
+private:
+    void send(uint32_t now)
+    {
+        _frames++;
+        _sentAt = now;
+        _pending = false;
+    }
+
+    uint32_t _flight;
+    uint32_t _sentAt = 0;
+    bool _pending = false;
+    unsigned long _changes = 0;
+    unsigned long _frames = 0;
+};
+
+// The level each input would read idle and active
+static uint16_t idleReading(size_t input)
+{
+    return (input == 1) ? 1 : 0;
+}
+
+static uint16_t activeReading(size_t input)
+{
+    return (input == 1) ? 0 : 1;
+}
+
+static uint32_t uniform(std::mt19937& rng, uint32_t low, uint32_t high)
+{
+    return std::uniform_int_distribution<uint32_t>(low, high)(rng);
+}
+
+static void fill(std::vector<uint16_t>& samples, uint32_t from, uint32_t to, uint16_t value)
+{
+    to = std::min<uint32_t>(to, (uint32_t)samples.size());
+    for (uint32_t t = from; t < to; t++)
+    {
+        samples[t] = value;
+    }
+}
+
+// Genuine events of one input, quiet gaps of at least 5 s between them
+static void addEvents(Trace& trace, size_t input, uint32_t length, uint32_t minMs, uint32_t maxMs,
+    const BenchOptions& options, std::mt19937& rng)
+{
+    std::exponential_distribution<double> gap(1.0 / options.eventGap);
+    uint32_t t = 5000 + (uint32_t)gap(rng);
+    while (t + maxMs + 5000 < length)
+    {
+        Event event = { input, t, t + uniform(rng, minMs, maxMs) };
+        trace.events.push_back(event);
+        t = event.end + 5000 + (uint32_t)gap(rng);
+    }
+}
+
+static void synthesise(Trace& trace, uint32_t length, const BenchOptions& options, std::mt19937& rng)
+{
+    for (size_t i = 0; i < BENCH_INPUTS; i++)
+    {
+        trace.samples[i].assign(length, idleReading(i));
+    }
+    addEvents(trace, 0, length, 2000, 10000, options, rng);
+    addEvents(trace, 1, length, 3000, 30000, options, rng);
+    addEvents(trace, 2, length, 3000, 15000, options, rng);
+
+    std::vector<uint16_t>& pir = trace.samples[0];
+    std::vector<uint16_t>& contact = trace.samples[1];
+    std::vector<uint16_t>& analog = trace.samples[2];
+
+    for (const Event& event : trace.events)
+    {
+        if (event.input == 0)
+        {
+            // High for the event, with short dropouts where the PIR retriggers
+            fill(pir, event.start, event.end, 1);
+            for (uint32_t t = event.start + uniform(rng, 200, 1500); t < event.end; t += uniform(rng, 200, 1500))
+            {
+                uint32_t width = (uniform(rng, 0, 9) == 0) ? uniform(rng, 30, 150) : uniform(rng, 2, 25);
+                fill(pir, t, std::min(t + width, event.end), 0);
+            }
+        }
+        else if (event.input == 1)
+        {
+            // The contact opens, bouncing on the way in and out
+            fill(contact, event.start, event.end, activeReading(1));
+            for (uint32_t edge : { event.start, event.end })
+            {
+                uint32_t bounce = uniform(rng, 1, 20);
+                for (uint32_t t = edge; t < edge + bounce; t += uniform(rng, 1, 3))
+                {
+                    contact[t] = contact[t] ? 0 : 1;
+                }
+            }
+        }
+    }
+
+    // Spikes on the PIR line, from the relays switching nearby
+    std::exponential_distribution<double> glitchGap(1.0 / 20000.0);
+    for (uint32_t t = (uint32_t)glitchGap(rng); t < length; t += 1 + (uint32_t)glitchGap(rng))
+    {
+        fill(pir, t, t + uniform(rng, 1, 10), 1);
+    }
+
+    // The analog input wanders around its level with noise and the odd spike.  Idle it sits
+    // near the clear level, active near the set level, so a single threshold chatters
+    std::normal_distribution<double> noise(0.0, 120.0);
+    std::vector<bool> active(length, false);
+    for (const Event& event : trace.events)
+    {
+        if (event.input == 2)
+        {
+            std::fill(active.begin() + event.start, active.begin() + event.end, true);
+        }
+    }
+    for (uint32_t t = 0; t < length; t++)
+    {
+        double level = (active[t] ? 2900.0 : 2000.0) + noise(rng);
+        if (uniform(rng, 0, 9999) == 0)
+        {
+            level = 3500.0;
+        }
+        analog[t] = (uint16_t)std::max(0.0, std::min(4095.0, level));
+    }
+}
+
+static bool loadTrace(Trace& trace, const char* path)
+{
+    FILE* file = fopen(path, "r");
+    if (file == nullptr)
+    {
+        printf("cannot read %s\n", path);
+        return false;
+    }
+    struct Change { uint32_t ms; size_t input; uint16_t value; };
+    std::vector<Change> changes;
+    uint32_t length = 0;
+    char line[128];
+    while (fgets(line, sizeof(line), file) != nullptr)
+    {
+        unsigned long a, b, c;
+        if (sscanf(line, "#event,%lu,%lu,%lu", &a, &b, &c) == 3 && a < BENCH_INPUTS && b < c)
+        {
+            Event event = { (size_t)a, (uint32_t)b, (uint32_t)c };
+            trace.events.push_back(event);
+            length = std::max(length, (uint32_t)c);
+        }
+        else if (sscanf(line, "%lu,%lu,%lu", &a, &b, &c) == 3 && b < BENCH_INPUTS)
+        {
+            Change change = { (uint32_t)a, (size_t)b, (uint16_t)c };
+            changes.push_back(change);
+            length = std::max(length, (uint32_t)a);
+        }
+    }
+    fclose(file);
+
+    length += 5000;     // Room for the last clear to come through
+    for (size_t i = 0; i < BENCH_INPUTS; i++)
+    {
+        trace.samples[i].assign(length, idleReading(i));
+    }
+    std::vector<bool> changed[BENCH_INPUTS];
+    for (size_t i = 0; i < BENCH_INPUTS; i++)
+    {
+        changed[i].assign(length, false);
+    }
+    for (const Change& change : changes)
+    {
+        trace.samples[change.input][change.ms] = change.value;
+        changed[change.input][change.ms] = true;
+    }
+    // Each value holds until the next change of its input
+    for (size_t i = 0; i < BENCH_INPUTS; i++)
+    {
+        for (uint32_t t = 1; t < length; t++)
+        {
+            if (!changed[i][t])
+            {
+                trace.samples[i][t] = trace.samples[i][t - 1];
+            }
+        }
+    }
+    printf("Trace %s: %lu changes, %zu events, %.1f s\n", path, (unsigned long)changes.size(),
+        trace.events.size(), length / 1000.0);
+    return true;
+}
+
+static bool recordTrace(const Trace& trace, const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (file == nullptr)
+    {
+        printf("cannot write %s\n", path);
+        return false;
+    }
+    for (const Event& event : trace.events)
+    {
+        fprintf(file, "#event,%zu,%lu,%lu\n", event.input, (unsigned long)event.start, (unsigned long)event.end);
+    }
+    for (size_t i = 0; i < BENCH_INPUTS; i++)
+    {
+        const std::vector<uint16_t>& samples = trace.samples[i];
+        for (size_t t = 0; t < samples.size(); t++)
+        {
+            if (t == 0 || samples[t] != samples[t - 1])
+            {
+                fprintf(file, "%zu,%zu,%u\n", t, i, samples[t]);
+            }
+        }
+    }
+    fclose(file);
+    printf("Recorded the trace to %s\n", path);
+    return true;
+}
+
+// What the node saw before the pipeline, the pin level or one fixed threshold
+static bool rawActive(size_t input, uint16_t reading)
+{
+    const InputConfig& config = benchConfigs[input];
+    if (config.kind == INPUT_ANALOG)
+    {
+        return reading >= config.setLevel;
+    }
+    return (reading != 0) == config.activeHigh;
+}
+
+typedef struct
+{
+    std::vector<uint32_t> rises[BENCH_INPUTS];      // ms the filtered bit went active
+    std::vector<uint32_t> falls[BENCH_INPUTS];
+} Edges;
+
+static void printLatency(const char* what, std::vector<uint32_t>& latency)
+{
+    if (latency.empty())
+    {
+        printf("  %-28s none\n", what);
+        return;
+    }
+    std::sort(latency.begin(), latency.end());
+    double sum = 0;
+    for (uint32_t ms : latency)
+    {
+        sum += ms;
+    }
+    printf("  %-28s mean %6.1f ms, 95%% %5lu ms, max %5lu ms\n", what, sum / latency.size(),
+        (unsigned long)latency[latency.size() * 95 / 100], (unsigned long)latency.back());
+}
+
+static bool run(const Trace& trace, const BenchOptions& options)
+{
+    uint32_t length = (uint32_t)trace.samples[0].size();
+    SensorPipeline<BENCH_INPUTS> pipeline;
+    pipeline.begin(benchConfigs, 0);
+    FrameCounter rawFrames(options.flight);
+    FrameCounter filteredFrames(options.flight);
+    Edges edges;
+    uint8_t rawMask = 0;
+    uint8_t mask = 0;
+    unsigned long scans = 0;
+    unsigned long settlingScans = 0;
+
+    for (uint32_t now = 0; now < length; now++)
+    {
+        rawFrames.tick(now);
+        filteredFrames.tick(now);
+        if (now % options.scan != 0)
+        {
+            continue;
+        }
+        uint16_t readings[BENCH_INPUTS];
+        uint8_t raw = 0;
+        for (size_t i = 0; i < BENCH_INPUTS; i++)
+        {
+            readings[i] = trace.samples[i][now];
+            if (rawActive(i, readings[i]))
+            {
+                raw |= (uint8_t)(1u << i);
+            }
+        }
+        if (raw != rawMask)
+        {
+            rawMask = raw;
+            rawFrames.change(now);
+        }
+        if (pipeline.update(readings, now))
+        {
+            uint8_t changed = mask ^ pipeline.mask();
+            mask = pipeline.mask();
+            for (size_t i = 0; i < BENCH_INPUTS; i++)
+            {
+                if (changed & (1u << i))
+                {
+                    ((mask & (1u << i)) ? edges.rises[i] : edges.falls[i]).push_back(now);
+                }
+            }
+            filteredFrames.change(now);
+        }
+        scans++;
+        if (pipeline.settling())
+        {
+            settlingScans++;
+        }
+    }
+
+    // Every genuine event should raise its bit before it ends, and clear it after.  A rise
+    // with no event around it is a false alarm
+    unsigned long missed = 0;
+    unsigned long falseAlarms = 0;
+    std::vector<uint32_t> setLatency;
+    std::vector<uint32_t> clearLatency;
+    printf("\n  %-10s %8s %8s %8s %8s\n", "input", "events", "missed", "false", "rises");
+    for (size_t i = 0; i < BENCH_INPUTS; i++)
+    {
+        unsigned long events = 0;
+        unsigned long inputMissed = 0;
+        std::vector<bool> explained(edges.rises[i].size(), false);
+        for (const Event& event : trace.events)
+        {
+            if (event.input != i)
+            {
+                continue;
+            }
+            events++;
+            bool seen = false;
+            uint32_t lastRise = 0;
+            for (size_t r = 0; r < edges.rises[i].size(); r++)
+            {
+                uint32_t rise = edges.rises[i][r];
+                if (rise >= event.start && rise <= event.end)
+                {
+                    if (!seen)
+                    {
+                        setLatency.push_back(rise - event.start);
+                    }
+                    seen = true;
+                    explained[r] = true;
+                    lastRise = rise;
+                }
+            }
+            if (!seen)
+            {
+                inputMissed++;
+                continue;
+            }
+            // A bit that dropped out near the end and cleared early adds no latency
+            auto fall = std::upper_bound(edges.falls[i].begin(), edges.falls[i].end(), lastRise);
+            if (fall != edges.falls[i].end() && *fall >= event.end)
+            {
+                clearLatency.push_back(*fall - event.end);
+            }
+        }
+        unsigned long inputFalse = (unsigned long)std::count(explained.begin(), explained.end(), false);
+        printf("  %-10s %8lu %8lu %8lu %8zu\n", inputNames[i], events, inputMissed, inputFalse, edges.rises[i].size());
+        missed += inputMissed;
+        falseAlarms += inputFalse;
+    }
+
+    printf("\n  %-28s %10s %10s\n", "", "raw", "pipeline");
+    printf("  %-28s %10lu %10lu\n", "input changes", rawFrames.changes(), filteredFrames.changes());
+    printf("  %-28s %10lu %10lu\n", "alarm frames on air", rawFrames.frames(), filteredFrames.frames());
+    if (rawFrames.frames() > 0)
+    {
+        printf("  frames saved by the pipeline %.1f%%\n",
+            100.0 * (1.0 - (double)filteredFrames.frames() / rawFrames.frames()));
+    }
+    printf("  settling, a low power node kept awake, %.2f%% of scans\n\n", 100.0 * settlingScans / std::max(1ul, scans));
+    printLatency("added latency, set", setLatency);
+    printLatency("added latency, clear", clearLatency);
+    printf("\ngenuine events missed: %lu, false alarms: %lu\n", missed, falseAlarms);
+    return missed == 0;
+}
+
+static void usage(void)
+{
+    printf("usage: input_bench [--seconds s] [--scan ms] [--flight ms] [--event-gap ms] [--seed s]\n"
+           "                   [--trace file] [--record file]\n");
+}
+
+static bool parseOptions(int argc, char** argv, BenchOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (value == nullptr)
+        {
+            return false;
+        }
+        i++;
+        if (strcmp(arg, "--seconds") == 0) options.seconds = (unsigned int)atoi(value);
+        else if (strcmp(arg, "--scan") == 0) options.scan = (uint32_t)atol(value);
+        else if (strcmp(arg, "--flight") == 0) options.flight = (uint32_t)atol(value);
+        else if (strcmp(arg, "--event-gap") == 0) options.eventGap = (uint32_t)atol(value);
+        else if (strcmp(arg, "--seed") == 0) options.seed = (uint32_t)atol(value);
+        else if (strcmp(arg, "--trace") == 0) options.tracePath = value;
+        else if (strcmp(arg, "--record") == 0) options.recordPath = value;
+        else return false;
+    }
+    return options.seconds > 0 && options.scan > 0 && options.eventGap > 0;
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions options;
+    options.seconds = 3600;
+    options.scan = 5;
+    options.flight = 250;
+    options.eventGap = 60000;
+    options.seed = 1;
+    options.tracePath = nullptr;
+    options.recordPath = nullptr;
+
+    if (!parseOptions(argc, argv, options))
+    {
+        usage();
+        return 1;
+    }
+
+    Trace trace;
+    if (options.tracePath != nullptr)
+    {
+        if (!loadTrace(trace, options.tracePath))
+        {
+            return 1;
+        }
+    }
+    else
+    {
+        std::mt19937 rng(options.seed);
+        synthesise(trace, options.seconds * 1000, options, rng);
+        printf("Synthetic trace: %u s, %zu genuine events\n", options.seconds, trace.events.size());
+    }
+    if (options.recordPath != nullptr && !recordTrace(trace, options.recordPath))
+    {
+        return 1;
+    }
+
+    printf("Scan every %lu ms, a frame in flight for %lu ms\n", (unsigned long)options.scan, (unsigned long)options.flight);
+    return run(trace, options) ? 0 : 1;
+}
@@ -0,0 +1,296 @@
+/*
+*  Title          :  JsonBench
+*  Desc           :  Times the JSON payload the sketches used to send, built in outDoc with
+*                 :  serializeJson() and read back with deserializeJson(), against a STATUS
+*                 :  frame sealed and opened by AlarmFrame.h.  Both carry the node address,
+*                 :  alarm state and relay states.  Prints the bytes each puts on air and the
+*                 :  airtime at each spreading factor.
+*                 :
+*                 :  json_bench --iterations 200000
+*                 :
+*                 :  ArduinoJson is used when CMake finds it.  Without it the baseline is a
+*                 :  built-in stand-in that writes the same compact text serializeJson() does
+*                 :  and parses it field by field, so its times are a floor for the library's.
+*                 :  Exits 1 if any check fails.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.2
+*  History        : 1.0 2026-10-17 JSON payload against the binary STATUS frame
+*                 : 1.1 2026-10-17 Airtime at each spreading factor
+*                 : 1.2 2026-10-17 Sealed STATUS frame, counter and MIC
+*
+*/
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#ifdef HAVE_ARDUINOJSON
+#include <ArduinoJson.h>
+#endif
+
+#include <AlarmFrame.h>
+#include <FrameSecurity.h>
+#include <LoRaAirtime.h>
+
+#define BUFFER_SIZE                                 50  // The sketches' old payload buffer
+
+typedef std::chrono::steady_clock BenchClock;
+
+static unsigned long failures = 0;
+
+static void check(bool ok, const char* what)
+{
+    if (!ok)
+    {
+        printf("  FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+static double secondsSince(BenchClock::time_point start)
+{
+    return std::chrono::duration<double>(BenchClock::now() - start).count();
+}
+
+#ifdef HAVE_ARDUINOJSON
+
+static JsonDocument inDoc;
+static JsonDocument outDoc;
+
+static size_t jsonEncode(const AlarmFrame& frame, char* out, size_t size)
+{
+    outDoc["g"] = frame.nodeAddress;
+    outDoc["m"] = frame.alarmState;
+    outDoc["r1"] = frame.relay1Enabled;
+    outDoc["r2"] = frame.relay2Enabled;
+    return serializeJson(outDoc, out, size);
+}
+
+static bool jsonDecode(const char* text, AlarmFrame& frame)
+{
+    if (deserializeJson(inDoc, text))
+    {
+        return false;
+    }
+    frame.nodeAddress = inDoc["g"];
+    frame.alarmState = inDoc["m"];
+    frame.relay1Enabled = inDoc["r1"];
+    frame.relay2Enabled = inDoc["r2"];
+    return true;
+}
+
+#define JSON_LIBRARY                                "ArduinoJson"
+
+#else
+
+// The text serializeJson() writes for outDoc, keys in the order they were set and no spaces
+static size_t jsonEncode(const AlarmFrame& frame, char* out, size_t size)
+{
+    int len = snprintf(out, size, "{\"g\":%u,\"m\":%u,\"r1\":%u,\"r2\":%u}", (unsigned int)frame.nodeAddress,
+        (unsigned int)frame.alarmState, (unsigned int)frame.relay1Enabled, (unsigned int)frame.relay2Enabled);
+    return (len > 0 && (size_t)len < size) ? (size_t)len : 0;
+}
+
+static const char* skipSpace(const char* p)
+{
+    while (isspace((unsigned char)*p)) p++;
+    return p;
+}
+
+// An object of integer members in any order and spacing, as deserializeJson() would take it
+static bool jsonDecode(const char* text, AlarmFrame& frame)
+{
+    const char* p = skipSpace(text);
+    if (*p++ != '{')
+    {
+        return false;
+    }
+    p = skipSpace(p);
+    if (*p == '}')
+    {
+        return *skipSpace(p + 1) == 0;
+    }
+    while (true)
+    {
+        if (*p++ != '"')
+        {
+            return false;
+        }
+        const char* key = p;
+        while (*p != '"' && *p != 0) p++;
+        if (*p == 0)
+        {
+            return false;
+        }
+        size_t keyLen = (size_t)(p - key);
+        p = skipSpace(p + 1);
+        if (*p++ != ':')
+        {
+            return false;
+        }
+        char* end;
+        long value = strtol(skipSpace(p), &end, 10);
+        if (end == skipSpace(p))
+        {
+            return false;
+        }
+        if (keyLen == 1 && key[0] == 'g') frame.nodeAddress = (uint16_t)value;
+        else if (keyLen == 1 && key[0] == 'm') frame.alarmState = (uint8_t)value;
+        else if (keyLen == 2 && key[0] == 'r' && key[1] == '1') frame.relay1Enabled = (uint8_t)value;
+        else if (keyLen == 2 && key[0] == 'r' && key[1] == '2') frame.relay2Enabled = (uint8_t)value;
+        p = skipSpace(end);
+        if (*p == '}')
+        {
+            return *skipSpace(p + 1) == 0;
+        }
+        if (*p++ != ',')
+        {
+            return false;
+        }
+        p = skipSpace(p);
+    }
+}
+
+#define JSON_LIBRARY                                "stand-in, ArduinoJson not found"
+
+#endif
+
+static bool sameStatus(const AlarmFrame& a, const AlarmFrame& b)
+{
+    return a.nodeAddress == b.nodeAddress && a.alarmState == b.alarmState
+        && a.relay1Enabled == b.relay1Enabled && a.relay2Enabled == b.relay2Enabled;
+}
+
+static AlarmFrame statusFrame(uint16_t address, unsigned long i)
+{
+    AlarmFrame frame = {};
+    frame.type = FRAME_STATUS;
+    frame.nodeAddress = address;
+    frame.alarmState = (uint8_t)(i % 4);
+    frame.relay1Enabled = (uint8_t)(i & 1);
+    frame.relay2Enabled = (uint8_t)((i >> 1) & 1);
+    return frame;
+}
+
+static void jsonChecks(void)
+{
+    char text[BUFFER_SIZE];
+    AlarmFrame frame = statusFrame(1, 6);
+    size_t len = jsonEncode(frame, text, sizeof(text));
+    check(len == strlen("{\"g\":1,\"m\":2,\"r1\":0,\"r2\":1}") && strcmp(text, "{\"g\":1,\"m\":2,\"r1\":0,\"r2\":1}") == 0,
+        "JSON text as the sketches sent it");
+
+    AlarmFrame decoded = {};
+    check(jsonDecode(" { \"r2\" : 1 , \"g\":300,\"r1\":1, \"m\" : 3 } ", decoded) && decoded.nodeAddress == 300
+        && decoded.alarmState == 3 && decoded.relay1Enabled == 1 && decoded.relay2Enabled == 1,
+        "JSON read with spaces and keys in another order");
+    check(!jsonDecode("{\"g\":1,\"m\":", decoded), "cut JSON refused");
+    check(!jsonDecode("", decoded), "empty JSON refused");
+
+    unsigned long bad = 0;
+    for (unsigned long i = 0; i < 4096; i++)
+    {
+        frame = statusFrame((uint16_t)(i * 17), i);
+        len = jsonEncode(frame, text, sizeof(text));
+        decoded = AlarmFrame();
+        bad += (len > 0 && jsonDecode(text, decoded) && sameStatus(frame, decoded)) ? 0 : 1;
+    }
+    check(bad == 0, "JSON round trips");
+}
+
+int main(int argc, char** argv)
+{
+    unsigned long iterations = 200000;
+    bool ok = true;
+    for (int i = 1; i < argc && ok; i += 2)
+    {
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        ok = value != nullptr && strcmp(argv[i], "--iterations") == 0;
+        if (ok) iterations = strtoul(value, nullptr, 10);
+    }
+    if (!ok || iterations == 0)
+    {
+        printf("usage: json_bench [--iterations n]\n");
+        return 1;
+    }
+
+    printf("JSON payload against the sealed STATUS frame, %s, %lu iterations\n", JSON_LIBRARY, iterations);
+    jsonChecks();
+
+    // JSON, as the hub built outDoc for the UI and read inDoc from a node
+    char text[BUFFER_SIZE];
+    size_t jsonBytes = 0;
+    unsigned long opened = 0;
+    BenchClock::time_point start = BenchClock::now();
+    for (unsigned long i = 0; i < iterations; i++)
+    {
+        jsonBytes += jsonEncode(statusFrame((uint16_t)i, i), text, sizeof(text));
+    }
+    double jsonEncodeNs = secondsSince(start) * 1e9 / (double)iterations;
+    check(jsonBytes > 0, "timed JSON payloads written");
+    AlarmFrame decoded;
+    start = BenchClock::now();
+    for (unsigned long i = 0; i < iterations; i++)
+    {
+        opened += jsonDecode(text, decoded) ? 1 : 0;
+    }
+    double jsonDecodeNs = secondsSince(start) * 1e9 / (double)iterations;
+    check(opened == iterations, "timed JSON payloads read");
+
+    // The sealed STATUS frame that replaced it
+    uint8_t key[FRAME_KEY_SIZE];
+    uint8_t networkKey[FRAME_KEY_SIZE];
+    for (uint8_t i = 0; i < FRAME_KEY_SIZE; i++)
+    {
+        networkKey[i] = i;
+    }
+    frameKeyDerive(networkKey, 1, key);
+    AesCcm cipher;
+    cipher.setKey(key);
+    uint8_t buf[ALARM_FRAME_MAX_SIZE];
+    size_t frameBytes = 0;
+    start = BenchClock::now();
+    for (unsigned long i = 0; i < iterations; i++)
+    {
+        frameBytes = alarmFrameEncode(statusFrame(1, i), cipher, FRAME_UPLINK, (uint32_t)i + 1, buf, sizeof(buf));
+    }
+    double frameEncodeNs = secondsSince(start) * 1e9 / (double)iterations;
+    opened = 0;
+    start = BenchClock::now();
+    for (unsigned long i = 0; i < iterations; i++)
+    {
+        // The same frame every time, a receiver that has not seen it yet
+        opened += alarmFrameDecode(buf, frameBytes, cipher, FRAME_UPLINK, (uint32_t)iterations - 1, decoded) == FRAME_OK ? 1 : 0;
+    }
+    double frameDecodeNs = secondsSince(start) * 1e9 / (double)iterations;
+    check(opened == iterations && sameStatus(statusFrame(1, iterations - 1), decoded), "timed frames open");
+
+    // The text grows with the address, node 1 is the shortest
+    jsonBytes = jsonEncode(statusFrame(1, 0), text, sizeof(text));
+    size_t jsonLongest = jsonEncode(statusFrame(65535, 0), text, sizeof(text));
+    printf("  JSON    %2zu bytes (%zu at address 65535), encode %6.0f ns, decode %6.0f ns\n",
+        jsonBytes, jsonLongest, jsonEncodeNs, jsonDecodeNs);
+    printf("  STATUS  %2zu bytes, encode %6.0f ns, decode %6.0f ns (sealed, counter and MIC included)\n",
+        frameBytes, frameEncodeNs, frameDecodeNs);
+
+    // Airtime, BW 125 kHz, CR 4/5, 8 symbol preamble as the sketches use
+    printf("  airtime ms, JSON -> STATUS:\n");
+    for (uint8_t sf = 7; sf <= 12; sf++)
+    {
+        uint32_t json = loraTimeOnAirMicros(sf, 0, 1, 8, (uint8_t)jsonBytes);
+        uint32_t frame = loraTimeOnAirMicros(sf, 0, 1, 8, (uint8_t)frameBytes);
+        printf("    SF%-2u %7.1f -> %7.1f (%5.1f%%)\n", sf, json / 1000.0, frame / 1000.0,
+            100.0 * ((double)frame - (double)json) / (double)json);
+    }
+
+    printf("  checks failed: %lu\n", failures);
+    if (failures > 0)
+    {
+        printf("FAILED\n");
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,243 @@
+/*
+*  Title          :  LogBench
+*  Desc           :  Runs the Hub's EventLog against SimFlash, a RAM copy of NOR flash.  Appends
+*                 :  random alarm events, checks every node's "last N events" against a model of
+*                 :  what was logged, then remounts the log as a reboot would, cuts the power in
+*                 :  the middle of a batch write and remounts again.  Reports append, query and
+*                 :  mount throughput, flash writes and how evenly the sectors wear.
+*                 :
+*                 :  log_bench --events 200000 --nodes 64 --sectors 16 --queries 100000 --depth 10
+*                 :
+*                 :  Exits 1 if any query disagrees with the model or the flash rules were broken.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.0
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <AlarmTypes.h>
+#include <EventLog.h>
+
+#include "SimFlash.h"
+
+#define MAX_NODES                                   256
+#define MAX_SECTORS                                 64
+#define MAX_DEPTH                                   64
+
+typedef EventLog<MAX_NODES, MAX_SECTORS> BenchLog;
+typedef std::chrono::steady_clock BenchClock;
+
+typedef struct
+{
+    unsigned long events;
+    unsigned int nodes;
+    unsigned int sectors;
+    unsigned long queries;
+    unsigned int depth;
+    uint32_t seed;
+} BenchOptions;
+
+static double secondsSince(BenchClock::time_point start)
+{
+    return std::chrono::duration<double>(BenchClock::now() - start).count();
+}
+
+// model[sequence - 1] is what was appended with that sequence
+static void appendEvents(BenchLog& log, std::vector<EventRecord>& model, unsigned long count, unsigned int nodes,
+                         std::mt19937& rng, uint32_t& now)
+{
+    std::uniform_int_distribution<unsigned int> node(1, nodes);
+    std::uniform_int_distribution<int> state(IDLE, TEST);
+    std::uniform_int_distribution<int> rssi(-120, -30);
+    std::uniform_int_distribution<int> snr(-20, 10);
+    for (unsigned long i = 0; i < count; i++)
+    {
+        EventRecord record = {};
+        record.sequence = (uint32_t)model.size() + 1;
+        record.timeMs = now;
+        record.nodeAddress = (uint16_t)node(rng);
+        record.state = (uint8_t)state(rng);
+        record.rssi = (int16_t)rssi(rng);
+        record.snr = (int8_t)snr(rng);
+        model.push_back(record);
+        log.append(now, record.nodeAddress, record.state, record.rssi, record.snr);
+        now += 1000;
+        log.service(now);
+    }
+}
+
+// Every node's newest events from the log against the newest the model says it still holds
+static unsigned long checkQueries(BenchLog& log, const std::vector<EventRecord>& model, const BenchOptions& options)
+{
+    unsigned long mismatches = 0;
+    size_t oldest = model.size() - log.count();
+    EventRecord got[MAX_DEPTH];
+    for (unsigned int node = 1; node <= options.nodes; node++)
+    {
+        size_t count = log.latest((uint16_t)node, got, options.depth);
+        size_t expected = 0;
+        for (size_t i = model.size(); i > oldest && expected < options.depth; i--)
+        {
+            const EventRecord& want = model[i - 1];
+            if (want.nodeAddress != node)
+            {
+                continue;
+            }
+            if (expected >= count || got[expected].sequence != want.sequence || got[expected].timeMs != want.timeMs
+                || got[expected].state != want.state || got[expected].rssi != want.rssi || got[expected].snr != want.snr)
+            {
+                mismatches++;
+                break;
+            }
+            expected++;
+        }
+        if (expected != count && mismatches == 0)
+        {
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+static void usage(void)
+{
+    printf("usage: log_bench [--events n] [--nodes n] [--sectors 2..%d] [--queries n] [--depth 1..%d] [--seed s]\n",
+           MAX_SECTORS, MAX_DEPTH);
+}
+
+static bool parseOptions(int argc, char** argv, BenchOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (value == nullptr)
+        {
+            return false;
+        }
+        i++;
+        if (strcmp(arg, "--events") == 0) options.events = strtoul(value, nullptr, 10);
+        else if (strcmp(arg, "--nodes") == 0) options.nodes = (unsigned int)atoi(value);
+        else if (strcmp(arg, "--sectors") == 0) options.sectors = (unsigned int)atoi(value);
+        else if (strcmp(arg, "--queries") == 0) options.queries = strtoul(value, nullptr, 10);
+        else if (strcmp(arg, "--depth") == 0) options.depth = (unsigned int)atoi(value);
+        else if (strcmp(arg, "--seed") == 0) options.seed = (uint32_t)atol(value);
+        else return false;
+    }
+    return options.events > 0 && options.nodes > 0 && options.nodes <= MAX_NODES
+        && options.sectors >= 2 && options.sectors <= MAX_SECTORS
+        && options.depth > 0 && options.depth <= MAX_DEPTH;
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions options;
+    options.events = 200000;
+    options.nodes = 64;
+    options.sectors = 16;              // Hub.ino EVENT_LOG_SECTORS
+    options.queries = 100000;
+    options.depth = 10;
+    options.seed = 1;
+
+    if (!parseOptions(argc, argv, options))
+    {
+        usage();
+        return 1;
+    }
+
+    std::mt19937 rng(options.seed);
+    SimFlash flash(options.sectors);
+    std::unique_ptr<BenchLog> log(new BenchLog(flash));
+    std::vector<EventRecord> model;
+    uint32_t now = 0;
+    bool ok = log->begin(10000);
+
+    // Append
+    BenchClock::time_point start = BenchClock::now();
+    appendEvents(*log, model, options.events, options.nodes, rng, now);
+    log->flush();
+    double appendSeconds = secondsSince(start);
+    unsigned long appendWrites = flash.writes;
+    unsigned long appendBytes = flash.bytesWritten;
+    unsigned long mismatches = checkQueries(*log, model, options);
+
+    // Query
+    std::uniform_int_distribution<unsigned int> node(1, options.nodes);
+    EventRecord got[MAX_DEPTH];
+    unsigned long returned = 0;
+    unsigned long readsBefore = flash.reads;
+    start = BenchClock::now();
+    for (unsigned long i = 0; i < options.queries; i++)
+    {
+        returned += log->latest((uint16_t)node(rng), got, options.depth);
+    }
+    double querySeconds = secondsSince(start);
+    unsigned long queryReads = flash.reads - readsBefore;
+
+    // Reboot
+    uint32_t heldBefore = log->count();
+    uint8_t bootBefore = log->boot();
+    log.reset(new BenchLog(flash));
+    start = BenchClock::now();
+    ok = log->begin(10000) && ok;
+    double mountSeconds = secondsSince(start);
+    bool remountOk = log->count() == heldBefore && log->boot() == (uint8_t)(bootBefore + 1);
+    mismatches += checkQueries(*log, model, options);
+
+    // Power cut part way through a batch.  The records before the tear survive, the torn one
+    // is skipped and the rest never reached the flash
+    size_t batchStart = model.size();
+    flash.cutAfter(1);
+    appendEvents(*log, model, EVENT_LOG_BATCH, options.nodes, rng, now);
+    log.reset(new BenchLog(flash));
+    ok = log->begin(10000) && ok;
+    size_t survivors = model.size() - batchStart;
+    while (survivors > 0 && log->count() < heldBefore + survivors)
+    {
+        survivors--;
+    }
+    model.resize(batchStart + survivors);
+    bool tornOk = log->torn() == 1;
+    mismatches += checkQueries(*log, model, options);
+    appendEvents(*log, model, options.events / 10, options.nodes, rng, now);
+    log->flush();
+    mismatches += checkQueries(*log, model, options);
+
+    uint32_t minErase = flash.eraseCount(0);
+    uint32_t maxErase = minErase;
+    for (unsigned int sector = 1; sector < options.sectors; sector++)
+    {
+        minErase = (flash.eraseCount(sector) < minErase) ? flash.eraseCount(sector) : minErase;
+        maxErase = (flash.eraseCount(sector) > maxErase) ? flash.eraseCount(sector) : maxErase;
+    }
+
+    printf("Event log benchmark: %lu events, %u nodes, %u sectors of %u records, batch %u, seed %u\n",
+           options.events, options.nodes, options.sectors, EVENT_LOG_SLOTS, EVENT_LOG_BATCH, options.seed);
+    printf("  append: %.0f events/s, %lu flash writes (%.1f events each), %lu bytes written\n",
+           (double)options.events / appendSeconds, appendWrites, (double)options.events / (double)appendWrites, appendBytes);
+    printf("  query last %u: %.0f queries/s, %.1f events and %.1f flash reads per query\n", options.depth,
+           (double)options.queries / querySeconds, (double)returned / (double)options.queries,
+           (double)queryReads / (double)options.queries);
+    printf("  mount: %.2f ms for %lu events, boot %u, %s\n", mountSeconds * 1000.0, (unsigned long)heldBefore,
+           bootBefore + 1, remountOk ? "all events found" : "EVENTS LOST");
+    printf("  power cut: %zu of %u batch records kept, %lu torn, %s\n", survivors, EVENT_LOG_BATCH,
+           (unsigned long)log->torn(), tornOk ? "log intact" : "TORN RECORD NOT DETECTED");
+    printf("  wear: sector erases min %u, max %u, write violations %lu\n", minErase, maxErase, flash.violations);
+    printf("  query mismatches: %lu\n", mismatches);
+
+    ok = ok && remountOk && tornOk && mismatches == 0 && flash.violations == 0;
+    if (!ok)
+    {
+        printf("FAILED\n");
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,222 @@
+/*
+*  Title          :  QueueBench
+*  Desc           :  Stress test for the SpscQueue the UI puts between the ESP-NOW receive
+*                 :  callback and loop().  One thread pushes numbered HubMessages as fast as it
+*                 :  can, or in bursts, and another drains them the way loop() does.  Every
+*                 :  message is checked for order and for being copied whole, and the run
+*                 :  reports throughput and drops.
+*                 :
+*                 :  queue_bench --wait                                   throughput, the producer waits for room
+*                 :  queue_bench --burst 8 --gap-us 2000 --frame-us 5000  ESP-NOW bursts, 5 ms UI frames
+*                 :
+*                 :  Exits 1 if any message arrived out of order or torn.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.0
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <AlarmTypes.h>
+#include <ConsoleLink.h>
+#include <SpscQueue.h>
+
+#define HUB_QUEUE_SIZE                              16  // As UI.ino
+
+typedef struct
+{
+    LoRaPacket packet;
+    uint8_t mac[CONSOLE_LINK_MAC_SIZE];
+} HubMessage;
+
+typedef struct
+{
+    unsigned long messages;
+    unsigned int burst;         // Messages pushed back to back
+    unsigned int gapUs;         // Pause after each burst, 0 to spin
+    unsigned int frameUs;       // Pause between drains, 0 to spin
+    bool wait;                  // Retry a push into a full queue instead of dropping it
+} BenchOptions;
+
+typedef struct
+{
+    unsigned long received;
+    unsigned long drains;       // Drains that found something, UpdateDisplay calls in the UI
+    unsigned long outOfOrder;
+    unsigned long torn;
+} BenchResult;
+
+typedef std::chrono::steady_clock BenchClock;
+
+// Every byte of the message is derived from the sequence number so a torn copy shows up
+static void fillMessage(HubMessage& message, unsigned long sequence)
+{
+    memset(&message, 0, sizeof(message));
+    message.packet.nodeAddress = (unsigned short)sequence;
+    message.packet.rxTimeoutCount = sequence;
+    message.packet.signalStrength = (int16_t)(sequence >> 16);
+    message.packet.commandSequence = (uint8_t)sequence;
+    message.packet.commandLatency = (uint16_t)(sequence >> 8);
+    for (int i = 0; i < CONSOLE_LINK_MAC_SIZE; i++)
+    {
+        message.mac[i] = (uint8_t)(sequence + i);
+    }
+}
+
+static bool messageWhole(const HubMessage& message)
+{
+    HubMessage expected;
+    fillMessage(expected, message.packet.rxTimeoutCount);
+    return memcmp(&expected.packet, &message.packet, sizeof(expected.packet)) == 0
+        && memcmp(expected.mac, message.mac, sizeof(expected.mac)) == 0;
+}
+
+static void producer(SpscQueue<HubMessage, HUB_QUEUE_SIZE>& queue, const BenchOptions& options, std::atomic<bool>& done)
+{
+    HubMessage message;
+    unsigned long sequence = 1;
+
+    while (sequence <= options.messages)
+    {
+        for (unsigned int i = 0; i < options.burst && sequence <= options.messages; i++, sequence++)
+        {
+            fillMessage(message, sequence);
+            while (!queue.push(message) && options.wait)
+            {
+                std::this_thread::yield();
+            }
+        }
+        if (options.gapUs > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(options.gapUs));
+        }
+    }
+    done.store(true, std::memory_order_release);
+}
+
+static void consumer(SpscQueue<HubMessage, HUB_QUEUE_SIZE>& queue, const BenchOptions& options, std::atomic<bool>& done, BenchResult& result)
+{
+    HubMessage message;
+    unsigned long last = 0;
+
+    for (;;)
+    {
+        bool finished = done.load(std::memory_order_acquire);
+        bool any = false;
+        while (queue.pop(message))
+        {
+            any = true;
+            result.received++;
+            if (!messageWhole(message))
+            {
+                result.torn++;
+            }
+            else if (message.packet.rxTimeoutCount <= last)
+            {
+                result.outOfOrder++;
+            }
+            else
+            {
+                last = message.packet.rxTimeoutCount;
+            }
+        }
+        result.drains += any ? 1 : 0;
+        if (finished)
+        {
+            return;
+        }
+        if (options.frameUs > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(options.frameUs));
+        }
+        else if (!any)
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+static void usage(void)
+{
+    printf("usage: queue_bench [--messages n] [--burst n] [--gap-us us] [--frame-us us] [--wait]\n");
+}
+
+static bool parseOptions(int argc, char** argv, BenchOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (strcmp(arg, "--wait") == 0)
+        {
+            options.wait = true;
+            continue;
+        }
+        if (value == nullptr)
+        {
+            return false;
+        }
+        i++;
+        if (strcmp(arg, "--messages") == 0) options.messages = strtoul(value, nullptr, 10);
+        else if (strcmp(arg, "--burst") == 0) options.burst = (unsigned int)atoi(value);
+        else if (strcmp(arg, "--gap-us") == 0) options.gapUs = (unsigned int)atoi(value);
+        else if (strcmp(arg, "--frame-us") == 0) options.frameUs = (unsigned int)atoi(value);
+        else return false;
+    }
+    return options.messages > 0 && options.burst > 0;
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions options;
+    options.messages = 10000000;
+    options.burst = 1;
+    options.gapUs = 0;
+    options.frameUs = 0;
+    options.wait = false;
+
+    if (!parseOptions(argc, argv, options))
+    {
+        usage();
+        return 1;
+    }
+
+    SpscQueue<HubMessage, HUB_QUEUE_SIZE> queue;
+    std::atomic<bool> done{false};
+    BenchResult result = {};
+
+    BenchClock::time_point start = BenchClock::now();
+    std::thread drain(consumer, std::ref(queue), std::cref(options), std::ref(done), std::ref(result));
+    std::thread push(producer, std::ref(queue), std::cref(options), std::ref(done));
+    push.join();
+    drain.join();
+    double seconds = std::chrono::duration<double>(BenchClock::now() - start).count();
+
+    // Waiting, every full push is retried and nothing is lost
+    unsigned long full = queue.dropped();
+    unsigned long dropped = options.wait ? 0 : full;
+    printf("messages        %lu, %u slots of %u bytes\n", options.messages, queue.capacity(), (unsigned int)sizeof(HubMessage));
+    printf("time            %.3f s\n", seconds);
+    printf("pushed          %.0f msg/s\n", (double)options.messages / seconds);
+    printf("received        %lu, %.0f msg/s\n", result.received, (double)result.received / seconds);
+    printf("queue full      %lu pushes\n", full);
+    printf("dropped         %lu (%.2f%%)\n", dropped, 100.0 * (double)dropped / (double)options.messages);
+    printf("drains          %lu, %.1f messages coalesced per drain\n", result.drains,
+           result.drains ? (double)result.received / (double)result.drains : 0.0);
+    printf("out of order    %lu\n", result.outOfOrder);
+    printf("torn            %lu\n", result.torn);
+
+    bool ok = result.outOfOrder == 0 && result.torn == 0 && result.received + dropped == options.messages;
+    if (!ok)
+    {
+        printf("FAILED\n");
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,550 @@
+/*
+*  Title          :  SchedBench
+*  Desc           :  Checks and times the TimerWheel the firmwares run their periodic work on.
+*                 :
+*                 :  Against a virtual millis() it checks that no task runs early, that every
+*                 :  task due runs at the first run() at or after its deadline, that periodic
+*                 :  tasks neither drift nor lose periods (runs plus overruns match the
+*                 :  deadlines passed), across loop stalls and the 49 day millis() wrap.  Then
+*                 :  one shots, cancel and reschedule, tasks changing the wheel from inside a
+*                 :  task, idle() against a brute force search and a full pool.
+*                 :
+*                 :  Then it times thousands of timers, against the "static previousMillis"
+*                 :  scan it replaces, and measures the lateness of every task against the
+*                 :  host's real clock.
+*                 :
+*                 :  sched_bench --timers 4096 --seconds 600 --wall-seconds 2
+*                 :
+*                 :  Exits 1 if any check fails.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.0
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <TimerWheel.h>
+
+#define BENCH_SLOTS                                 256
+#define BENCH_MAX_TASKS                             16384
+
+typedef TimerWheel<BENCH_SLOTS, BENCH_MAX_TASKS> BenchWheel;
+typedef std::chrono::steady_clock BenchClock;
+
+typedef struct
+{
+    unsigned int timers;
+    unsigned int seconds;       // Virtual time for the throughput run
+    unsigned int wallSeconds;   // Real time for the lateness run
+    uint32_t seed;
+} BenchOptions;
+
+// One task's view of what the wheel owes it
+typedef struct
+{
+    int id;
+    uint32_t interval;          // 0 for a one shot
+    uint32_t first;             // First deadline
+    uint32_t expected;          // Next deadline
+    unsigned long fired;
+    unsigned long early;
+    uint32_t maxLate;
+    bool cancelled;
+} Probe;
+
+static unsigned long failures = 0;
+
+static void check(bool ok, const char* what)
+{
+    printf("  %-62s %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok)
+    {
+        failures++;
+    }
+}
+
+static double secondsSince(BenchClock::time_point start)
+{
+    return std::chrono::duration<double>(BenchClock::now() - start).count();
+}
+
+static void probeFire(void* context, uint32_t now)
+{
+    Probe& probe = *(Probe*)context;
+    int32_t late = (int32_t)(now - probe.expected);
+    probe.fired++;
+    if (late < 0)
+    {
+        probe.early++;
+        return;
+    }
+    if ((uint32_t)late > probe.maxLate)
+    {
+        probe.maxLate = (uint32_t)late;
+    }
+    if (probe.interval > 0)
+    {
+        probe.expected += ((uint32_t)late / probe.interval + 1) * probe.interval;
+    }
+}
+
+// Deadlines of a periodic probe at or before end
+static unsigned long deadlinesBy(const Probe& probe, uint32_t end)
+{
+    if ((int32_t)(end - probe.first) < 0)
+    {
+        return 0;
+    }
+    return (end - probe.first) / probe.interval + 1;
+}
+
+// Calls run() from start to end, steps of 1 to maxStep ms, the last exactly at end
+static void drive(BenchWheel& wheel, uint32_t start, uint32_t end, uint32_t maxStep, std::mt19937& rng)
+{
+    std::uniform_int_distribution<uint32_t> step(1, maxStep);
+    uint32_t now = start;
+    wheel.run(now);
+    while ((int32_t)(end - now) > 0)
+    {
+        uint32_t next = now + step(rng);
+        now = ((int32_t)(end - next) < 0) ? end : next;
+        wheel.run(now);
+    }
+}
+
+static void addPeriodic(BenchWheel& wheel, std::vector<Probe>& probes, uint32_t start, uint32_t maxInterval, std::mt19937& rng)
+{
+    std::uniform_int_distribution<uint32_t> interval(1, maxInterval);
+    std::uniform_int_distribution<uint32_t> delay(0, maxInterval);
+    for (Probe& probe : probes)
+    {
+        probe = Probe();
+        probe.interval = interval(rng);
+        uint32_t first = delay(rng);
+        probe.first = start + first;
+        probe.expected = probe.first;
+        probe.id = wheel.every(probe.interval, probeFire, &probe, first);
+    }
+}
+
+static bool periodicMatch(const std::vector<Probe>& probes, const BenchWheel& wheel, uint32_t end,
+                          uint32_t lateLimit, bool noOverruns)
+{
+    for (const Probe& probe : probes)
+    {
+        const TimerTask& task = wheel.task(probe.id);
+        if (probe.early > 0 || probe.fired != task.runs || probe.maxLate > lateLimit
+            || task.runs + task.overruns != deadlinesBy(probe, end) || (noOverruns && task.overruns > 0))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Periodic tasks run every 1 ms and with stalls, both across the millis() wrap
+static void checkPeriodic(std::mt19937& rng)
+{
+    const uint32_t start = 0xFFFFFFFFu - 60000;
+    const uint32_t end = start + 120000;
+    printf("periodic, 2000 tasks of 1 to 5000 ms, 120 s across the millis() wrap\n");
+
+    static BenchWheel steady;
+    std::vector<Probe> probes(2000);
+    steady.begin(start);
+    addPeriodic(steady, probes, start, 5000, rng);
+
+    // Sample idle() against the earliest deadline of any task
+    bool idleOk = true;
+    std::uniform_int_distribution<uint32_t> pick(0, 999);
+    uint32_t now = start;
+    steady.run(now);
+    while (now != end)
+    {
+        now++;
+        steady.run(now);
+        if (pick(rng) == 0)
+        {
+            uint32_t earliest = BENCH_SLOTS;
+            for (const Probe& probe : probes)
+            {
+                uint32_t until = probe.expected - now;
+                earliest = std::min(earliest, until);
+            }
+            idleOk = idleOk && steady.idle(now) == earliest;
+        }
+    }
+    check(periodicMatch(probes, steady, end, 0, true), "run every 1 ms, on time, no drift, no overruns");
+    check(idleOk, "idle() is the time to the earliest deadline");
+
+    static BenchWheel stalled;
+    stalled.begin(start);
+    addPeriodic(stalled, probes, start, 5000, rng);
+    drive(stalled, start, end, 300, rng);
+    check(periodicMatch(probes, stalled, end, 299, false), "stalls of up to 300 ms, run at the next run(), periods kept");
+    check(stalled.overruns() > 0, "periods lost to stalls counted as overruns");
+
+    static BenchWheel frozen;
+    frozen.begin(start);
+    addPeriodic(frozen, probes, start, 50, rng);
+    drive(frozen, start, end, 5000, rng);
+    check(periodicMatch(probes, frozen, end, 4999, false), "stalls longer than the wheel, every slot still visited");
+}
+
+static void checkOneShots(std::mt19937& rng)
+{
+    printf("one shots, cancel and reschedule\n");
+    static BenchWheel wheel;
+    std::vector<Probe> probes(3000);
+    std::uniform_int_distribution<uint32_t> delay(0, 20000);
+    std::uniform_int_distribution<int> action(0, 3);
+    const uint32_t start = 1000;
+    wheel.begin(start);
+    for (Probe& probe : probes)
+    {
+        probe = Probe();
+        uint32_t after = delay(rng);
+        probe.first = start + after;
+        probe.expected = probe.first;
+        probe.id = wheel.after(after, probeFire, &probe);
+    }
+
+    // Halfway, cancel a quarter and move a quarter of those still waiting
+    drive(wheel, start, start + 10000, 20, rng);
+    uint32_t now = start + 10000;
+    bool stateOk = true;
+    for (Probe& probe : probes)
+    {
+        const TimerTask& task = wheel.task(probe.id);
+        stateOk = stateOk && task.queued == (probe.fired == 0);
+        if (!task.queued)
+        {
+            continue;
+        }
+        int what = action(rng);
+        if (what == 0)
+        {
+            wheel.cancel(probe.id);
+            probe.cancelled = true;
+        }
+        else if (what == 1)
+        {
+            uint32_t after = delay(rng);
+            wheel.reschedule(probe.id, now, after);
+            probe.expected = now + after;
+        }
+    }
+    drive(wheel, now, start + 40000, 20, rng);
+
+    bool once = true;
+    bool cancelled = true;
+    bool onTime = true;
+    for (const Probe& probe : probes)
+    {
+        once = once && (probe.cancelled || probe.fired == 1);
+        cancelled = cancelled && (!probe.cancelled || probe.fired == 0);
+        onTime = onTime && probe.early == 0 && probe.maxLate < 20;
+    }
+    check(stateOk, "a one shot leaves the wheel when it runs");
+    check(once, "every one shot runs exactly once");
+    check(cancelled, "cancelled one shots never run");
+    check(onTime, "one shots and rescheduled ones on time");
+}
+
+// Tasks that change the wheel from inside their own run
+typedef struct
+{
+    BenchWheel* wheel;
+    int victim;
+    int self;
+    int added;
+    unsigned long runs;
+    Probe* probe;
+} Meddler;
+
+static void cancelVictim(void* context, uint32_t now)
+{
+    Meddler& meddler = *(Meddler*)context;
+    (void)now;
+    meddler.runs++;
+    meddler.wheel->cancel(meddler.victim);
+    meddler.wheel->remove(meddler.self);
+}
+
+static void addChild(void* context, uint32_t now)
+{
+    Meddler& meddler = *(Meddler*)context;
+    meddler.runs++;
+    meddler.probe->expected = now;
+    meddler.probe->first = now;
+    meddler.added = meddler.wheel->after(0, probeFire, meddler.probe);
+}
+
+static void countRun(void* context, uint32_t now)
+{
+    (void)now;
+    ((Meddler*)context)->runs++;
+}
+
+static void checkMeddling(void)
+{
+    printf("tasks changing the wheel\n");
+    static BenchWheel wheel;
+    wheel.begin(0);
+
+    // Same deadline and slot, the first to run cancels the other
+    Meddler a = {}, b = {};
+    a.wheel = &wheel;
+    int idB = wheel.after(10, countRun, &b);
+    int idA = wheel.after(10, cancelVictim, &a);    // Linked at the head, runs first
+    a.victim = idB;
+    a.self = idA;
+    wheel.run(10);
+    check(a.runs == 1 && b.runs == 0 && wheel.count() == 1, "a task cancels one due in the same tick and removes itself");
+
+    // A task added with no delay from inside a run() runs at the next run(), not a lap later
+    Probe child = {};
+    Meddler c = {};
+    c.wheel = &wheel;
+    c.probe = &child;
+    wheel.after(5, addChild, &c);
+    wheel.run(15);
+    wheel.run(16);
+    check(c.runs == 1 && child.fired == 1 && child.early == 0 && child.maxLate == 1, "a task added from a task runs at the next run()");
+
+    // A periodic task that reschedules itself carries its interval on from the new deadline
+    Meddler d = {};
+    int idD = wheel.every(100, countRun, &d, 0);
+    wheel.run(17);
+    wheel.reschedule(idD, 17, 1000);
+    wheel.run(500);
+    wheel.run(1017);
+    wheel.run(1117);
+    check(d.runs == 3 && wheel.task(idD).overruns == 0, "reschedule moves a periodic task and keeps its interval");
+}
+
+static void checkPool(void)
+{
+    printf("pool\n");
+    static TimerWheel<8, 4> wheel;
+    Meddler m = {};
+    int ids[4];
+    for (int i = 0; i < 4; i++)
+    {
+        ids[i] = wheel.every(10, countRun, &m);
+    }
+    int full = wheel.every(10, countRun, &m);
+    wheel.remove(ids[2]);
+    int reused = wheel.every(10, countRun, &m);
+    check(full == -1 && reused == ids[2] && wheel.count() == 4, "full pool refuses a task, a removed entry is reused");
+}
+
+// The pattern the firmwares used before, a previous time per job and a scan of every job each pass
+typedef struct
+{
+    uint32_t interval;
+    uint32_t previous;
+    Probe* probe;
+} ScanTimer;
+
+static void throughput(const BenchOptions& options, std::mt19937& rng)
+{
+    printf("throughput, %u timers of 10 to 10000 ms, %u s of millis() a ms at a time\n", options.timers, options.seconds);
+    static BenchWheel wheel;
+    std::vector<Probe> probes(options.timers);
+    std::uniform_int_distribution<uint32_t> interval(10, 10000);
+    std::uniform_int_distribution<uint32_t> delay(0, 10000);
+    const uint32_t passes = options.seconds * 1000;
+
+    BenchClock::time_point start = BenchClock::now();
+    wheel.begin(0);
+    for (Probe& probe : probes)
+    {
+        probe = Probe();
+        probe.interval = interval(rng);
+        uint32_t first = delay(rng);
+        probe.first = first;
+        probe.expected = first;
+        probe.id = wheel.every(probe.interval, probeFire, &probe, first);
+    }
+    double addSeconds = secondsSince(start);
+
+    start = BenchClock::now();
+    for (uint32_t now = 0; now < passes; now++)
+    {
+        wheel.run(now);
+    }
+    double wheelSeconds = secondsSince(start);
+    unsigned long fired = wheel.runs();
+    check(periodicMatch(probes, wheel, passes - 1, 0, true), "every timer on time");
+
+    std::vector<ScanTimer> scan(options.timers);
+    for (size_t i = 0; i < probes.size(); i++)
+    {
+        probes[i].fired = 0;
+        probes[i].expected = probes[i].first;
+        // The previous run such that the first deadline comes out the same
+        scan[i].interval = probes[i].interval;
+        scan[i].previous = probes[i].first - probes[i].interval;
+        scan[i].probe = &probes[i];
+    }
+    start = BenchClock::now();
+    unsigned long scanFired = 0;
+    for (uint32_t now = 0; now < passes; now++)
+    {
+        for (ScanTimer& timer : scan)
+        {
+            if ((int32_t)(now - timer.previous) >= (int32_t)timer.interval)
+            {
+                timer.previous += timer.interval;
+                probeFire(timer.probe, now);
+                scanFired++;
+            }
+        }
+    }
+    double scanSeconds = secondsSince(start);
+
+    start = BenchClock::now();
+    for (Probe& probe : probes)
+    {
+        wheel.remove(probe.id);
+    }
+    double removeSeconds = secondsSince(start);
+
+    printf("  add           %8.1f ns a timer\n", addSeconds * 1e9 / options.timers);
+    printf("  remove        %8.1f ns a timer\n", removeSeconds * 1e9 / options.timers);
+    printf("  wheel         %8.1f ns a pass, %lu runs, %.1f ns a run, %.2f M runs/s\n",
+           wheelSeconds * 1e9 / passes, fired, wheelSeconds * 1e9 / (double)fired, (double)fired / wheelSeconds / 1e6);
+    printf("  scan          %8.1f ns a pass, %lu runs, %.1fx the wheel's time\n",
+           scanSeconds * 1e9 / passes, scanFired, scanSeconds / wheelSeconds);
+    check(scanFired == fired, "same runs as the scan");
+}
+
+static uint32_t percentile(std::vector<uint32_t>& values, double p)
+{
+    if (values.empty())
+    {
+        return 0;
+    }
+    size_t index = (size_t)(p * (double)(values.size() - 1));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+// The same timers against the host clock, lateness in us past each deadline
+typedef struct
+{
+    uint32_t interval;
+    uint32_t expected;
+    BenchClock::time_point origin;
+    std::vector<uint32_t>* lates;
+} WallProbe;
+
+static void wallFire(void* context, uint32_t now)
+{
+    WallProbe& probe = *(WallProbe*)context;
+    int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(BenchClock::now() - probe.origin).count();
+    int64_t late = us - (int64_t)probe.expected * 1000;
+    probe.lates->push_back(late < 0 ? 0 : (uint32_t)late);
+    probe.expected += ((now - probe.expected) / probe.interval + 1) * probe.interval;
+}
+
+static void wallClock(const BenchOptions& options, std::mt19937& rng)
+{
+    printf("lateness against the host clock, %u timers of 10 to 1000 ms for %u s\n", options.timers, options.wallSeconds);
+    static BenchWheel wheel;
+    std::vector<WallProbe> probes(options.timers);
+    std::vector<uint32_t> lates;
+    std::uniform_int_distribution<uint32_t> interval(10, 1000);
+    BenchClock::time_point origin = BenchClock::now();
+    wheel.begin(0);
+    for (WallProbe& probe : probes)
+    {
+        probe.interval = interval(rng);
+        probe.expected = probe.interval;
+        probe.origin = origin;
+        probe.lates = &lates;
+        wheel.every(probe.interval, wallFire, &probe, probe.interval);
+    }
+    lates.reserve((size_t)options.timers * options.wallSeconds * 20);
+
+    unsigned long passes = 0;
+    uint32_t end = options.wallSeconds * 1000;
+    for (;;)
+    {
+        uint32_t now = (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(BenchClock::now() - origin).count();
+        if (now > end)
+        {
+            break;
+        }
+        wheel.run(now);
+        passes++;
+    }
+    unsigned long runs = lates.size();
+    printf("  %lu runs in %lu passes, overruns %lu\n", runs, passes, wheel.overruns());
+    printf("  late us       p50 %u, p99 %u, p99.9 %u, max %u\n", percentile(lates, 0.5), percentile(lates, 0.99),
+           percentile(lates, 0.999), percentile(lates, 1.0));
+}
+
+static void usage(void)
+{
+    printf("usage: sched_bench [--timers 1..%d] [--seconds s] [--wall-seconds s] [--seed s]\n", BENCH_MAX_TASKS);
+}
+
+static bool parseOptions(int argc, char** argv, BenchOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (value == nullptr)
+        {
+            return false;
+        }
+        i++;
+        if (strcmp(arg, "--timers") == 0) options.timers = (unsigned int)atoi(value);
+        else if (strcmp(arg, "--seconds") == 0) options.seconds = (unsigned int)atoi(value);
+        else if (strcmp(arg, "--wall-seconds") == 0) options.wallSeconds = (unsigned int)atoi(value);
+        else if (strcmp(arg, "--seed") == 0) options.seed = (uint32_t)atol(value);
+        else return false;
+    }
+    return options.timers > 0 && options.timers <= BENCH_MAX_TASKS && options.seconds > 0;
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions options;
+    options.timers = 4096;
+    options.seconds = 600;
+    options.wallSeconds = 2;
+    options.seed = 1;
+
+    if (!parseOptions(argc, argv, options))
+    {
+        usage();
+        return 1;
+    }
+
+    std::mt19937 rng(options.seed);
+    printf("Timer wheel benchmark: %d slots, %d task pool, %u bytes\n", BENCH_SLOTS, BENCH_MAX_TASKS, (unsigned int)sizeof(BenchWheel));
+    checkPeriodic(rng);
+    checkOneShots(rng);
+    checkMeddling();
+    checkPool();
+    throughput(options, rng);
+    if (options.wallSeconds > 0)
+    {
+        wallClock(options, rng);
+    }
+
+    printf("checks failed: %lu\n", failures);
+    return failures == 0 ? 0 : 1;
+}
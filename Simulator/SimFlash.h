@@ -0,0 +1,97 @@
+/*
+*  Title          :  SimFlash
+*  Desc           :  RAM backed FlashPort with NOR rules for the event log benchmark.  Erase
+*                 :  sets a sector to 0xFF, a write can only clear bits.  Writes that try to set
+*                 :  a bit are counted as violations, the log must never need one.
+*                 :
+*                 :  cutAfter(n) simulates a power cut: the n'th write from now stops a few bytes
+*                 :  past half way, part way through a record, and fails.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.0
+*
+*/
+
+#ifndef LORA_ALARM_SIM_FLASH_H
+#define LORA_ALARM_SIM_FLASH_H
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include <FlashPort.h>
+
+class SimFlash : public FlashPort
+{
+public:
+    explicit SimFlash(uint32_t sectors)
+        : _data(sectors * FLASH_SECTOR_SIZE, 0xFF), _eraseCounts(sectors, 0)
+    {
+    }
+
+    uint32_t sectorCount(void) override { return (uint32_t)_eraseCounts.size(); }
+
+    bool read(uint32_t offset, void* data, uint32_t len) override
+    {
+        if (offset + len > _data.size())
+        {
+            return false;
+        }
+        memcpy(data, &_data[offset], len);
+        reads++;
+        bytesRead += len;
+        return true;
+    }
+
+    bool write(uint32_t offset, const void* data, uint32_t len) override
+    {
+        if (offset + len > _data.size())
+        {
+            return false;
+        }
+        const uint8_t* bytes = (const uint8_t*)data;
+        bool cut = _cutCountdown > 0 && --_cutCountdown == 0;
+        uint32_t programmed = cut ? len / 2 + 3 : len;
+        for (uint32_t i = 0; i < programmed; i++)
+        {
+            if ((_data[offset + i] & bytes[i]) != bytes[i])
+            {
+                violations++;
+            }
+            _data[offset + i] &= bytes[i];
+        }
+        writes++;
+        bytesWritten += programmed;
+        return !cut;
+    }
+
+    bool erase(uint32_t sector) override
+    {
+        if (sector >= _eraseCounts.size())
+        {
+            return false;
+        }
+        memset(&_data[sector * FLASH_SECTOR_SIZE], 0xFF, FLASH_SECTOR_SIZE);
+        _eraseCounts[sector]++;
+        erases++;
+        return true;
+    }
+
+    void cutAfter(uint32_t writeCount) { _cutCountdown = writeCount; }
+    uint32_t eraseCount(uint32_t sector) const { return _eraseCounts[sector]; }
+
+    unsigned long reads = 0;
+    unsigned long writes = 0;
+    unsigned long erases = 0;
+    unsigned long bytesRead = 0;
+    unsigned long bytesWritten = 0;
+    unsigned long violations = 0;   // Writes that needed a 0 bit turned back into a 1
+
+private:
+    std::vector<uint8_t> _data;
+    std::vector<uint32_t> _eraseCounts;
+    uint32_t _cutCountdown = 0;
+};
+
+#endif // LORA_ALARM_SIM_FLASH_H
@@ -0,0 +1,531 @@
+/*
+*  Title          :  SimRadio
+*  Desc           :  Software LoRa medium for the host simulator.  Every SimRadio is a RadioPort
+*                 :  so the HubProtocol and NodeProtocol state machines run unchanged.
+*                 :
+*                 :  Airtime comes from LoRaAirtime.h for each radio's SF and the configured
+*                 :  BW/CR.  Each link has a fixed path loss, a frame is heard if its SNR is
+*                 :  above the demodulation floor for its spreading factor.  A receiver locks
+*                 :  onto the first frame at its own SF it hears, provided it was listening
+*                 :  before the last few preamble symbols.  Any overlapping frame at the same
+*                 :  SF less than captureThreshold dB weaker destroys it, other spreading
+*                 :  factors are treated as orthogonal, and so are channels.  A frame's preamble
+*                 :  is the sender's, a longer one gives a receiver longer to start listening.
+*                 :  Radios are half duplex and a random
+*                 :  loss rate is applied on top.  Each radio counts the time it spends sending,
+*                 :  receiving or in CAD, what a battery node's radio costs it, and the frames
+*                 :  it lost to collisions.  Reported SNR stops rising at +10 dB, as the
+*                 :  SX126x packet SNR does.
+*                 :
+*                 :  Radio events are queued and handed out from service(), the same way
+*                 :  Radio.IrqProcess() runs the RadioEvents_t callbacks on the hardware.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.4
+*  History        : 1.0 2026-10-17 Single data rate medium
+*                 : 1.1 2026-10-17 Per radio spreading factor and TX power for adaptive data rate
+*                 : 1.2 2026-10-17 Per radio channel and preamble, frames on other channels are not heard
+*                 : 1.3 2026-10-17 Time each radio is on and the collisions it saw
+*                 : 1.4 2026-10-17 eventPending(), the host side of DIO1
+*
+*/
+
+#ifndef LORA_ALARM_SIM_RADIO_H
+#define LORA_ALARM_SIM_RADIO_H
+
+#include <stdint.h>
+#include <math.h>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include <LinkAdr.h>
+#include <LoRaAirtime.h>
+#include <RadioPort.h>
+
+typedef struct
+{
+    uint8_t spreadingFactor;    // [SF7..SF12] radios start on
+    int8_t txPower;             // dBm radios start on
+    uint8_t bandwidth;          // [0: 125 kHz, 1: 250 kHz, 2: 500 kHz]
+    uint8_t codingRate;         // [1: 4/5 .. 4: 4/8]
+    uint16_t preambleLength;
+    double lossRate;            // Probability a frame that survived the channel is dropped anyway
+    double captureThreshold;    // dB, a frame this much stronger than the interferer survives
+    double noiseFigure;         // dB, receiver noise figure
+} SimRadioConfig;
+
+typedef struct
+{
+    unsigned long framesSent;
+    unsigned long framesReceived;
+    unsigned long collisions;       // Frames destroyed by an overlapping transmission
+    unsigned long belowSensitivity; // Frames too weak to demodulate at a listening receiver
+    unsigned long randomLoss;
+    unsigned long cadBusy;
+    unsigned long cadClear;
+    unsigned long rxTimeouts;
+    uint64_t airtime_ms;
+} SimStats;
+
+class SimMedium;
+
+class SimRadio : public RadioPort
+{
+public:
+    // Set by the owner, the RadioEvents_t of the simulator
+    std::function<void(void)> TxDone;
+    std::function<void(void)> TxTimeout;
+    std::function<void(const uint8_t*, uint16_t, int16_t, int8_t)> RxDone;
+    std::function<void(void)> RxTimeout;
+    std::function<void(bool)> CadDone;
+    std::function<void(const uint8_t*, uint8_t)> Sent;     // Every frame this radio transmits
+
+    void send(const uint8_t* data, uint8_t len) override;
+    void receive(uint32_t timeoutMs) override;
+    void startCad(void) override;
+    void standby(void) override;
+    void sleep(void) override;
+    void service(void) override;
+    void setDataRate(uint8_t spreadingFactor, int8_t txPower) override;
+    void setChannel(uint32_t frequency, uint16_t preambleLength) override;
+    uint32_t timeOnAir(uint8_t len) override;
+
+    unsigned int id(void) const { return _id; }
+    bool eventPending(void) const { return !_events.empty(); }    // DIO1 would be high
+    uint8_t spreadingFactor(void) const { return _spreadingFactor; }
+    int8_t txPower(void) const { return _txPower; }
+    uint32_t frequency(void) const { return _frequency; }
+
+    uint64_t airtime_ms = 0;        // This radio's transmissions
+    uint64_t active_ms = 0;         // Time sending, receiving or in CAD
+    unsigned long collisions = 0;   // Frames this radio lost to an overlapping transmission
+
+private:
+    friend class SimMedium;
+
+    typedef enum
+    {
+        SIM_SLEEP,
+        SIM_STANDBY,
+        SIM_TX,
+        SIM_RX,
+        SIM_CAD
+    } SimMode_t;
+
+    typedef enum
+    {
+        EVENT_TX_DONE,
+        EVENT_RX_DONE,
+        EVENT_RX_TIMEOUT,
+        EVENT_CAD_DONE
+    } SimEventType_t;
+
+    typedef struct
+    {
+        SimEventType_t type;
+        std::vector<uint8_t> data;
+        int16_t rssi;
+        int8_t snr;
+        bool channelActivity;
+    } SimEvent;
+
+    void idle(SimMode_t mode)
+    {
+        _mode = mode;
+        _locked = -1;
+        _events.clear();
+    }
+
+    SimMedium* _medium = nullptr;
+    unsigned int _id = 0;
+    uint8_t _spreadingFactor = 7;
+    int8_t _txPower = 0;
+    uint32_t _frequency = 0;
+    uint16_t _preambleLength = 0;
+    SimMode_t _mode = SIM_SLEEP;
+    uint64_t _rxDeadline = 0;       // 0 receives until told otherwise
+    uint64_t _cadEnd = 0;
+    bool _cadDetected = false;
+    long _locked = -1;              // Serial number of the frame being received
+    std::vector<SimEvent> _events;
+};
+
+class SimMedium
+{
+public:
+    SimMedium(const SimRadioConfig& config, uint32_t seed)
+        : _config(config), _random(seed)
+    {
+        _stats = SimStats();
+    }
+
+    // The medium does not own the radio.  Returns its id
+    unsigned int attach(SimRadio& radio)
+    {
+        radio._medium = this;
+        radio._id = (unsigned int)_radios.size();
+        radio._spreadingFactor = _config.spreadingFactor;
+        radio._txPower = _config.txPower;
+        radio._preambleLength = _config.preambleLength;
+        _radios.push_back(&radio);
+        for (std::vector<double>& row : _pathLoss)
+        {
+            row.push_back(300.0);
+        }
+        _pathLoss.push_back(std::vector<double>(_radios.size(), 300.0));
+        return radio._id;
+    }
+
+    // Links are symmetrical
+    void setLink(unsigned int a, unsigned int b, double pathLoss)
+    {
+        _pathLoss[a][b] = pathLoss;
+        _pathLoss[b][a] = pathLoss;
+    }
+
+    double pathLoss(unsigned int a, unsigned int b) const { return _pathLoss[a][b]; }
+
+    double noiseFloor(void) const
+    {
+        return -174.0 + 10.0 * log10((double)loraBandwidthHz(_config.bandwidth)) + _config.noiseFigure;
+    }
+
+    double snrLimit(uint8_t spreadingFactor) const
+    {
+        return (double)loraRequiredSnr(spreadingFactor);
+    }
+
+    uint32_t airtime(uint8_t spreadingFactor, uint8_t len) const
+    {
+        return airtime(spreadingFactor, _config.preambleLength, len);
+    }
+
+    uint32_t airtime(uint8_t spreadingFactor, uint16_t preambleLength, uint8_t len) const
+    {
+        return loraTimeOnAirMillis(spreadingFactor, _config.bandwidth, _config.codingRate, preambleLength, len);
+    }
+
+    uint32_t cadDuration(uint8_t spreadingFactor) const
+    {
+        // Two symbols of detection plus the processing time
+        return (2 * loraSymbolMicros(spreadingFactor, _config.bandwidth) + 999) / 1000 + 1;
+    }
+
+    uint64_t now(void) const { return _now; }
+    const SimStats& stats(void) const { return _stats; }
+    const SimRadioConfig& config(void) const { return _config; }
+
+    // Advance the clock by one millisecond
+    void tick(void)
+    {
+        for (SimRadio* radio : _radios)
+        {
+            // The millisecond going by, in the mode the radio was left in
+            if (radio->_mode != SimRadio::SIM_SLEEP && radio->_mode != SimRadio::SIM_STANDBY)
+            {
+                radio->active_ms++;
+            }
+        }
+        _now++;
+        for (size_t i = 0; i < _frames.size(); )
+        {
+            if (_frames[i].end <= _now)
+            {
+                finishFrame(_frames[i]);
+                _frames.erase(_frames.begin() + i);
+            }
+            else
+            {
+                i++;
+            }
+        }
+        for (SimRadio* radio : _radios)
+        {
+            if (radio->_mode == SimRadio::SIM_RX && radio->_locked < 0 && radio->_rxDeadline != 0 && _now >= radio->_rxDeadline)
+            {
+                radio->_mode = SimRadio::SIM_STANDBY;
+                queue(*radio, SimRadio::EVENT_RX_TIMEOUT);
+                _stats.rxTimeouts++;
+            }
+            else if (radio->_mode == SimRadio::SIM_CAD && _now >= radio->_cadEnd)
+            {
+                radio->_mode = SimRadio::SIM_STANDBY;
+                SimRadio::SimEvent event = { SimRadio::EVENT_CAD_DONE, {}, 0, 0, radio->_cadDetected };
+                radio->_events.push_back(event);
+                radio->_cadDetected ? _stats.cadBusy++ : _stats.cadClear++;
+            }
+        }
+    }
+
+private:
+    friend class SimRadio;
+
+    typedef struct
+    {
+        long serial;
+        unsigned int sender;
+        uint8_t spreadingFactor;
+        int8_t txPower;
+        uint32_t frequency;
+        uint64_t lockBy;                // Last moment a receiver can still catch the preamble
+        uint64_t end;
+        std::vector<uint8_t> data;
+        std::vector<bool> corrupted;    // Per receiver
+    } SimFrame;
+
+    double rssi(const SimFrame& frame, unsigned int to) const
+    {
+        return (double)frame.txPower - _pathLoss[frame.sender][to];
+    }
+
+    double snr(const SimFrame& frame, unsigned int to) const
+    {
+        return rssi(frame, to) - noiseFloor();
+    }
+
+    // The radio is set to the frame's channel and SF and could demodulate it
+    bool audible(const SimFrame& frame, const SimRadio& radio) const
+    {
+        return frame.frequency == radio._frequency && frame.spreadingFactor == radio._spreadingFactor
+            && snr(frame, radio._id) >= snrLimit(frame.spreadingFactor);
+    }
+
+    void queue(SimRadio& radio, SimRadio::SimEventType_t type)
+    {
+        SimRadio::SimEvent event = { type, {}, 0, 0, false };
+        radio._events.push_back(event);
+    }
+
+    void transmit(SimRadio& sender, const uint8_t* data, uint8_t len)
+    {
+        SimFrame frame;
+        frame.serial = _nextSerial++;
+        frame.sender = sender._id;
+        frame.spreadingFactor = sender._spreadingFactor;
+        frame.txPower = sender._txPower;
+        frame.frequency = sender._frequency;
+        frame.lockBy = _now + preambleLockTime(frame.spreadingFactor, sender._preambleLength);
+        uint32_t onAir = airtime(frame.spreadingFactor, sender._preambleLength, len);
+        frame.end = _now + onAir;
+        frame.data.assign(data, data + len);
+        frame.corrupted.assign(_radios.size(), false);
+        _stats.framesSent++;
+        _stats.airtime_ms += onAir;
+        sender.airtime_ms += onAir;
+
+        for (SimRadio* radio : _radios)
+        {
+            if (radio == &sender || radio->_spreadingFactor != frame.spreadingFactor || radio->_frequency != frame.frequency)
+            {
+                continue;
+            }
+            unsigned int to = radio->_id;
+            if (radio->_mode == SimRadio::SIM_CAD && audible(frame, *radio))
+            {
+                radio->_cadDetected = true;
+            }
+            if (radio->_mode != SimRadio::SIM_RX)
+            {
+                continue;
+            }
+            if (radio->_locked < 0)
+            {
+                if (audible(frame, *radio))
+                {
+                    lock(*radio, frame);
+                }
+                else
+                {
+                    _stats.belowSensitivity++;
+                }
+            }
+            else
+            {
+                // Already receiving, the new frame destroys it unless the first is much stronger
+                for (SimFrame& other : _frames)
+                {
+                    if (other.serial == radio->_locked && rssi(frame, to) > rssi(other, to) - _config.captureThreshold)
+                    {
+                        other.corrupted[to] = true;
+                    }
+                }
+            }
+        }
+        _frames.push_back(frame);
+        sender._mode = SimRadio::SIM_TX;
+    }
+
+    // The SX126x needs about four preamble symbols to detect a frame
+    uint32_t preambleLockTime(uint8_t spreadingFactor, uint16_t preambleLength) const
+    {
+        uint32_t symbols = preambleLength > 4 ? preambleLength - 4 : 0;
+        return (symbols * loraSymbolMicros(spreadingFactor, _config.bandwidth)) / 1000;
+    }
+
+    // Receive the frame, it is lost if another frame the radio can hear is not much weaker
+    void lock(SimRadio& radio, SimFrame& frame)
+    {
+        unsigned int to = radio._id;
+        radio._locked = frame.serial;
+        for (const SimFrame& other : _frames)
+        {
+            if (other.serial != frame.serial && other.sender != to
+                && rssi(other, to) > rssi(frame, to) - _config.captureThreshold
+                && audible(other, radio))
+            {
+                frame.corrupted[to] = true;
+            }
+        }
+    }
+
+    // A receiver that starts listening while a preamble is still on air can catch it
+    void listen(SimRadio& radio)
+    {
+        SimFrame* best = nullptr;
+        for (SimFrame& frame : _frames)
+        {
+            if (_now <= frame.lockBy && frame.sender != radio._id && audible(frame, radio)
+                && (best == nullptr || rssi(frame, radio._id) > rssi(*best, radio._id)))
+            {
+                best = &frame;
+            }
+        }
+        if (best != nullptr)
+        {
+            lock(radio, *best);
+        }
+    }
+
+    void finishFrame(const SimFrame& frame)
+    {
+        SimRadio& sender = *_radios[frame.sender];
+        if (sender._mode == SimRadio::SIM_TX)
+        {
+            sender._mode = SimRadio::SIM_STANDBY;
+            queue(sender, SimRadio::EVENT_TX_DONE);
+        }
+        for (SimRadio* radio : _radios)
+        {
+            if (radio->_locked != frame.serial)
+            {
+                continue;
+            }
+            radio->_locked = -1;
+            unsigned int to = radio->_id;
+            if (frame.corrupted[to])
+            {
+                _stats.collisions++;
+                radio->collisions++;
+                continue;       // CRC error, the receiver carries on listening
+            }
+            if (_loss(_random) < _config.lossRate)
+            {
+                _stats.randomLoss++;
+                continue;
+            }
+            _stats.framesReceived++;
+            if (radio->_rxDeadline != 0)
+            {
+                radio->_mode = SimRadio::SIM_STANDBY;   // Single receive, continuous stays in RX
+            }
+            double frameSnr = snr(frame, to);
+            SimRadio::SimEvent event = { SimRadio::EVENT_RX_DONE, frame.data,
+                (int16_t)lround(rssi(frame, to)), (int8_t)lround(frameSnr > 10.0 ? 10.0 : frameSnr), false };
+            radio->_events.push_back(event);
+        }
+    }
+
+    SimRadioConfig _config;
+    std::mt19937 _random;
+    std::uniform_real_distribution<double> _loss{ 0.0, 1.0 };
+    SimStats _stats;
+    uint64_t _now = 0;
+    long _nextSerial = 0;
+    std::vector<SimRadio*> _radios;
+    std::vector<std::vector<double>> _pathLoss; // [from][to] dB
+    std::vector<SimFrame> _frames;              // On air now
+};
+
+inline void SimRadio::send(const uint8_t* data, uint8_t len)
+{
+    idle(SIM_STANDBY);
+    if (Sent) Sent(data, len);
+    _medium->transmit(*this, data, len);
+}
+
+inline void SimRadio::receive(uint32_t timeoutMs)
+{
+    idle(SIM_RX);
+    _rxDeadline = (timeoutMs == 0) ? 0 : _medium->now() + timeoutMs;
+    _medium->listen(*this);
+}
+
+inline void SimRadio::startCad(void)
+{
+    idle(SIM_CAD);
+    _cadEnd = _medium->now() + _medium->cadDuration(_spreadingFactor);
+    _cadDetected = false;
+    for (const SimMedium::SimFrame& frame : _medium->_frames)
+    {
+        if (_medium->audible(frame, *this))
+        {
+            _cadDetected = true;
+        }
+    }
+}
+
+inline void SimRadio::setDataRate(uint8_t spreadingFactor, int8_t txPower)
+{
+    _spreadingFactor = spreadingFactor;
+    _txPower = txPower;
+}
+
+inline void SimRadio::setChannel(uint32_t frequency, uint16_t preambleLength)
+{
+    _frequency = frequency;
+    _preambleLength = preambleLength;
+}
+
+inline uint32_t SimRadio::timeOnAir(uint8_t len)
+{
+    return _medium->airtime(_spreadingFactor, _preambleLength, len);
+}
+
+inline void SimRadio::standby(void)
+{
+    idle(SIM_STANDBY);
+}
+
+inline void SimRadio::sleep(void)
+{
+    idle(SIM_SLEEP);
+}
+
+inline void SimRadio::service(void)
+{
+    // A handler may start the next operation, which clears the queue
+    while (!_events.empty())
+    {
+        SimEvent event = _events.front();
+        _events.erase(_events.begin());
+        switch (event.type)
+        {
+        case EVENT_TX_DONE:
+            if (TxDone) TxDone();
+            break;
+        case EVENT_RX_DONE:
+            if (RxDone) RxDone(event.data.data(), (uint16_t)event.data.size(), event.rssi, event.snr);
+            break;
+        case EVENT_RX_TIMEOUT:
+            if (RxTimeout) RxTimeout();
+            break;
+        case EVENT_CAD_DONE:
+            if (CadDone) CadDone(event.channelActivity);
+            break;
+        }
+    }
+}
+
+#endif // LORA_ALARM_SIM_RADIO_H
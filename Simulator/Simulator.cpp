@@ -0,0 +1,1079 @@
+/*
+*  Title          :  Simulator
+*  Desc           :  Runs one hub and any number of remote nodes on the simulated LoRa medium,
+*                 :  using the same HubProtocol and NodeProtocol code as the firmware.  Nodes are
+*                 :  scattered around the hub, their PIR sensors fire as a Poisson process and
+*                 :  the run reports alarm latency, delivery, retries and channel statistics.
+*                 :  Relay commands are issued at random, as the UI would, and tracked to the
+*                 :  node's acknowledgement.  --command-burst sends several to the same node at
+*                 :  once, as a user tapping the relay buttons would, to load the hub's queue.
+*                 :
+*                 :  lora_sim --nodes 200 --minutes 60 --alarms-per-hour 4 --sf 7
+*                 :
+*                 :  --sf is the base spreading factor.  With --adr the hub moves nodes that can
+*                 :  afford it to faster spreading factors and lower power, compare
+*                 :    lora_sim --radius 5000 --sf 7            fixed SF7, distant nodes are lost
+*                 :    lora_sim --radius 5000 --sf 10           fixed SF10, everyone heard, slow
+*                 :    lora_sim --radius 5000 --sf 10 --adr     SF10 base with ADR
+*                 :
+*                 :  --readdress n gives n nodes a new address from the UI during the first half
+*                 :  of the run, an address then a commit, and reports how long the hub took to
+*                 :  follow each node to it.  Nodes keep their settings and frame counters in
+*                 :  memory that survives the restart.
+*                 :
+*                 :  Every device keeps to the hourly duty cycle of the sub-band it is on, see
+*                 :  DutyCycle.h.  The run reports the busiest hour of the hub and of the
+*                 :  busiest node, and the frames each held back.  --frequency moves everyone,
+*                 :  869525000 is in the 10 % sub-band.
+*                 :
+*                 :  --channels n spreads the nodes over n channels 200 kHz apart, see
+*                 :  ChannelPlan.h.  The run reports the frames delivered per second, compare
+*                 :    lora_sim --nodes 400 --low-power --channels 1
+*                 :    lora_sim --nodes 400 --low-power --channels 3
+*                 :
+*                 :  --repeaters n makes nodes 1 to n mains powered repeaters, see Repeater.h,
+*                 :  placed on spokes out from the hub --relay-hops apart so nodes past the
+*                 :  hub's range are carried in.  The run reports latency and delivery by the
+*                 :  repeaters each node ended up behind, and the airtime every frame of those
+*                 :  nodes took against what it would have taken sent once, compare
+*                 :    lora_sim --nodes 100 --radius 12000 --frequency 869525000
+*                 :    lora_sim --nodes 100 --radius 12000 --frequency 869525000 --repeaters 12 --relay-hops 2
+*                 :
+*                 :  --superframe ms has the hub send beacons that often and give each low power
+*                 :  node a check in slot, see Superframe.h.  Each node's sleep timer runs off by
+*                 :  up to --rtc-drift and the node measures it against the beacons.  The run
+*                 :  reports the slots kept and missed, how close the nodes got to their real
+*                 :  drift, and the time the nodes' radios were on, compare
+*                 :    lora_sim --nodes 200 --low-power
+*                 :    lora_sim --nodes 200 --low-power --superframe 60000
+*                 :
+*                 :  --hub-wake runs the hub only when Hub.ino's radio task would wake: a radio
+*                 :  event, a UI command or the end of HubProtocol::idle().  The results should
+*                 :  match a run without it, the report adds how often the task woke.
+*                 :
+*                 :  --poll-only turns off the nodes' alarm uplink, an edge waits for the next
+*                 :  poll or check in as the firmware used to.  Compare the latency to the hub
+*                 :  and the missed alarms against the same run without it:
+*                 :    lora_sim --nodes 64 --hold 130000
+*                 :    lora_sim --nodes 64 --hold 130000 --poll-only
+*                 :  With the default --hold a PIR clears long before most polls and the hub
+*                 :  never sees it set.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  2.1
+*  History        : 1.0 2026-10-17 Alarm, command and channel statistics
+*                 : 1.1 2026-10-17 Adaptive data rate, poll delivery ratio and node airtime
+*                 : 1.2 2026-10-17 Sealed frames, a random network key and a key per node
+*                 : 1.3 2026-10-17 Command bursts, every command tracked, hub command queue statistics
+*                 : 1.4 2026-10-17 Nodes with stored settings, moved to a new address over the air
+*                 : 1.5 2026-10-17 Radio defaults from the AlarmRadio profile the firmware is built with
+*                 : 1.6 2026-10-17 Duty cycle of the hub and the nodes, --frequency
+*                 : 1.7 2026-10-17 Channel plan, --channels, frames delivered per second
+*                 : 1.8 2026-10-17 Repeaters, --repeaters, --relay-hops, latency and airtime by hops
+*                 : 1.9 2026-10-17 Superframe slots, --superframe, node radio on time and collisions at the hub
+*                 : 2.0 2026-10-17 --hub-wake, the hub driven by radio events and idle() like the radio task
+*                 : 2.1 2026-10-17 --poll-only, alarm edges left to the poll to compare with the uplink
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <AlarmFrame.h>
+#include <AlarmProfile.h>
+#include <HubProtocol.h>
+#include <NodeProtocol.h>
+#include <NodeSettings.h>
+
+#include "SimRadio.h"
+
+#define MAX_NODES                                   1024 // Size of the hub node table
+#define RESTART_MS                                  300  // ESP.restart() to the node running again
+#define HUB_WAKE_GUARD                              1000 // Hub.ino radioTaskGuard, longest the radio task sleeps
+
+typedef struct
+{
+    unsigned int nodes;
+    double minutes;
+    double alarmsPerHour;       // Per node
+    double commandsPerHour;     // Whole system
+    unsigned int commandBurst;  // Commands sent to the node each time
+    unsigned int readdress;     // Nodes given a new address
+    uint32_t sensorHold;        // ms the PIR output stays high
+    uint32_t pollInterval;      // ms, the hub watchdogInterval
+    uint32_t bootSpread;        // ms, nodes power up at random within this
+    double radius;              // m, nodes are spread over a disc around the hub
+    double pathLossExponent;
+    double rtcDrift;            // Deep sleep timer error, each node gets a fixed rate within +/- this
+    bool lowPower;
+    bool adr;
+    uint32_t seed;
+    uint32_t frequency;         // Hz, channel 0, and the duty cycle sub-band of the report
+    unsigned int channels;
+    unsigned int repeaters;     // Nodes 1 to this are repeaters
+    unsigned int relayHops;
+    uint32_t superframe;        // ms, beacon period, 0 for none
+    bool hubWake;               // Run the hub only when the firmware's radio task would wake
+    bool pollOnly;              // Nodes leave alarm edges to the next poll or check in
+    SimRadioConfig radio;
+} SimOptions;
+
+// Airtime of one node's frames
+typedef struct
+{
+    uint64_t once;              // ms, each frame sent once by the hub or the node
+    uint64_t all;               // ms, with every copy the repeaters sent
+} SimRelayAirtime;
+
+typedef struct
+{
+    unsigned long sensorEdges;
+    unsigned long alarmsDelivered;
+    unsigned long alarmsMissed;         // The hub saw the node clear without ever seeing it set
+    unsigned long alarmsAcknowledged;
+    unsigned long alarmAttempts;
+    std::vector<uint32_t> latency;      // ms, sensor edge to the hub knowing
+    std::vector<uint32_t> ackLatency;   // ms, sensor edge to the node getting its ACK
+    unsigned long commandsIssued;
+    unsigned long commandsDelivered;
+    unsigned long commandsFailed;
+    unsigned long commandAttempts;
+    std::vector<uint32_t> commandLatency;   // ms, first transmission to the node's ACK
+    std::vector<uint32_t> commandLatencyUI; // ms, UI Send to the hub knowing it was delivered
+    unsigned long polls;                // Hub frames that expect a reply: watchdog, command, link
+    unsigned long hubFrames;            // Frames the hub received
+    unsigned long nodeFrames;           // Frames a node received that were addressed to it
+    unsigned long settingsIssued;       // Address and commit settings from the UI
+    unsigned long settingsDelivered;
+    unsigned long settingsFailed;       // Refused by the node or out of attempts
+    unsigned long nodesMoved;
+    std::vector<uint32_t> moveLatency;  // ms, the UI sending the address to the hub following the node
+    unsigned long delivered[RELAY_HOPS_MAX + 1];        // Alarms, by the repeaters the node was reached through
+    std::vector<uint32_t> hopLatency[RELAY_HOPS_MAX + 1];
+    std::map<uint16_t, SimRelayAirtime> relayAirtime;   // By node address
+} SimMetrics;
+
+// Charges a frame sent to the node it is about.  Copies a repeater passes on only count once they
+// are all added up
+static void relayAirtimeSent(SimMetrics& metrics, SimRadio& radio, uint16_t sender, const uint8_t* data, uint8_t len)
+{
+    RelayHeader relay = {};
+    AlarmFrame frame = {};
+    bool wrapped = relayFramePeek(data, len, relay) == FRAME_OK;
+    if (wrapped ? alarmFramePeek(relay.frame, relay.length, frame) != FRAME_OK : alarmFramePeek(data, len, frame) != FRAME_OK)
+    {
+        return;
+    }
+    SimRelayAirtime& airtime = metrics.relayAirtime[frame.nodeAddress];
+    airtime.all += radio.timeOnAir(len);
+    if (sender == 0 || sender == frame.nodeAddress)
+    {
+        airtime.once += radio.timeOnAir(wrapped ? relay.length : len);
+    }
+}
+
+// The node's Preferences, they survive a restart
+class SimSettings : public SettingsPort
+{
+public:
+    size_t read(const char* name, void* buf, size_t size) override
+    {
+        auto stored = _stored.find(name);
+        if (stored == _stored.end() || stored->second.size() > size)
+        {
+            return 0;
+        }
+        memcpy(buf, stored->second.data(), stored->second.size());
+        return stored->second.size();
+    }
+
+    void write(const char* name, const void* data, size_t len) override
+    {
+        const uint8_t* bytes = (const uint8_t*)data;
+        _stored[name].assign(bytes, bytes + len);
+    }
+
+private:
+    std::map<std::string, std::vector<uint8_t>> _stored;
+};
+
+class SimNode : public NodePlatform
+{
+public:
+    SimNode(SimMedium& medium, SimMetrics& metrics, const NodeConfig& config, const SimRadioConfig& radioConfig,
+        const uint8_t* networkKey, uint32_t seed)
+        : _medium(medium), _metrics(metrics), _random(seed), _config(config), _store(_flash)
+    {
+        // Each node is built with only its own key, as RemoteNode.ino is
+        NodeSettings defaults = {};
+        defaults.address = config.address;
+        frameKeyDerive(networkKey, config.address, defaults.key);
+        defaults.frequency = config.channels.frequency;
+        defaults.bandwidth = radioConfig.bandwidth;
+        defaults.codingRate = radioConfig.codingRate;
+        defaults.spreadingFactor = config.fallbackRate.spreadingFactor;
+        defaults.txPower = config.fallbackRate.txPower;
+        defaults.checkInInterval = config.checkInInterval;
+        defaults.scanInterval = 10;
+        defaults.ackTimeout = config.ackTimeout;
+        defaults.rxWindow = config.rxWindow;
+        _store.begin(defaults);
+        retained = NodeRetained();
+        protocol.reset(new NodeProtocol(radio, *this, settingsConfig(), retained));
+        radio.TxDone = [this]() { protocol->onTxDone(); };
+        radio.TxTimeout = [this]() { protocol->onTxTimeout(); };
+        radio.RxDone = [this](const uint8_t* payload, uint16_t size, int16_t rssi, int8_t snr)
+        {
+            AlarmFrame frame = {};
+            RelayHeader relay = {};
+            bool forNode = (relayFramePeek(payload, size, relay) == FRAME_OK)
+                ? relay.downlink && alarmFramePeek(relay.frame, relay.length, frame) == FRAME_OK
+                : alarmFramePeek(payload, size, frame) == FRAME_OK;
+            if (forNode && frame.nodeAddress == _store.settings().address)
+            {
+                _metrics.nodeFrames++;
+            }
+            protocol->onRxDone(payload, size, rssi, snr);
+        };
+        radio.RxTimeout = [this]() { protocol->onRxTimeout(); };
+        radio.CadDone = [this](bool channelActivityDetected) { protocol->onCadDone(channelActivityDetected); };
+        radio.Sent = [this](const uint8_t* data, uint8_t len)
+        {
+            relayAirtimeSent(_metrics, radio, _store.settings().address, data, len);
+        };
+    }
+
+    uint32_t millis(void) override { return (uint32_t)_medium.now(); }
+
+    // The slow clock the sleep timer runs on, out by the same rate
+    uint32_t rtcMillis(void) override { return (uint32_t)((double)_medium.now() / clockRate); }
+
+    long random(long min, long max) override
+    {
+        return std::uniform_int_distribution<long>(min, max - 1)(_random);
+    }
+
+    uint8_t readInputs(void) override { return sensor ? 1 : 0; }
+    void setRelays(bool relay1, bool relay2) override { (void)relay1; (void)relay2; }
+
+    void deepSleep(uint32_t wakeAfterMs, bool wakeOnSensor, bool wakeLevel) override
+    {
+        asleep = true;
+        _wakeAt = _medium.now() + (uint64_t)((double)wakeAfterMs * clockRate);
+        _wakeOnSensor = wakeOnSensor;
+        _wakeLevel = wakeLevel;
+    }
+
+    void alarmAcknowledged(uint8_t sequence, uint32_t edgeToAckMs, uint8_t attempts) override
+    {
+        (void)sequence;
+        _metrics.alarmsAcknowledged++;
+        _metrics.alarmAttempts += attempts;
+        _metrics.ackLatency.push_back(edgeToAckMs);
+    }
+
+    bool loadCounters(FrameCounters& counters) override
+    {
+        counters = _storedCounters;
+        _store.applyCounterFloor(counters);
+        return _countersStored || _store.settings().counterFloor > 0;
+    }
+
+    void storeCounters(const FrameCounters& counters) override
+    {
+        _storedCounters = counters;
+        _countersStored = true;
+    }
+
+    uint8_t configure(uint8_t key, uint32_t value) override { return _store.configure(key, value); }
+
+    // Takes effect on the next pass, the protocol is still in its TX done handler
+    void restart(void) override { _restartAt = _medium.now() + RESTART_MS; }
+
+    // One pass of the Arduino loop()
+    void run(void)
+    {
+        uint64_t now = _medium.now();
+        if (_restartAt != 0)
+        {
+            // Powered down until the restart is over, then a cold start with the new settings
+            radio.sleep();
+            protocol->configure(settingsConfig());
+            asleep = false;
+            booted = false;
+            bootAt = _restartAt;
+            _restartAt = 0;
+        }
+        if (!booted)
+        {
+            if (now < bootAt)
+            {
+                return;
+            }
+            booted = true;
+            protocol->begin(WAKE_COLD_START);
+        }
+        if (asleep)
+        {
+            if (_wakeOnSensor && sensor == _wakeLevel)
+            {
+                asleep = false;
+                protocol->begin(WAKE_SENSOR);
+            }
+            else if (now >= _wakeAt)
+            {
+                asleep = false;
+                protocol->begin(WAKE_TIMER);
+            }
+            else
+            {
+                return;
+            }
+        }
+        awake_ms++;
+        protocol->loop();
+    }
+
+    SimRadio radio;
+    NodeRetained retained;
+    std::unique_ptr<NodeProtocol> protocol;
+    bool sensor = false;
+    bool booted = false;
+    bool asleep = false;
+    uint64_t bootAt = 0;
+    uint64_t nextTrigger = 0;
+    uint64_t sensorUntil = 0;
+    uint64_t setPendingSince = 0;   // Sensor edge the hub has not seen yet, 0 if none
+    uint64_t awake_ms = 0;
+    uint8_t commandSequence = 0;    // The UI's numbering for this node
+    std::map<uint8_t, uint64_t> commandsOpen;   // When each command still waiting was issued
+    std::map<uint8_t, uint64_t> settingsOpen;   // The same for settings
+    uint64_t moveIssued = 0;        // When the UI sent a new address, 0 if none is on its way
+    double clockRate = 1.0;         // RTC slow clock error, without it check ins that clash once clash forever
+
+private:
+    // The settings the node was built with, as RemoteNode.ino reads them at boot
+    NodeConfig settingsConfig(void) const
+    {
+        const NodeSettings& settings = _store.settings();
+        NodeConfig config = _config;
+        config.address = settings.address;
+        config.key = settings.key;
+        config.ackTimeout = settings.ackTimeout;
+        config.rxWindow = settings.rxWindow;
+        config.checkInInterval = settings.checkInInterval;
+        config.channels = channelPlanMake(settings.frequency, _config.channels.spacing, _config.channels.count,
+            _config.channels.preambleLength, settings.spreadingFactor, settings.bandwidth);
+        config.fallbackRate.spreadingFactor = settings.spreadingFactor;
+        config.fallbackRate.txPower = settings.txPower;
+        config.relay = relayPlanMake(_config.relay.hops, settings.spreadingFactor, settings.bandwidth, settings.codingRate,
+            config.channels.preambleLength, config.channels.scanPreamble);
+        config.superframe = superframePlanMake(_config.superframe.period, _config.superframe.slots, config.channels.count,
+            settings.spreadingFactor, settings.bandwidth, settings.codingRate, config.channels.preambleLength,
+            config.channels.scanPreamble);
+        return config;
+    }
+
+    SimMedium& _medium;
+    SimMetrics& _metrics;
+    std::mt19937 _random;
+    NodeConfig _config;
+    SimSettings _flash;
+    NodeSettingsStore _store;
+    FrameCounters _storedCounters = {};
+    bool _countersStored = false;
+    uint64_t _restartAt = 0;
+    uint64_t _wakeAt = 0;
+    bool _wakeOnSensor = false;
+    bool _wakeLevel = true;
+};
+
+class SimHub : public HubPlatform
+{
+public:
+    SimHub(SimMedium& medium, SimMetrics& metrics, std::vector<std::unique_ptr<SimNode>>& nodes)
+        : protocol(radio, *this), _medium(medium), _metrics(metrics), _nodes(nodes)
+    {
+        radio.TxDone = [this]() { protocol.onTxDone(); };
+        radio.TxTimeout = [this]() { protocol.onTxTimeout(); };
+        radio.RxDone = [this](const uint8_t* payload, uint16_t size, int16_t rssi, int8_t snr)
+        {
+            _metrics.hubFrames++;
+            protocol.onRxDone(payload, size, rssi, snr);
+        };
+        radio.RxTimeout = [this]() { protocol.onRxTimeout(); };
+        radio.CadDone = [this](bool channelActivityDetected) { protocol.onCadDone(channelActivityDetected); };
+        radio.Sent = [this](const uint8_t* data, uint8_t len)
+        {
+            AlarmFrame frame = {};
+            RelayHeader relay = {};
+            bool wrapped = relayFramePeek(data, len, relay) == FRAME_OK;
+            if ((wrapped ? alarmFramePeek(relay.frame, relay.length, frame) : alarmFramePeek(data, len, frame)) == FRAME_OK
+                && frame.type != FRAME_ACK && frame.type != FRAME_SLOT)
+            {
+                _metrics.polls++;
+            }
+            relayAirtimeSent(_metrics, radio, 0, data, len);
+        };
+    }
+
+    uint32_t millis(void) override { return (uint32_t)_medium.now(); }
+    void setBuzzer(bool on) override { (void)on; }
+
+    void nodeUpdated(size_t index) override
+    {
+        SimNode& node = *_nodes[index];
+        if (node.setPendingSince == 0)
+        {
+            return;
+        }
+        DeviceStates_t reported = protocol.nodeState(index).alarmState;
+        if (reported == SET)
+        {
+            uint8_t hops = protocol.route(index).hops;
+            _metrics.alarmsDelivered++;
+            _metrics.latency.push_back((uint32_t)(_medium.now() - node.setPendingSince));
+            _metrics.delivered[hops]++;
+            _metrics.hopLatency[hops].push_back((uint32_t)(_medium.now() - node.setPendingSince));
+            node.setPendingSince = 0;
+        }
+        else if (reported == CLEAR && !node.sensor)
+        {
+            _metrics.alarmsMissed++;
+            node.setPendingSince = 0;
+        }
+    }
+
+    bool loadCounters(uint16_t address, FrameCounters& counters) override
+    {
+        auto stored = _counters.find(address);
+        if (stored == _counters.end())
+        {
+            return false;
+        }
+        counters = stored->second;
+        return true;
+    }
+
+    void storeCounters(uint16_t address, const FrameCounters& counters) override { _counters[address] = counters; }
+
+    void nodeMoved(size_t index, uint16_t oldAddress) override
+    {
+        (void)oldAddress;
+        SimNode& node = *_nodes[index];
+        _metrics.nodesMoved++;
+        if (node.moveIssued != 0)
+        {
+            _metrics.moveLatency.push_back((uint32_t)(_medium.now() - node.moveIssued));
+            node.moveIssued = 0;
+        }
+    }
+
+    void commandUpdated(size_t index) override
+    {
+        SimNode& node = *_nodes[index];
+        const LoRaPacket& status = protocol.nodeState(index);
+        auto setting = node.settingsOpen.find(status.commandSequence);
+        if (setting != node.settingsOpen.end())
+        {
+            if (status.commandState == COMMAND_DELIVERED)
+            {
+                _metrics.settingsDelivered++;
+                node.settingsOpen.erase(setting);
+            }
+            else if (status.commandState == COMMAND_FAILED || status.commandState == COMMAND_REJECTED)
+            {
+                _metrics.settingsFailed++;
+                node.settingsOpen.erase(setting);
+            }
+            return;
+        }
+        auto open = node.commandsOpen.find(status.commandSequence);
+        if (open == node.commandsOpen.end())
+        {
+            return;
+        }
+        if (status.commandState == COMMAND_DELIVERED)
+        {
+            _metrics.commandsDelivered++;
+            _metrics.commandAttempts += protocol.command(index).attempts;
+            // The hub's own figure, status.commandLatency stops at 65535
+            _metrics.commandLatency.push_back(millis() - protocol.command(index).firstSentMs);
+            _metrics.commandLatencyUI.push_back((uint32_t)(_medium.now() - open->second));
+            node.commandsOpen.erase(open);
+        }
+        else if (status.commandState == COMMAND_FAILED)
+        {
+            _metrics.commandsFailed++;
+            node.commandsOpen.erase(open);
+        }
+    }
+
+    // What action_send_states() does on the UI, each one toggles relay 1 of the last command
+    void issueCommand(size_t index)
+    {
+        SimNode& node = *_nodes[index];
+        LoRaPacket command = _lastIssued.count(index) ? _lastIssued[index] : protocol.nodeCommand(index);
+        command.nodeAddress = protocol.nodeState(index).nodeAddress;    // It may have moved
+        command.relay1Enabled = (command.relay1Enabled == ACTIVE) ? INACTIVE : ACTIVE;
+        command.commandSequence = nextSequence(node);
+        node.commandsOpen[command.commandSequence] = _medium.now();
+        _metrics.commandsIssued++;
+        _lastIssued[index] = command;
+        protocol.setCommand(command);
+    }
+
+    // What the UI's node settings screen does, a setting then another behind it
+    void issueSetting(size_t index, uint8_t key, uint32_t value)
+    {
+        SimNode& node = *_nodes[index];
+        LoRaPacket setting = {};
+        setting.nodeAddress = protocol.nodeState(index).nodeAddress;
+        setting.configKey = key;
+        setting.configValue = value;
+        setting.commandSequence = nextSequence(node);
+        node.settingsOpen[setting.commandSequence] = _medium.now();
+        if (key == CONFIG_ADDRESS)
+        {
+            node.moveIssued = _medium.now();
+        }
+        _metrics.settingsIssued++;
+        protocol.setCommand(setting);
+    }
+
+    SimRadio radio;
+    HubProtocol<MAX_NODES> protocol;
+
+private:
+    static uint8_t nextSequence(SimNode& node)
+    {
+        node.commandSequence = (uint8_t)(node.commandSequence + 1);
+        if (node.commandSequence == 0)
+        {
+            node.commandSequence = 1;
+        }
+        return node.commandSequence;
+    }
+
+    SimMedium& _medium;
+    SimMetrics& _metrics;
+    std::vector<std::unique_ptr<SimNode>>& _nodes;
+    std::map<size_t, LoRaPacket> _lastIssued;
+    std::map<uint16_t, FrameCounters> _counters;
+};
+
+static uint32_t percentile(std::vector<uint32_t>& samples, double fraction)
+{
+    if (samples.empty())
+    {
+        return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    size_t index = (size_t)ceil(fraction * (double)samples.size());
+    return samples[index == 0 ? 0 : index - 1];
+}
+
+static void usage(void)
+{
+    printf("usage: lora_sim [--nodes n] [--minutes m] [--alarms-per-hour a] [--hold ms] [--commands-per-hour c]\n"
+           "                [--command-burst n] [--poll-interval ms] [--radius m] [--sf 7..12] [--bw 0..2] [--cr 1..4]\n"
+           "                [--loss p] [--rtc-drift fraction] [--low-power] [--adr] [--readdress n] [--frequency hz]\n"
+           "                [--channels n] [--repeaters n] [--relay-hops 1..3] [--superframe ms] [--hub-wake]\n"
+           "                [--poll-only] [--seed s]\n");
+}
+
+static bool parseOptions(int argc, char** argv, SimOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (strcmp(arg, "--low-power") == 0)
+        {
+            options.lowPower = true;
+            continue;
+        }
+        if (strcmp(arg, "--adr") == 0)
+        {
+            options.adr = true;
+            continue;
+        }
+        if (strcmp(arg, "--hub-wake") == 0)
+        {
+            options.hubWake = true;
+            continue;
+        }
+        if (strcmp(arg, "--poll-only") == 0)
+        {
+            options.pollOnly = true;
+            continue;
+        }
+        if (value == nullptr)
+        {
+            return false;
+        }
+        i++;
+        if (strcmp(arg, "--nodes") == 0) options.nodes = (unsigned int)atoi(value);
+        else if (strcmp(arg, "--minutes") == 0) options.minutes = atof(value);
+        else if (strcmp(arg, "--alarms-per-hour") == 0) options.alarmsPerHour = atof(value);
+        else if (strcmp(arg, "--commands-per-hour") == 0) options.commandsPerHour = atof(value);
+        else if (strcmp(arg, "--command-burst") == 0) options.commandBurst = (unsigned int)atoi(value);
+        else if (strcmp(arg, "--hold") == 0) options.sensorHold = (uint32_t)atol(value);
+        else if (strcmp(arg, "--poll-interval") == 0) options.pollInterval = (uint32_t)atol(value);
+        else if (strcmp(arg, "--radius") == 0) options.radius = atof(value);
+        else if (strcmp(arg, "--sf") == 0) options.radio.spreadingFactor = (uint8_t)atoi(value);
+        else if (strcmp(arg, "--bw") == 0) options.radio.bandwidth = (uint8_t)atoi(value);
+        else if (strcmp(arg, "--cr") == 0) options.radio.codingRate = (uint8_t)atoi(value);
+        else if (strcmp(arg, "--loss") == 0) options.radio.lossRate = atof(value);
+        else if (strcmp(arg, "--rtc-drift") == 0) options.rtcDrift = atof(value);
+        else if (strcmp(arg, "--readdress") == 0) options.readdress = (unsigned int)atoi(value);
+        else if (strcmp(arg, "--frequency") == 0) options.frequency = (uint32_t)atol(value);
+        else if (strcmp(arg, "--channels") == 0) options.channels = (unsigned int)atoi(value);
+        else if (strcmp(arg, "--repeaters") == 0) options.repeaters = (unsigned int)atoi(value);
+        else if (strcmp(arg, "--relay-hops") == 0) options.relayHops = (unsigned int)atoi(value);
+        else if (strcmp(arg, "--superframe") == 0) options.superframe = (uint32_t)atol(value);
+        else if (strcmp(arg, "--seed") == 0) options.seed = (uint32_t)atol(value);
+        else return false;
+    }
+    return options.nodes > 0 && options.nodes <= MAX_NODES && options.commandBurst > 0 && options.readdress <= options.nodes
+        && radioSpreadingFactorValid(options.radio.spreadingFactor) && radioBandwidthValid(options.radio.bandwidth)
+        && radioCodingRateValid(options.radio.codingRate) && radioFrequencyValid(options.frequency)
+        && options.channels >= 1 && options.channels <= CHANNEL_PLAN_MAX
+        && radioFrequencyValid(options.frequency + AlarmChannels::spacing * (options.channels - 1))
+        && options.repeaters <= options.nodes && options.relayHops <= RELAY_HOPS_MAX
+        && (options.repeaters == 0 || options.relayHops >= 1);
+}
+
+int main(int argc, char** argv)
+{
+    SimOptions options;
+    options.nodes = 50;
+    options.minutes = 60.0;
+    options.alarmsPerHour = 2.0;
+    options.commandsPerHour = 60.0;
+    options.commandBurst = 1;
+    options.readdress = 0;
+    options.sensorHold = 5000;
+    options.pollInterval = 120000;      // Hub.ino watchdogInterval
+    options.bootSpread = 10000;
+    options.radius = 2000.0;
+    options.pathLossExponent = 2.7;
+    options.rtcDrift = 0.005;
+    options.lowPower = false;
+    options.adr = false;
+    options.seed = 1;
+    options.frequency = AlarmRadio::frequency;
+    options.channels = AlarmChannels::count;
+    options.repeaters = 0;
+    options.relayHops = AlarmRelay::hops;
+    options.superframe = AlarmSuperframe::period;
+    options.hubWake = false;
+    options.pollOnly = false;
+    options.radio.spreadingFactor = AlarmRadio::spreadingFactor;
+    options.radio.txPower = AlarmRadio::txPower;
+    options.radio.bandwidth = AlarmRadio::bandwidth;
+    options.radio.codingRate = AlarmRadio::codingRate;
+    options.radio.preambleLength = AlarmRadio::preambleLength;
+    options.radio.lossRate = 0.0;
+    options.radio.captureThreshold = 6.0;
+    options.radio.noiseFigure = 6.0;
+
+    if (!parseOptions(argc, argv, options))
+    {
+        usage();
+        return 1;
+    }
+
+    // Any key will do, every node's is derived from it
+    uint8_t networkKey[FRAME_KEY_SIZE];
+    std::mt19937 keyRandom(options.seed);
+    for (uint8_t& b : networkKey)
+    {
+        b = (uint8_t)keyRandom();
+    }
+
+    SimMedium medium(options.radio, options.seed);
+    SimMetrics metrics = {};
+    std::mt19937 random(options.seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::exponential_distribution<double> trigger(options.alarmsPerHour / 3600000.0);
+    std::exponential_distribution<double> commandGap(options.commandsPerHour / 3600000.0);
+
+    // Same settings as RemoteNode.ino
+    NodeConfig nodeConfig;
+    nodeConfig.lowPower = options.lowPower;
+    nodeConfig.ackTimeout = 200;
+    nodeConfig.rxWindow = 200;
+    nodeConfig.checkInInterval = 60000;
+    nodeConfig.alarmMaxAttempts = 6;
+    nodeConfig.alarmBackoffSlot = 20;
+    nodeConfig.alarmUplink = !options.pollOnly;
+    nodeConfig.channels = channelPlanMake(options.frequency, AlarmChannels::spacing, (uint8_t)options.channels,
+        options.radio.preambleLength, options.radio.spreadingFactor, options.radio.bandwidth);
+    nodeConfig.relay = relayPlanMake((uint8_t)options.relayHops, options.radio.spreadingFactor, options.radio.bandwidth,
+        options.radio.codingRate, options.radio.preambleLength, nodeConfig.channels.scanPreamble);
+    nodeConfig.superframe = superframePlanMake(options.superframe, (uint16_t)options.nodes, (uint8_t)options.channels,
+        options.radio.spreadingFactor, options.radio.bandwidth, options.radio.codingRate, options.radio.preambleLength,
+        nodeConfig.channels.scanPreamble);
+    nodeConfig.fallbackRate.spreadingFactor = options.radio.spreadingFactor;
+    nodeConfig.fallbackRate.txPower = options.radio.txPower;
+    nodeConfig.linkTimeout = 5 * options.pollInterval / 2;
+    nodeConfig.linkCheckInterval = 10;
+    nodeConfig.linkMissLimit = 2;
+    nodeConfig.key = nullptr;           // Derived per node
+
+    // Same settings as Hub.ino
+    HubConfig hubConfig;
+    hubConfig.pollInterval = options.pollInterval;
+    hubConfig.minSlot = 250;
+    hubConfig.rxTimeout = 100;
+    hubConfig.commandWindow = 4;
+    hubConfig.commandMaxAttempts = 6;
+    hubConfig.commandBackoff = 500;
+    hubConfig.txPower = options.radio.txPower;
+    hubConfig.bandwidth = options.radio.bandwidth;
+    hubConfig.codingRate = options.radio.codingRate;
+    hubConfig.channels = nodeConfig.channels;
+    hubConfig.relay = nodeConfig.relay;
+    hubConfig.superframe = nodeConfig.superframe;
+    hubConfig.adr = options.adr;
+    hubConfig.link.fallback = nodeConfig.fallbackRate;
+    hubConfig.link.minSpreadingFactor = 7;
+    hubConfig.link.minTxPower = 2;
+    hubConfig.link.powerStep = 2;
+    hubConfig.link.margin = 10;
+    hubConfig.link.history = 10;
+    hubConfig.link.missLimit = 3;
+    hubConfig.networkKey = networkKey;
+
+    std::vector<std::unique_ptr<SimNode>> nodes;
+    SimHub hub(medium, metrics, nodes);
+    medium.attach(hub.radio);
+    hub.protocol.begin(hubConfig);
+
+    // Log distance path loss, 40 dB at 1 m.  Repeaters go on spokes out from the hub, evenly
+    // spaced to the edge of the disc, and are always on
+    unsigned int spokes = std::max(1u, (options.relayHops > 0) ? options.repeaters / options.relayHops : 1u);
+    std::vector<double> x(1, 0.0), y(1, 0.0);
+    for (unsigned int i = 0; i < options.nodes; i++)
+    {
+        nodeConfig.address = (uint16_t)(i + 1);
+        nodeConfig.repeater = i < options.repeaters;
+        nodeConfig.lowPower = options.lowPower && !nodeConfig.repeater;
+        nodes.emplace_back(new SimNode(medium, metrics, nodeConfig, options.radio, networkKey, (uint32_t)random()));
+        SimNode& node = *nodes.back();
+        medium.attach(node.radio);
+        hub.protocol.addNode(nodeConfig.address);
+
+        double r = options.radius * sqrt(unit(random));
+        double a = 2.0 * M_PI * unit(random);
+        x.push_back(r * cos(a));
+        y.push_back(r * sin(a));
+        node.bootAt = (uint64_t)(unit(random) * options.bootSpread);
+        node.clockRate = 1.0 + options.rtcDrift * (2.0 * unit(random) - 1.0);
+        node.nextTrigger = node.bootAt + 1 + (uint64_t)trigger(random);
+        if (nodeConfig.repeater)
+        {
+            double ring = (double)(i / spokes + 1);
+            double spoke = 2.0 * M_PI * (double)(i % spokes) / (double)spokes;
+            x.back() = ring * options.radius / (double)(options.relayHops + 1) * cos(spoke);
+            y.back() = ring * options.radius / (double)(options.relayHops + 1) * sin(spoke);
+        }
+    }
+    for (size_t a = 0; a < x.size(); a++)
+    {
+        for (size_t b = a + 1; b < x.size(); b++)
+        {
+            double d = std::max(1.0, hypot(x[a] - x[b], y[a] - y[b]));
+            medium.setLink((unsigned int)a, (unsigned int)b, 40.0 + 10.0 * options.pathLossExponent * log10(d));
+        }
+    }
+
+    uint64_t end = (uint64_t)(options.minutes * 60000.0);
+    uint64_t nextCommand = options.commandsPerHour > 0.0 ? options.bootSpread + (uint64_t)commandGap(random) : end;
+
+    // Nodes to move, each to an address above the ones in use, at a random time in the first half
+    std::vector<std::pair<uint64_t, size_t>> moves;
+    if (options.readdress > 0)
+    {
+        std::vector<size_t> order(nodes.size());
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            order[i] = i;
+        }
+        std::shuffle(order.begin(), order.end(), random);
+        for (unsigned int i = 0; i < options.readdress; i++)
+        {
+            moves.push_back(std::make_pair(options.bootSpread + (uint64_t)(unit(random) * (double)(end / 2)), order[i]));
+        }
+        std::sort(moves.begin(), moves.end());
+    }
+    size_t nextMove = 0;
+    uint64_t hubWakeAt = 0;
+    unsigned long hubWakes = 0;
+    while (medium.now() < end)
+    {
+        medium.tick();
+        uint64_t now = medium.now();
+        for (std::unique_ptr<SimNode>& node : nodes)
+        {
+            // PIR output, a trigger while high restarts the hold time
+            if (now >= node->nextTrigger)
+            {
+                if (!node->sensor)
+                {
+                    metrics.sensorEdges++;
+                    if (node->setPendingSince == 0)
+                    {
+                        node->setPendingSince = now;
+                    }
+                }
+                node->sensor = true;
+                node->sensorUntil = now + options.sensorHold;
+                node->nextTrigger = now + 1 + (uint64_t)trigger(random);
+            }
+            else if (node->sensor && now >= node->sensorUntil)
+            {
+                node->sensor = false;
+            }
+        }
+        if (now >= nextCommand)
+        {
+            size_t target = std::uniform_int_distribution<size_t>(0, nodes.size() - 1)(random);
+            for (unsigned int n = 0; n < options.commandBurst; n++)
+            {
+                hub.issueCommand(target);
+            }
+            hubWakeAt = now;    // The UI's command wakes the radio task
+            nextCommand = now + 1 + (uint64_t)commandGap(random);
+        }
+        while (nextMove < moves.size() && now >= moves[nextMove].first)
+        {
+            size_t target = moves[nextMove].second;
+            hub.issueSetting(target, CONFIG_ADDRESS, options.nodes + 1 + nextMove);
+            hub.issueSetting(target, CONFIG_COMMIT, 0);
+            hubWakeAt = now;
+            nextMove++;
+        }
+
+        // As Hub.ino's radio task: on a radio event, a UI command or when idle() runs out, then
+        // on until the frame is on air or the window open
+        if (options.hubWake && (now >= hubWakeAt || hub.radio.eventPending()))
+        {
+            hubWakes++;
+            do
+            {
+                hub.protocol.loop();
+            } while (hub.protocol.state() == STATE_TX || hub.protocol.state() == STATE_RX || hub.radio.eventPending());
+            uint32_t idle = hub.protocol.idle();
+            hubWakeAt = now + std::min<uint32_t>(idle, HUB_WAKE_GUARD);
+        }
+
+        // The firmware loop() spins much faster than the 1 ms tick, run it twice so state
+        // changes queued by a radio event are acted on in the same tick
+        for (int pass = 0; pass < 2; pass++)
+        {
+            if (!options.hubWake)
+            {
+                hub.protocol.loop();
+            }
+            for (std::unique_ptr<SimNode>& node : nodes)
+            {
+                node->run();
+            }
+        }
+    }
+
+    const SimStats& stats = medium.stats();
+    unsigned long pending = 0;
+    unsigned long commandsOpen = 0;
+    unsigned long pollMisses = 0;
+    uint64_t awake = 0;
+    uint64_t radioOn = 0;
+    uint64_t nodeAirtime = 0;
+    unsigned long atSf[13] = {};
+    double power = 0.0;
+    DutyCycleStats nodeDuty = {};
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        const DutyCycleStats& duty = nodes[i]->retained.airtime.stats();
+        nodeDuty.deferred += duty.deferred;
+        nodeDuty.overLimit += duty.overLimit;
+        nodeDuty.maxUsedMs = std::max(nodeDuty.maxUsedMs, duty.maxUsedMs);
+        pending += nodes[i]->setPendingSince != 0 ? 1 : 0;
+        commandsOpen += (unsigned long)nodes[i]->commandsOpen.size();
+        pollMisses += hub.protocol.nodeState(i).rxTimeoutCount;
+        awake += nodes[i]->awake_ms;
+        radioOn += nodes[i]->radio.active_ms;
+        nodeAirtime += nodes[i]->radio.airtime_ms;
+        atSf[hub.protocol.link(i).rate().spreadingFactor]++;
+        power += (double)hub.protocol.link(i).rate().txPower;
+    }
+
+    printf("LoRa alarm simulation: %u nodes, %.0f minutes, SF%u BW%u CR4/%u, %s, %s, seed %u\n",
+        options.nodes, options.minutes, options.radio.spreadingFactor, options.radio.bandwidth,
+        options.radio.codingRate + 4, options.lowPower ? "low power nodes" : "always on nodes",
+        options.adr ? "ADR" : "fixed rate", options.seed);
+    if (options.pollOnly)
+    {
+        printf("  alarm uplink off, edges wait for the next poll or check in\n");
+    }
+    printf("  airtime: status %u ms, alarm %u ms, ack %u ms, channel busy %.2f%%, nodes %.1f s per node per hour\n",
+        medium.airtime(options.radio.spreadingFactor, alarmFrameSize(FRAME_STATUS)),
+        medium.airtime(options.radio.spreadingFactor, alarmFrameSize(FRAME_ALARM)),
+        medium.airtime(options.radio.spreadingFactor, alarmFrameSize(FRAME_ACK)), 100.0 * (double)stats.airtime_ms / (double)end,
+        (double)nodeAirtime / 1000.0 / (double)nodes.size() / (options.minutes / 60.0));
+    int band = dutyCycleBandOf(options.frequency);
+    const DutyCycleStats& hubDuty = hub.protocol.airtimeStats();
+    if (band >= 0)
+    {
+        double limit = (double)dutyCycleLimit(band);
+        printf("  duty cycle: %.1f%% sub-band, busiest hour hub %.1f%% of it, node %.1f%%, held back hub %lu, nodes %lu,"
+            " past the limit hub %lu, nodes %lu\n", dutyCycleBand(band).dutyCycle / 100.0,
+            100.0 * hubDuty.maxUsedMs / limit, 100.0 * nodeDuty.maxUsedMs / limit,
+            hubDuty.deferred, nodeDuty.deferred, hubDuty.overLimit, nodeDuty.overLimit);
+    }
+    printf("  channels: %u, frames delivered per second %.2f, to the hub %.2f, to their node %.2f, unsolicited uplink preamble %u symbols\n",
+        options.channels, (double)(metrics.hubFrames + metrics.nodeFrames) * 1000.0 / (double)end,
+        (double)metrics.hubFrames * 1000.0 / (double)end, (double)metrics.nodeFrames * 1000.0 / (double)end,
+        nodeConfig.channels.scanPreamble);
+    printf("  polls: sent %lu, answered %lu, delivery ratio %.2f%%\n", metrics.polls, metrics.polls - pollMisses,
+        metrics.polls ? 100.0 * (double)(metrics.polls - pollMisses) / (double)metrics.polls : 0.0);
+    printf("  link rates at the end:");
+    for (uint8_t sf = 7; sf <= 12; sf++)
+    {
+        if (atSf[sf] > 0)
+        {
+            printf(" SF%u %lu", sf, atSf[sf]);
+        }
+    }
+    printf(", mean node TX power %.1f dBm\n", power / (double)nodes.size());
+    printf("  frames: sent %lu, received %lu, collisions %lu, below sensitivity %lu, random loss %lu\n",
+        stats.framesSent, stats.framesReceived, stats.collisions, stats.belowSensitivity, stats.randomLoss);
+    printf("  cad: clear %lu, busy %lu, hub poll misses %lu, frames failing authentication %lu\n",
+        stats.cadClear, stats.cadBusy, pollMisses, hub.protocol.rejectedFrames());
+    printf("  node radios on %.3f%% of the time, frames the hub lost to collisions %.2f%%\n",
+        100.0 * (double)radioOn / ((double)end * (double)nodes.size()),
+        metrics.hubFrames + hub.radio.collisions
+            ? 100.0 * (double)hub.radio.collisions / (double)(metrics.hubFrames + hub.radio.collisions) : 0.0);
+    printf("  alarms: edges %lu, delivered %lu, missed %lu, still pending %lu\n",
+        metrics.sensorEdges, metrics.alarmsDelivered, metrics.alarmsMissed, pending);
+    printf("  latency to hub ms: p50 %u, p95 %u, p99 %u, max %u\n",
+        percentile(metrics.latency, 0.50), percentile(metrics.latency, 0.95),
+        percentile(metrics.latency, 0.99), percentile(metrics.latency, 1.0));
+    printf("  alarm ACKs: %lu, attempts per ACK %.2f, edge to ACK ms p50 %u, p99 %u\n",
+        metrics.alarmsAcknowledged,
+        metrics.alarmsAcknowledged ? (double)metrics.alarmAttempts / (double)metrics.alarmsAcknowledged : 0.0,
+        percentile(metrics.ackLatency, 0.50), percentile(metrics.ackLatency, 0.99));
+    printf("  commands: issued %lu, delivered %lu, failed %lu, attempts per delivery %.2f\n",
+        metrics.commandsIssued, metrics.commandsDelivered, metrics.commandsFailed,
+        metrics.commandsDelivered ? (double)metrics.commandAttempts / (double)metrics.commandsDelivered : 0.0);
+    printf("  command latency ms: radio p50 %u, p99 %u, from the UI p50 %u, p99 %u, max %u\n",
+        percentile(metrics.commandLatency, 0.50), percentile(metrics.commandLatency, 0.99),
+        percentile(metrics.commandLatencyUI, 0.50), percentile(metrics.commandLatencyUI, 0.99),
+        percentile(metrics.commandLatencyUI, 1.0));
+    const CommandQueueStats& queue = hub.protocol.commandStats();
+    printf("  command queue: still open %lu, dropped %lu, deepest %zu, wait to go on air ms mean %.0f, max %u\n",
+        commandsOpen - queue.dropped, queue.dropped, queue.maxDepth,
+        queue.started ? (double)queue.totalWaitMs / (double)queue.started : 0.0, queue.maxWaitMs);
+    if (options.readdress > 0)
+    {
+        unsigned long atNew = 0;
+        for (size_t i = 0; i < moves.size(); i++)
+        {
+            size_t index = moves[i].second;
+            atNew += (hub.protocol.nodeState(index).nodeAddress == options.nodes + 1 + i) ? 1 : 0;
+        }
+        printf("  readdress: settings issued %lu, delivered %lu, failed %lu, nodes moved %lu, at the new address %lu of %zu\n",
+            metrics.settingsIssued, metrics.settingsDelivered, metrics.settingsFailed, metrics.nodesMoved, atNew, moves.size());
+        printf("  readdress latency ms: p50 %u, max %u\n",
+            percentile(metrics.moveLatency, 0.50), percentile(metrics.moveLatency, 1.0));
+    }
+    if (options.repeaters > 0)
+    {
+        RepeaterStats relayed = {};
+        for (unsigned int i = 0; i < options.repeaters; i++)
+        {
+            const RepeaterStats& repeater = nodes[i]->protocol->relayStats();
+            relayed.forwarded += repeater.forwarded;
+            relayed.suppressed += repeater.suppressed;
+            relayed.duplicates += repeater.duplicates;
+            relayed.noRoute += repeater.noRoute;
+            relayed.dropped += repeater.dropped;
+        }
+        printf("  repeaters: %u, up to %u hops, forwarded %lu, suppressed %lu, duplicates %lu, no route %lu, dropped %lu,"
+            " copies the hub dropped %lu\n", options.repeaters, options.relayHops, relayed.forwarded, relayed.suppressed,
+            relayed.duplicates, relayed.noRoute, relayed.dropped, hub.protocol.duplicateFrames());
+        unsigned long unheard = 0;
+        unsigned long byHops[RELAY_HOPS_MAX + 1] = {};
+        SimRelayAirtime airtime[RELAY_HOPS_MAX + 1] = {};
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            if (hub.protocol.nodeState(i).rxCount == 0)
+            {
+                unheard++;
+                continue;
+            }
+            uint8_t hops = hub.protocol.route(i).hops;
+            const SimRelayAirtime& node = metrics.relayAirtime[hub.protocol.nodeState(i).nodeAddress];
+            byHops[hops]++;
+            airtime[hops].once += node.once;
+            airtime[hops].all += node.all;
+        }
+        for (unsigned int hops = 0; hops <= options.relayHops; hops++)
+        {
+            printf("  %u hops: nodes %lu, alarms delivered %lu, latency ms p50 %u, p95 %u, airtime per frame sent once %.2f\n",
+                hops, byHops[hops], metrics.delivered[hops], percentile(metrics.hopLatency[hops], 0.50),
+                percentile(metrics.hopLatency[hops], 0.95),
+                airtime[hops].once ? (double)airtime[hops].all / (double)airtime[hops].once : 0.0);
+        }
+        printf("  nodes the hub never heard %lu\n", unheard);
+    }
+    if (options.lowPower)
+    {
+        printf("  nodes awake %.3f%% of the time\n", 100.0 * (double)awake / ((double)end * (double)nodes.size()));
+    }
+    if (options.hubWake)
+    {
+        printf("  hub radio task: wakes per second %.2f, runs of hub.loop() saved against a 1 ms tick %.1f%%\n",
+            (double)hubWakes * 1000.0 / (double)end, 100.0 - 100.0 * (double)hubWakes / (double)end);
+    }
+    if (options.superframe > 0)
+    {
+        // The drift a node measures is how fast its slow clock runs against the hub's
+        const SuperframePlan& plan = hubConfig.superframe;
+        const SuperframeStats& superframe = hub.protocol.superframeStats();
+        SlotClockStats clocks = {};
+        unsigned long slotted = 0;
+        unsigned long measured = 0;
+        double driftError = 0.0;
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            const SlotClock& clock = nodes[i]->retained.slots;
+            clocks.syncs += clock.stats().syncs;
+            clocks.misses += clock.stats().misses;
+            slotted += (hub.protocol.slot(i) != SUPERFRAME_NO_SLOT) ? 1 : 0;
+            if (clock.driftKnown())
+            {
+                measured++;
+                driftError += fabs((double)clock.drift() - (1.0 / nodes[i]->clockRate - 1.0) * 1e6);
+            }
+        }
+        printf("  superframe: %u ms, %u slots of %u ms, nodes with a slot %lu, beacons sent %lu, skipped %lu\n",
+            plan.period, plan.slots, plan.slotLength, slotted, superframe.beacons, superframe.beaconsSkipped);
+        printf("  check ins: in their slot %lu, outside it %lu, slot frames %lu, node syncs %lu, beacons missed %lu\n",
+            superframe.slotted, superframe.unslotted, superframe.slotFrames, clocks.syncs, clocks.misses);
+        printf("  node clocks: drift measured by %lu, mean error %.0f ppm\n", measured,
+            measured ? driftError / (double)measured : 0.0);
+    }
+    return 0;
+}
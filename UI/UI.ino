@@ -10,20 +10,54 @@
 *  Version        :  1.0  Integration Test
 *                 :  2025-04-25  A.1  alpha test
 *                 :  2025-04-26  1.0  made variable naming and function naming more consistent.  End to end testing complete
+*                 :  2026-10-17  1.1  shared LoRaPacket from the LoRaAlarm library.  Commands carry a sequence number
+*                 :                   and the settings screen shows when the node confirms them
+*                 :  2026-10-17  1.2  no more 500 ms polling of the hub.  The hub pushes changes and a heartbeat,
+*                 :                   the UI sends commands and its own heartbeat, both to the paired MAC once
+*                 :                   discovery is done.  The stats screen shows the ESP-NOW messages/s saved
+*                 :  2026-10-17  1.3  OnDataRecv no longer touches LVGL.  Messages are queued for loop(), which
+*                 :                   applies them once per frame.  espNowBusy is gone
+*                 :  2026-10-17  1.4  UpdateDisplay only touches widgets whose value changed.  render_trace
+*                 :                   prints widget updates, invalidated pixels and flush time every second
+*                 :  2026-10-17  1.5  Own TFT_eSPI flush with two DMA capable draw buffers, LVGL renders into one
+*                 :                   while the other is sent over SPI.  fps_overlay shows frame rate and time
+*                 :  2026-10-17  1.6  link history per node on the stats screen, an RSSI and SNR chart with
+*                 :                   min/mean/max and the share of frames the hub heard
+*                 :  2026-10-17  1.7  messages to and from the hub are AES-128 CCM sealed with consoleKey and
+*                 :                   a frame counter.  Anything that fails is dropped before it can pair
+*                 :  2026-10-17  1.8  loop() runs LVGL, the hub link, the saver and the stats as TimerWheel tasks
+*                 :                   and sleeps until the next one is due instead of a fixed delay(5)
+*                 :  2026-10-17  1.9  node settings panel, opened from the settings screen.  Each setting goes to the
+*                 :                   hub as a command and on to the node over LoRa.  After a new address is
+*                 :                   committed the UI follows the node to it
+*                 :  2026-10-17  1.10 link delivery, RSSI and SNR on rows of their own below the EEZ labels, the
+*                 :                   chart beside the Main button
+*                 :  2026-10-17  1.11 the node settings panel no longer offers the radio settings the hub cannot follow
 *
 */
 
 #include <esp_now.h>
 #include <WiFi.h>
+#include <Preferences.h>
 #include <lvgl.h>
 #include "ui.h"
 #include <TFT_eSPI.h>
 #include <XPT2046_Touchscreen.h>
 #include "actions.h"
+#include <AlarmTypes.h>
+#include <ConsoleLink.h>
+#include <NodeSettings.h>
+#include <FrameSecurity.h>
+#include <SpscQueue.h>
+#include <LinkHistory.h>
+#include <TimerWheel.h>
 //#include "D:/Projects/Arduino/libraries/lvgl/src/display/lv_display_private.h"
 
 // debug stuff
 //#define debug_print  // manages most of the print and println debug
+//#define render_trace  // prints the display work done each second
+//#define fps_overlay   // frames per second and frame time in the top corner of every screen
+//#define task_trace    // prints the runs, overruns and worst lateness of every loop() task each minute
 
 #if defined debug_print
 #define debug_begin(x)        Serial.begin(x)
@@ -36,6 +70,16 @@
 #endif
 
 #define BUFFER_SIZE 50 // Define the payload size here
+#define HUB_QUEUE_SIZE 16 // Messages from the hub waiting for loop(), a power of two
+#define TASK_WHEEL_SLOTS 64 // 1 ms each, a power of two
+#define TASK_POOL_SIZE 8 // Periodic tasks loop() can run
+
+// Link history on the stats screen.  HISTORY_POINTS chart points of HISTORY_PER_POINT samples each,
+// a sample is one frame the hub heard from the node or one poll it missed
+#define HISTORY_NODES 8
+#define HISTORY_POINTS 40
+#define HISTORY_PER_POINT 6
+#define HISTORY_CATCH_UP 8 // Most samples taken from one message, the rest were missed with the UI away
 
 // ----------------------------
 // Touch Screen pins
@@ -54,9 +98,20 @@
 #define TFT_BACKLIGHT_FREQUENCY 12000
 #define TFT_BACKLIGHT_RESOLUTION_BITS 8
 
-constexpr long watchdogInterval = 500;  // interval at which to send watchdog signal
+constexpr long heartbeatInterval = 10000;   // the hub is sent the selected node at least this often
+constexpr long commandRetryInterval = 1000; // an open command is repeated this often until the hub reports on it
+constexpr long hubTimeout = 15000;          // three hub heartbeats missed, the hub is gone
 constexpr long saverInterval = 120000; // interval to switch to saver screen
-uint32_t saverMillis = 0;
+constexpr uint32_t frameInterval = 5;       // LVGL runs and messages from the hub are applied this often
+constexpr uint32_t linkServiceInterval = 10; // commands and heartbeats are sent, and the hub timed out, this often
+constexpr uint32_t statsInterval = 1000;
+constexpr uint32_t taskReportInterval = 60000;
+
+/******************************************************************************************
+SET THE KEY BEFORE COMPILING.  The same consoleKey as the hub */
+const uint8_t consoleKey[FRAME_KEY_SIZE] = { 0xf0, 0xe1, 0xd2, 0xc3, 0xb4, 0xa5, 0x96, 0x87,
+                                             0x78, 0x69, 0x5a, 0x4b, 0x3c, 0x2d, 0x1e, 0x0f };
+/*******************************************************************************************/
 
 SPIClass touchscreenSpi = SPIClass(VSPI);
 XPT2046_Touchscreen touchscreen(XPT2046_CS, XPT2046_IRQ);
@@ -68,10 +123,14 @@ uint16_t touchScreenMinimumX = 200, touchScreenMaximumX = 3700, touchScreenMinim
 
 /* lvgl declarations*/
 lv_indev_t* indev;      //Touchscreen input device
-uint8_t* draw_buf;      //draw_buf is allocated on heap otherwise the static area is too big on ESP32 at compile
+TFT_eSPI tft = TFT_eSPI();
+uint8_t* draw_buf[2];   //draw_buf is allocated on heap otherwise the static area is too big on ESP32 at compile
 
-/*LVGL draw into this buffer, 1/10 screen size usually works well. The size is in bytes*/
-#define DRAW_BUF_SIZE (TFT_HOR_RES * TFT_VER_RES / 10 * (LV_COLOR_DEPTH / 8))
+/*LVGL draws into one buffer while DMA sends the other to the panel.  Each is 1/DRAW_BUF_DIVISOR of the
+screen, bigger means fewer, longer transfers.  DRAW_BUF_COUNT 1 renders and sends one after the other*/
+#define DRAW_BUF_DIVISOR 10
+#define DRAW_BUF_COUNT 2
+#define DRAW_BUF_SIZE (TFT_HOR_RES * TFT_VER_RES / DRAW_BUF_DIVISOR * (LV_COLOR_DEPTH / 8))
 
 /*
 #if LV_USE_LOG != 0
@@ -85,56 +144,133 @@ void my_print(lv_log_level_t level, const char *buf) {
 
 void initialiseEspNow(void);
 void initialiseGUI(void);
+void createConfigPanel(void);
+void openCommand(void);
+void showCommandState(const char* text);
 void OnDataSent(const uint8_t* mac_addr, esp_now_send_status_t status);
 void OnDataRecv(const uint8_t* mac, const uint8_t* incomingData, int len);
 void UpdateDisplay(void);
+void drainHubQueue(uint32_t currentMillis);
+void runFrame(void* context, uint32_t now);
+void serviceHubLink(void* context, uint32_t now);
+void saverTimeout(void* context, uint32_t now);
+#ifdef task_trace
+void reportTasks(void* context, uint32_t now);
+#endif
+void recordLinkSample(const LoRaPacket& packet);
+void updateLinkChart(void);
+#if defined render_trace || defined fps_overlay
+void renderEvent(lv_event_t* e);
+void reportRenderStats(void* context, uint32_t currentMillis);
+#endif
 void my_disp_flush(lv_display_t* disp, const lv_area_t* area, uint8_t* px_map);
+void my_disp_flush_wait(lv_display_t* disp);
 void my_touchpad_read(lv_indev_t* indev, lv_indev_data_t* data);
 void turn_backlight_off(void);
 void turn_backlight_on(void);
 
 lv_display_t* disp;
 
-typedef enum
-{
-    IDLE,
-    CLEAR,
-    SET,
-    TEST
-} DeviceStates_t;
-
-typedef enum
-{
-    INACTIVE,
-    ACTIVE
-} RelayStates_t;
+LoRaPacket txBuffer;
+LoRaPacket selectedState;
+LoRaPacket incomingPacket;
 
 typedef struct
 {
-    unsigned short nodeAddress;
-    DeviceStates_t alarmState;
-    RelayStates_t relay1Enabled;
-    RelayStates_t relay2Enabled;
-    unsigned long rxTimeoutCount;
-    int16_t signalStrength;
-} LoRaPacket;
+    uint8_t data[CONSOLE_LINK_MESSAGE_SIZE];    // Still sealed, loop() checks it
+    uint8_t mac[CONSOLE_LINK_MAC_SIZE];
+} HubMessage;
 
-LoRaPacket txBuffer;
-LoRaPacket selectedState;
-LoRaPacket incomingPacket;
+// LVGL is not thread safe.  OnDataRecv runs in the Wi-Fi task and only queues, loop() owns the display
+SpscQueue<HubMessage, HUB_QUEUE_SIZE> hubQueue;
 
-// REPLACE WITH THE MAC Address of your receiver 
+// Discovery goes to everyone, once a hub answers the UI only talks to that hub
 uint8_t broadcastAddress[] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
 esp_now_peer_info_t peerInfo;
-bool espNowBusy = false;
+ConsoleLink hubLink;
+TimerWheel<TASK_WHEEL_SLOTS, TASK_POOL_SIZE> tasks;
+int saverTask = -1;
+Preferences counterStore;   // hubLink's frame counters, so a reboot neither reuses one nor accepts an old message
 unsigned short selectedNode = 1;    // Hard code 1 for now but we may want to increase the node count in the future
 bool saverActive = false; // Used to track if the saver screen is active
 ScreensEnum screenID = SCREEN_ID_MAIN;
 
+// Command tracking, the hub reports progress against commandSequence in every reply
+uint8_t commandSequence = 0;
+uint32_t commandIssuedMillis = 0;
+bool commandOpen = false;       // Waiting for the hub to report delivered or failed
+bool sendNow = false;           // Send the new command without waiting for the retry tick
+lv_obj_t* lblCommandState;      // Added to the settings screen at run time, it is not in the EEZ project
+unsigned short movingTo = 0;    // Address a node is being moved to, followed once the hub reports it there
+
+// Node settings panel, over the settings screen and also added at run time
+lv_obj_t* panelConfig;
+lv_obj_t* ddConfigKey;
+lv_obj_t* taConfigValue;
+lv_obj_t* lblConfigState;
+// No frequency, bandwidth, coding rate or spreading factor, the hub's are compiled in and a node
+// on others would not be heard again
+const uint8_t configKeys[] = { CONFIG_ADDRESS, CONFIG_TX_POWER, CONFIG_CHECK_IN_INTERVAL, CONFIG_SCAN_INTERVAL,
+    CONFIG_ACK_TIMEOUT, CONFIG_RX_WINDOW, CONFIG_RELAY_PIN_1, CONFIG_RELAY_PIN_2, CONFIG_INPUT_PIN, CONFIG_DEFAULTS };
+lv_obj_t* lblMessageRate;       // Added to the stats screen at run time
+lv_obj_t* lblMessagesSaved;
+#ifdef fps_overlay
+lv_obj_t* lblFps;               // On the top layer so it shows over every screen and the fades
+#endif
+lv_obj_t* lblDelivery;          // Link history of the selected node, on the stats screen
+lv_obj_t* lblLinkRssi;
+lv_obj_t* lblLinkSnr;
+lv_obj_t* chartLink;
+lv_chart_series_t* seriesRssi;
+lv_chart_series_t* seriesSnr;
+
+// The hub reports running totals, a node's history turns their increments into samples
+typedef struct
+{
+    unsigned short address;
+    unsigned long rxCount;
+    unsigned long rxTimeoutCount;
+    LinkHistory<HISTORY_POINTS, HISTORY_PER_POINT> link;
+} NodeHistory;
+NodeHistory histories[HISTORY_NODES];
+uint8_t historyCount = 0;
+bool chartDirty = false;        // The selected node's history has new samples
+
+// Last value drawn into each widget UpdateDisplay owns, see showLed() and friends
+typedef struct
+{
+    bool drawn;                     // False until the first UpdateDisplay, everything is drawn then
+    uint32_t watchdogColor;
+    uint32_t stateColor;
+    RelayStates_t relay1;
+    RelayStates_t relay2;
+    long nodeAddress;
+    long nodeAddress1;
+    long rxTimeoutCount;
+    long signalStrength;
+    long triggers;
+    CommandStates_t commandState;   // Reset when a command is issued
+} DisplayView;
+DisplayView view = {};
+
+// Per second display work, printed with render_trace
+typedef struct
+{
+    unsigned long updates;          // Widgets UpdateDisplay changed
+    unsigned long skipped;          // and left alone because nothing changed
+    unsigned long invalidatedPixels;
+    unsigned long flushes;
+    unsigned long flushMicros;      // Starting each transfer
+    unsigned long waitMicros;       // LVGL waiting for the previous transfer to finish
+    unsigned long frames;           // Refreshes that drew something
+    unsigned long frameMicros;
+} RenderStats;
+RenderStats renderStats = {};
+
 void processScreenRequest()
 {
     saverActive = false; // Reset saver active state
-    saverMillis = millis(); // Reset saver timer
+    tasks.reschedule(saverTask, millis(), saverInterval); // Reset saver timer
     loadScreen(screenID);
 }
 
@@ -227,7 +363,79 @@ extern "C" void action_send_states(lv_event_t* e)
     selectedState.nodeAddress = selectedNode;
     selectedState.relay1Enabled = txBuffer.relay1Enabled;
     selectedState.relay2Enabled = txBuffer.relay2Enabled;
-	selectedState.alarmState = txBuffer.alarmState;
+    selectedState.alarmState = txBuffer.alarmState;
+    selectedState.configKey = CONFIG_NONE;
+    openCommand();
+}
+
+// Number the command, it is repeated every retry tick until the hub reports the outcome
+void openCommand(void)
+{
+    commandSequence++;
+    if (commandSequence == 0)
+    {
+        commandSequence = 1;    // 0 means no command
+    }
+    selectedState.commandSequence = commandSequence;
+    commandIssuedMillis = millis();
+    commandOpen = true;
+    sendNow = true;
+    showCommandState("Sending");
+    view.commandState = COMMAND_IN_FLIGHT;
+}
+
+void showCommandState(const char* text)
+{
+    lv_label_set_text(lblCommandState, text);
+    lv_label_set_text(lblConfigState, text);
+}
+
+// One setting for the selected node, the hub sends it on as it would a command.  The relay and
+// test state already sent stays as it is
+void sendSetting(uint8_t key, uint32_t value)
+{
+    if (commandOpen)
+    {
+        lv_label_set_text(lblConfigState, "Busy, wait for the last one");
+        return;
+    }
+    selectedState.nodeAddress = selectedNode;
+    selectedState.configKey = key;
+    selectedState.configValue = value;
+    movingTo = (key == CONFIG_ADDRESS) ? (unsigned short)value : movingTo;
+    openCommand();
+}
+
+void configEvent(lv_event_t* e)
+{
+    intptr_t action = (intptr_t)lv_event_get_user_data(e);
+
+    if (action == CONFIG_NONE)
+    {
+        lv_obj_add_flag(panelConfig, LV_OBJ_FLAG_HIDDEN);
+    }
+    else if (action == CONFIG_COMMIT)
+    {
+        sendSetting(CONFIG_COMMIT, 0);
+    }
+    else
+    {
+        // An input pin is entered as input.gpio
+        uint8_t key = configKeys[lv_dropdown_get_selected(ddConfigKey)];
+        const char* text = lv_textarea_get_text(taConfigValue);
+        const char* dot = strchr(text, '.');
+        uint32_t value = (uint32_t)atol(text);
+        if (key == CONFIG_INPUT_PIN && dot != NULL)
+        {
+            value = ((uint32_t)atoi(text) << 8) | (uint32_t)atoi(dot + 1);
+        }
+        sendSetting(key, value);
+    }
+}
+
+void showConfigPanel(lv_event_t* e)
+{
+    lv_obj_remove_flag(panelConfig, LV_OBJ_FLAG_HIDDEN);
 }
 
 extern "C" void action_show_backlight(lv_event_t* e)
@@ -247,9 +455,17 @@ void loadScreenSaver()
 void sendData()
 {
     debugln("sendData");
-    espNowBusy = true;
 
-    esp_err_t result = esp_now_send(broadcastAddress, (uint8_t*)&selectedState, sizeof(selectedState));
+    uint8_t sealed[CONSOLE_LINK_MESSAGE_SIZE];
+    bool store;
+    selectedState.nodeAddress = selectedNode;
+    size_t len = hubLink.seal(selectedState, sealed, store);
+    if (store)
+    {
+        counterStore.putBytes("hub", &hubLink.counters(), sizeof(FrameCounters));
+    }
+    esp_err_t result = esp_now_send(hubLink.paired() ? hubLink.peer() : broadcastAddress, sealed, len);
+    hubLink.onSent(millis());
     if (result == ESP_OK)
     {
         debug("sendData() Transmitting: ");
@@ -276,37 +492,93 @@ void setup()
     ledcAttachChannel(TFT_BACK_LIGHT_PIN, TFT_BACKLIGHT_FREQUENCY, TFT_BACKLIGHT_RESOLUTION_BITS, TFT_BACKLIGHT_CHANNEL);
     initialiseEspNow();
     initialiseGUI();
+
+    uint32_t now = millis();
+    tasks.begin(now);
+    tasks.every(frameInterval, runFrame);
+    tasks.every(linkServiceInterval, serviceHubLink);
+    saverTask = tasks.every(saverInterval, saverTimeout, NULL, saverInterval);
+#if defined render_trace || defined fps_overlay
+    tasks.every(statsInterval, reportRenderStats, NULL, statsInterval);
+#endif
+#ifdef task_trace
+    tasks.every(taskReportInterval, reportTasks, NULL, taskReportInterval);
+#endif
 }
 
 void loop()
+{
+    tasks.run(millis());
+    delay(tasks.idle(millis()));    // Sleep until the next task is due, the Wi-Fi task gets the CPU
+}
+
+// Apply what the hub sent and let LVGL read the touchscreen and redraw
+void runFrame(void* context, uint32_t now)
 {
     static uint32_t lastTick = 0;  //Used to track the tick timer
-    static uint32_t previousMillis = 0;
-    uint32_t currentMillis = millis();
 
-    if (currentMillis - previousMillis >= watchdogInterval)
+    drainHubQueue(now);
+    if (chartDirty)
     {
-        // Disable the display updates until ESP Now has completed a round trip
-        // LVGL is not thread safe
-        previousMillis = currentMillis;
+        chartDirty = false;
+        updateLinkChart();
+    }
+    lv_tick_inc(now - lastTick);  //Update the tick timer. Tick is new for LVGL 9
+    lastTick = now;
+    lv_timer_handler();  //Update the UI
+}
+
+// Send commands, their retries and the heartbeat, go back to discovery if the hub goes quiet
+void serviceHubLink(void* context, uint32_t now)
+{
+    char tempBuffer[BUFFER_SIZE];
+
+    if (hubLink.lost(now))
+    {
+        // Back to discovery
+        debugln("Hub lost");
+        esp_now_del_peer(hubLink.peer());
+        lv_led_set_color(objects.led_watchdog, lv_color_hex(0xffff0000));
+    }
+
+    if (sendNow || (commandOpen && hubLink.sinceSent(now) >= commandRetryInterval)
+        || hubLink.heartbeatDue(now))
+    {
+        sendNow = false;
         sendData();
     }
 
-    if(currentMillis - saverMillis >= saverInterval)
+    float rate, saved;
+    if (hubLink.rateUpdate(now, rate, saved))
     {
-        saverMillis = currentMillis;
-        loadScreenSaver(); // Load the saver screen after 60 seconds of inactivity
-	}
+        sprintf(tempBuffer, "%.2f", rate);
+        lv_label_set_text(lblMessageRate, tempBuffer);
+        sprintf(tempBuffer, "%.2f", saved);
+        lv_label_set_text(lblMessagesSaved, tempBuffer);
+    }
+}
 
-    lv_tick_inc(millis() - lastTick);  //Update the tick timer. Tick is new for LVGL 9
+// Runs every saverInterval, put back a full interval by every screen request
+void saverTimeout(void* context, uint32_t now)
+{
+    loadScreenSaver(); // Load the saver screen after 120 seconds of inactivity
+}
 
-    if (!espNowBusy)
+#ifdef task_trace
+void reportTasks(void* context, uint32_t now)
+{
+    for (int id = 0; id < TASK_POOL_SIZE; id++)
     {
-        lastTick = millis();
-        lv_timer_handler();  //Update the UI
+        const TimerTask& task = tasks.task(id);
+        if (task.fn != NULL)
+        {
+            Serial.printf("Task %d every %lu ms: %lu runs, %lu overruns, %lu ms late at worst\r\n",
+                id, task.interval, task.runs, task.overruns, task.maxLate);
+        }
     }
-    delay(5);
+    tasks.resetStats();
 }
+#endif
 
 void initialiseEspNow()
 {
@@ -324,10 +596,17 @@ void initialiseEspNow()
     // get the status of Transmitted packet
     esp_now_register_send_cb(OnDataSent);
 
-    // Register peer
+    // Register the broadcast peer for discovery, the hub is added when it answers
     memcpy(peerInfo.peer_addr, broadcastAddress, 6);
     peerInfo.channel = 0;
     peerInfo.encrypt = false;
+    hubLink.begin(heartbeatInterval, hubTimeout);
+    hubLink.setKey(consoleKey, FRAME_UI_TO_HUB, FRAME_HUB_TO_UI);
+    counterStore.begin("counters", false);
+    if (counterStore.getBytes("hub", &hubLink.counters(), sizeof(FrameCounters)) == sizeof(FrameCounters))
+    {
+        frameCountersRestore(hubLink.counters());
+    }
 
     // Add peer        
     if (esp_now_add_peer(&peerInfo) != ESP_OK) {
@@ -349,10 +628,25 @@ void initialiseGUI()
     //Initialise LVGL GUI
     lv_init();
 
-    draw_buf = new uint8_t[DRAW_BUF_SIZE];
-    //lv_display_t *disp;
-    disp = lv_tft_espi_create(TFT_HOR_RES, TFT_VER_RES, draw_buf, DRAW_BUF_SIZE);
+    // The SPI bus is the display's alone, the touchscreen has its own, so it is held for good
+    tft.begin();
+    tft.setSwapBytes(true);
+    tft.initDMA();
+    tft.startWrite();
+
+    for (int i = 0; i < DRAW_BUF_COUNT; i++)
+    {
+        draw_buf[i] = (uint8_t*)heap_caps_malloc(DRAW_BUF_SIZE, MALLOC_CAP_DMA);
+    }
+    disp = lv_display_create(TFT_HOR_RES, TFT_VER_RES);
+    lv_display_set_flush_cb(disp, my_disp_flush);
+    lv_display_set_flush_wait_cb(disp, my_disp_flush_wait);
+    lv_display_set_buffers(disp, draw_buf[0], DRAW_BUF_COUNT > 1 ? draw_buf[1] : NULL, DRAW_BUF_SIZE, LV_DISPLAY_RENDER_MODE_PARTIAL);
     lv_display_set_rotation(disp, LV_DISPLAY_ROTATION_90);
+    tft.setRotation((uint8_t)lv_display_get_rotation(disp));
+#if defined render_trace || defined fps_overlay
+    lv_display_add_event_cb(disp, renderEvent, LV_EVENT_ALL, NULL);
+#endif
 
     //Initialise the XPT2046 input device driver
     indev = lv_indev_create();
@@ -362,9 +656,147 @@ void initialiseGUI()
     //Integrate EEZ Studio GUI
     ui_init();
 
+    lblCommandState = lv_label_create(objects.settings);
+    lv_obj_set_pos(lblCommandState, 110, 190);
+    lv_label_set_text(lblCommandState, "");
+    createConfigPanel();
+
+    lv_obj_t* label = lv_label_create(objects.stats);
+    lv_obj_set_pos(label, 10, 75);
+    lv_label_set_text(label, "ESP-NOW msg/s");
+    lblMessageRate = lv_label_create(objects.stats);
+    lv_obj_set_pos(lblMessageRate, 196, 75);
+    lv_obj_set_size(lblMessageRate, 116, LV_SIZE_CONTENT);
+    lv_obj_set_style_text_color(lblMessageRate, lv_color_hex(0xff00ff00), LV_PART_MAIN | LV_STATE_DEFAULT);
+    lv_obj_set_style_text_align(lblMessageRate, LV_TEXT_ALIGN_RIGHT, LV_PART_MAIN | LV_STATE_DEFAULT);
+    lv_label_set_text(lblMessageRate, "-");
+    label = lv_label_create(objects.stats);
+    lv_obj_set_pos(label, 10, 95);
+    lv_label_set_text(label, "Saved msg/s");
+    lblMessagesSaved = lv_label_create(objects.stats);
+    lv_obj_set_pos(lblMessagesSaved, 196, 95);
+    lv_obj_set_size(lblMessagesSaved, 116, LV_SIZE_CONTENT);
+    lv_obj_set_style_text_color(lblMessagesSaved, lv_color_hex(0xff00ff00), LV_PART_MAIN | LV_STATE_DEFAULT);
+    lv_obj_set_style_text_align(lblMessagesSaved, LV_TEXT_ALIGN_RIGHT, LV_PART_MAIN | LV_STATE_DEFAULT);
+    lv_label_set_text(lblMessagesSaved, "-");
+
+    // Rows under the EEZ ones, which end at 55
+    label = lv_label_create(objects.stats);
+    lv_obj_set_pos(label, 10, 115);
+    lv_label_set_text(label, "Delivery %");
+    lblDelivery = lv_label_create(objects.stats);
+    lv_obj_set_pos(lblDelivery, 196, 115);
+    lv_obj_set_size(lblDelivery, 116, LV_SIZE_CONTENT);
+    lv_obj_set_style_text_color(lblDelivery, lv_color_hex(0xff00ff00), LV_PART_MAIN | LV_STATE_DEFAULT);
+    lv_obj_set_style_text_align(lblDelivery, LV_TEXT_ALIGN_RIGHT, LV_PART_MAIN | LV_STATE_DEFAULT);
+    lv_label_set_text(lblDelivery, "-");
+    label = lv_label_create(objects.stats);
+    lv_obj_set_pos(label, 10, 135);
+    lv_label_set_text(label, "RSSI min/mean/max");
+    lblLinkRssi = lv_label_create(objects.stats);
+    lv_obj_set_pos(lblLinkRssi, 196, 135);
+    lv_obj_set_size(lblLinkRssi, 116, LV_SIZE_CONTENT);
+    lv_obj_set_style_text_color(lblLinkRssi, lv_color_hex(0xff00ff00), LV_PART_MAIN | LV_STATE_DEFAULT);
+    lv_obj_set_style_text_align(lblLinkRssi, LV_TEXT_ALIGN_RIGHT, LV_PART_MAIN | LV_STATE_DEFAULT);
+    lv_label_set_text(lblLinkRssi, "-");
+    label = lv_label_create(objects.stats);
+    lv_obj_set_pos(label, 10, 155);
+    lv_label_set_text(label, "SNR min/mean/max");
+    lblLinkSnr = lv_label_create(objects.stats);
+    lv_obj_set_pos(lblLinkSnr, 196, 155);
+    lv_obj_set_size(lblLinkSnr, 116, LV_SIZE_CONTENT);
+    lv_obj_set_style_text_color(lblLinkSnr, lv_color_hex(0xffffff00), LV_PART_MAIN | LV_STATE_DEFAULT);
+    lv_obj_set_style_text_align(lblLinkSnr, LV_TEXT_ALIGN_RIGHT, LV_PART_MAIN | LV_STATE_DEFAULT);
+    lv_label_set_text(lblLinkSnr, "-");
+
+    // RSSI on the left axis, SNR on the right, newest point on the right.  Left of the Main button,
+    // which starts at 212,180
+    chartLink = lv_chart_create(objects.stats);
+    lv_obj_set_pos(chartLink, 10, 176);
+    lv_obj_set_size(chartLink, 190, 58);
+    lv_chart_set_type(chartLink, LV_CHART_TYPE_LINE);
+    lv_chart_set_point_count(chartLink, HISTORY_POINTS);
+    lv_chart_set_div_line_count(chartLink, 3, 0);
+    lv_chart_set_range(chartLink, LV_CHART_AXIS_PRIMARY_Y, -130, -30);
+    lv_chart_set_range(chartLink, LV_CHART_AXIS_SECONDARY_Y, -20, 15);
+    lv_obj_set_style_size(chartLink, 0, 0, LV_PART_INDICATOR);
+    seriesRssi = lv_chart_add_series(chartLink, lv_color_hex(0xff00ff00), LV_CHART_AXIS_PRIMARY_Y);
+    seriesSnr = lv_chart_add_series(chartLink, lv_color_hex(0xffffff00), LV_CHART_AXIS_SECONDARY_Y);
+    lv_chart_set_all_value(chartLink, seriesRssi, LV_CHART_POINT_NONE);
+    lv_chart_set_all_value(chartLink, seriesSnr, LV_CHART_POINT_NONE);
+
+#ifdef fps_overlay
+    lblFps = lv_label_create(lv_layer_top());
+    lv_obj_align(lblFps, LV_ALIGN_TOP_RIGHT, -4, 2);
+    lv_obj_set_style_text_color(lblFps, lv_color_hex(0xffffff00), LV_PART_MAIN | LV_STATE_DEFAULT);
+    lv_label_set_text(lblFps, "");
+#endif
+
     debugln("LVGL setup done");
 }
 
+// Node settings, a button on the settings screen opens a panel over it
+void createConfigPanel(void)
+{
+    lv_obj_t* button = lv_button_create(objects.settings);
+    lv_obj_set_pos(button, 270, 12);
+    lv_obj_set_size(button, 44, 30);
+    lv_obj_add_event_cb(button, showConfigPanel, LV_EVENT_CLICKED, NULL);
+    lv_obj_t* label = lv_label_create(button);
+    lv_label_set_text(label, "Cfg");
+    lv_obj_center(label);
+
+    panelConfig = lv_obj_create(objects.settings);
+    lv_obj_set_pos(panelConfig, 0, 0);
+    lv_obj_set_size(panelConfig, 320, 240);
+    lv_obj_set_style_pad_all(panelConfig, 0, LV_PART_MAIN);
+    lv_obj_remove_flag(panelConfig, LV_OBJ_FLAG_SCROLLABLE);
+    lv_obj_add_flag(panelConfig, LV_OBJ_FLAG_HIDDEN);
+
+    char options[256] = "";
+    for (size_t i = 0; i < sizeof(configKeys); i++)
+    {
+        strcat(options, nodeConfigKeyName(configKeys[i]));
+        strcat(options, (i + 1 < sizeof(configKeys)) ? "\n" : "");
+    }
+    ddConfigKey = lv_dropdown_create(panelConfig);
+    lv_obj_set_pos(ddConfigKey, 6, 6);
+    lv_obj_set_size(ddConfigKey, 160, 36);
+    lv_dropdown_set_options(ddConfigKey, options);
+
+    taConfigValue = lv_textarea_create(panelConfig);
+    lv_obj_set_pos(taConfigValue, 172, 6);
+    lv_obj_set_size(taConfigValue, 142, 36);
+    lv_textarea_set_one_line(taConfigValue, true);
+    lv_textarea_set_accepted_chars(taConfigValue, "0123456789-.");
+    lv_textarea_set_placeholder_text(taConfigValue, "value");
+
+    const struct { const char* text; intptr_t action; int16_t x; } buttons[] =
+    {
+        { "Set", CONFIG_KEY_COUNT, 6 }, { "Commit", CONFIG_COMMIT, 110 }, { "Close", CONFIG_NONE, 214 }
+    };
+    for (const auto& b : buttons)
+    {
+        button = lv_button_create(panelConfig);
+        lv_obj_set_pos(button, b.x, 48);
+        lv_obj_set_size(button, 100, 32);
+        lv_obj_add_event_cb(button, configEvent, LV_EVENT_CLICKED, (void*)b.action);
+        label = lv_label_create(button);
+        lv_label_set_text(label, b.text);
+        lv_obj_center(label);
+    }
+
+    lblConfigState = lv_label_create(panelConfig);
+    lv_obj_set_pos(lblConfigState, 6, 86);
+    lv_label_set_text(lblConfigState, "Settings apply after Commit");
+
+    lv_obj_t* keyboard = lv_keyboard_create(panelConfig);
+    lv_obj_set_size(keyboard, 320, 130);
+    lv_obj_align(keyboard, LV_ALIGN_BOTTOM_MID, 0, 0);
+    lv_keyboard_set_mode(keyboard, LV_KEYBOARD_MODE_NUMBER);
+    lv_keyboard_set_textarea(keyboard, taConfigValue);
+}
+
 // Callback when data is sent
 void OnDataSent(const uint8_t* mac_addr, esp_now_send_status_t status)
 {
@@ -372,22 +804,209 @@ void OnDataSent(const uint8_t* mac_addr, esp_now_send_status_t status)
     debugln(status == ESP_NOW_SEND_SUCCESS ? "Delivery Success" : "Delivery Fail");
 }
 
-// Callback when data is received
+// Callback when data is received.  Runs in the Wi-Fi task, so queue it for loop() and nothing else
 void OnDataRecv(const uint8_t* mac, const uint8_t* incomingData, int len)
 {
-    memcpy(&incomingPacket, incomingData, sizeof(incomingPacket));
+    HubMessage message;
+
+    if (len != CONSOLE_LINK_MESSAGE_SIZE)
+    {
+        return;
+    }
+    memcpy(message.data, incomingData, sizeof(message.data));
+    memcpy(message.mac, mac, sizeof(message.mac));
+    hubQueue.push(message);
+}
+
+// Apply everything the hub sent since the last frame.  Only the newest state is drawn, except
+// that an alarm state change is never coalesced away so SET always brings up the main screen
+void drainHubQueue(uint32_t currentMillis)
+{
+    static uint32_t dropped = 0;
+    HubMessage message;
+    LoRaPacket packet;
+    bool pending = false;
+    bool store = false;
+
+    while (hubQueue.pop(message))
+    {
+        bool accepted;
+        AlarmFrameResult_t result = hubLink.open(message.data, sizeof(message.data), packet, accepted);
+        if (result != FRAME_OK)
+        {
+            debug("Hub message rejected: ");
+            debugln(alarmFrameResultString(result));
+            continue;
+        }
+        store |= accepted;
+        if (hubLink.heard(message.mac, currentMillis))
+        {
+            // Talk to this hub only from now on
+            debugln("Hub paired");
+            memcpy(peerInfo.peer_addr, message.mac, sizeof(message.mac));
+            if (!esp_now_is_peer_exist(message.mac))
+            {
+                esp_now_add_peer(&peerInfo);
+            }
+        }
+        if (pending && packet.alarmState != incomingPacket.alarmState)
+        {
+            UpdateDisplay();
+        }
+        incomingPacket = packet;
+        pending = true;
+        recordLinkSample(packet);
+
+        debug("onDataRecv: ");
+        debug("Node address: ");
+        debug(incomingPacket.nodeAddress);
+        debug(", Alarm state: ");
+        debug(incomingPacket.alarmState);
+        debug(", Relay 1 enabled: ");
+        debug(incomingPacket.relay1Enabled);
+        debug(", Relay 2 enabled: ");
+        debugln(incomingPacket.relay2Enabled);
+    }
+    if (store)
+    {
+        counterStore.putBytes("hub", &hubLink.counters(), sizeof(FrameCounters));
+    }
+    if (pending)
+    {
+        UpdateDisplay();
+    }
+    if (hubQueue.dropped() != dropped)
+    {
+        dropped = hubQueue.dropped();
+        debug("Hub queue full, dropped: ");
+        debugln(dropped);
+    }
+}
+
+// Every message from the hub carries its running totals for the node.  Each frame heard since the
+// last message becomes a sample with the latest RSSI and SNR, each poll missed a sample without
+void recordLinkSample(const LoRaPacket& packet)
+{
+    NodeHistory* history = NULL;
+    for (uint8_t i = 0; i < historyCount; i++)
+    {
+        if (histories[i].address == packet.nodeAddress)
+        {
+            history = &histories[i];
+            break;
+        }
+    }
+    if (history == NULL)
+    {
+        if (historyCount == HISTORY_NODES)
+        {
+            return;
+        }
+        history = &histories[historyCount++];
+        history->address = packet.nodeAddress;
+        history->link.clear();
+        history->rxCount = ULONG_MAX;   // Counts as a restart, so the latest frame is sampled
+    }
+    if (packet.rxCount < history->rxCount || packet.rxTimeoutCount < history->rxTimeoutCount)
+    {
+        // First message or the hub restarted, only the frame this message reports is new
+        history->rxCount = (packet.rxCount > 0) ? packet.rxCount - 1 : 0;
+        history->rxTimeoutCount = packet.rxTimeoutCount;
+    }
 
-    debug("onDataRecv: ");
-    debug("Node address: ");
-    debug(incomingPacket.nodeAddress);
-    debug(", Alarm state: ");
-    debug(incomingPacket.alarmState);
-    debug(", Relay 1 enabled: ");
-    debug(incomingPacket.relay1Enabled);
-    debug(", Relay 2 enabled: ");
-    debugln(incomingPacket.relay2Enabled);
+    unsigned long heard = packet.rxCount - history->rxCount;
+    unsigned long missed = packet.rxTimeoutCount - history->rxTimeoutCount;
+    history->rxCount = packet.rxCount;
+    history->rxTimeoutCount = packet.rxTimeoutCount;
+    for (unsigned long i = 0; i < missed && i < HISTORY_CATCH_UP; i++)
+    {
+        history->link.addMissed();
+    }
+    for (unsigned long i = 0; i < heard && i < HISTORY_CATCH_UP; i++)
+    {
+        history->link.addHeard(packet.signalStrength, packet.snr);
+    }
+    chartDirty |= (heard > 0 || missed > 0) && packet.nodeAddress == selectedNode;
+}
 
-    UpdateDisplay();
+// Redraws the chart and summary of the selected node.  Always HISTORY_POINTS points however
+// long the history is
+void updateLinkChart(void)
+{
+    char tempBuffer[BUFFER_SIZE];
+    const NodeHistory* history = NULL;
+    for (uint8_t i = 0; i < historyCount; i++)
+    {
+        if (histories[i].address == selectedNode)
+        {
+            history = &histories[i];
+        }
+    }
+    if (history == NULL)
+    {
+        return;
+    }
+
+    uint16_t points = history->link.points();
+    uint16_t first = HISTORY_POINTS - points;
+    for (uint16_t i = 0; i < HISTORY_POINTS; i++)
+    {
+        int16_t rssi;
+        int8_t snr;
+        bool heard = i >= first && history->link.point(i - first, rssi, snr);
+        lv_chart_set_value_by_id(chartLink, seriesRssi, i, heard ? rssi : LV_CHART_POINT_NONE);
+        lv_chart_set_value_by_id(chartLink, seriesSnr, i, heard ? snr : LV_CHART_POINT_NONE);
+    }
+    lv_chart_refresh(chartLink);
+
+    LinkSummary summary = history->link.summary();
+    sprintf(tempBuffer, "%u", summary.deliveryPercent);
+    lv_label_set_text(lblDelivery, tempBuffer);
+    sprintf(tempBuffer, "%d/%d/%d", summary.rssiMin, summary.rssiMean, summary.rssiMax);
+    lv_label_set_text(lblLinkRssi, tempBuffer);
+    sprintf(tempBuffer, "%d/%d/%d", summary.snrMin, summary.snrMean, summary.snrMax);
+    lv_label_set_text(lblLinkSnr, tempBuffer);
+}
+
+// Widgets are only touched, and so only invalidated and redrawn, when their value changes
+static void showLed(lv_obj_t* led, uint32_t color, uint32_t& shown)
+{
+    if (view.drawn && color == shown)
+    {
+        renderStats.skipped++;
+        return;
+    }
+    shown = color;
+    renderStats.updates++;
+    lv_led_set_color(led, lv_color_hex(color));
+}
+
+static void showRelay(lv_obj_t* led, lv_obj_t* label, RelayStates_t state, RelayStates_t& shown)
+{
+    if (view.drawn && state == shown)
+    {
+        renderStats.skipped += 2;
+        return;
+    }
+    shown = state;
+    renderStats.updates += 2;
+    lv_led_set_color(led, lv_color_hex(state == ACTIVE ? 0xff00ff00 : 0xffff0000));
+    lv_label_set_text(label, state == ACTIVE ? "Enabled" : "Disabled");
+}
+
+static void showNumber(lv_obj_t* label, long value, long& shown)
+{
+    char tempBuffer[BUFFER_SIZE];
+
+    if (view.drawn && value == shown)
+    {
+        renderStats.skipped++;
+        return;
+    }
+    shown = value;
+    renderStats.updates++;
+    sprintf(tempBuffer, "%ld", value);
+    lv_label_set_text(label, tempBuffer);
 }
 
 void UpdateDisplay()
@@ -398,17 +1017,11 @@ void UpdateDisplay()
 	static uint32_t triggers = 0;   
     static bool ledOn = true;
     char tempBuffer[BUFFER_SIZE];
+    uint32_t stateColor;
 
-    if (ledOn)
-    {
-        lv_led_set_color(objects.led_watchdog, lv_color_hex(0xff00ff00));
-        ledOn = false;
-    }
-    else
-    {
-        lv_led_set_color(objects.led_watchdog, lv_color_hex(0xff000000));
-        ledOn = true;
-    }
+    // Blinks on every message from the hub
+    showLed(objects.led_watchdog, ledOn ? 0xff00ff00 : 0xff000000, view.watchdogColor);
+    ledOn = !ledOn;
 
     switch (incomingPacket.alarmState)
     {
@@ -423,11 +1036,11 @@ void UpdateDisplay()
             debug("Alarm triggered: ");
             debugln(triggers);
 		}
-        lv_led_set_color(objects.led_state, lv_color_hex(0xffff0000));
+        stateColor = 0xffff0000;
         break;
     case CLEAR:
     case IDLE:
-        lv_led_set_color(objects.led_state, lv_color_hex(0xff00ff00));
+        stateColor = 0xff00ff00;
         if (alarmTriggered)
         {
             debug("Alarm cleared: ");
@@ -436,50 +1049,160 @@ void UpdateDisplay()
 		}
         break;
     default:
-        lv_led_set_color(objects.led_state, lv_color_hex(0xff0000ff));
+        stateColor = 0xff0000ff;
         break;
     }
+    showLed(objects.led_state, stateColor, view.stateColor);
+
+    showRelay(objects.relay1_state_led, objects.relay1_state, incomingPacket.relay1Enabled, view.relay1);
+    showRelay(objects.relay2_state_led, objects.relay2_state, incomingPacket.relay2Enabled, view.relay2);
 
-    switch (incomingPacket.relay1Enabled)
+    showNumber(objects.lbl_node_id, incomingPacket.nodeAddress, view.nodeAddress);
+    showNumber(objects.lbl_node_id_1, incomingPacket.nodeAddress, view.nodeAddress1);
+    showNumber(objects.lbl_retry_count, (long)incomingPacket.rxTimeoutCount, view.rxTimeoutCount);
+    showNumber(objects.lbl_rssi, incomingPacket.signalStrength, view.signalStrength);
+    showNumber(objects.lbl_activations, (long)triggers, view.triggers);
+    view.drawn = true;
+
+    if (movingTo != 0 && incomingPacket.nodeAddress == movingTo)
     {
-    case ACTIVE:
-        lv_led_set_color(objects.relay1_state_led, lv_color_hex(0xff00ff00));
-        lv_label_set_text(objects.relay1_state, "Enabled");
-        break;
-    default:
-        lv_led_set_color(objects.relay1_state_led, lv_color_hex(0xffff0000));
-        lv_label_set_text(objects.relay1_state, "Disabled");
-        break;
+        // The node committed its new address and the hub followed it
+        debug("Node moved to ");
+        debugln(movingTo);
+        selectedNode = movingTo;
+        movingTo = 0;
+    }
+
+    if (commandOpen && incomingPacket.nodeAddress == selectedNode && incomingPacket.commandSequence == commandSequence)
+    {
+        // Queued and in flight are reported on every message until the command closes
+        CommandStates_t state = (incomingPacket.commandState == COMMAND_NONE) ? COMMAND_IN_FLIGHT : incomingPacket.commandState;
+        if (state == view.commandState)
+        {
+            renderStats.skipped++;
+            return;
+        }
+        view.commandState = state;
+        renderStats.updates++;
+        switch (state)
+        {
+        case COMMAND_DELIVERED:
+            // Hub to node and back, and the whole trip from the Send button
+            sprintf(tempBuffer, "Done %u/%lu ms", incomingPacket.commandLatency, millis() - commandIssuedMillis);
+            showCommandState(tempBuffer);
+            debug("Command confirmed: ");
+            debugln(tempBuffer);
+            commandOpen = false;
+            break;
+        case COMMAND_FAILED:
+            showCommandState("Failed");
+            debugln("Command failed");
+            commandOpen = false;
+            break;
+        case COMMAND_REJECTED:
+            showCommandState("Refused");
+            debugln("Setting refused");
+            movingTo = (selectedState.configKey == CONFIG_ADDRESS) ? 0 : movingTo;
+            commandOpen = false;
+            break;
+        case COMMAND_QUEUED:
+            showCommandState("Queued");
+            break;
+        default:
+            showCommandState("Sending");
+            break;
+        }
     }
+}
+
+#if defined render_trace || defined fps_overlay
+// Display events, every area LVGL marks for redraw, the time spent starting transfers to the panel
+// and the time from the start of a refresh to its last transfer
+void renderEvent(lv_event_t* e)
+{
+    static uint32_t flushStart = 0;
+    static uint32_t frameStart = 0;
+    lv_display_t* display = (lv_display_t*)lv_event_get_target(e);
 
-    switch (incomingPacket.relay2Enabled)
+    switch (lv_event_get_code(e))
     {
-    case ACTIVE:
-        lv_led_set_color(objects.relay2_state_led, lv_color_hex(0xff00ff00));
-        lv_label_set_text(objects.relay2_state, "Enabled");
+    case LV_EVENT_INVALIDATE_AREA:
+        renderStats.invalidatedPixels += lv_area_get_size((const lv_area_t*)lv_event_get_param(e));
+        break;
+    case LV_EVENT_REFR_START:
+        frameStart = micros();
+        break;
+    case LV_EVENT_FLUSH_START:
+        flushStart = micros();
+        break;
+    case LV_EVENT_FLUSH_FINISH:
+        renderStats.flushes++;
+        renderStats.flushMicros += micros() - flushStart;
+        if (lv_display_flush_is_last(display))
+        {
+            renderStats.frames++;
+            renderStats.frameMicros += micros() - frameStart;
+        }
         break;
     default:
-        lv_led_set_color(objects.relay2_state_led, lv_color_hex(0xffff0000));
-        lv_label_set_text(objects.relay2_state, "Disabled");
         break;
     }
+}
 
-    sprintf(tempBuffer, "%u", incomingPacket.nodeAddress);
-    lv_label_set_text(objects.lbl_node_id, tempBuffer);
-    lv_label_set_text(objects.lbl_node_id_1, tempBuffer);
-    sprintf(tempBuffer, "%lu", incomingPacket.rxTimeoutCount);
-    lv_label_set_text(objects.lbl_retry_count, tempBuffer);
-    sprintf(tempBuffer, "%d", incomingPacket.signalStrength);
-    lv_label_set_text(objects.lbl_rssi, tempBuffer);
-    sprintf(tempBuffer, "%lu", triggers);
-    lv_label_set_text(objects.lbl_activations, tempBuffer);
-
-    espNowBusy = false;   // We can resume updating the display
+// Once a second, what UpdateDisplay changed and skipped and what it cost LVGL
+void reportRenderStats(void* context, uint32_t currentMillis)
+{
+    static uint32_t lastMillis = 0;
+    uint32_t elapsed = currentMillis - lastMillis;
+
+    lastMillis = currentMillis;
+    unsigned long frameMicros = renderStats.frames ? renderStats.frameMicros / renderStats.frames : 0;
+#ifdef render_trace
+    Serial.printf("render: %lu widget updates, %lu skipped, %lu px invalidated, %lu flushes, %lu us flushing, %lu us DMA wait, %lu frames of %lu us\r\n",
+                  renderStats.updates, renderStats.skipped, renderStats.invalidatedPixels,
+                  renderStats.flushes, renderStats.flushMicros, renderStats.waitMicros,
+                  renderStats.frames, frameMicros);
+#endif
+#ifdef fps_overlay
+    // Only redrawn when it changes, or the overlay would keep itself at 1 fps
+    static unsigned long shownFps = ~0UL;
+    static unsigned long shownMicros = ~0UL;
+    unsigned long fps = renderStats.frames * 1000 / elapsed;
+    if (fps != shownFps || frameMicros / 1000 != shownMicros / 1000)
+    {
+        char tempBuffer[BUFFER_SIZE];
+        shownFps = fps;
+        shownMicros = frameMicros;
+        sprintf(tempBuffer, "%lu fps %lu.%lu ms", fps, frameMicros / 1000, (frameMicros / 100) % 10);
+        lv_label_set_text(lblFps, tempBuffer);
+    }
+#endif
+    renderStats = {};
 }
+#endif
 
-/* LVGL calls it when a rendered image needs to copied to the display*/
+/* LVGL calls it when a rendered image needs to copied to the display.  The transfer is only
+started here, LVGL carries on rendering into the other buffer and my_disp_flush_wait is called
+before that buffer is flushed in turn*/
 void my_disp_flush(lv_display_t* disp, const lv_area_t* area, uint8_t* px_map)
 {
+    uint32_t w = lv_area_get_width(area);
+    uint32_t h = lv_area_get_height(area);
+
+    // Waits for the previous transfer before it sets the address window
+    tft.pushImageDMA(area->x1, area->y1, w, h, (uint16_t*)px_map);
+}
+
+/* LVGL calls it when it needs the buffer that is being sent*/
+void my_disp_flush_wait(lv_display_t* disp)
+{
+#if defined render_trace || defined fps_overlay
+    uint32_t waitStart = micros();
+    tft.dmaWait();
+    renderStats.waitMicros += micros() - waitStart;
+#else
+    tft.dmaWait();
+#endif
     /*Call it to tell LVGL you are ready*/
     lv_disp_flush_ready(disp);
 }
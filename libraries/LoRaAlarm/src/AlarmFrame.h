@@ -0,0 +1,478 @@
+/*
+*  Title          :  AlarmFrame
+*  Desc           :  Compact binary frame codec shared by the Hub and RemoteNode.
+*                 :  Replaces the JSON payload previously sent over LoRa.  Every byte
+*                 :  on air costs airtime so the fields are bit packed into a fixed
+*                 :  size frame.  The payload is encrypted and the frame signed with the node's
+*                 :  AES-128 CCM key, see FrameSecurity.h.  The MIC replaces the CRC-8 and the
+*                 :  radio's own CRC catches noise, so the only extra bytes on air are the
+*                 :  counter and the rest of the MIC.
+*                 :
+*                 :  Frame layout (all multi byte fields little endian)
+*                 :    byte 0    version (high nibble) | frame type (low nibble)
+*                 :    byte 1-2  node address
+*                 :    byte 3-4  low 16 bits of the sender's frame counter
+*                 :    byte 5..  payload, depends on frame type, encrypted
+*                 :    last 4    MIC, CCM tag over the header and the plain payload
+*                 :
+*                 :  The header is sent in the clear so a receiver knows whose key to use and
+*                 :  can ignore frames for other nodes without any crypto.
+*                 :
+*                 :  A repeater passes a frame on inside a RELAY envelope, see Repeater.h.  It
+*                 :  cannot open the frame and does not need to, the frame goes through as it
+*                 :  was sealed and is checked by whoever it was for.  The envelope is clear
+*                 :    byte 0    version | FRAME_RELAY
+*                 :    byte 1-2  repeater address: toward the hub the one sending this copy,
+*                 :              toward a node the one to pass it on next, or the node itself
+*                 :    byte 3    bit 7 toward a node, bit 0-3 repeaters passed so far
+*                 :    byte 4..  the frame
+*                 :
+*                 :  The hub starts each superframe with a BEACON on every channel, see
+*                 :  Superframe.h.  It is for everyone and only gives the time, so it is clear
+*                 :  and not sealed
+*                 :    byte 0    version | FRAME_BEACON
+*                 :    byte 1    superframe number, counts up and wraps
+*                 :    byte 2-4  ms into the superframe the beacon started to go
+*                 :
+*                 :  Payloads
+*                 :    STATUS    state byte: bit 0-1 alarm state, bit 2 relay 1, bit 3 relay 2,
+*                 :              bit 4 low power check in (receive window open after this frame),
+*                 :              bit 5 node is on the fallback link rate, bit 6 link check, a low
+*                 :              power node on a reduced rate wants to hear from the hub, bit 7
+*                 :              the node is a repeater
+*                 :    ALARM     state byte, sequence number, inputs byte: bit n set while the
+*                 :              node's input n is active
+*                 :    ACK       sequence number being acknowledged
+*                 :    COMMAND   state byte, command sequence number
+*                 :    CMD_ACK   state byte after the command, command sequence number
+*                 :    LINK      spreading factor, TX power in dBm (signed) the node should use
+*                 :    LINK_ACK  the same two bytes, the node switches once this is sent
+*                 :    CONFIG    command sequence number, setting (NodeConfigKey_t), 4 byte value
+*                 :    CFG_ACK   command sequence number, setting, result (NodeConfigResult_t)
+*                 :    SLOT      slot (0xFFFF none), then the hub's clock as a beacon gives it:
+*                 :              superframe number, 3 byte ms into it the frame started to go
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  3.3
+*  History        : 1.0 2026-10-17 Status frame
+*                 : 1.1 2026-10-17 Unsolicited alarm frame and its acknowledgement
+*                 : 1.2 2026-10-17 Check in flag for low power nodes
+*                 : 1.3 2026-10-17 Sequenced relay/test commands and their acknowledgement
+*                 : 1.4 2026-10-17 Link rate negotiation for adaptive data rate
+*                 : 2.0 2026-10-17 Encrypted and authenticated, frame counter against replay.  The
+*                 :     CRC-8 is kept for other users
+*                 : 3.0 2026-10-17 Alarm frames carry the mask of active inputs
+*                 : 3.1 2026-10-17 Node settings over the air and their acknowledgement
+*                 : 3.2 2026-10-17 Relay envelope for frames passed on by a repeater, repeater flag
+*                 : 3.3 2026-10-17 Superframe beacon and slot assignment
+*
+*/
+
+#ifndef LORA_ALARM_FRAME_H
+#define LORA_ALARM_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "FrameSecurity.h"
+
+#define ALARM_FRAME_VERSION                         3
+#define ALARM_FRAME_HEADER_SIZE                     5   // version/type + node address + counter
+#define ALARM_FRAME_MIC_SIZE                        4   // Truncated CCM tag, 4, 6 ... 16
+#define ALARM_FRAME_MAX_SIZE                        16  // Largest frame any firmware will build
+#define ALARM_FRAME_MAX_PAYLOAD                     6   // CONFIG, SLOT
+
+#define RELAY_FRAME_HEADER_SIZE                     4   // version/type + repeater address + hops
+#define RELAY_FRAME_MAX_SIZE                        (RELAY_FRAME_HEADER_SIZE + ALARM_FRAME_MAX_SIZE)
+#define RELAY_FRAME_DOWNLINK                        0x80
+
+#define BEACON_FRAME_SIZE                           5   // version/type + superframe number + phase
+
+static_assert(ALARM_FRAME_MIC_SIZE >= 4 && ALARM_FRAME_MIC_SIZE <= 16 && ALARM_FRAME_MIC_SIZE % 2 == 0,
+    "CCM tags are 4, 6 ... 16 bytes");
+
+typedef enum
+{
+    FRAME_STATUS = 1,           // Hub watchdog poll / node status, same shape both ways
+    FRAME_ALARM = 2,            // Unsolicited alarm uplink from a node, must be acknowledged
+    FRAME_ACK = 3,              // Hub acknowledgement of an alarm frame
+    FRAME_COMMAND = 4,          // Hub to node relay/test command, applied once per sequence number
+    FRAME_COMMAND_ACK = 5,      // Node acknowledgement of a command, with the state it is now in
+    FRAME_LINK = 6,             // Hub to node spreading factor and TX power change
+    FRAME_LINK_ACK = 7,         // Node acceptance of a link change, sent at the old rate
+    FRAME_CONFIG = 8,           // Hub to node, one setting, sequenced like a command
+    FRAME_CONFIG_ACK = 9,       // Node acknowledgement of a setting, with whether it took it
+    FRAME_RELAY = 10,           // Another frame passed on by a repeater, not sealed itself
+    FRAME_BEACON = 11,          // Hub to everyone, start of a superframe, not sealed
+    FRAME_SLOT = 12             // Hub to node, its superframe slot and the hub's clock
+} AlarmFrameType_t;
+
+typedef enum
+{
+    FRAME_OK,
+    FRAME_TOO_SHORT,
+    FRAME_BAD_VERSION,
+    FRAME_BAD_TYPE,
+    FRAME_BAD_LENGTH,
+    FRAME_BAD_MIC,              // Forged, damaged or sealed with another key
+    FRAME_REPLAY                // Genuine, but not newer than the last frame accepted
+} AlarmFrameResult_t;
+
+typedef struct
+{
+    uint8_t type;
+    uint16_t nodeAddress;
+    uint8_t alarmState;         // DeviceStates_t
+    uint8_t relay1Enabled;      // RelayStates_t
+    uint8_t relay2Enabled;      // RelayStates_t
+    uint8_t checkIn;            // STATUS from a low power node, it listens briefly afterwards
+    uint8_t linkFallback;       // The node is on the fallback link rate
+    uint8_t linkCheck;          // Low power check in that wants an answer to prove the link
+    uint8_t repeater;           // STATUS from a node that passes frames on for others
+    uint8_t sequence;           // ALARM, ACK, COMMAND, COMMAND_ACK, CONFIG and CONFIG_ACK only
+    uint8_t inputs;             // ALARM only, bit n set while input n is active
+    uint8_t spreadingFactor;    // LINK and LINK_ACK only
+    int8_t txPower;             // LINK and LINK_ACK only, dBm
+    uint8_t configKey;          // CONFIG and CONFIG_ACK only, NodeConfigKey_t
+    uint32_t configValue;       // CONFIG only
+    uint8_t configResult;       // CONFIG_ACK only, NodeConfigResult_t
+    uint16_t slot;              // SLOT only
+    uint8_t superframe;         // SLOT and BEACON only, superframe number
+    uint32_t phase;             // SLOT and BEACON only, ms into the superframe, 24 bits
+    uint32_t counter;           // Sender's frame counter, only the low 16 bits from alarmFramePeek()
+} AlarmFrame;
+
+// CRC-8, polynomial 0x07, initial value 0x00.  Bitwise is fine for a handful of bytes.
+// No longer on air, the event log still uses it
+inline uint8_t alarmFrameCrc8(const uint8_t* data, size_t len)
+{
+    uint8_t crc = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+// Number of payload bytes that follow the header for a given frame type, -1 if unknown
+inline int alarmFramePayloadSize(uint8_t type)
+{
+    switch (type)
+    {
+    case FRAME_STATUS:
+    case FRAME_ACK:
+        return 1;
+    case FRAME_ALARM:
+    case FRAME_CONFIG_ACK:
+        return 3;
+    case FRAME_CONFIG:
+    case FRAME_SLOT:
+        return 6;
+    case FRAME_COMMAND:
+    case FRAME_COMMAND_ACK:
+    case FRAME_LINK:
+    case FRAME_LINK_ACK:
+        return 2;
+    default:
+        return -1;
+    }
+}
+
+// Total frame size on air for a given frame type, 0 if unknown
+inline size_t alarmFrameSize(uint8_t type)
+{
+    int payload = alarmFramePayloadSize(type);
+    return (payload < 0) ? 0 : ALARM_FRAME_HEADER_SIZE + (size_t)payload + ALARM_FRAME_MIC_SIZE;
+}
+
+// Encode a frame into buf, sealed with cipher.  counter is the sender's next frame counter and
+// direction a FrameDirection_t.  Returns the number of bytes written, 0 if buf is too small
+inline size_t alarmFrameEncode(const AlarmFrame& frame, const AesCcm& cipher, uint8_t direction, uint32_t counter,
+    uint8_t* buf, size_t bufLen)
+{
+    size_t len = alarmFrameSize(frame.type);
+    if (len == 0 || bufLen < len)
+    {
+        return 0;
+    }
+
+    buf[0] = (uint8_t)((ALARM_FRAME_VERSION << 4) | (frame.type & 0x0F));
+    buf[1] = (uint8_t)(frame.nodeAddress & 0xFF);
+    buf[2] = (uint8_t)(frame.nodeAddress >> 8);
+    buf[3] = (uint8_t)(counter & 0xFF);
+    buf[4] = (uint8_t)((counter >> 8) & 0xFF);
+
+    uint8_t payload[ALARM_FRAME_MAX_PAYLOAD] = {};
+    switch (frame.type)
+    {
+    case FRAME_ALARM:
+        payload[2] = frame.inputs;
+        // fall through
+    case FRAME_COMMAND:
+    case FRAME_COMMAND_ACK:
+        payload[1] = frame.sequence;
+        // The state byte is shared with STATUS
+        // fall through
+    case FRAME_STATUS:
+        payload[0] = (uint8_t)((frame.alarmState & 0x03)
+            | ((frame.relay1Enabled & 0x01) << 2)
+            | ((frame.relay2Enabled & 0x01) << 3)
+            | ((frame.checkIn & 0x01) << 4)
+            | ((frame.linkFallback & 0x01) << 5)
+            | ((frame.linkCheck & 0x01) << 6)
+            | ((frame.repeater & 0x01) << 7));
+        break;
+    case FRAME_ACK:
+        payload[0] = frame.sequence;
+        break;
+    case FRAME_LINK:
+    case FRAME_LINK_ACK:
+        payload[0] = frame.spreadingFactor;
+        payload[1] = (uint8_t)frame.txPower;
+        break;
+    case FRAME_CONFIG:
+        payload[0] = frame.sequence;
+        payload[1] = frame.configKey;
+        payload[2] = (uint8_t)(frame.configValue & 0xFF);
+        payload[3] = (uint8_t)((frame.configValue >> 8) & 0xFF);
+        payload[4] = (uint8_t)((frame.configValue >> 16) & 0xFF);
+        payload[5] = (uint8_t)(frame.configValue >> 24);
+        break;
+    case FRAME_CONFIG_ACK:
+        payload[0] = frame.sequence;
+        payload[1] = frame.configKey;
+        payload[2] = frame.configResult;
+        break;
+    case FRAME_SLOT:
+        payload[0] = (uint8_t)(frame.slot & 0xFF);
+        payload[1] = (uint8_t)(frame.slot >> 8);
+        payload[2] = frame.superframe;
+        payload[3] = (uint8_t)(frame.phase & 0xFF);
+        payload[4] = (uint8_t)((frame.phase >> 8) & 0xFF);
+        payload[5] = (uint8_t)((frame.phase >> 16) & 0xFF);
+        break;
+    default:
+        break;
+    }
+
+    uint8_t nonce[FRAME_NONCE_SIZE];
+    size_t payloadLen = len - ALARM_FRAME_HEADER_SIZE - ALARM_FRAME_MIC_SIZE;
+    frameNonce(nonce, frame.nodeAddress, direction, counter);
+    cipher.seal(nonce, buf, ALARM_FRAME_HEADER_SIZE, payload, payloadLen, &buf[ALARM_FRAME_HEADER_SIZE],
+        &buf[len - ALARM_FRAME_MIC_SIZE], ALARM_FRAME_MIC_SIZE);
+    return len;
+}
+
+// Check the clear header of a received frame and read the type, node address and low 16 bits
+// of the counter from it.  Tells the receiver whose key to decode with, no key needed
+inline AlarmFrameResult_t alarmFramePeek(const uint8_t* buf, size_t len, AlarmFrame& frame)
+{
+    if (len < ALARM_FRAME_HEADER_SIZE + ALARM_FRAME_MIC_SIZE)
+    {
+        return FRAME_TOO_SHORT;
+    }
+    if ((buf[0] >> 4) != ALARM_FRAME_VERSION)
+    {
+        return FRAME_BAD_VERSION;
+    }
+
+    uint8_t type = buf[0] & 0x0F;
+    size_t expected = alarmFrameSize(type);
+    if (expected == 0)
+    {
+        return FRAME_BAD_TYPE;
+    }
+    if (len != expected)
+    {
+        return FRAME_BAD_LENGTH;
+    }
+
+    frame.type = type;
+    frame.nodeAddress = (uint16_t)(buf[1] | (buf[2] << 8));
+    frame.counter = (uint32_t)(buf[3] | (buf[4] << 8));
+    return FRAME_OK;
+}
+
+// Decode, authenticate and decrypt a received frame.  lastCounter is the last counter accepted
+// from the sender.  On FRAME_OK frame.counter is the full counter, the caller accepts it with
+// frameCounterAccept().  A frame that only authenticates with an older counter is a replay
+inline AlarmFrameResult_t alarmFrameDecode(const uint8_t* buf, size_t len, const AesCcm& cipher, uint8_t direction,
+    uint32_t lastCounter, AlarmFrame& frame)
+{
+    AlarmFrameResult_t result = alarmFramePeek(buf, len, frame);
+    if (result != FRAME_OK)
+    {
+        return result;
+    }
+
+    uint8_t nonce[FRAME_NONCE_SIZE];
+    uint8_t payload[ALARM_FRAME_MAX_PAYLOAD];
+    size_t payloadLen = len - ALARM_FRAME_HEADER_SIZE - ALARM_FRAME_MIC_SIZE;
+    if (payloadLen > sizeof(payload))
+    {
+        return FRAME_BAD_LENGTH;
+    }
+    uint32_t counter = frameCounterExpand(lastCounter, (uint16_t)frame.counter);
+    frameNonce(nonce, frame.nodeAddress, direction, counter);
+    if (!cipher.open(nonce, buf, ALARM_FRAME_HEADER_SIZE, &buf[ALARM_FRAME_HEADER_SIZE], payloadLen, payload,
+        &buf[len - ALARM_FRAME_MIC_SIZE], ALARM_FRAME_MIC_SIZE))
+    {
+        // Only worth the second try to tell the two apart
+        frameNonce(nonce, frame.nodeAddress, direction, counter - 0x10000u);
+        bool replay = counter >= 0x10000u && cipher.open(nonce, buf, ALARM_FRAME_HEADER_SIZE,
+            &buf[ALARM_FRAME_HEADER_SIZE], payloadLen, payload, &buf[len - ALARM_FRAME_MIC_SIZE], ALARM_FRAME_MIC_SIZE);
+        return replay ? FRAME_REPLAY : FRAME_BAD_MIC;
+    }
+    frame.counter = counter;
+
+    switch (frame.type)
+    {
+    case FRAME_ALARM:
+        frame.inputs = payload[2];
+        // fall through
+    case FRAME_COMMAND:
+    case FRAME_COMMAND_ACK:
+        frame.sequence = payload[1];
+        // fall through
+    case FRAME_STATUS:
+        frame.alarmState = payload[0] & 0x03;
+        frame.relay1Enabled = (payload[0] >> 2) & 0x01;
+        frame.relay2Enabled = (payload[0] >> 3) & 0x01;
+        frame.checkIn = (payload[0] >> 4) & 0x01;
+        frame.linkFallback = (payload[0] >> 5) & 0x01;
+        frame.linkCheck = (payload[0] >> 6) & 0x01;
+        frame.repeater = (payload[0] >> 7) & 0x01;
+        break;
+    case FRAME_ACK:
+        frame.sequence = payload[0];
+        break;
+    case FRAME_LINK:
+    case FRAME_LINK_ACK:
+        frame.spreadingFactor = payload[0];
+        frame.txPower = (int8_t)payload[1];
+        break;
+    case FRAME_CONFIG:
+        frame.sequence = payload[0];
+        frame.configKey = payload[1];
+        frame.configValue = (uint32_t)payload[2] | ((uint32_t)payload[3] << 8) | ((uint32_t)payload[4] << 16)
+            | ((uint32_t)payload[5] << 24);
+        break;
+    case FRAME_CONFIG_ACK:
+        frame.sequence = payload[0];
+        frame.configKey = payload[1];
+        frame.configResult = payload[2];
+        break;
+    case FRAME_SLOT:
+        frame.slot = (uint16_t)(payload[0] | (payload[1] << 8));
+        frame.superframe = payload[2];
+        frame.phase = (uint32_t)payload[3] | ((uint32_t)payload[4] << 8) | ((uint32_t)payload[5] << 16);
+        break;
+    default:
+        break;
+    }
+    return FRAME_OK;
+}
+
+// The envelope around a frame a repeater passes on
+typedef struct
+{
+    uint16_t via;               // Repeater address, see the layout above
+    uint8_t hops;               // Repeaters the frame has passed so far
+    bool downlink;              // On its way from the hub to a node
+    const uint8_t* frame;       // The frame inside, in the buffer peeked
+    uint8_t length;
+} RelayHeader;
+
+// Writes the envelope into the first RELAY_FRAME_HEADER_SIZE bytes of buf, the frame follows it
+inline void relayFrameWrap(const RelayHeader& relay, uint8_t* buf)
+{
+    buf[0] = (uint8_t)((ALARM_FRAME_VERSION << 4) | FRAME_RELAY);
+    buf[1] = (uint8_t)(relay.via & 0xFF);
+    buf[2] = (uint8_t)(relay.via >> 8);
+    buf[3] = (uint8_t)((relay.downlink ? RELAY_FRAME_DOWNLINK : 0) | (relay.hops & 0x0F));
+}
+
+// Reads the envelope of a RELAY frame, FRAME_BAD_TYPE for any other frame.  The frame inside is
+// only checked for length, alarmFramePeek() it next
+inline AlarmFrameResult_t relayFramePeek(const uint8_t* buf, size_t len, RelayHeader& relay)
+{
+    if (len < RELAY_FRAME_HEADER_SIZE + ALARM_FRAME_HEADER_SIZE + ALARM_FRAME_MIC_SIZE)
+    {
+        return FRAME_TOO_SHORT;
+    }
+    if ((buf[0] >> 4) != ALARM_FRAME_VERSION)
+    {
+        return FRAME_BAD_VERSION;
+    }
+    if ((buf[0] & 0x0F) != FRAME_RELAY)
+    {
+        return FRAME_BAD_TYPE;
+    }
+    if (len > RELAY_FRAME_MAX_SIZE)
+    {
+        return FRAME_BAD_LENGTH;
+    }
+    relay.via = (uint16_t)(buf[1] | (buf[2] << 8));
+    relay.hops = buf[3] & 0x0F;
+    relay.downlink = (buf[3] & RELAY_FRAME_DOWNLINK) != 0;
+    relay.frame = &buf[RELAY_FRAME_HEADER_SIZE];
+    relay.length = (uint8_t)(len - RELAY_FRAME_HEADER_SIZE);
+    return FRAME_OK;
+}
+
+// Writes a BEACON into the first BEACON_FRAME_SIZE bytes of buf
+inline void beaconFrameWrite(uint8_t superframe, uint32_t phase, uint8_t* buf)
+{
+    buf[0] = (uint8_t)((ALARM_FRAME_VERSION << 4) | FRAME_BEACON);
+    buf[1] = superframe;
+    buf[2] = (uint8_t)(phase & 0xFF);
+    buf[3] = (uint8_t)((phase >> 8) & 0xFF);
+    buf[4] = (uint8_t)((phase >> 16) & 0xFF);
+}
+
+// Reads a BEACON into frame.superframe and frame.phase, FRAME_BAD_TYPE for any other frame
+inline AlarmFrameResult_t beaconFramePeek(const uint8_t* buf, size_t len, AlarmFrame& frame)
+{
+    if (len < 1)
+    {
+        return FRAME_TOO_SHORT;
+    }
+    if ((buf[0] >> 4) != ALARM_FRAME_VERSION)
+    {
+        return FRAME_BAD_VERSION;
+    }
+    if ((buf[0] & 0x0F) != FRAME_BEACON)
+    {
+        return FRAME_BAD_TYPE;
+    }
+    if (len != BEACON_FRAME_SIZE)
+    {
+        return FRAME_BAD_LENGTH;
+    }
+    frame.type = FRAME_BEACON;
+    frame.superframe = buf[1];
+    frame.phase = (uint32_t)buf[2] | ((uint32_t)buf[3] << 8) | ((uint32_t)buf[4] << 16);
+    return FRAME_OK;
+}
+
+inline const char* alarmFrameResultString(AlarmFrameResult_t result)
+{
+    switch (result)
+    {
+    case FRAME_OK:          return "OK";
+    case FRAME_TOO_SHORT:   return "TooShort";
+    case FRAME_BAD_VERSION: return "BadVersion";
+    case FRAME_BAD_TYPE:    return "BadType";
+    case FRAME_BAD_LENGTH:  return "BadLength";
+    case FRAME_BAD_MIC:     return "BadMic";
+    case FRAME_REPLAY:      return "Replay";
+    default:                return "Unknown";
+    }
+}
+
+#endif // LORA_ALARM_FRAME_H
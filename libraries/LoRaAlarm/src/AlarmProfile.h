@@ -0,0 +1,185 @@
+/*
+*  Title          :  AlarmProfile
+*  Desc           :  Compile time profiles of the radio every device on the network shares and
+*                 :  of the boards the firmware runs on.  Each is a template whose parameters
+*                 :  are checked by static_assert, so a spreading factor out of range or a pin
+*                 :  the board already uses stops the build rather than a device in the field.
+*                 :  The values are constexpr members, nothing is stored or worked out at run
+*                 :  time.
+*                 :
+*                 :  The Hub and RemoteNode are built separately and used to repeat the radio
+*                 :  settings in each sketch.  Both now take them from AlarmRadio below, the
+*                 :  simulator starts from it too.  A node's stored settings can still move it
+*                 :  to another frequency or spreading factor, see NodeSettings.h, and are
+*                 :  checked against the same limits when they arrive.
+*                 :
+*                 :  AlarmChannels is how many channels the nodes are spread over, starting at
+*                 :  AlarmRadio's frequency.  See ChannelPlan.h.
+*                 :
+*                 :  AlarmRelay is how many repeaters a frame may pass on its way.  The hub and
+*                 :  every node work out their receive windows from it.  See Repeater.h.
+*                 :
+*                 :  AlarmSuperframe is how often the hub sends a beacon and how many low power
+*                 :  nodes it gives a check in slot, 0 for no beacons.  See Superframe.h.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.3
+*  History        : 1.0 2026-10-17 Radio and board profiles
+*                 : 1.1 2026-10-17 Channel plan profile
+*                 : 1.2 2026-10-17 Relay profile
+*                 : 1.3 2026-10-17 Superframe profile
+*
+*/
+
+#ifndef LORA_ALARM_PROFILE_H
+#define LORA_ALARM_PROFILE_H
+
+#include <stdint.h>
+
+#include "ChannelPlan.h"
+#include "Repeater.h"
+#include "Superframe.h"
+
+#define BOARD_NO_PIN                                0xFF
+#define BOARD_MAX_PIN                               48  // Highest ESP32-S3 GPIO
+
+// Heltec WiFi LoRa 32 V3 GPIOs the firmware must leave alone: the strapping pins 0, 3, 45 and
+// 46, the SX1262 on 8 to 14, the OLED on 17, 18 and 21, USB on 19 and 20, the flash on 26 to 32,
+// the LED on 35 and Vext on 36.  22 to 25 do not exist on the ESP32-S3
+#define HELTEC_V3_RESERVED_PINS                     ((1ULL << 0) | (1ULL << 3) | (0x7FULL << 8) | (0x1FULL << 17) \
+                                                    | (0xFULL << 22) | (0x7FULL << 26) | (0x3ULL << 35) | (0x3ULL << 45))
+#define HELTEC_V3_MAX_RTC_PIN                       21  // ext0 wake from deep sleep only works on these
+
+// What the SX1262 accepts.  Checked at build time for a profile and at run time for a node setting
+constexpr bool radioFrequencyValid(uint32_t hz) { return hz >= 150000000 && hz <= 960000000; }
+constexpr bool radioBandwidthValid(uint32_t bandwidth) { return bandwidth <= 2; }
+constexpr bool radioCodingRateValid(uint32_t codingRate) { return codingRate >= 1 && codingRate <= 4; }
+constexpr bool radioSpreadingFactorValid(uint32_t spreadingFactor) { return spreadingFactor >= 7 && spreadingFactor <= 12; }
+constexpr bool radioTxPowerValid(int32_t dbm) { return dbm >= -9 && dbm <= 22; }
+
+// True if the pin exists and is not in the reserved mask
+constexpr bool boardPinFree(uint64_t reservedPins, uint32_t pin)
+{
+    return pin <= BOARD_MAX_PIN && ((reservedPins >> pin) & 1) == 0;
+}
+
+// The base rate and channel.  Alarms, check ins and the hub's listening between polls are all on
+// this, adaptive data rate only ever moves a node to a faster SF or lower power
+template <uint32_t Frequency, uint8_t Bandwidth, uint8_t SpreadingFactor, uint8_t CodingRate, int8_t TxPower,
+    uint16_t PreambleLength = 8>
+struct RadioProfile
+{
+    static_assert(radioFrequencyValid(Frequency), "Frequency outside the SX1262's 150 to 960 MHz");
+    static_assert(radioBandwidthValid(Bandwidth), "Bandwidth is 0: 125 kHz, 1: 250 kHz or 2: 500 kHz");
+    static_assert(radioCodingRateValid(CodingRate), "Coding rate is 1: 4/5 to 4: 4/8");
+    static_assert(radioSpreadingFactorValid(SpreadingFactor), "Spreading factor is SF7 to SF12");
+    static_assert(radioTxPowerValid(TxPower), "The SX1262 transmits -9 to 22 dBm");
+    static_assert(PreambleLength >= 6, "The SX1262 needs a preamble of at least 6 symbols");
+
+    static constexpr uint32_t frequency = Frequency;            // Hz
+    static constexpr uint8_t bandwidth = Bandwidth;
+    static constexpr uint8_t spreadingFactor = SpreadingFactor;
+    static constexpr uint8_t codingRate = CodingRate;
+    static constexpr int8_t txPower = TxPower;                  // dBm
+    static constexpr uint16_t preambleLength = PreambleLength;  // Same for Tx and Rx
+    static constexpr bool fixLengthPayload = false;             // AlarmFrame sizes vary with the type
+    static constexpr bool iqInversion = false;
+};
+
+// Count channels from the radio's frequency, spacing Hz apart.  The spacing has to clear the
+// bandwidth, and the last channel has to be one the SX1262 can tune to
+template <typename Radio, uint8_t Count, uint32_t Spacing = 200000>
+struct ChannelProfile
+{
+    static_assert(Count >= 1 && Count <= CHANNEL_PLAN_MAX, "A plan has 1 to CHANNEL_PLAN_MAX channels");
+    static_assert(Count == 1 || Spacing >= (125000UL << Radio::bandwidth), "Channels overlap at this bandwidth");
+    static_assert(radioFrequencyValid(Radio::frequency + (uint64_t)Spacing * (Count - 1)), "The last channel is outside the SX1262's range");
+
+    static constexpr uint32_t frequency = Radio::frequency;    // Hz, channel 0
+    static constexpr uint32_t spacing = Spacing;
+    static constexpr uint8_t count = Count;
+};
+
+// Repeaters a frame may pass, 0 for a network without any
+template <uint8_t Hops>
+struct RelayProfile
+{
+    static_assert(Hops <= RELAY_HOPS_MAX, "A frame passes at most RELAY_HOPS_MAX repeaters");
+
+    static constexpr uint8_t hops = Hops;
+};
+
+// A beacon every Period ms and up to Slots check in slots after it, Period 0 for no beacons.  The
+// slots that do not fit in the period are left out, see superframePlanMake()
+template <uint32_t Period, uint16_t Slots>
+struct SuperframeProfile
+{
+    static_assert(Period == 0 || Period >= 10000, "Beacons at least 10 s apart, each one wakes every node with a slot");
+    static_assert(Period <= 0xFFFFFF, "A beacon gives the time into the superframe in 24 bits");
+    static_assert(Period != 0 || Slots == 0, "Slots need beacons");
+
+    static constexpr uint32_t period = Period;
+    static constexpr uint16_t slots = Slots;
+};
+
+// A hub on a Heltec V3
+template <uint8_t BuzzerPin>
+struct HeltecV3HubPins
+{
+    static_assert(boardPinFree(HELTEC_V3_RESERVED_PINS, BuzzerPin), "The buzzer pin is used by the board");
+
+    static constexpr uint8_t buzzer = BuzzerPin;
+};
+
+// A RemoteNode on a Heltec V3.  The sensor is input 0, the one that wakes a low power node.
+// Frames carry two relay states, a node with one relay ignores the second
+template <uint8_t RelayCount, uint8_t SensorPin, uint8_t Relay1Pin, uint8_t Relay2Pin = BOARD_NO_PIN>
+struct HeltecV3NodePins
+{
+    static_assert(RelayCount == 1 || RelayCount == 2, "A node has one or two relays");
+    static_assert((RelayCount == 2) == (Relay2Pin != BOARD_NO_PIN), "One pin for each relay");
+    static_assert(boardPinFree(HELTEC_V3_RESERVED_PINS, SensorPin), "The sensor pin is used by the board");
+    static_assert(SensorPin <= HELTEC_V3_MAX_RTC_PIN, "The sensor pin has to be an RTC GPIO to wake the node");
+    static_assert(boardPinFree(HELTEC_V3_RESERVED_PINS, Relay1Pin), "The relay 1 pin is used by the board");
+    static_assert(RelayCount == 1 || boardPinFree(HELTEC_V3_RESERVED_PINS, Relay2Pin), "The relay 2 pin is used by the board");
+    static_assert(SensorPin != Relay1Pin && SensorPin != Relay2Pin && Relay1Pin != Relay2Pin, "A pin is used twice");
+
+    static constexpr uint8_t relayCount = RelayCount;
+    static constexpr uint8_t sensor = SensorPin;
+    static constexpr uint8_t relay1 = Relay1Pin;
+    static constexpr uint8_t relay2 = Relay2Pin;
+    static constexpr uint64_t reservedPins = HELTEC_V3_RESERVED_PINS;
+};
+
+/******************************************************************************************
+THE RADIO OF THIS NETWORK.  The Hub and every RemoteNode are built with it.  The spreading factor
+is the slowest any node needs to reach the hub.
+   frequency Hz, bandwidth [0: 125 kHz, 1: 250 kHz, 2: 500 kHz], SF, coding rate [1: 4/5 .. 4: 4/8], dBm */
+typedef RadioProfile<868000000, 0, 7, 1, 14> AlarmRadio;
+/*******************************************************************************************/
+
+/******************************************************************************************
+THE CHANNELS OF THIS NETWORK.  More channels let more nodes share the hub with fewer collisions,
+see ChannelPlan.h.  868.0, 868.2 and 868.4 MHz are all in the 1 % sub-band, check the duty cycle
+of any other channel where you are.
+   radio, channels, spacing Hz */
+typedef ChannelProfile<AlarmRadio, 1, 200000> AlarmChannels;
+/*******************************************************************************************/
+
+/******************************************************************************************
+THE REPEATERS OF THIS NETWORK.  Set to the most repeaters between the hub and any node, each one
+adds to how long the hub and the nodes wait for an answer.  Build repeaters with repeater_mode in
+RemoteNode.ino.
+   hops [0 .. 3] */
+typedef RelayProfile<0> AlarmRelay;
+/*******************************************************************************************/
+
+/******************************************************************************************
+THE SUPERFRAME OF THIS NETWORK.  Low power nodes check in once a period in a slot of their own
+rather than at random, see Superframe.h.  Keep the period near the nodes' checkInInterval.
+   period ms [0: no beacons, 10000 ..], slots */
+typedef SuperframeProfile<0, 0> AlarmSuperframe;
+/*******************************************************************************************/
+
+#endif // LORA_ALARM_PROFILE_H
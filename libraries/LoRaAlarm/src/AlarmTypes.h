@@ -0,0 +1,95 @@
+/*
+*  Title          :  AlarmTypes
+*  Desc           :  State and packet types shared by the Hub and RemoteNode firmware.
+*                 :  LoRaPacket is also the ESP-NOW payload between the Hub and the UI.
+*                 :
+*                 :  The Hub and UI are built separately, so LoRaPacket only uses fixed width
+*                 :  fields and its layout is pinned by WireFormat below.  A change to it fails
+*                 :  the build of both until the size there, and CONSOLE_LINK_VERSION, are
+*                 :  moved on together.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.5
+*  History        : 1.0 2026-10-17 Moved out of the Hub and RemoteNode sketches
+*                 : 1.1 2026-10-17 Command sequence, delivery state and latency for the UI
+*                 : 1.2 2026-10-17 SNR and frames heard, for the UI's link history
+*                 : 1.3 2026-10-17 Mask of the node's active inputs
+*                 : 1.4 2026-10-17 A command may carry one node setting instead of a state, see NodeSettings.h
+*                 : 1.5 2026-10-17 Fixed width counters and a static_assert'ed layout, host builds match the boards
+*
+*/
+
+#ifndef LORA_ALARM_TYPES_H
+#define LORA_ALARM_TYPES_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <type_traits>
+
+typedef enum
+{
+    IDLING,
+    LOWPOWER,
+    STATE_RX,
+    STATE_TX
+} States_t;
+
+typedef enum
+{
+    IDLE,
+    CLEAR,
+    SET,
+    TEST
+} DeviceStates_t;
+
+typedef enum
+{
+    INACTIVE,
+    ACTIVE
+} RelayStates_t;
+
+typedef enum
+{
+    COMMAND_NONE,
+    COMMAND_QUEUED,             // Waiting for room in the hub's in flight window
+    COMMAND_IN_FLIGHT,          // Being sent to the node, retried with backoff
+    COMMAND_DELIVERED,          // The node acknowledged it
+    COMMAND_FAILED,             // Retries exhausted
+    COMMAND_REJECTED            // The setting it carried was refused, by the node or the hub
+} CommandStates_t;
+
+typedef struct
+{
+    unsigned short nodeAddress;
+    DeviceStates_t alarmState;
+    RelayStates_t relay1Enabled;
+    RelayStates_t relay2Enabled;
+    uint32_t rxTimeoutCount;
+    int16_t signalStrength;
+    uint8_t commandSequence;        // UI to hub: id of this command.  Hub to UI: id of the last command
+    CommandStates_t commandState;   // Hub to UI, where that command has got to
+    uint16_t commandLatency;        // Hub to UI, ms from first transmission to the node's ACK, 65535 or more
+    int8_t snr;                     // dB, last frame heard from the node
+    uint32_t rxCount;               // Frames heard from the node, rxTimeoutCount counts the polls it missed
+    uint8_t inputs;                 // Inputs active at the node's last alarm frame, bit n for input n
+    uint8_t configKey;              // UI to hub: a NodeConfigKey_t to set instead of the state, 0 for none
+    uint32_t configValue;
+} LoRaPacket;
+
+// A struct sent as raw bytes between two separately built devices.  Size is what both ends
+// were built with, anything else fails to compile rather than garbling the link
+template <typename T, size_t Size>
+struct WireFormat
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Sent with memcpy");
+    static_assert(sizeof(T) == Size, "The wire layout changed, update the size and the link version");
+
+    static constexpr size_t size = Size;
+};
+
+typedef WireFormat<LoRaPacket, 44> LoRaPacketWire;
+static_assert(offsetof(LoRaPacket, rxTimeoutCount) == 16 && offsetof(LoRaPacket, commandState) == 24
+    && offsetof(LoRaPacket, rxCount) == 32 && offsetof(LoRaPacket, configValue) == 40, "LoRaPacket field moved");
+
+#endif // LORA_ALARM_TYPES_H
@@ -0,0 +1,68 @@
+/*
+*  Title          :  ChannelPlan
+*  Desc           :  The channels a network spreads its nodes over.  Channel 0 is the radio
+*                 :  profile's frequency and the rest follow it spacing Hz apart.  Each node
+*                 :  works on one channel, worked out from its address so the hub and the node
+*                 :  agree on it without asking.  Polls, replies, alarms and check ins all go
+*                 :  there, and frames on different channels do not collide.
+*                 :
+*                 :  The hub has one radio.  It polls each node on the node's own channel and
+*                 :  between polls scans the channels in turn with CAD, staying to receive on
+*                 :  one where it finds a preamble.  An alarm or check in, which nobody is
+*                 :  listening for, is sent with a preamble long enough to still be on air when
+*                 :  the scan comes round to its channel.  Everything else keeps the short one.
+*                 :  With one channel there is no scan, the hub listens on it as before.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.0
+*
+*/
+
+#ifndef LORA_ALARM_CHANNEL_PLAN_H
+#define LORA_ALARM_CHANNEL_PLAN_H
+
+#include <stdint.h>
+
+#include "LoRaAirtime.h"
+
+#define CHANNEL_PLAN_MAX                            8   // Channels a hub scans
+#define CHANNEL_SCAN_SYMBOLS                        4   // Preamble added per channel, a CAD is two symbols plus the retune
+
+typedef struct
+{
+    uint32_t frequency;         // Hz, channel 0
+    uint32_t spacing;           // Hz from one channel to the next
+    uint8_t count;              // 1 to CHANNEL_PLAN_MAX
+    uint16_t preambleLength;    // Symbols, frames the receiver is already listening for
+    uint16_t scanPreamble;      // Symbols, alarms and check ins, long enough for the hub's scan to find
+    uint32_t scanWindow;        // ms a receive opened on a busy CAD waits for the header
+} ChannelPlan;
+
+// The scan preamble and window follow from the count and the base rate, unsolicited frames are
+// always at the base rate
+inline ChannelPlan channelPlanMake(uint32_t frequency, uint32_t spacing, uint8_t count, uint16_t preambleLength,
+    uint8_t spreadingFactor, uint8_t bandwidth)
+{
+    ChannelPlan plan;
+    plan.frequency = frequency;
+    plan.spacing = spacing;
+    plan.count = (count < 1) ? 1 : (count > CHANNEL_PLAN_MAX) ? CHANNEL_PLAN_MAX : count;
+    plan.preambleLength = preambleLength;
+    plan.scanPreamble = (plan.count > 1) ? (uint16_t)(preambleLength + CHANNEL_SCAN_SYMBOLS * plan.count) : preambleLength;
+    plan.scanWindow = ((uint32_t)plan.scanPreamble * loraSymbolMicros(spreadingFactor, bandwidth) + 999) / 1000;
+    return plan;
+}
+
+inline uint32_t channelPlanFrequency(const ChannelPlan& plan, uint8_t channel)
+{
+    return plan.frequency + plan.spacing * channel;
+}
+
+// A node's channel.  Addresses are handed out in order, so they spread evenly
+inline uint8_t channelPlanChannel(const ChannelPlan& plan, uint16_t address)
+{
+    return (uint8_t)(address % plan.count);
+}
+
+#endif // LORA_ALARM_CHANNEL_PLAN_H
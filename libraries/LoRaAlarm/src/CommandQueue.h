@@ -0,0 +1,165 @@
+/*
+*  Title          :  CommandQueue
+*  Desc           :  Commands from the UI waiting at the hub for the one in front of them to be
+*                 :  delivered.  Each node has its own queue of Depth commands, kept in the
+*                 :  order they arrived because every command is a whole state and the last
+*                 :  one has to land last.
+*                 :
+*                 :  Each command has a priority, alarm related commands over the rest, which
+*                 :  the hub uses to decide which node's command is sent first.  A full queue
+*                 :  drops its oldest normal command to make room, an alarm command only if
+*                 :  there is nothing else to drop.  Drops are counted, along with the depth
+*                 :  and the time commands wait before they go on air.
+*                 :
+*                 :  Not thread safe, the radio state machine owns it.  Commands reach it from
+*                 :  the ESP-NOW task through an SpscQueue.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.0
+*
+*/
+
+#ifndef LORA_ALARM_COMMAND_QUEUE_H
+#define LORA_ALARM_COMMAND_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "AlarmTypes.h"
+
+typedef enum
+{
+    COMMAND_PRIORITY_NORMAL,    // Relays of a quiet node
+    COMMAND_PRIORITY_ALARM      // Changes the alarm state, or the relays of a node in alarm
+} CommandPriority_t;
+
+typedef struct
+{
+    LoRaPacket command;
+    uint8_t priority;           // CommandPriority_t
+    uint32_t queuedMs;
+} QueuedCommand;
+
+typedef struct
+{
+    unsigned long queued;       // Commands accepted
+    unsigned long started;      // Commands that went in flight
+    unsigned long dropped;      // Commands pushed out of a full queue
+    size_t depth;               // Commands waiting now, every node
+    size_t maxDepth;
+    uint32_t maxWaitMs;         // Longest wait from the UI to going in flight
+    uint64_t totalWaitMs;
+} CommandQueueStats;
+
+template <size_t MaxNodes, size_t Depth>
+class CommandQueue
+{
+    static_assert(Depth >= 1 && Depth <= 255, "CommandQueue holds 1 to 255 commands per node");
+
+public:
+    void clear(size_t node)
+    {
+        _stats.depth -= _counts[node];
+        _counts[node] = 0;
+    }
+
+    // Adds a command behind the ones already waiting.  False if one was dropped to make room
+    bool push(size_t node, const LoRaPacket& command, uint8_t priority, uint32_t now)
+    {
+        bool room = true;
+        if (_counts[node] == Depth)
+        {
+            // The state each waiting command sets is overwritten by the ones behind it
+            size_t victim = 0;
+            for (size_t i = 0; i < Depth; i++)
+            {
+                if (_entries[node][i].priority == COMMAND_PRIORITY_NORMAL)
+                {
+                    victim = i;
+                    break;
+                }
+            }
+            remove(node, victim);
+            _stats.dropped++;
+            room = false;
+        }
+        QueuedCommand& entry = _entries[node][_counts[node]++];
+        entry.command = command;
+        entry.priority = priority;
+        entry.queuedMs = now;
+        _stats.queued++;
+        _stats.depth++;
+        if (_stats.depth > _stats.maxDepth)
+        {
+            _stats.maxDepth = _stats.depth;
+        }
+        return room;
+    }
+
+    // The oldest command waiting for the node
+    bool pop(size_t node, QueuedCommand& entry)
+    {
+        if (_counts[node] == 0)
+        {
+            return false;
+        }
+        entry = _entries[node][0];
+        remove(node, 0);
+        return true;
+    }
+
+    // A UI command number already waiting, the UI repeats a command until it sees the outcome
+    bool contains(size_t node, uint8_t commandSequence) const
+    {
+        for (size_t i = 0; i < _counts[node]; i++)
+        {
+            if (_entries[node][i].command.commandSequence == commandSequence)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // The hub sent a command waitMs after it was queued
+    void started(uint32_t waitMs)
+    {
+        _stats.started++;
+        _stats.totalWaitMs += waitMs;
+        if (waitMs > _stats.maxWaitMs)
+        {
+            _stats.maxWaitMs = waitMs;
+        }
+    }
+
+    size_t depth(size_t node) const { return _counts[node]; }
+    const CommandQueueStats& stats(void) const { return _stats; }
+
+    // Zeroes everything but the depth
+    void resetStats(void)
+    {
+        size_t depth = _stats.depth;
+        CommandQueueStats none = {};
+        _stats = none;
+        _stats.depth = depth;
+        _stats.maxDepth = depth;
+    }
+
+private:
+    void remove(size_t node, size_t at)
+    {
+        for (size_t i = at + 1; i < _counts[node]; i++)
+        {
+            _entries[node][i - 1] = _entries[node][i];
+        }
+        _counts[node]--;
+        _stats.depth--;
+    }
+
+    QueuedCommand _entries[MaxNodes][Depth];
+    uint8_t _counts[MaxNodes] = {};
+    CommandQueueStats _stats = {};
+};
+
+#endif // LORA_ALARM_COMMAND_QUEUE_H
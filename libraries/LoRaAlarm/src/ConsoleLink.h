@@ -0,0 +1,240 @@
+/*
+*  Title          :  ConsoleLink
+*  Desc           :  Pairing, heartbeat and traffic counters for the ESP-NOW link between the
+*                 :  Hub and the UI.  No ESP-NOW calls in here, the sketches do the sending.
+*                 :
+*                 :  The UI broadcasts until it hears a hub, after that both ends send to each
+*                 :  other's MAC only.  The hub pushes the state of the node the UI is showing
+*                 :  when it changes and otherwise every heartbeat.  The UI sends when a command
+*                 :  is issued or still open, and otherwise every heartbeat.  An end that hears
+*                 :  nothing for the timeout forgets its peer.
+*                 :
+*                 :  Every message sent or received is counted so the display can show the
+*                 :  traffic next to what the old 500 ms request/reply polling used.
+*                 :
+*                 :  Messages are a LoRaPacket sealed with the console key shared by the hub and
+*                 :  the UI, the same AES-128 CCM as the LoRa frames.  Discovery is broadcast, so
+*                 :  ESP-NOW's own peer encryption cannot cover it.  A message that does not
+*                 :  authenticate, or whose counter is not newer than the last one accepted, is
+*                 :  dropped before it can pair or change anything.  Airtime is cheap here, so
+*                 :  the whole 32 bit counter and an 8 byte MIC are sent.
+*                 :
+*                 :    byte 0     CONSOLE_LINK_VERSION
+*                 :    byte 1-4   sender's frame counter, little endian
+*                 :    byte 5..   LoRaPacket, encrypted
+*                 :    last 8     MIC
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.2
+*  History        : 1.0 2026-10-17 Pairing, heartbeat and message rate
+*                 : 1.1 2026-10-17 Sealed messages with replay protection
+*                 : 1.2 2026-10-17 Message size from the pinned LoRaPacket layout, checked against ESP-NOW's limit
+*
+*/
+
+#ifndef LORA_ALARM_CONSOLE_LINK_H
+#define LORA_ALARM_CONSOLE_LINK_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "AlarmTypes.h"
+#include "AlarmFrame.h"
+#include "FrameSecurity.h"
+
+#define CONSOLE_LINK_MAC_SIZE                       6
+#define CONSOLE_LINK_VERSION                        1
+#define CONSOLE_LINK_HEADER_SIZE                    5   // version + counter
+#define CONSOLE_LINK_MIC_SIZE                       8
+#define CONSOLE_LINK_MESSAGE_SIZE                   (CONSOLE_LINK_HEADER_SIZE + LoRaPacketWire::size + CONSOLE_LINK_MIC_SIZE)
+#define CONSOLE_LINK_MAX_MESSAGE                    250     // ESP_NOW_MAX_DATA_LEN
+#define CONSOLE_LINK_RATE_WINDOW                    10000   // ms the message rate is averaged over
+#define CONSOLE_LINK_LEGACY_RATE                    4.0f    // msg/s, a request and a reply every 500 ms
+
+static_assert(CONSOLE_LINK_MESSAGE_SIZE <= CONSOLE_LINK_MAX_MESSAGE, "A sealed LoRaPacket no longer fits one ESP-NOW message");
+
+// True if the UI would show something different.  RSSI moves on every poll and only
+// rides along with the other changes and the heartbeat
+inline bool consolePacketChanged(const LoRaPacket& a, const LoRaPacket& b)
+{
+    return a.nodeAddress != b.nodeAddress
+        || a.alarmState != b.alarmState
+        || a.relay1Enabled != b.relay1Enabled
+        || a.relay2Enabled != b.relay2Enabled
+        || a.rxTimeoutCount != b.rxTimeoutCount
+        || a.commandSequence != b.commandSequence
+        || a.commandState != b.commandState
+        || a.commandLatency != b.commandLatency;
+}
+
+class ConsoleLink
+{
+public:
+    void begin(uint32_t heartbeatMs, uint32_t timeoutMs)
+    {
+        _heartbeat = heartbeatMs;
+        _timeout = timeoutMs;
+        _paired = false;
+        _lastSentMs = 0;
+        _lastHeardMs = 0;
+        _windowStartMs = 0;
+        _sent = 0;
+        _received = 0;
+        _windowCount = 0;
+    }
+
+    bool paired(void) const { return _paired; }
+    const uint8_t* peer(void) const { return _peer; }
+    unsigned long sent(void) const { return _sent; }
+    unsigned long received(void) const { return _received; }
+    unsigned long rejected(void) const { return _rejected; }
+    // Read back from flash and restored with frameCountersRestore() after a power cut
+    FrameCounters& counters(void) { return _counters; }
+
+    // Both ends share the key.  Messages sent go out as txDirection and are accepted as rxDirection
+    void setKey(const uint8_t key[FRAME_KEY_SIZE], uint8_t txDirection, uint8_t rxDirection)
+    {
+        _cipher.setKey(key);
+        _txDirection = txDirection;
+        _rxDirection = rxDirection;
+        FrameCounters counters = {};
+        _counters = counters;
+    }
+
+    // Seals packet into buf, which holds CONSOLE_LINK_MESSAGE_SIZE bytes.  store is set when the
+    // counters should be written to flash, before the message is sent
+    size_t seal(const LoRaPacket& packet, uint8_t* buf, bool& store)
+    {
+        uint32_t counter = frameCounterNext(_counters, store);
+        uint8_t nonce[FRAME_NONCE_SIZE];
+        buf[0] = CONSOLE_LINK_VERSION;
+        buf[1] = (uint8_t)(counter & 0xFF);
+        buf[2] = (uint8_t)((counter >> 8) & 0xFF);
+        buf[3] = (uint8_t)((counter >> 16) & 0xFF);
+        buf[4] = (uint8_t)(counter >> 24);
+        frameNonce(nonce, 0, _txDirection, counter);
+        _cipher.seal(nonce, buf, CONSOLE_LINK_HEADER_SIZE, (const uint8_t*)&packet, LoRaPacketWire::size,
+            &buf[CONSOLE_LINK_HEADER_SIZE], &buf[CONSOLE_LINK_HEADER_SIZE + LoRaPacketWire::size], CONSOLE_LINK_MIC_SIZE);
+        return CONSOLE_LINK_MESSAGE_SIZE;
+    }
+
+    // FRAME_OK and packet filled in if the message is genuine and newer than the last one.  store
+    // is set when the counters should be written to flash
+    AlarmFrameResult_t open(const uint8_t* buf, size_t len, LoRaPacket& packet, bool& store)
+    {
+        store = false;
+        AlarmFrameResult_t result = FRAME_OK;
+        LoRaPacket opened;
+        uint8_t nonce[FRAME_NONCE_SIZE];
+        uint32_t counter = 0;
+        if (len != CONSOLE_LINK_MESSAGE_SIZE)
+        {
+            result = FRAME_BAD_LENGTH;
+        }
+        else if (buf[0] != CONSOLE_LINK_VERSION)
+        {
+            result = FRAME_BAD_VERSION;
+        }
+        else
+        {
+            counter = (uint32_t)buf[1] | ((uint32_t)buf[2] << 8) | ((uint32_t)buf[3] << 16) | ((uint32_t)buf[4] << 24);
+            frameNonce(nonce, 0, _rxDirection, counter);
+            if (!_cipher.open(nonce, buf, CONSOLE_LINK_HEADER_SIZE, &buf[CONSOLE_LINK_HEADER_SIZE], LoRaPacketWire::size,
+                (uint8_t*)&opened, &buf[CONSOLE_LINK_HEADER_SIZE + LoRaPacketWire::size], CONSOLE_LINK_MIC_SIZE))
+            {
+                result = FRAME_BAD_MIC;
+            }
+            else if (counter <= _counters.rx)
+            {
+                result = FRAME_REPLAY;
+            }
+        }
+        if (result != FRAME_OK)
+        {
+            _rejected++;
+            return result;
+        }
+        frameCounterAccept(_counters, counter, store);
+        packet = opened;
+        return FRAME_OK;
+    }
+
+    // A message arrived from mac.  True if it is a new peer, the caller registers it with ESP-NOW
+    bool heard(const uint8_t* mac, uint32_t now)
+    {
+        _received++;
+        _windowCount++;
+        _lastHeardMs = now;
+        if (_paired && memcmp(mac, _peer, CONSOLE_LINK_MAC_SIZE) == 0)
+        {
+            return false;
+        }
+        memcpy(_peer, mac, CONSOLE_LINK_MAC_SIZE);
+        _paired = true;
+        return true;
+    }
+
+    // True once when the peer has been silent for the timeout, the caller removes it from ESP-NOW
+    bool lost(uint32_t now)
+    {
+        if (_paired && now - _lastHeardMs >= _timeout)
+        {
+            _paired = false;
+            return true;
+        }
+        return false;
+    }
+
+    bool heartbeatDue(uint32_t now) const
+    {
+        return now - _lastSentMs >= _heartbeat;
+    }
+
+    uint32_t sinceSent(uint32_t now) const
+    {
+        return now - _lastSentMs;
+    }
+
+    void onSent(uint32_t now)
+    {
+        _sent++;
+        _windowCount++;
+        _lastSentMs = now;
+    }
+
+    // True every CONSOLE_LINK_RATE_WINDOW with the messages/s both ways on this link and
+    // how many fewer than the old polling would have sent
+    bool rateUpdate(uint32_t now, float& rate, float& saved)
+    {
+        uint32_t elapsed = now - _windowStartMs;
+        if (elapsed < CONSOLE_LINK_RATE_WINDOW)
+        {
+            return false;
+        }
+        rate = (float)_windowCount * 1000.0f / (float)elapsed;
+        saved = CONSOLE_LINK_LEGACY_RATE - rate;
+        _windowCount = 0;
+        _windowStartMs = now;
+        return true;
+    }
+
+private:
+    uint32_t _heartbeat = 0;
+    uint32_t _timeout = 0;
+    bool _paired = false;
+    uint8_t _peer[CONSOLE_LINK_MAC_SIZE] = {};
+    uint32_t _lastSentMs = 0;
+    uint32_t _lastHeardMs = 0;
+    uint32_t _windowStartMs = 0;
+    unsigned long _sent = 0;
+    unsigned long _received = 0;
+    unsigned long _windowCount = 0;
+    unsigned long _rejected = 0;
+    AesCcm _cipher;
+    FrameCounters _counters = {};
+    uint8_t _txDirection = FRAME_HUB_TO_UI;
+    uint8_t _rxDirection = FRAME_UI_TO_HUB;
+};
+
+#endif // LORA_ALARM_CONSOLE_LINK_H
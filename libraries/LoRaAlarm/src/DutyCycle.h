@@ -0,0 +1,365 @@
+/*
+*  Title          :  DutyCycle
+*  Desc           :  Time on air spent in each EU 868 MHz sub-band over the last hour, and
+*                 :  whether the next frame may go.  ETSI EN 300 220 limits a transmitter to
+*                 :  1 % of any hour in most of the band, 36 s, and interference that makes
+*                 :  every exchange go twice uses that up quicker than it looks.
+*                 :
+*                 :  Every frame sent is charged to its sub-band.  Before sending, the protocol
+*                 :  asks wait() with the frame's airtime and priority:
+*                 :
+*                 :    AIRTIME_LOW     polls, check ins, link frames, up to DUTY_CYCLE_LOW_SHARE
+*                 :    AIRTIME_NORMAL  commands, settings and their ACKs, up to DUTY_CYCLE_NORMAL_SHARE
+*                 :    AIRTIME_ALARM   alarms and their ACKs, always sent
+*                 :
+*                 :  What is left above each share is kept for the traffic above it, so a busy
+*                 :  hour leaves room for the alarms that matter.  An alarm sent past the limit
+*                 :  is still sent, and counted.  Alarm airtime past that reserve is not held
+*                 :  against the shares below it, an alarm storm cannot stop polls and commands.
+*                 :  Low priority frames are also paced, a slice takes no more than
+*                 :  DUTY_CYCLE_PACE times its part of what the hour has left.  Polls that would
+*                 :  not fit run the share down gradually rather than spend it in the first part
+*                 :  of the hour and then stop.  A slice that has sent no command always takes
+*                 :  one while the hour still fits under the limit, so no command waits much
+*                 :  more than a slice unless the limit itself is spent.
+*                 :
+*                 :  The hour is Buckets slices, a slice drops out of the sum once all of it is
+*                 :  more than an hour old.  The sum can include up to one slice too much, never
+*                 :  too little.  Airtimes come from RadioPort::timeOnAir(), see LoRaAirtime.h.
+*                 :
+*                 :  Nothing is set up by a constructor so the node can keep it in RTC memory
+*                 :  through deep sleep, begin() and resume() do that.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.1
+*  History        : 1.0 2026-10-17 Sliding hour per sub-band, shares and pacing
+*                 : 1.1 2026-10-17 Alarms past their reserve leave the shares alone, a command a slice
+*
+*/
+
+#ifndef LORA_ALARM_DUTY_CYCLE_H
+#define LORA_ALARM_DUTY_CYCLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DUTY_CYCLE_WINDOW_MS                        3600000UL   // ETSI measures over one hour
+#define DUTY_CYCLE_BUCKETS                          60          // One minute slices
+#define DUTY_CYCLE_BANDS                            7
+#define DUTY_CYCLE_LOW_SHARE                        70          // % of a sub-band's limit low priority frames may use
+#define DUTY_CYCLE_NORMAL_SHARE                     90          // The rest is kept for alarms
+#define DUTY_CYCLE_PACE                             4           // Low priority settles at 4/5 of its share
+
+typedef enum
+{
+    AIRTIME_LOW,                // Polls, check ins and link frames, the next one will do
+    AIRTIME_NORMAL,             // Commands and settings, someone is waiting on them
+    AIRTIME_ALARM               // Alarms and their ACKs, never held back
+} AirtimePriority_t;
+
+typedef struct
+{
+    uint32_t lowHz;
+    uint32_t highHz;
+    uint16_t dutyCycle;         // Hundredths of a percent
+} DutyCycleBand;
+
+// EU 863 to 870 MHz sub-bands of ERC Recommendation 70-03 annex 1.  Anything else in 863 to 870
+// gets the strictest limit, outside it none is applied
+inline const DutyCycleBand& dutyCycleBand(size_t band)
+{
+    static const DutyCycleBand bands[DUTY_CYCLE_BANDS] =
+    {
+        { 863000000, 865000000, 10 },       // 0.1 %
+        { 865000000, 868000000, 100 },      // 1 %
+        { 868000000, 868600000, 100 },      // 1 %, 868.1, 868.3 and 868.5 MHz
+        { 868700000, 869200000, 10 },       // 0.1 %
+        { 869400000, 869650000, 1000 },     // 10 %
+        { 869700000, 870000000, 100 },      // 1 %
+        { 863000000, 870000000, 10 }        // The gaps between them
+    };
+    return bands[band];
+}
+
+// Index of the sub-band a frequency is in, -1 if it has no limit
+inline int dutyCycleBandOf(uint32_t hz)
+{
+    for (size_t i = 0; i < DUTY_CYCLE_BANDS; i++)
+    {
+        const DutyCycleBand& band = dutyCycleBand(i);
+        if (hz >= band.lowHz && hz < band.highHz)
+        {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// ms of airtime a sub-band allows in an hour
+inline uint32_t dutyCycleLimit(size_t band)
+{
+    return (uint32_t)(DUTY_CYCLE_WINDOW_MS / 10000 * dutyCycleBand(band).dutyCycle);
+}
+
+typedef struct
+{
+    unsigned long frames;       // Frames charged
+    uint64_t airtimeMs;
+    unsigned long deferred;     // Frames told to wait
+    unsigned long overLimit;    // Frames that took a sub-band past its limit, only alarms can
+    unsigned long floorFrames;  // Commands sent past their share as the slice's one
+    uint32_t maxUsedMs;         // Most airtime in any sub-band in an hour, at the time a frame went
+} DutyCycleStats;
+
+// One sub-band's airtime over the last hour
+template <size_t Buckets>
+class DutyCycleWindow
+{
+    static_assert(Buckets >= 2 && Buckets <= 254, "DutyCycleWindow has 2 to 254 slices");
+
+public:
+    static constexpr uint32_t bucketMs = DUTY_CYCLE_WINDOW_MS / Buckets;
+
+    void begin(uint32_t now)
+    {
+        for (size_t i = 0; i <= Buckets; i++)
+        {
+            _buckets[i] = 0;
+            _alarms[i] = 0;
+        }
+        _head = 0;
+        _used = 0;
+        _alarmUsed = 0;
+        _commandSent = false;
+        _bucketStart = now;
+        _lastMs = now;
+    }
+
+    // After deep sleep millis() has started again.  asleepMs is how long for, the time awake
+    // since the last frame is not known and left out, which only makes the hour look busier
+    void resume(uint32_t now, uint32_t asleepMs)
+    {
+        advance(_lastMs + asleepMs);
+        uint32_t into = _lastMs - _bucketStart;
+        _bucketStart = now - into;
+        _lastMs = now;
+    }
+
+    // Drops the slices that have left the hour
+    void advance(uint32_t now)
+    {
+        uint32_t elapsed = now - _bucketStart;
+        if ((int32_t)elapsed < 0)
+        {
+            return;
+        }
+        if (elapsed >= DUTY_CYCLE_WINDOW_MS + bucketMs)
+        {
+            begin(now - elapsed % bucketMs);
+        }
+        while (now - _bucketStart >= bucketMs)
+        {
+            _bucketStart += bucketMs;
+            _head = (uint8_t)((_head + 1) % (Buckets + 1));
+            _used -= _buckets[_head];
+            _alarmUsed -= _alarms[_head];
+            _buckets[_head] = 0;
+            _alarms[_head] = 0;
+            _commandSent = false;
+        }
+        _lastMs = now;
+    }
+
+    void add(uint32_t airtime, uint8_t priority)
+    {
+        _buckets[_head] += airtime;
+        _used += airtime;
+        if (priority == AIRTIME_ALARM)
+        {
+            _alarms[_head] += airtime;
+            _alarmUsed += airtime;
+        }
+        else if (priority == AIRTIME_NORMAL)
+        {
+            _commandSent = true;
+        }
+    }
+
+    uint32_t used(void) const { return _used; }
+    uint32_t alarmUsed(void) const { return _alarmUsed; }
+    bool commandSent(void) const { return _commandSent; }  // In the current slice
+
+    // What the shares are measured against, alarm airtime past reserve left out
+    uint32_t counted(uint32_t reserve) const
+    {
+        return countedOf(_used, _alarmUsed, reserve);
+    }
+
+    // ms until the next slice starts
+    uint32_t sliceLeft(uint32_t now) const { return _bucketStart + bucketMs - now; }
+
+    // ms until the next slice if airtime more would take this one past its pace, 0 if it fits.
+    // An empty slice always takes one frame
+    uint32_t paceFor(uint32_t now, uint32_t limit, uint32_t reserve, uint32_t airtime) const
+    {
+        uint32_t earlier = countedOf(_used - _buckets[_head], _alarmUsed - _alarms[_head], reserve);
+        uint32_t pace = (limit > earlier) ? (uint32_t)((uint64_t)(limit - earlier) * DUTY_CYCLE_PACE / Buckets) : 0;
+        if (_buckets[_head] == 0 || _buckets[_head] + airtime <= pace)
+        {
+            return 0;
+        }
+        return _bucketStart + bucketMs - now;
+    }
+
+    // ms until airtime more fits under limit, 0 if it does now.  Alarm airtime past reserve is
+    // not counted
+    uint32_t waitFor(uint32_t now, uint32_t limit, uint32_t reserve, uint32_t airtime) const
+    {
+        if (counted(reserve) + airtime <= limit)
+        {
+            return 0;
+        }
+        if (airtime > limit)
+        {
+            return DUTY_CYCLE_WINDOW_MS;
+        }
+        // Oldest slice first, each leaves the hour one slice after the one before it
+        uint32_t used = _used;
+        uint32_t alarms = _alarmUsed;
+        for (size_t k = 1; k <= Buckets; k++)
+        {
+            size_t i = (_head + k) % (Buckets + 1);
+            used -= _buckets[i];
+            alarms -= _alarms[i];
+            if (countedOf(used, alarms, reserve) + airtime <= limit)
+            {
+                return _bucketStart + (uint32_t)k * bucketMs - now;
+            }
+        }
+        return _bucketStart + DUTY_CYCLE_WINDOW_MS + bucketMs - now;
+    }
+
+private:
+    static uint32_t countedOf(uint32_t used, uint32_t alarms, uint32_t reserve)
+    {
+        return (alarms > reserve) ? used - (alarms - reserve) : used;
+    }
+
+    uint32_t _buckets[Buckets + 1]; // ms sent in each slice, _head is the current one and Buckets full ones before it
+    uint32_t _alarms[Buckets + 1];  // The part of each that was alarms
+    uint32_t _used;                 // Sum of _buckets
+    uint32_t _alarmUsed;            // Sum of _alarms
+    uint32_t _bucketStart;          // When the current slice started
+    uint32_t _lastMs;
+    uint8_t _head;
+    bool _commandSent;              // A command went in the current slice
+};
+
+template <size_t Buckets = DUTY_CYCLE_BUCKETS>
+class DutyCycle
+{
+public:
+    void begin(uint32_t now)
+    {
+        for (size_t i = 0; i < DUTY_CYCLE_BANDS; i++)
+        {
+            _windows[i].begin(now);
+        }
+        resetStats();
+    }
+
+    void resume(uint32_t now, uint32_t asleepMs)
+    {
+        for (size_t i = 0; i < DUTY_CYCLE_BANDS; i++)
+        {
+            _windows[i].resume(now, asleepMs);
+        }
+    }
+
+    // ms before a frame of airtime ms may go on frequency, 0 if it may go now.  A frame told to
+    // wait is counted as deferred, the caller holds it back or drops it
+    uint32_t wait(uint32_t now, uint32_t frequency, uint32_t airtime, uint8_t priority)
+    {
+        int band = dutyCycleBandOf(frequency);
+        if (priority == AIRTIME_ALARM || band < 0)
+        {
+            return 0;
+        }
+        DutyCycleWindow<Buckets>& window = _windows[band];
+        window.advance(now);
+        uint32_t share = (priority == AIRTIME_NORMAL) ? DUTY_CYCLE_NORMAL_SHARE : DUTY_CYCLE_LOW_SHARE;
+        uint32_t full = dutyCycleLimit(band);
+        uint32_t limit = full / 100 * share;
+        uint32_t reserve = full - full / 100 * DUTY_CYCLE_NORMAL_SHARE;
+        uint32_t wait = window.waitFor(now, limit, reserve, airtime);
+        if (wait == 0 && priority == AIRTIME_LOW)
+        {
+            wait = window.paceFor(now, limit, reserve, airtime);
+        }
+        if (wait > 0 && priority == AIRTIME_NORMAL && window.counted(reserve) + airtime <= full)
+        {
+            // The slice's one command, or the next slice's
+            if (!window.commandSent())
+            {
+                _stats.floorFrames++;
+                return 0;
+            }
+            uint32_t next = window.sliceLeft(now);
+            wait = (next < wait) ? next : wait;
+        }
+        if (wait > 0)
+        {
+            _stats.deferred++;
+        }
+        return wait;
+    }
+
+    // Every frame sent, whatever wait() said, with the priority it was asked with
+    void charge(uint32_t now, uint32_t frequency, uint32_t airtime, uint8_t priority)
+    {
+        _stats.frames++;
+        _stats.airtimeMs += airtime;
+        int band = dutyCycleBandOf(frequency);
+        if (band < 0)
+        {
+            return;
+        }
+        DutyCycleWindow<Buckets>& window = _windows[band];
+        window.advance(now);
+        window.add(airtime, priority);
+        if (window.used() > dutyCycleLimit(band))
+        {
+            _stats.overLimit++;
+        }
+        if (window.used() > _stats.maxUsedMs)
+        {
+            _stats.maxUsedMs = window.used();
+        }
+    }
+
+    // ms sent on frequency's sub-band in the last hour
+    uint32_t used(uint32_t now, uint32_t frequency)
+    {
+        int band = dutyCycleBandOf(frequency);
+        if (band < 0)
+        {
+            return 0;
+        }
+        _windows[band].advance(now);
+        return _windows[band].used();
+    }
+
+    const DutyCycleStats& stats(void) const { return _stats; }
+    void resetStats(void)
+    {
+        DutyCycleStats none = {};
+        _stats = none;
+    }
+
+private:
+    DutyCycleWindow<Buckets> _windows[DUTY_CYCLE_BANDS];
+    DutyCycleStats _stats;
+};
+
+#endif // LORA_ALARM_DUTY_CYCLE_H
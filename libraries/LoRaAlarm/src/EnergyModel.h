@@ -0,0 +1,96 @@
+/*
+*  Title          :  EnergyModel
+*  Desc           :  Battery life estimate for a RemoteNode running in low power mode.
+*                 :  The node spends its life in deep sleep and wakes for two reasons, a
+*                 :  timed check in with the hub and a sensor edge.  Each wake is costed as
+*                 :  boot time at MCU active current plus the radio time it needs, the rest
+*                 :  of the day is charged at the sleep current.
+*                 :
+*                 :  Currents are board level figures.  The Heltec V3 defaults are measured
+*                 :  values from the bench supply, rounded up.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.0
+*
+*/
+
+#ifndef LORA_ALARM_ENERGY_MODEL_H
+#define LORA_ALARM_ENERGY_MODEL_H
+
+#include <stdint.h>
+
+typedef struct
+{
+    float sleepCurrent_uA;      // Deep sleep, radio asleep, sensor powered
+    float activeCurrent_mA;     // MCU running, radio in standby
+    float rxCurrent_mA;         // MCU running, radio receiving or in CAD
+    float txCurrent_mA;         // MCU running, radio transmitting at the configured power
+    float wakeTime_ms;          // Boot and radio initialisation on every wake
+} EnergyProfile;
+
+typedef struct
+{
+    uint32_t checkInInterval_ms;
+    float alarmsPerDay;         // Sensor edges, SET and CLEAR both count
+    float uplinkAirtime_ms;     // One status or alarm frame
+    float rxWindow_ms;          // Receive window after a check in
+    float ackWait_ms;           // Time spent waiting for an alarm ACK, CAD included
+    float batteryCapacity_mAh;
+    float batteryUsable;        // Fraction of the rated capacity that is usable, 0..1
+} EnergyUsage;
+
+typedef struct
+{
+    float averageCurrent_uA;
+    float chargePerDay_mAh;
+    float awakeFraction;        // Fraction of time the MCU is not in deep sleep
+    float batteryLife_days;
+} EnergyEstimate;
+
+inline EnergyProfile energyProfileHeltecV3(void)
+{
+    EnergyProfile profile;
+    profile.sleepCurrent_uA = 70.0f;    // ~20 uA board + ~50 uA PIR
+    profile.activeCurrent_mA = 40.0f;
+    profile.rxCurrent_mA = 46.0f;
+    profile.txCurrent_mA = 85.0f;       // 14 dBm
+    profile.wakeTime_ms = 150.0f;
+    return profile;
+}
+
+inline EnergyEstimate energyEstimate(const EnergyProfile& profile, const EnergyUsage& usage)
+{
+    const float msPerDay = 86400000.0f;
+    float checkInsPerDay = (usage.checkInInterval_ms > 0) ? msPerDay / (float)usage.checkInInterval_ms : 0.0f;
+
+    // Charge per event in mA.ms
+    float checkIn = profile.wakeTime_ms * profile.activeCurrent_mA
+        + usage.uplinkAirtime_ms * profile.txCurrent_mA
+        + usage.rxWindow_ms * profile.rxCurrent_mA;
+    float alarm = profile.wakeTime_ms * profile.activeCurrent_mA
+        + usage.uplinkAirtime_ms * profile.txCurrent_mA
+        + usage.ackWait_ms * profile.rxCurrent_mA;
+
+    float awake_ms = checkInsPerDay * (profile.wakeTime_ms + usage.uplinkAirtime_ms + usage.rxWindow_ms)
+        + usage.alarmsPerDay * (profile.wakeTime_ms + usage.uplinkAirtime_ms + usage.ackWait_ms);
+    if (awake_ms > msPerDay)
+    {
+        awake_ms = msPerDay;
+    }
+    float asleep_ms = msPerDay - awake_ms;
+
+    float awakeCharge = checkInsPerDay * checkIn + usage.alarmsPerDay * alarm;
+    float sleepCharge = asleep_ms * profile.sleepCurrent_uA / 1000.0f;
+
+    EnergyEstimate estimate;
+    estimate.chargePerDay_mAh = (awakeCharge + sleepCharge) / 3600000.0f;
+    estimate.averageCurrent_uA = estimate.chargePerDay_mAh * 1000.0f / 24.0f;
+    estimate.awakeFraction = awake_ms / msPerDay;
+    estimate.batteryLife_days = (estimate.chargePerDay_mAh > 0.0f)
+        ? usage.batteryCapacity_mAh * usage.batteryUsable / estimate.chargePerDay_mAh
+        : 0.0f;
+    return estimate;
+}
+
+#endif // LORA_ALARM_ENERGY_MODEL_H
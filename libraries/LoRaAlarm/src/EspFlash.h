@@ -0,0 +1,57 @@
+/*
+*  Title          :  EspFlash
+*  Desc           :  FlashPort on an ESP32 data partition.  Firmware only, the simulator does
+*                 :  not include this file.
+*                 :
+*                 :  The default Heltec partition tables have a "spiffs" partition the alarm
+*                 :  firmware does not otherwise use.  The log takes it over, any file system
+*                 :  on it is lost.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.0
+*
+*/
+
+#ifndef LORA_ALARM_ESP_FLASH_H
+#define LORA_ALARM_ESP_FLASH_H
+
+#include <esp_partition.h>
+
+#include "FlashPort.h"
+
+class EspFlash : public FlashPort
+{
+public:
+    // False if there is no data partition with this label
+    bool begin(const char* label)
+    {
+        _partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+        return _partition != NULL;
+    }
+
+    uint32_t sectorCount(void) override
+    {
+        return (_partition == NULL) ? 0 : _partition->size / FLASH_SECTOR_SIZE;
+    }
+
+    bool read(uint32_t offset, void* data, uint32_t len) override
+    {
+        return esp_partition_read(_partition, offset, data, len) == ESP_OK;
+    }
+
+    bool write(uint32_t offset, const void* data, uint32_t len) override
+    {
+        return esp_partition_write(_partition, offset, data, len) == ESP_OK;
+    }
+
+    bool erase(uint32_t sector) override
+    {
+        return esp_partition_erase_range(_partition, sector * FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE) == ESP_OK;
+    }
+
+private:
+    const esp_partition_t* _partition = NULL;
+};
+
+#endif // LORA_ALARM_ESP_FLASH_H
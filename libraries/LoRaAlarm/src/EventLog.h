@@ -0,0 +1,433 @@
+/*
+*  Title          :  EventLog
+*  Desc           :  Append only alarm event log in NOR flash for the Hub.
+*                 :
+*                 :  Fixed size 16 byte records go into the sectors of a FlashPort in turn.
+*                 :  When the newest sector fills, the oldest is erased and becomes the newest,
+*                 :  so every sector is erased the same number of times and the log always
+*                 :  holds the most recent (sectors - 1) * 255 to sectors * 255 events.  Each
+*                 :  sector starts with a header holding its place in the ring and its erase
+*                 :  count.
+*                 :
+*                 :  Appends are held in RAM and written EVENT_LOG_BATCH at a time, or when the
+*                 :  oldest has waited maxAgeMs, to keep flash writes down.  Every record has
+*                 :  its own CRC so one torn by a power cut mid write is skipped at the next
+*                 :  begin() and the rest of the log is kept.
+*                 :
+*                 :  begin() rebuilds a RAM index, a chain from each record to the previous
+*                 :  record for the same node, so "last N events for node X" reads N records
+*                 :  rather than scanning the log.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.0
+*
+*/
+
+#ifndef LORA_ALARM_EVENT_LOG_H
+#define LORA_ALARM_EVENT_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "AlarmFrame.h"
+#include "FlashPort.h"
+
+#define EVENT_LOG_MAGIC                             0x474F4C41  // "ALOG"
+#define EVENT_LOG_RECORD_SIZE                       16
+#define EVENT_LOG_SLOTS                             (FLASH_SECTOR_SIZE / EVENT_LOG_RECORD_SIZE - 1) // Per sector, the first slot is the header
+#define EVENT_LOG_BATCH                             8       // Records written to flash at once
+#define EVENT_LOG_READ_CHUNK                        16      // Records read at once by begin()
+#define EVENT_LOG_NONE                              0xFFFF
+#define EVENT_LOG_EMPTY                             0xFFFFFFFF
+
+typedef struct
+{
+    uint32_t sequence;          // Log wide, counts up from 1, EVENT_LOG_EMPTY is an unwritten slot
+    uint32_t timeMs;            // Hub millis() when the event was logged
+    uint16_t nodeAddress;
+    uint8_t state;              // DeviceStates_t
+    uint8_t boot;               // Hub boots since the log was created, mod 256, so timeMs can be placed
+    int16_t rssi;               // dBm
+    int8_t snr;                 // dB
+    uint8_t crc;                // CRC-8 of the bytes before it
+} EventRecord;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t sequence;          // Position in the ring, the newest sector has the highest
+    uint32_t eraseCount;
+    uint32_t reserved;
+} EventLogSector;
+
+static_assert(sizeof(EventRecord) == EVENT_LOG_RECORD_SIZE, "EventRecord must be 16 bytes");
+static_assert(sizeof(EventLogSector) == EVENT_LOG_RECORD_SIZE, "EventLogSector must be 16 bytes");
+
+template <size_t MaxNodes, uint16_t Sectors>
+class EventLog
+{
+    static_assert(Sectors >= 2, "EventLog needs at least two sectors");
+    static_assert((uint32_t)Sectors * EVENT_LOG_SLOTS < EVENT_LOG_NONE, "EventLog index is 16 bit");
+
+public:
+    explicit EventLog(FlashPort& flash)
+        : _flash(flash)
+    {
+    }
+
+    // Finds the end of the log and rebuilds the index, formats the area if it holds no log.
+    // False if the area is under two sectors or the flash fails
+    bool begin(uint32_t maxAgeMs)
+    {
+        _maxAge = maxAgeMs;
+        _sectors = (_flash.sectorCount() < Sectors) ? (uint16_t)_flash.sectorCount() : Sectors;
+        _nodeCount = 0;
+        _records = 0;
+        _pendingCount = 0;
+        _nextSequence = 1;
+        _boot = 0;
+        _torn = 0;
+        _writes = 0;
+        _erases = 0;
+        _maxEraseCount = 0;
+        memset(_prev, 0xFF, sizeof(_prev));
+        memset(_sectorRecords, 0, sizeof(_sectorRecords));
+        if (_sectors < 2)
+        {
+            return false;
+        }
+
+        bool found = false;
+        EventLogSector header;
+        for (uint16_t sector = 0; sector < _sectors; sector++)
+        {
+            if (!readHeader(sector, header))
+            {
+                return false;
+            }
+            if (header.magic != EVENT_LOG_MAGIC)
+            {
+                continue;
+            }
+            _maxEraseCount = (header.eraseCount > _maxEraseCount) ? header.eraseCount : _maxEraseCount;
+            if (!found || header.sequence > _headSequence)
+            {
+                found = true;
+                _head = sector;
+                _headSequence = header.sequence;
+            }
+        }
+        if (!found)
+        {
+            // Nothing here yet, start the ring at sector 0
+            _head = 0;
+            _headSequence = 0;
+            _headSlot = 0;
+            return startSector(0, 0);
+        }
+
+        // Oldest sector first so the chains point backwards in time
+        bool anyRecord = false;
+        uint8_t lastBoot = 0;
+        _headSlot = EVENT_LOG_SLOTS;
+        for (uint16_t n = 1; n <= _sectors; n++)
+        {
+            uint16_t sector = (uint16_t)((_head + n) % _sectors);
+            if (!readHeader(sector, header))
+            {
+                return false;
+            }
+            if (header.magic != EVENT_LOG_MAGIC)
+            {
+                continue;
+            }
+            EventRecord chunk[EVENT_LOG_READ_CHUNK];
+            for (uint16_t slot = 0; slot < EVENT_LOG_SLOTS; slot++)
+            {
+                uint16_t inChunk = slot % EVENT_LOG_READ_CHUNK;
+                if (inChunk == 0)
+                {
+                    uint16_t count = (EVENT_LOG_SLOTS - slot < EVENT_LOG_READ_CHUNK) ? (uint16_t)(EVENT_LOG_SLOTS - slot) : EVENT_LOG_READ_CHUNK;
+                    if (!_flash.read(slotOffset(sector, slot), chunk, count * EVENT_LOG_RECORD_SIZE))
+                    {
+                        return false;
+                    }
+                }
+                const EventRecord& record = chunk[inChunk];
+                if (recordEmpty(record))
+                {
+                    if (sector == _head)
+                    {
+                        // The rest of the newest sector has never been written
+                        _headSlot = slot;
+                        break;
+                    }
+                    continue;
+                }
+                if (!recordValid(record))
+                {
+                    _torn++;
+                    continue;
+                }
+                indexRecord(sector, slot, record);
+                _nextSequence = record.sequence + 1;
+                lastBoot = record.boot;
+                anyRecord = true;
+            }
+        }
+        _boot = anyRecord ? (uint8_t)(lastBoot + 1) : 0;
+        return true;
+    }
+
+    // Queues an event, written with the rest of its batch
+    void append(uint32_t now, uint16_t nodeAddress, uint8_t state, int16_t rssi, int8_t snr)
+    {
+        if (_pendingCount == 0)
+        {
+            _pendingSinceMs = now;
+        }
+        EventRecord& record = _pending[_pendingCount++];
+        record.sequence = _nextSequence++;
+        record.timeMs = now;
+        record.nodeAddress = nodeAddress;
+        record.state = state;
+        record.boot = _boot;
+        record.rssi = rssi;
+        record.snr = snr;
+        record.crc = alarmFrameCrc8((const uint8_t*)&record, EVENT_LOG_RECORD_SIZE - 1);
+        if (_pendingCount == EVENT_LOG_BATCH)
+        {
+            flush();
+        }
+    }
+
+    // Call from loop(), writes a part batch once its oldest record has waited maxAgeMs
+    void service(uint32_t now)
+    {
+        if (_pendingCount > 0 && now - _pendingSinceMs >= _maxAge)
+        {
+            flush();
+        }
+    }
+
+    // Writes everything queued.  False if the flash failed, the records it was writing are lost
+    bool flush(void)
+    {
+        bool ok = true;
+        uint8_t done = 0;
+        while (done < _pendingCount)
+        {
+            if (_headSlot >= EVENT_LOG_SLOTS && !nextSector())
+            {
+                ok = false;
+                break;
+            }
+            uint16_t room = (uint16_t)(EVENT_LOG_SLOTS - _headSlot);
+            uint8_t count = (uint8_t)((_pendingCount - done < room) ? _pendingCount - done : room);
+            _writes++;
+            if (!_flash.write(slotOffset(_head, _headSlot), &_pending[done], count * EVENT_LOG_RECORD_SIZE))
+            {
+                // What reached the flash is found, or skipped as torn, by the next begin()
+                _headSlot = (uint16_t)(_headSlot + count);
+                ok = false;
+                break;
+            }
+            for (uint8_t i = 0; i < count; i++)
+            {
+                indexRecord(_head, _headSlot++, _pending[done + i]);
+            }
+            done = (uint8_t)(done + count);
+        }
+        _pendingCount = 0;
+        return ok;
+    }
+
+    // Newest first, up to max of the node's events including any not yet written.  Returns the count
+    size_t latest(uint16_t nodeAddress, EventRecord* out, size_t max)
+    {
+        size_t count = 0;
+        for (int i = (int)_pendingCount - 1; i >= 0 && count < max; i--)
+        {
+            if (_pending[i].nodeAddress == nodeAddress)
+            {
+                out[count++] = _pending[i];
+            }
+        }
+        int node = findNode(nodeAddress);
+        uint16_t slot = (node < 0) ? EVENT_LOG_NONE : _nodes[node].last;
+        uint32_t newer = EVENT_LOG_EMPTY;
+        while (slot != EVENT_LOG_NONE && count < max)
+        {
+            EventRecord record;
+            if (!_flash.read(slotOffset(slot / EVENT_LOG_SLOTS, slot % EVENT_LOG_SLOTS), &record, sizeof(record)))
+            {
+                break;
+            }
+            // A link into a sector that has since been erased finds a newer record or none at all
+            if (!recordValid(record) || record.nodeAddress != nodeAddress || record.sequence >= newer)
+            {
+                break;
+            }
+            out[count++] = record;
+            newer = record.sequence;
+            slot = _prev[slot];
+        }
+        return count;
+    }
+
+    uint32_t count(void) const { return _records + _pendingCount; }     // Events held, written or not
+    uint8_t pending(void) const { return _pendingCount; }
+    uint8_t boot(void) const { return _boot; }
+    uint16_t sectors(void) const { return _sectors; }
+    uint32_t torn(void) const { return _torn; }                 // Damaged records skipped by begin()
+    uint32_t writes(void) const { return _writes; }             // Flash writes since begin()
+    uint32_t erases(void) const { return _erases; }             // Sector erases since begin()
+    uint32_t maxEraseCount(void) const { return _maxEraseCount; }
+
+private:
+    typedef struct
+    {
+        uint16_t address;
+        uint16_t last;          // Slot of the node's newest record in flash
+    } NodeIndex;
+
+    static uint32_t slotOffset(uint32_t sector, uint32_t slot)
+    {
+        return sector * FLASH_SECTOR_SIZE + (slot + 1) * EVENT_LOG_RECORD_SIZE;
+    }
+
+    static bool recordEmpty(const EventRecord& record)
+    {
+        const uint8_t* bytes = (const uint8_t*)&record;
+        for (size_t i = 0; i < sizeof(record); i++)
+        {
+            if (bytes[i] != 0xFF)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool recordValid(const EventRecord& record)
+    {
+        return record.sequence != EVENT_LOG_EMPTY
+            && record.crc == alarmFrameCrc8((const uint8_t*)&record, EVENT_LOG_RECORD_SIZE - 1);
+    }
+
+    bool readHeader(uint16_t sector, EventLogSector& header)
+    {
+        return _flash.read(sector * FLASH_SECTOR_SIZE, &header, sizeof(header));
+    }
+
+    int findNode(uint16_t address) const
+    {
+        for (size_t i = 0; i < _nodeCount; i++)
+        {
+            if (_nodes[i].address == address)
+            {
+                return (int)i;
+            }
+        }
+        return -1;
+    }
+
+    void indexRecord(uint16_t sector, uint16_t slot, const EventRecord& record)
+    {
+        uint16_t index = (uint16_t)(sector * EVENT_LOG_SLOTS + slot);
+        int node = findNode(record.nodeAddress);
+        if (node < 0 && _nodeCount < MaxNodes)
+        {
+            node = (int)_nodeCount++;
+            _nodes[node].address = record.nodeAddress;
+            _nodes[node].last = EVENT_LOG_NONE;
+        }
+        _records++;
+        _sectorRecords[sector]++;
+        if (node < 0)
+        {
+            // Node table full, kept in flash but not found by latest()
+            return;
+        }
+        _prev[index] = _nodes[node].last;
+        _nodes[node].last = index;
+    }
+
+    // The oldest sector is erased and becomes the newest
+    bool nextSector(void)
+    {
+        uint16_t sector = (uint16_t)((_head + 1) % _sectors);
+        EventLogSector header;
+        if (!readHeader(sector, header))
+        {
+            return false;
+        }
+        uint32_t eraseCount = (header.magic == EVENT_LOG_MAGIC) ? header.eraseCount : 0;
+
+        // Forget what is in it.  It is the oldest sector so a node whose newest record is
+        // in there has no others
+        _records -= _sectorRecords[sector];
+        _sectorRecords[sector] = 0;
+        for (size_t i = 0; i < _nodeCount; i++)
+        {
+            if (_nodes[i].last != EVENT_LOG_NONE && _nodes[i].last / EVENT_LOG_SLOTS == sector)
+            {
+                _nodes[i].last = EVENT_LOG_NONE;
+            }
+        }
+        memset(&_prev[sector * EVENT_LOG_SLOTS], 0xFF, EVENT_LOG_SLOTS * sizeof(_prev[0]));
+
+        if (!startSector(sector, eraseCount))
+        {
+            return false;
+        }
+        _head = sector;
+        _headSlot = 0;
+        return true;
+    }
+
+    bool startSector(uint16_t sector, uint32_t eraseCount)
+    {
+        EventLogSector header;
+        header.magic = EVENT_LOG_MAGIC;
+        header.sequence = _headSequence + 1;
+        header.eraseCount = eraseCount + 1;
+        header.reserved = EVENT_LOG_EMPTY;
+        _erases++;
+        if (!_flash.erase(sector) || !_flash.write(sector * FLASH_SECTOR_SIZE, &header, sizeof(header)))
+        {
+            return false;
+        }
+        _headSequence = header.sequence;
+        _maxEraseCount = (header.eraseCount > _maxEraseCount) ? header.eraseCount : _maxEraseCount;
+        return true;
+    }
+
+    FlashPort& _flash;
+    uint32_t _maxAge = 0;
+    uint16_t _sectors = 0;
+    uint16_t _head = 0;             // Newest sector
+    uint32_t _headSequence = 0;
+    uint16_t _headSlot = 0;         // Next free slot in it, EVENT_LOG_SLOTS when full
+
+    uint16_t _prev[Sectors * EVENT_LOG_SLOTS];  // Previous slot for the same node
+    uint8_t _sectorRecords[Sectors];
+    NodeIndex _nodes[MaxNodes];
+    size_t _nodeCount = 0;
+    uint32_t _records = 0;
+
+    EventRecord _pending[EVENT_LOG_BATCH];
+    uint8_t _pendingCount = 0;
+    uint32_t _pendingSinceMs = 0;
+
+    uint32_t _nextSequence = 1;
+    uint8_t _boot = 0;
+    uint32_t _torn = 0;
+    uint32_t _writes = 0;
+    uint32_t _erases = 0;
+    uint32_t _maxEraseCount = 0;
+};
+
+#endif // LORA_ALARM_EVENT_LOG_H
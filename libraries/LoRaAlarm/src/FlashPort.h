@@ -0,0 +1,35 @@
+/*
+*  Title          :  FlashPort
+*  Desc           :  The slice of NOR flash the event log needs.  EspFlash.h forwards it to a
+*                 :  data partition on the ESP32, the simulator provides a RAM backed copy with
+*                 :  the same rules.
+*                 :
+*                 :  NOR rules: erase sets a whole sector to 0xFF, a write can only clear bits,
+*                 :  so every byte is written at most once between erases.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.0
+*
+*/
+
+#ifndef LORA_ALARM_FLASH_PORT_H
+#define LORA_ALARM_FLASH_PORT_H
+
+#include <stdint.h>
+
+#define FLASH_SECTOR_SIZE                           4096 // Smallest erasable unit, bytes
+
+class FlashPort
+{
+public:
+    virtual ~FlashPort() {}
+
+    virtual uint32_t sectorCount(void) = 0;
+    // Offsets are bytes from the start of the area, false on any driver error
+    virtual bool read(uint32_t offset, void* data, uint32_t len) = 0;
+    virtual bool write(uint32_t offset, const void* data, uint32_t len) = 0;
+    virtual bool erase(uint32_t sector) = 0;
+};
+
+#endif // LORA_ALARM_FLASH_PORT_H
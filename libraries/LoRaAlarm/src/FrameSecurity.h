@@ -0,0 +1,354 @@
+/*
+*  Title          :  FrameSecurity
+*  Desc           :  AES-128 CCM authenticated encryption and frame counters for the LoRa and
+*                 :  ESP-NOW links.
+*                 :
+*                 :  CCM (RFC 3610) only ever runs the block cipher forwards, so only AES
+*                 :  encryption is needed.  On the ESP32 that goes to the hardware AES block
+*                 :  through mbedtls, on the host a small table driven AES-128 is used.  A frame
+*                 :  of up to 16 bytes of payload costs five block operations: B0, one block of
+*                 :  header, one of payload for the MIC and two of key stream.
+*                 :
+*                 :  The nonce is the node address, the direction and the sender's 32 bit frame
+*                 :  counter.  Every sender numbers its frames and every receiver drops anything
+*                 :  not newer than the last frame it accepted, so a recorded frame cannot be
+*                 :  played back.  Counters have to survive a power cut.  Rather than write flash
+*                 :  on every frame the sender reserves FRAME_COUNTER_RESERVE numbers at a time
+*                 :  and starts after the reservation when it boots, and the receiver writes the
+*                 :  last counter it accepted every FRAME_COUNTER_RESERVE frames.  After a power
+*                 :  cut the receiver can be fooled by at most that many of the newest frames.
+*                 :
+*                 :  Each node has its own key, derived from the hub's network key and the node
+*                 :  address, so a node that is stolen and read out gives away only its own link.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.0
+*
+*/
+
+#ifndef LORA_ALARM_FRAME_SECURITY_H
+#define LORA_ALARM_FRAME_SECURITY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(ESP_PLATFORM)
+#include "mbedtls/aes.h"
+#endif
+
+#define FRAME_KEY_SIZE                              16
+#define FRAME_BLOCK_SIZE                            16
+#define FRAME_NONCE_SIZE                            13  // CCM with a 2 byte length field
+#define FRAME_COUNTER_RESERVE                       64  // Frames between counter writes to flash
+
+typedef enum
+{
+    FRAME_UPLINK = 0,           // Node to hub
+    FRAME_DOWNLINK = 1,         // Hub to node
+    FRAME_UI_TO_HUB = 2,        // ESP-NOW
+    FRAME_HUB_TO_UI = 3
+} FrameDirection_t;
+
+// Counters of one link, one end's view.  tx is the last counter sent, rx the last accepted
+typedef struct
+{
+    uint32_t tx;
+    uint32_t rx;
+    uint32_t txReserved;        // Counters up to this may have been used before a power cut
+    uint32_t rxStored;          // Last rx written to flash
+} FrameCounters;
+
+// Counters read back from flash after a power cut
+inline void frameCountersRestore(FrameCounters& counters)
+{
+    counters.tx = counters.txReserved;
+    counters.rx = counters.rxStored;
+}
+
+// Next counter to send.  store is set when the reservation moved, write the counters to flash
+// before the frame goes out
+inline uint32_t frameCounterNext(FrameCounters& counters, bool& store)
+{
+    counters.tx++;
+    store = counters.tx >= counters.txReserved;
+    if (store)
+    {
+        counters.txReserved = counters.tx + FRAME_COUNTER_RESERVE;
+    }
+    return counters.tx;
+}
+
+// A frame with this counter was authenticated.  store is set when the counters should be written
+inline void frameCounterAccept(FrameCounters& counters, uint32_t counter, bool& store)
+{
+    counters.rx = counter;
+    store = counters.rx - counters.rxStored >= FRAME_COUNTER_RESERVE;
+    if (store)
+    {
+        counters.rxStored = counters.rx;
+    }
+}
+
+// The full counter of a frame that only carries the low 16 bits, the first after last with them
+inline uint32_t frameCounterExpand(uint32_t last, uint16_t low)
+{
+    uint32_t full = (last & 0xFFFF0000u) | low;
+    return (full > last) ? full : full + 0x10000u;
+}
+
+inline void frameNonce(uint8_t nonce[FRAME_NONCE_SIZE], uint16_t address, uint8_t direction, uint32_t counter)
+{
+    memset(nonce, 0, FRAME_NONCE_SIZE);
+    nonce[0] = (uint8_t)(address & 0xFF);
+    nonce[1] = (uint8_t)(address >> 8);
+    nonce[2] = direction;
+    nonce[3] = (uint8_t)(counter & 0xFF);
+    nonce[4] = (uint8_t)((counter >> 8) & 0xFF);
+    nonce[5] = (uint8_t)((counter >> 16) & 0xFF);
+    nonce[6] = (uint8_t)(counter >> 24);
+}
+
+#if !defined(ESP_PLATFORM)
+// FIPS-197 forward S-box
+static const uint8_t frameAesSbox[256] =
+{
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+#endif
+
+class AesCcm
+{
+public:
+    AesCcm(void)
+    {
+#if defined(ESP_PLATFORM)
+        mbedtls_aes_init(&_context);
+#endif
+    }
+
+    ~AesCcm()
+    {
+#if defined(ESP_PLATFORM)
+        mbedtls_aes_free(&_context);
+#endif
+    }
+
+    void setKey(const uint8_t key[FRAME_KEY_SIZE])
+    {
+#if defined(ESP_PLATFORM)
+        mbedtls_aes_setkey_enc(&_context, key, 128);
+#else
+        // FIPS-197 key expansion, 11 round keys
+        static const uint8_t rcon[10] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36 };
+        memcpy(_roundKeys, key, FRAME_KEY_SIZE);
+        for (uint8_t i = 4; i < 44; i++)
+        {
+            uint8_t word[4];
+            memcpy(word, &_roundKeys[(i - 1) * 4], 4);
+            if (i % 4 == 0)
+            {
+                uint8_t first = word[0];
+                word[0] = (uint8_t)(frameAesSbox[word[1]] ^ rcon[i / 4 - 1]);
+                word[1] = frameAesSbox[word[2]];
+                word[2] = frameAesSbox[word[3]];
+                word[3] = frameAesSbox[first];
+            }
+            for (uint8_t j = 0; j < 4; j++)
+            {
+                _roundKeys[i * 4 + j] = (uint8_t)(_roundKeys[(i - 4) * 4 + j] ^ word[j]);
+            }
+        }
+#endif
+    }
+
+    void encryptBlock(const uint8_t in[FRAME_BLOCK_SIZE], uint8_t out[FRAME_BLOCK_SIZE]) const
+    {
+#if defined(ESP_PLATFORM)
+        mbedtls_aes_crypt_ecb(&_context, MBEDTLS_AES_ENCRYPT, in, out);
+#else
+        uint8_t state[FRAME_BLOCK_SIZE];
+        for (uint8_t i = 0; i < FRAME_BLOCK_SIZE; i++)
+        {
+            state[i] = (uint8_t)(in[i] ^ _roundKeys[i]);
+        }
+        for (uint8_t round = 1; round <= 10; round++)
+        {
+            // SubBytes and ShiftRows together, state is column major
+            uint8_t shifted[FRAME_BLOCK_SIZE];
+            for (uint8_t column = 0; column < 4; column++)
+            {
+                for (uint8_t row = 0; row < 4; row++)
+                {
+                    shifted[column * 4 + row] = frameAesSbox[state[((column + row) % 4) * 4 + row]];
+                }
+            }
+            if (round < 10)
+            {
+                for (uint8_t column = 0; column < 4; column++)
+                {
+                    uint8_t* c = &shifted[column * 4];
+                    uint8_t all = (uint8_t)(c[0] ^ c[1] ^ c[2] ^ c[3]);
+                    uint8_t first = c[0];
+                    c[0] = (uint8_t)(c[0] ^ all ^ xtime((uint8_t)(c[0] ^ c[1])));
+                    c[1] = (uint8_t)(c[1] ^ all ^ xtime((uint8_t)(c[1] ^ c[2])));
+                    c[2] = (uint8_t)(c[2] ^ all ^ xtime((uint8_t)(c[2] ^ c[3])));
+                    c[3] = (uint8_t)(c[3] ^ all ^ xtime((uint8_t)(c[3] ^ first)));
+                }
+            }
+            for (uint8_t i = 0; i < FRAME_BLOCK_SIZE; i++)
+            {
+                state[i] = (uint8_t)(shifted[i] ^ _roundKeys[round * FRAME_BLOCK_SIZE + i]);
+            }
+        }
+        memcpy(out, state, FRAME_BLOCK_SIZE);
+#endif
+    }
+
+    // Encrypts len bytes from in to out and writes a micLen byte tag over aad and the plain text.
+    // micLen is 4, 6 ... 16, len at most 65535
+    void seal(const uint8_t nonce[FRAME_NONCE_SIZE], const uint8_t* aad, size_t aadLen,
+        const uint8_t* in, size_t len, uint8_t* out, uint8_t* mic, size_t micLen) const
+    {
+        uint8_t tag[FRAME_BLOCK_SIZE];
+        cbcMac(nonce, aad, aadLen, in, len, micLen, tag);
+        ctr(nonce, in, len, out);
+        uint8_t s0[FRAME_BLOCK_SIZE];
+        counterBlock(nonce, 0, s0);
+        for (size_t i = 0; i < micLen; i++)
+        {
+            mic[i] = (uint8_t)(tag[i] ^ s0[i]);
+        }
+    }
+
+    // Decrypts len bytes from in to out.  False, and out is not to be used, if the tag does not match
+    bool open(const uint8_t nonce[FRAME_NONCE_SIZE], const uint8_t* aad, size_t aadLen,
+        const uint8_t* in, size_t len, uint8_t* out, const uint8_t* mic, size_t micLen) const
+    {
+        ctr(nonce, in, len, out);
+        uint8_t tag[FRAME_BLOCK_SIZE];
+        cbcMac(nonce, aad, aadLen, out, len, micLen, tag);
+        uint8_t s0[FRAME_BLOCK_SIZE];
+        counterBlock(nonce, 0, s0);
+        uint8_t diff = 0;
+        for (size_t i = 0; i < micLen; i++)
+        {
+            diff |= (uint8_t)(mic[i] ^ tag[i] ^ s0[i]);    // Same time whichever byte is wrong
+        }
+        return diff == 0;
+    }
+
+private:
+    static uint8_t xtime(uint8_t x)
+    {
+        return (uint8_t)((x << 1) ^ ((x & 0x80) ? 0x1b : 0x00));
+    }
+
+    // S_i, the key stream block for counter i
+    void counterBlock(const uint8_t nonce[FRAME_NONCE_SIZE], uint16_t i, uint8_t out[FRAME_BLOCK_SIZE]) const
+    {
+        uint8_t a[FRAME_BLOCK_SIZE];
+        a[0] = 0x01;                        // L - 1 with a 2 byte length field
+        memcpy(&a[1], nonce, FRAME_NONCE_SIZE);
+        a[14] = (uint8_t)(i >> 8);
+        a[15] = (uint8_t)(i & 0xFF);
+        encryptBlock(a, out);
+    }
+
+    void ctr(const uint8_t nonce[FRAME_NONCE_SIZE], const uint8_t* in, size_t len, uint8_t* out) const
+    {
+        uint8_t stream[FRAME_BLOCK_SIZE];
+        for (size_t i = 0; i < len; i++)
+        {
+            if (i % FRAME_BLOCK_SIZE == 0)
+            {
+                counterBlock(nonce, (uint16_t)(i / FRAME_BLOCK_SIZE + 1), stream);
+            }
+            out[i] = (uint8_t)(in[i] ^ stream[i % FRAME_BLOCK_SIZE]);
+        }
+    }
+
+    void cbcMac(const uint8_t nonce[FRAME_NONCE_SIZE], const uint8_t* aad, size_t aadLen,
+        const uint8_t* data, size_t len, size_t micLen, uint8_t x[FRAME_BLOCK_SIZE]) const
+    {
+        uint8_t block[FRAME_BLOCK_SIZE];
+        block[0] = (uint8_t)((aadLen > 0 ? 0x40 : 0x00) | (((micLen - 2) / 2) << 3) | 0x01);
+        memcpy(&block[1], nonce, FRAME_NONCE_SIZE);
+        block[14] = (uint8_t)(len >> 8);
+        block[15] = (uint8_t)(len & 0xFF);
+        encryptBlock(block, x);
+
+        // Associated data, with its 2 byte length in front
+        size_t used = 2;
+        block[0] = (uint8_t)(aadLen >> 8);
+        block[1] = (uint8_t)(aadLen & 0xFF);
+        for (size_t i = 0; i < aadLen; i++)
+        {
+            block[used++] = aad[i];
+            if (used == FRAME_BLOCK_SIZE)
+            {
+                macBlock(block, used, x);
+                used = 0;
+            }
+        }
+        if (aadLen > 0 && used > 0)
+        {
+            macBlock(block, used, x);
+        }
+
+        for (size_t offset = 0; offset < len; offset += FRAME_BLOCK_SIZE)
+        {
+            size_t chunk = (len - offset < FRAME_BLOCK_SIZE) ? len - offset : FRAME_BLOCK_SIZE;
+            for (size_t i = 0; i < chunk; i++)
+            {
+                block[i] = data[offset + i];
+            }
+            macBlock(block, chunk, x);
+        }
+    }
+
+    // x = E(x ^ block), block zero padded after used bytes
+    void macBlock(const uint8_t block[FRAME_BLOCK_SIZE], size_t used, uint8_t x[FRAME_BLOCK_SIZE]) const
+    {
+        uint8_t in[FRAME_BLOCK_SIZE];
+        for (size_t i = 0; i < FRAME_BLOCK_SIZE; i++)
+        {
+            in[i] = (uint8_t)(x[i] ^ (i < used ? block[i] : 0));
+        }
+        encryptBlock(in, x);
+    }
+
+#if defined(ESP_PLATFORM)
+    mutable mbedtls_aes_context _context;   // The hardware AES block holds the key schedule
+#else
+    uint8_t _roundKeys[11 * FRAME_BLOCK_SIZE] = {};
+#endif
+};
+
+// A node's key is the network key's encryption of its address.  The hub derives every node key
+// this way, each node is built with only its own.  frame_bench --derive prints them
+inline void frameKeyDerive(const uint8_t networkKey[FRAME_KEY_SIZE], uint16_t address, uint8_t key[FRAME_KEY_SIZE])
+{
+    AesCcm cipher;
+    uint8_t block[FRAME_BLOCK_SIZE] = { 'N', 'K', (uint8_t)(address & 0xFF), (uint8_t)(address >> 8) };
+    cipher.setKey(networkKey);
+    cipher.encryptBlock(block, key);
+}
+
+#endif // LORA_ALARM_FRAME_SECURITY_H
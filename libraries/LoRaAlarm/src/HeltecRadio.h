@@ -0,0 +1,178 @@
+/*
+*  Title          :  HeltecRadio
+*  Desc           :  RadioPort for the Heltec WiFi LoRa V3 boards.  Forwards to the global
+*                 :  Radio object from LoRaWan_APP.h.  Firmware only, the simulator does not
+*                 :  include this file.
+*                 :
+*                 :  begin() does the Radio.Init() and channel/modem setup the sketches used to
+*                 :  do themselves.  The modem settings are kept so setDataRate() can reapply
+*                 :  them with a different spreading factor, TX power or preamble.
+*                 :
+*                 :  notifyOnIrq() lets a FreeRTOS task block until the SX1262 raises DIO1
+*                 :  instead of calling service() in a loop.  It takes DIO1 over from the
+*                 :  driver and passes every interrupt on to the driver's own handler, so
+*                 :  Radio.IrqProcess() still finds it, then notifies the task.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.3
+*  History        : 1.0 2026-10-17 Forwards the RadioPort calls
+*                 : 1.1 2026-10-17 begin() and setDataRate() for adaptive data rate
+*                 : 1.2 2026-10-17 DIO1 interrupt wakes a task, with the time it came in
+*                 : 1.3 2026-10-17 setChannel() for a channel plan
+*
+*/
+
+#ifndef LORA_ALARM_HELTEC_RADIO_H
+#define LORA_ALARM_HELTEC_RADIO_H
+
+#include "LoRaWan_APP.h"
+#include "esp_timer.h"
+#include "RadioPort.h"
+
+extern "C" void RadioOnDioIrq(void);    // The driver's DIO1 handler, flags the IRQ for Radio.IrqProcess()
+
+// DIO1 interrupt state, the ISR has no HeltecRadio to reach
+static TaskHandle_t heltecRadioTask = NULL;
+static volatile uint32_t heltecRadioIrqMicros = 0;
+static volatile bool heltecRadioIrq = false;
+
+static void IRAM_ATTR heltecRadioOnDio1(void)
+{
+    RadioOnDioIrq();
+    heltecRadioIrqMicros = (uint32_t)esp_timer_get_time();
+    heltecRadioIrq = true;
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(heltecRadioTask, &woken);
+    if (woken == pdTRUE)
+    {
+        portYIELD_FROM_ISR();
+    }
+}
+
+typedef struct
+{
+    uint32_t frequency;         // Hz
+    uint8_t bandwidth;          // [0: 125 kHz, 1: 250 kHz, 2: 500 kHz]
+    uint8_t codingRate;         // [1: 4/5 .. 4: 4/8]
+    uint16_t preambleLength;    // Same for Tx and Rx
+    uint16_t symbolTimeout;     // Symbols
+    bool fixLengthPayload;
+    bool iqInversion;
+    bool rxContinuous;
+    uint32_t txTimeout;         // ms
+} HeltecRadioConfig;
+
+class HeltecRadio : public RadioPort
+{
+public:
+    void begin(RadioEvents_t* events, const HeltecRadioConfig& config, uint8_t spreadingFactor, int8_t txPower)
+    {
+        _config = config;
+        _frequency = config.frequency;
+        Radio.Init(events);
+        Radio.SetChannel(config.frequency);
+        apply(spreadingFactor, txPower);
+    }
+
+    void send(const uint8_t* data, uint8_t len) override
+    {
+        Radio.Send(const_cast<uint8_t*>(data), len);
+    }
+
+    void receive(uint32_t timeoutMs) override
+    {
+        Radio.Rx(timeoutMs);
+    }
+
+    void startCad(void) override
+    {
+        Radio.StartCad();
+    }
+
+    void standby(void) override
+    {
+        Radio.Standby();
+    }
+
+    void sleep(void) override
+    {
+        Radio.Sleep();
+    }
+
+    void service(void) override
+    {
+        Radio.IrqProcess();
+    }
+
+    void setDataRate(uint8_t spreadingFactor, int8_t txPower) override
+    {
+        if (spreadingFactor != _spreadingFactor || txPower != _txPower)
+        {
+            apply(spreadingFactor, txPower);
+        }
+    }
+
+    void setChannel(uint32_t frequency, uint16_t preambleLength) override
+    {
+        if (frequency != _frequency)
+        {
+            _frequency = frequency;
+            Radio.SetChannel(frequency);
+        }
+        if (preambleLength != _config.preambleLength)
+        {
+            _config.preambleLength = preambleLength;
+            apply(_spreadingFactor, _txPower);
+        }
+    }
+
+    // Radio.TimeOnAir() works from the packet parameters apply() last set
+    uint32_t timeOnAir(uint8_t len) override
+    {
+        return Radio.TimeOnAir(MODEM_LORA, len);
+    }
+
+    // Call after begin(), which attached the driver's own handler
+    void notifyOnIrq(TaskHandle_t task)
+    {
+        heltecRadioTask = task;
+        attachInterrupt(RADIO_DIO_1, heltecRadioOnDio1, RISING);
+    }
+
+    // True if DIO1 fired since the last call, with the esp_timer_get_time() it fired at.  Two
+    // interrupts before the task gets to run count as one, the later one's time is kept
+    bool takeIrq(uint32_t& irqMicros)
+    {
+        if (!heltecRadioIrq)
+        {
+            return false;
+        }
+        heltecRadioIrq = false;
+        irqMicros = heltecRadioIrqMicros;
+        return true;
+    }
+
+private:
+    void apply(uint8_t spreadingFactor, int8_t txPower)
+    {
+        _spreadingFactor = spreadingFactor;
+        _txPower = txPower;
+        Radio.SetTxConfig(MODEM_LORA, txPower, 0, _config.bandwidth,
+            spreadingFactor, _config.codingRate,
+            _config.preambleLength, _config.fixLengthPayload,
+            true, 0, 0, _config.iqInversion, _config.txTimeout);
+
+        Radio.SetRxConfig(MODEM_LORA, _config.bandwidth, spreadingFactor,
+            _config.codingRate, 0, _config.preambleLength,
+            _config.symbolTimeout, _config.fixLengthPayload,
+            0, true, 0, 0, _config.iqInversion, _config.rxContinuous);
+    }
+
+    HeltecRadioConfig _config = {};
+    uint32_t _frequency = 0;
+    uint8_t _spreadingFactor = 0;
+    int8_t _txPower = 0;
+};
+
+#endif // LORA_ALARM_HELTEC_RADIO_H
@@ -0,0 +1,1527 @@
+/*
+*  Title          :  HubProtocol
+*  Desc           :  Radio state machine of the Hub, free of any Arduino or Heltec calls so the
+*                 :  same code runs on the board and in the host simulator.
+*                 :
+*                 :  IDLING    ask the scheduler for a node to poll, otherwise listen for
+*                 :            unsolicited alarm and check in frames
+*                 :  STATE_TX  send the node its command/watchdog frame
+*                 :  STATE_RX  open the reply window
+*                 :  LOWPOWER  wait for a radio event
+*                 :
+*                 :  The firmware forwards its RadioEvents_t callbacks to onTxDone() ... and
+*                 :  supplies time and outputs through HubPlatform.
+*                 :
+*                 :  UI commands get a hub assigned sequence number and go out as COMMAND
+*                 :  frames until the node acknowledges that number.  Failed exchanges back off
+*                 :  exponentially and at most commandWindow commands are in flight at once.
+*                 :  A command for a node that already has one on the way waits behind it in
+*                 :  the node's CommandQueue, so none is lost or overtaken.  Alarm related
+*                 :  commands get into the window and on air before the rest.
+*                 :
+*                 :  With adaptive data rate on, every frame heard from a node feeds its LinkAdr.
+*                 :  A better rate goes out in place of the next watchdog poll, or after the
+*                 :  next check in of a low power node, and is used for that node's polls once
+*                 :  acknowledged.  The hub listens at the base SF between polls.  A node that
+*                 :  misses missLimit polls in a row is polled at the fallback rate again.
+*                 :
+*                 :  Every node has its own key, derived from the network key when it is added.
+*                 :  Frames that fail authentication, or repeat a counter already accepted, are
+*                 :  dropped before anything is read from them.  The frame counters of each node
+*                 :  go to HubPlatform to be kept in flash.
+*                 :
+*                 :  A command with a configKey is a setting for the node, sent as a CONFIG
+*                 :  frame and never alarm related.  A new address goes out as six settings in
+*                 :  turn, the key the hub derives for it, a counter floor above anything that
+*                 :  key was used with, then the address, each numbered like a command.  A low
+*                 :  power node gets the next one in the same receive window.  Once the node
+*                 :  acknowledges its commit, or is heard from at the new address, its entry
+*                 :  moves there and HubPlatform is told.
+*                 :
+*                 :  The hub's own radio settings are compiled in, so a frequency, bandwidth,
+*                 :  coding rate or spreading factor other than the hub's is refused before it
+*                 :  is sent.  A node that took one would never be heard again.
+*                 :
+*                 :  Every frame sent is charged to its sub-band's hourly duty cycle, see
+*                 :  DutyCycle.h.  A poll, command or link frame that does not fit is not sent
+*                 :  and nothing of its priority or below is started until it would, a command
+*                 :  keeps its attempts and goes when the airtime is there.  The hub listens
+*                 :  meanwhile, alarm ACKs and alarm related commands always go.
+*                 :
+*                 :  With a channel plan of more than one channel, see ChannelPlan.h, each node
+*                 :  is polled and answered on its own channel.  Between polls the hub scans
+*                 :  the channels with CAD instead of listening on one, and receives on any
+*                 :  where it finds a preamble.  No poll starts while that frame comes in.
+*                 :
+*                 :  A node may only be heard through repeaters, see Repeater.h.  The hub opens
+*                 :  their envelopes and keeps the route each node's frames came by, the first
+*                 :  repeater and how many there were.  Frames to the node go back the same way
+*                 :  and its reply window is kept open for the hops.  A node heard through a
+*                 :  repeater goes back to direct only when it is heard with SNR to spare, one
+*                 :  that stops answering is tried on the route it had before.  More than one
+*                 :  copy of a frame can arrive, the first is taken and the rest are counted.
+*                 :  Relayed nodes and repeaters stay on the fallback rate.
+*                 :
+*                 :  With a superframe, see Superframe.h, the hub sends a BEACON on every channel
+*                 :  at the start of each period and gives every low power node heard directly a
+*                 :  slot after them.  A check in outside the node's slot is answered with a SLOT
+*                 :  frame, it carries the slot and the hub's clock.  No poll starts in the beacons
+*                 :  or the slots given out, or too close to the next beacon to be over by then,
+*                 :  unless an alarm command is waiting.
+*                 :
+*                 :  idle() is how long loop() has nothing to do unless a radio event or a UI
+*                 :  command comes first: until the next poll, command retry or beacon, or for
+*                 :  as long as it likes while only the radio can move it on.  Firmware that
+*                 :  runs loop() from an interrupt driven task sleeps that long.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  2.4
+*  History        : 1.0 2026-10-17 Moved out of Hub.ino
+*                 : 1.1 2026-10-17 Sequenced commands with ACK, retry and backoff
+*                 : 1.2 2026-10-17 Adaptive data rate, per node SF and TX power
+*                 : 1.3 2026-10-17 SNR of each node's last frame, for the event log
+*                 : 1.4 2026-10-17 SNR and frames heard kept in the node's LoRaPacket
+*                 : 1.5 2026-10-17 Per node keys, authenticated frames and replay protection
+*                 : 1.6 2026-10-17 Which inputs a node has active, from its alarm frames
+*                 : 1.7 2026-10-17 Per node command queue, alarm commands first, depth, wait and drop counts
+*                 : 1.8 2026-10-17 Node settings over the air, a node moved to a new address
+*                 : 1.9 2026-10-17 Duty cycle governor, polls and commands held back when the airtime is spent
+*                 : 2.0 2026-10-17 Channel plan, nodes polled on their own channel and the rest scanned
+*                 : 2.1 2026-10-17 Routes through repeaters, relayed frames unwrapped and duplicates dropped
+*                 : 2.2 2026-10-17 Superframe beacons, slots for low power check ins
+*                 : 2.3 2026-10-17 idle(), time until loop() has a poll, retry or beacon to start
+*                 : 2.4 2026-10-17 Airtime charged with the priority it was asked with
+*                 : 2.5 2026-10-17 Radio settings other than the hub's own refused
+*
+*/
+
+#ifndef LORA_ALARM_HUB_PROTOCOL_H
+#define LORA_ALARM_HUB_PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "AlarmTypes.h"
+#include "AlarmFrame.h"
+#include "ChannelPlan.h"
+#include "CommandQueue.h"
+#include "DutyCycle.h"
+#include "LinkAdr.h"
+#include "NodeScheduler.h"
+#include "NodeSettings.h"
+#include "RadioPort.h"
+#include "Repeater.h"
+#include "Superframe.h"
+
+#define HUB_COMMAND_DEPTH                           4   // Commands waiting per node behind the one on its way
+#define HUB_IDLE_NONE                               0xFFFFFFFFUL    // idle() when only a radio event or command moves the hub on
+
+class HubPlatform
+{
+public:
+    virtual ~HubPlatform() {}
+
+    virtual uint32_t millis(void) = 0;
+    virtual void setBuzzer(bool on) = 0;
+    virtual void nodeUpdated(size_t index) { (void)index; }    // A node reported its state
+    virtual void commandUpdated(size_t index) { (void)index; } // A node's command changed state
+    virtual void trace(const char* msg) { (void)msg; }
+    // A node's frame counters as last stored, false if there are none
+    virtual bool loadCounters(uint16_t address, FrameCounters& counters) { (void)address; (void)counters; return false; }
+    // Called before the frame that needs it is sent, keep the counters in flash
+    virtual void storeCounters(uint16_t address, const FrameCounters& counters) { (void)address; (void)counters; }
+    // The node committed a new address, keep the node list in flash
+    virtual void nodeMoved(size_t index, uint16_t oldAddress) { (void)index; (void)oldAddress; }
+};
+
+typedef struct
+{
+    uint32_t pollInterval;      // ms, every node is polled at least this often
+    uint32_t minSlot;           // ms, shortest poll slot, one TX + RX exchange
+    uint32_t rxTimeout;         // ms, reply window after a poll
+    uint8_t commandWindow;      // Commands in flight at once, the rest wait their turn
+    uint8_t commandMaxAttempts; // Transmissions before a command is reported failed
+    uint32_t commandBackoff;    // ms, first retry delay, doubles on every failed attempt
+    int8_t txPower;             // dBm, the hub always sends at full power
+    uint8_t bandwidth;          // The hub's radio, as in NodeSettings.  A node is only heard on the
+    uint8_t codingRate;         // same, with channels.frequency and link.fallback.spreadingFactor
+    ChannelPlan channels;       // Each frame counts against the duty cycle of its channel's sub-band
+    RelayPlan relay;            // Repeaters on the network, see Repeater.h
+    SuperframePlan superframe;  // Beacons and check in slots, period 0 for none
+    bool adr;                   // Adaptive data rate, otherwise every node stays on link.fallback
+    LinkAdrConfig link;
+    const uint8_t* networkKey;  // FRAME_KEY_SIZE bytes, every node's key is derived from it
+} HubConfig;
+
+typedef struct
+{
+    uint8_t sequence;           // On air, hub assigned, never 0
+    uint8_t attempts;
+    uint8_t priority;           // CommandPriority_t
+    uint8_t step;               // Settings of a new address sent so far
+    bool armed;                 // Handed to the scheduler, waiting for a slot or a check in
+    uint32_t queuedMs;          // When the UI sent it
+    uint32_t firstSentMs;
+    uint32_t retryAtMs;
+} HubCommand;
+
+// A new address on its way to a node
+typedef struct
+{
+    uint16_t address;           // 0 if none
+    bool staged;                // The node has it, waiting for the commit
+    uint32_t counterFloor;
+    uint8_t key[FRAME_KEY_SIZE];
+} HubMove;
+
+#define HUB_ADDRESS_STEPS                           6   // Key in four, counter floor, address
+
+// How the hub reaches a node
+typedef struct
+{
+    uint16_t via;               // First repeater toward the node, 0 if heard directly
+    uint8_t hops;               // Repeaters in between
+    uint16_t otherVia;          // The route before, tried if the node stops answering
+    uint8_t otherHops;
+    bool repeater;              // The node is a repeater itself
+} HubRoute;
+
+template <size_t MaxNodes, size_t CommandDepth = HUB_COMMAND_DEPTH>
+class HubProtocol
+{
+public:
+    HubProtocol(RadioPort& radio, HubPlatform& platform)
+        : _radio(radio), _platform(platform)
+    {
+    }
+
+    void begin(const HubConfig& config)
+    {
+        _config = config;
+        _scheduler.begin(config.pollInterval, config.minSlot);
+        _state = IDLING;
+        _currentNode = -1;
+        _listening = false;
+        _ackInFlight = false;
+        _awaitingReply = false;
+        _commandExchange = false;
+        _checkInReply = false;
+        _alarmActive = false;
+        _holding = false;
+        _scanReceive = false;
+        _scanChannel = 0;
+        _frequency = config.channels.frequency;
+        _airtime.begin(_platform.millis());
+        _superframeStart = _platform.millis();
+        _superframeNumber = 0;
+        _beaconChannel = 0;
+        _slotsUsed = 0;
+    }
+
+    // Returns the table index of the node, -1 if the table is full.  It is polled a poll interval
+    // from now, unless it checks in first
+    int addNode(uint16_t address)
+    {
+        int index = _scheduler.addNode(address, _platform.millis());
+        if (index >= 0)
+        {
+            LoRaPacket blank = {};
+            _nodeStates[index] = blank;
+            _nodeStates[index].nodeAddress = address;
+            _nodeCommands[index] = blank;
+            _nodeCommands[index].nodeAddress = address;
+            _nodeCommands[index].relay1Enabled = ACTIVE;
+            _nodeCommands[index].relay2Enabled = ACTIVE;
+            HubCommand none = {};
+            _commands[index] = none;
+            HubMove noMove = {};
+            _moves[index] = noMove;
+            _queue.clear(index);
+            _links[index].begin(_config.link.fallback);
+            HubRoute direct = {};
+            _routes[index] = direct;
+            _slotOf[index] = SUPERFRAME_NO_SLOT;
+            _slotPending[index] = false;
+
+            uint8_t key[FRAME_KEY_SIZE];
+            frameKeyDerive(_config.networkKey, address, key);
+            _ciphers[index].setKey(key);
+            FrameCounters counters = {};
+            _counters[index] = counters;
+            if (_platform.loadCounters(address, _counters[index]))
+            {
+                frameCountersRestore(_counters[index]);
+            }
+        }
+        return index;
+    }
+
+    void loop(void)
+    {
+        switch (_state)
+        {
+        case IDLING:
+            if (beacon())
+            {
+                break;
+            }
+            releaseCommands();
+            handshake();
+            if (_state == IDLING)
+            {
+                // Nothing to poll, listen for unsolicited alarm frames
+                if (!_listening)
+                {
+                    listen();
+                }
+                _radio.service();
+            }
+            break;
+        case STATE_TX:
+            txPacket();
+            break;
+        case STATE_RX:
+            {
+                // The window has to stay open for the whole reply at slower spreading factors,
+                // and for the repeaters both ways
+                uint32_t window = _config.rxTimeout + _radio.timeOnAir((uint8_t)alarmFrameSize(FRAME_CONFIG_ACK))
+                    + 2 * (uint32_t)_routes[_currentNode].hops * _config.relay.hopTime;
+                _awaitingReply = true;
+                _replyDeadline = _platform.millis() + window;
+                _radio.receive(window);
+                _state = LOWPOWER;
+            }
+            break;
+        case LOWPOWER:
+            _radio.service();
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Command from the UI, or a setting if configKey is set.  The UI repeats it until it sees the
+    // outcome, a sequence number already seen or waiting is ignored.  Returns the table index of
+    // the node, -1 if it is not one of ours
+    int setCommand(const LoRaPacket& command)
+    {
+        int index = _scheduler.find(command.nodeAddress);
+        if (index >= 0 && command.commandSequence != 0 && command.commandSequence != _nodeStates[index].commandSequence
+            && !_queue.contains(index, command.commandSequence))
+        {
+            _platform.trace("State change requested");
+            if (!_queue.push(index, command, commandPriority(index, command), _platform.millis()))
+            {
+                _platform.trace("Command queue full, oldest dropped");
+            }
+            nextCommand(index);
+        }
+        return index;
+    }
+
+    void onTxDone(void)
+    {
+        if (_ackInFlight)
+        {
+            // Nothing comes back for an ACK
+            _ackInFlight = false;
+            _state = IDLING;
+        }
+        else
+        {
+            _state = STATE_RX;
+        }
+    }
+
+    void onTxTimeout(void)
+    {
+        _platform.trace("TX timeout");
+        _radio.sleep();
+        if (_ackInFlight)
+        {
+            // The node retries the alarm if it misses the ACK
+            _ackInFlight = false;
+            _state = IDLING;
+        }
+        else
+        {
+            _state = STATE_TX;
+        }
+    }
+
+    void onRxTimeout(void)
+    {
+        if (_scanReceive)
+        {
+            // Whatever the scan found is gone, carry on from the next channel
+            _scanReceive = false;
+            _listening = false;
+            _scanChannel = (uint8_t)((_scanChannel + 1) % _config.channels.count);
+            return;
+        }
+        _platform.trace("RX timeout");
+        _awaitingReply = false;
+        _radio.sleep();
+        if (_currentNode >= 0)
+        {
+            _nodeStates[_currentNode].rxTimeoutCount++;
+            _scheduler.onMissed(_currentNode);
+            if (_commandExchange)
+            {
+                commandAttemptFailed(_currentNode);
+            }
+            linkMissed(_currentNode);
+        }
+        _commandExchange = false;
+        _state = IDLING;         // The scheduler polls nodes that missed a reply again sooner
+    }
+
+    void onRxDone(const uint8_t* payload, uint16_t size, int16_t rssi, int8_t snr)
+    {
+        AlarmFrame frame = {};
+        bool pollReply = _awaitingReply;
+        bool commandExchange = _commandExchange;
+        _awaitingReply = false;
+        _commandExchange = false;
+        _listening = false;
+        _scanReceive = false;
+        _radio.sleep();
+        _state = IDLING;
+
+        // A repeater's envelope.  One on its way to a node is the hub's own frame passed on
+        RelayHeader relay = {};
+        bool relayed = relayFramePeek(payload, size, relay) == FRAME_OK;
+        if (relayed && relay.downlink)
+        {
+            resumeReply(pollReply, commandExchange);
+            return;
+        }
+        if (relayed)
+        {
+            payload = relay.frame;
+            size = relay.length;
+        }
+
+        // The clear header says whose key to use
+        int index = -1;
+        AlarmFrameResult_t result = alarmFramePeek(payload, size, frame);
+        if (result == FRAME_OK && (frame.type == FRAME_STATUS || frame.type == FRAME_ALARM
+            || frame.type == FRAME_COMMAND_ACK || frame.type == FRAME_LINK_ACK || frame.type == FRAME_CONFIG_ACK))
+        {
+            index = _scheduler.find(frame.nodeAddress);
+            if (index < 0)
+            {
+                index = arrived(frame.nodeAddress, payload, size);
+            }
+            if (index < 0)
+            {
+                _platform.trace("Unknown node");
+            }
+            else if (_counters[index].rx != 0 && (uint16_t)frame.counter == (uint16_t)_counters[index].rx)
+            {
+                // Another copy of the frame last accepted, by another path
+                _duplicates++;
+                resumeReply(pollReply, commandExchange);
+                return;
+            }
+            else
+            {
+                uint16_t counter = (uint16_t)frame.counter;
+                result = alarmFrameDecode(payload, size, _ciphers[index], FRAME_UPLINK, _counters[index].rx, frame);
+                if (relayed && (result == FRAME_REPLAY || (result == FRAME_BAD_MIC && counter == (uint16_t)_counters[index].tx)))
+                {
+                    // An older copy, or a repeater passing on the hub's own poll
+                    _duplicates++;
+                    resumeReply(pollReply, commandExchange);
+                    return;
+                }
+                if (result == FRAME_OK)
+                {
+                    bool store;
+                    frameCounterAccept(_counters[index], frame.counter, store);
+                    if (store)
+                    {
+                        _platform.storeCounters(frame.nodeAddress, _counters[index]);
+                    }
+                }
+                else
+                {
+                    index = -1;
+                }
+            }
+        }
+        if (result != FRAME_OK)
+        {
+            _rejected++;
+            _platform.trace(alarmFrameResultString(result));
+        }
+
+        // Anything but the ACK for the command just sent counts against it
+        bool delivered = index >= 0 && ((frame.type == FRAME_COMMAND_ACK && commandDelivered(index, frame.sequence))
+            || (frame.type == FRAME_CONFIG_ACK && configDelivered(index, frame)));
+        if (commandExchange && !delivered && pollReply && _currentNode >= 0)
+        {
+            commandAttemptFailed(_currentNode);
+        }
+        if (index < 0)
+        {
+            return;
+        }
+
+        // Extract the values, a LINK_ACK or CONFIG_ACK carries none
+        LoRaPacket& packetData = _nodeStates[index];
+        bool carriesState = frame.type != FRAME_LINK_ACK && frame.type != FRAME_CONFIG_ACK;
+        if (carriesState)
+        {
+            packetData.nodeAddress = frame.nodeAddress;
+            packetData.alarmState = static_cast<DeviceStates_t>(frame.alarmState);
+            packetData.relay1Enabled = static_cast<RelayStates_t>(frame.relay1Enabled);
+            packetData.relay2Enabled = static_cast<RelayStates_t>(frame.relay2Enabled);
+            if (frame.type == FRAME_ALARM)
+            {
+                packetData.inputs = frame.inputs;
+            }
+            else if (packetData.alarmState != SET)
+            {
+                packetData.inputs = 0;      // A status frame only says whether any input is active
+            }
+        }
+        packetData.signalStrength = rssi;
+        packetData.snr = snr;
+        packetData.rxCount++;
+        routeHeard(index, frame, relayed ? &relay : nullptr, snr);
+        linkHeard(index, frame, snr, relayed);
+
+        uint32_t now = _platform.millis();
+        bool alarm = packetData.alarmState == SET;
+        bool checkIn = frame.type == FRAME_STATUS && frame.checkIn && !(pollReply && index == _currentNode);
+        if (checkIn || (frame.type != FRAME_STATUS && _scheduler.node(index).checksIn))
+        {
+            // Low power nodes report by themselves, any contact counts as a poll
+            _scheduler.onCheckIn(index, now, alarm);
+        }
+        else
+        {
+            _scheduler.onReply(index, now, alarm);
+        }
+        if (checkIn)
+        {
+            slotCheckIn(index, relayed);
+        }
+        if (checkIn && (_scheduler.takeCommand(index) || _links[index].changePending() || _slotPending[index]))
+        {
+            // The node's receive window is open now
+            _currentNode = index;
+            _checkInReply = true;
+            _state = STATE_TX;
+        }
+        else if (delivered && frame.type == FRAME_CONFIG_ACK && _scheduler.node(index).checksIn
+            && _nodeStates[index].commandState == COMMAND_IN_FLIGHT && _nodeCommands[index].configKey != CONFIG_NONE)
+        {
+            // The next setting of an address, the node opened another window after its ACK
+            _scheduler.takeCommand(index);
+            _currentNode = index;
+            _checkInReply = true;
+            _state = STATE_TX;
+        }
+        updateBuzzer();
+        checkCommandHeld(index);
+        _platform.nodeUpdated(index);
+
+        if (frame.type == FRAME_ALARM)
+        {
+            txAck(index, frame.sequence);
+        }
+        if (_moves[index].staged && frame.type == FRAME_CONFIG_ACK && frame.configKey == CONFIG_COMMIT
+            && frame.configResult == CONFIG_RESTARTING && delivered)
+        {
+            // The node restarts at its new address now
+            completeMove(index);
+        }
+        else if (checkIn && frame.linkCheck && _state == IDLING)
+        {
+            // Nothing else to send, an ACK nobody is waiting for proves the link
+            txAck(index, 0);
+        }
+    }
+
+    // Scanning between polls.  A channel with a preamble on it is received, a clear one passes the
+    // scan on to the next
+    void onCadDone(bool channelActivityDetected)
+    {
+        if (!_listening || _state != IDLING)
+        {
+            return;     // A poll has the radio now
+        }
+        if (channelActivityDetected)
+        {
+            _scanReceive = true;
+            _radio.receive(_config.channels.scanWindow);
+        }
+        else
+        {
+            _scanChannel = (uint8_t)((_scanChannel + 1) % _config.channels.count);
+            scan();
+        }
+    }
+
+    // ms loop() can be left for, HUB_IDLE_NONE while a frame in flight or an open window ends with
+    // a radio event.  Call loop() on every radio event and new command as well
+    uint32_t idle(void) const
+    {
+        if (_state == STATE_TX || _state == STATE_RX || (_state == IDLING && !_listening))
+        {
+            return 0;
+        }
+        if (_state != IDLING || _scanReceive)
+        {
+            return HUB_IDLE_NONE;
+        }
+        uint32_t now = _platform.millis();
+        uint32_t wait = beaconIdle(now);
+        uint32_t commands = commandIdle(now);
+        wait = (commands < wait) ? commands : wait;
+
+        // The next poll, and what handshake() keeps it waiting for
+        uint32_t poll = _scheduler.idle(now);
+        if (poll != NODE_IDLE_NONE && _holding && (int32_t)(now - _holdUntil) < 0 && !commandArmed(_holdPriority))
+        {
+            uint32_t held = _holdUntil - now;
+            poll = (held > poll) ? held : poll;
+        }
+        if (poll != NODE_IDLE_NONE && superframeBusy(now) && !commandArmed(AIRTIME_NORMAL))
+        {
+            uint32_t busy = superframeBusyLeft(now);
+            poll = (busy > poll) ? busy : poll;
+        }
+        return (poll < wait) ? poll : wait;
+    }
+
+    States_t state(void) const { return _state; }
+    bool alarmActive(void) const { return _alarmActive; }
+    size_t nodeCount(void) const { return _scheduler.count(); }
+    int findNode(uint16_t address) const { return _scheduler.find(address); }
+    const LoRaPacket& nodeState(size_t index) const { return _nodeStates[index]; }
+    const LoRaPacket& nodeCommand(size_t index) const { return _nodeCommands[index]; }
+    const HubCommand& command(size_t index) const { return _commands[index]; }
+    const HubMove& move(size_t index) const { return _moves[index]; }
+    size_t commandsWaiting(size_t index) const { return _queue.depth(index); }
+    const CommandQueueStats& commandStats(void) const { return _queue.stats(); }
+    void resetCommandStats(void) { _queue.resetStats(); }
+    const LinkAdr& link(size_t index) const { return _links[index]; }
+    const HubRoute& route(size_t index) const { return _routes[index]; }
+    unsigned long duplicateFrames(void) const { return _duplicates; }    // Copies of frames already taken
+    const FrameCounters& counters(size_t index) const { return _counters[index]; }
+    unsigned long rejectedFrames(void) const { return _rejected; }  // Forged, damaged or replayed
+    const DutyCycleStats& airtimeStats(void) const { return _airtime.stats(); }
+    uint32_t airtimeUsed(void) { return _airtime.used(_platform.millis(), _config.channels.frequency); }    // ms in the last hour on channel 0's sub-band
+    uint8_t channel(size_t index) const { return channelPlanChannel(_config.channels, _scheduler.node(index).address); }
+    uint16_t slot(size_t index) const { return _slotOf[index]; }    // SUPERFRAME_NO_SLOT if none
+    const SuperframeStats& superframeStats(void) const { return _superframeStats; }
+    NodeScheduler<MaxNodes>& scheduler(void) { return _scheduler; }
+
+private:
+    void handshake(void)
+    {
+        uint32_t now = _platform.millis();
+        if (_scanReceive)
+        {
+            return;     // A frame the scan found is coming in
+        }
+        if (_holding && (int32_t)(now - _holdUntil) < 0 && !commandArmed(_holdPriority))
+        {
+            return;     // Out of airtime, listen until the frame held back would fit
+        }
+        _holding = false;
+        if (superframeBusy(now) && !commandArmed(AIRTIME_NORMAL))
+        {
+            return;     // Beacons and check in slots, only an alarm command goes
+        }
+        int index = _scheduler.next(now);
+        if (index >= 0)
+        {
+            _currentNode = index;
+            _state = STATE_TX;  // Send a watchdog signal or command
+        }
+    }
+
+    // Alarm related: it arms, tests or clears the node, or it sets the relays of a node in alarm
+    uint8_t commandPriority(size_t index, const LoRaPacket& command) const
+    {
+        bool alarm = command.configKey == CONFIG_NONE
+            && (command.alarmState != _nodeCommands[index].alarmState || _scheduler.node(index).alarmActive);
+        return alarm ? COMMAND_PRIORITY_ALARM : COMMAND_PRIORITY_NORMAL;
+    }
+
+    // Once the node's command is delivered or has failed, the next one waiting takes its place.
+    // A setting leaves the state the UI wants alone
+    void nextCommand(size_t index)
+    {
+        QueuedCommand next;
+        LoRaPacket& wanted = _nodeCommands[index];
+        while (_nodeStates[index].commandState != COMMAND_QUEUED && _nodeStates[index].commandState != COMMAND_IN_FLIGHT
+            && _queue.pop(index, next))
+        {
+            _nodeStates[index].commandSequence = next.command.commandSequence;
+            if (next.command.configKey == CONFIG_NONE)
+            {
+                wanted = next.command;
+            }
+            else if (next.command.configKey == CONFIG_ADDRESS && !startMove(index, next.command.configValue))
+            {
+                _platform.trace("Address refused");
+                _nodeStates[index].commandState = COMMAND_REJECTED;
+                _platform.commandUpdated(index);
+                continue;
+            }
+            else if (!radioSettingMatches(next.command.configKey, next.command.configValue))
+            {
+                _platform.trace("Radio setting refused, the hub's is compiled in");
+                _nodeStates[index].commandState = COMMAND_REJECTED;
+                _platform.commandUpdated(index);
+                continue;
+            }
+            wanted.nodeAddress = _scheduler.node(index).address;
+            wanted.commandSequence = next.command.commandSequence;
+            wanted.configKey = next.command.configKey;
+            wanted.configValue = next.command.configValue;
+            queueCommand(index, next.priority, next.queuedMs);
+        }
+    }
+
+    void queueCommand(size_t index, uint8_t priority, uint32_t queuedMs)
+    {
+        HubCommand& command = _commands[index];
+        LoRaPacket& status = _nodeStates[index];
+        command.sequence = (uint8_t)(command.sequence + 1);
+        if (command.sequence == 0)
+        {
+            command.sequence = 1;   // 0 is what a freshly booted node has applied
+        }
+        command.attempts = 0;
+        command.step = 0;
+        command.priority = priority;
+        command.armed = false;
+        command.queuedMs = queuedMs;
+        command.retryAtMs = _platform.millis();
+        status.commandState = COMMAND_QUEUED;
+        status.commandLatency = 0;
+        _platform.commandUpdated(index);
+    }
+
+    // Admit queued commands to the in flight window, alarm commands then the longest waiting,
+    // and hand due retries to the scheduler
+    void releaseCommands(void)
+    {
+        uint32_t now = _platform.millis();
+        size_t inFlight = 0;
+        for (size_t i = 0; i < _scheduler.count(); i++)
+        {
+            inFlight += (_nodeStates[i].commandState == COMMAND_IN_FLIGHT) ? 1 : 0;
+        }
+        while (inFlight < _config.commandWindow)
+        {
+            int best = -1;
+            for (size_t i = 0; i < _scheduler.count(); i++)
+            {
+                if (_nodeStates[i].commandState != COMMAND_QUEUED)
+                {
+                    continue;
+                }
+                const HubCommand& command = _commands[i];
+                if (best < 0 || command.priority > _commands[best].priority
+                    || (command.priority == _commands[best].priority && (int32_t)(command.queuedMs - _commands[best].queuedMs) < 0))
+                {
+                    best = (int)i;
+                }
+            }
+            if (best < 0)
+            {
+                break;
+            }
+            _nodeStates[best].commandState = COMMAND_IN_FLIGHT;
+            _queue.started(now - _commands[best].queuedMs);
+            inFlight++;
+            _platform.commandUpdated(best);
+        }
+        for (size_t i = 0; i < _scheduler.count(); i++)
+        {
+            HubCommand& command = _commands[i];
+            if (_nodeStates[i].commandState == COMMAND_IN_FLIGHT && !command.armed && (int32_t)(now - command.retryAtMs) >= 0)
+            {
+                command.armed = true;
+                _scheduler.requestCommand(i, command.priority == COMMAND_PRIORITY_ALARM);
+            }
+        }
+    }
+
+    // 0 if releaseCommands() has a command to let into the window, otherwise until the next retry
+    // is handed to the scheduler
+    uint32_t commandIdle(uint32_t now) const
+    {
+        size_t inFlight = 0;
+        bool queued = false;
+        uint32_t wait = HUB_IDLE_NONE;
+        for (size_t i = 0; i < _scheduler.count(); i++)
+        {
+            const HubCommand& command = _commands[i];
+            queued |= _nodeStates[i].commandState == COMMAND_QUEUED;
+            if (_nodeStates[i].commandState != COMMAND_IN_FLIGHT)
+            {
+                continue;
+            }
+            inFlight++;
+            if (!command.armed)
+            {
+                int32_t left = (int32_t)(command.retryAtMs - now);
+                uint32_t retry = (left > 0) ? (uint32_t)left : 0;
+                wait = (retry < wait) ? retry : wait;
+            }
+        }
+        return (queued && inFlight < _config.commandWindow) ? 0 : wait;
+    }
+
+    bool commandDelivered(size_t index, uint8_t sequence)
+    {
+        LoRaPacket& status = _nodeStates[index];
+        const HubCommand& command = _commands[index];
+        if (status.commandState != COMMAND_IN_FLIGHT || command.attempts == 0 || sequence != command.sequence)
+        {
+            return false;
+        }
+        uint32_t latency = _platform.millis() - command.firstSentMs;
+        status.commandState = COMMAND_DELIVERED;
+        status.commandLatency = (latency > UINT16_MAX) ? UINT16_MAX : (uint16_t)latency;
+        _platform.commandUpdated(index);
+        nextCommand(index);
+        return true;
+    }
+
+    // The node's answer to the setting just sent.  An address goes on to its next step
+    bool configDelivered(size_t index, const AlarmFrame& frame)
+    {
+        LoRaPacket& status = _nodeStates[index];
+        LoRaPacket& wanted = _nodeCommands[index];
+        HubCommand& command = _commands[index];
+        if (status.commandState != COMMAND_IN_FLIGHT || command.attempts == 0 || frame.sequence != command.sequence
+            || wanted.configKey == CONFIG_NONE)
+        {
+            return false;
+        }
+        if (frame.configResult == CONFIG_REJECTED)
+        {
+            _platform.trace("Setting refused");
+            status.commandState = COMMAND_REJECTED;
+        }
+        else if (wanted.configKey == CONFIG_ADDRESS && command.step + 1 < HUB_ADDRESS_STEPS)
+        {
+            // Next step under a number of its own, its time runs from the first
+            command.step++;
+            command.sequence = (uint8_t)(command.sequence + 1);
+            if (command.sequence == 0)
+            {
+                command.sequence = 1;
+            }
+            command.attempts = 0;
+            command.armed = false;
+            command.retryAtMs = _platform.millis();
+            return true;
+        }
+        else
+        {
+            uint32_t latency = _platform.millis() - command.firstSentMs;
+            status.commandState = COMMAND_DELIVERED;
+            status.commandLatency = (latency > UINT16_MAX) ? UINT16_MAX : (uint16_t)latency;
+            _moves[index].staged |= wanted.configKey == CONFIG_ADDRESS;
+        }
+        bool moving = wanted.configKey == CONFIG_COMMIT && frame.configResult == CONFIG_RESTARTING && _moves[index].staged;
+        wanted.configKey = CONFIG_NONE;
+        if (!moving)
+        {
+            // Otherwise completeMove() reports it once the entry has its new address
+            _platform.commandUpdated(index);
+            nextCommand(index);
+        }
+        return true;
+    }
+
+    // A radio setting is only let through if it is what the hub already uses, any other setting is
+    // the node's to check
+    bool radioSettingMatches(uint8_t key, uint32_t value) const
+    {
+        switch (key)
+        {
+        case CONFIG_FREQUENCY:          return value == _config.channels.frequency;
+        case CONFIG_BANDWIDTH:          return value == _config.bandwidth;
+        case CONFIG_CODING_RATE:        return value == _config.codingRate;
+        case CONFIG_SPREADING_FACTOR:   return value == _config.link.fallback.spreadingFactor;
+        default:                        return true;
+        }
+    }
+
+    // The key for a new address and a counter floor above anything either end has used it with.
+    // False if the address is not one a node can have
+    bool startMove(size_t index, uint32_t address)
+    {
+        if (address == 0 || address >= 0xFFFF || _scheduler.find((uint16_t)address) >= 0)
+        {
+            return false;
+        }
+        HubMove& move = _moves[index];
+        FrameCounters stored = {};
+        _platform.loadCounters((uint16_t)address, stored);
+        const FrameCounters& current = _counters[index];
+        uint32_t floor = 0;
+        const uint32_t seen[] = { stored.tx, stored.rx, stored.txReserved, stored.rxStored,
+            current.tx, current.rx, current.txReserved, current.rxStored };
+        for (uint32_t counter : seen)
+        {
+            floor = (counter > floor) ? counter : floor;
+        }
+        move.address = (uint16_t)address;
+        move.staged = false;
+        move.counterFloor = floor + 2 * FRAME_COUNTER_RESERVE;
+        frameKeyDerive(_config.networkKey, move.address, move.key);
+        return true;
+    }
+
+    // A frame from an address not in the table.  The node that was moving there if the frame
+    // authenticates under the new key, the commit ACK was lost
+    int arrived(uint16_t address, const uint8_t* payload, uint16_t size)
+    {
+        for (size_t i = 0; i < _scheduler.count(); i++)
+        {
+            AesCcm cipher;
+            AlarmFrame frame = {};
+            if (_moves[i].address != address || !_moves[i].staged)
+            {
+                continue;
+            }
+            cipher.setKey(_moves[i].key);
+            if (alarmFrameDecode(payload, size, cipher, FRAME_UPLINK, _moves[i].counterFloor, frame) == FRAME_OK)
+            {
+                _platform.trace("Node heard at its new address");
+                completeMove(i);
+                return (int)i;
+            }
+        }
+        return -1;
+    }
+
+    void completeMove(size_t index)
+    {
+        HubMove& move = _moves[index];
+        uint16_t oldAddress = _scheduler.node(index).address;
+        _scheduler.node(index).address = move.address;
+        _nodeStates[index].nodeAddress = move.address;
+        _nodeCommands[index].nodeAddress = move.address;
+        _ciphers[index].setKey(move.key);
+        FrameCounters counters = { move.counterFloor, move.counterFloor, move.counterFloor, move.counterFloor };
+        _counters[index] = counters;
+        _platform.storeCounters(move.address, counters);
+        _links[index].begin(_config.link.fallback);     // The node restarts at the fallback rate
+        HubMove noMove = {};
+        move = noMove;
+        _platform.nodeMoved(index, oldAddress);
+        _platform.commandUpdated(index);
+        nextCommand(index);
+    }
+
+    void commandAttemptFailed(size_t index)
+    {
+        LoRaPacket& status = _nodeStates[index];
+        HubCommand& command = _commands[index];
+        if (status.commandState != COMMAND_IN_FLIGHT)
+        {
+            return;
+        }
+        if (command.attempts >= _config.commandMaxAttempts)
+        {
+            _platform.trace("Command failed");
+            status.commandState = COMMAND_FAILED;
+            _nodeCommands[index].configKey = CONFIG_NONE;
+            _platform.commandUpdated(index);
+            nextCommand(index);
+            return;
+        }
+        // Exponential backoff, capped so a long outage still gets retried every few minutes
+        uint8_t shift = (command.attempts > 8) ? 8 : (uint8_t)(command.attempts - 1);
+        command.retryAtMs = _platform.millis() + (_config.commandBackoff << shift);
+        command.armed = false;
+    }
+
+    // A node that rebooted, or ignored a command numbered like one it had already applied,
+    // reports relays that differ from the delivered command.  Send it again
+    void checkCommandHeld(size_t index)
+    {
+        const LoRaPacket& status = _nodeStates[index];
+        const LoRaPacket& wanted = _nodeCommands[index];
+        if (status.commandState == COMMAND_DELIVERED && _queue.depth(index) == 0
+            && (status.relay1Enabled != wanted.relay1Enabled || status.relay2Enabled != wanted.relay2Enabled))
+        {
+            _platform.trace("Node lost its command, resending");
+            queueCommand(index, commandPriority(index, wanted), _platform.millis());
+        }
+    }
+
+    // The way the node's frame came.  A relayed node heard directly has to be heard well before
+    // the repeater is given up, one relayed by a longer way only changes if it has been missing
+    void routeHeard(size_t index, const AlarmFrame& frame, const RelayHeader* relay, int8_t snr)
+    {
+        HubRoute& route = _routes[index];
+        if (frame.type == FRAME_STATUS)
+        {
+            route.repeater = frame.repeater != 0;
+        }
+        uint16_t via = (relay != nullptr) ? relay->via : 0;
+        uint8_t hops = (relay != nullptr) ? relay->hops : 0;
+        if (via == route.via && hops == route.hops)
+        {
+            return;
+        }
+        if (relay == nullptr && (float)snr - loraRequiredSnr(_config.link.fallback.spreadingFactor) < (float)_config.link.margin)
+        {
+            return;
+        }
+        if (relay != nullptr && route.hops > 0 && hops > route.hops && _scheduler.node(index).missedReplies == 0)
+        {
+            return;
+        }
+        _platform.trace((relay != nullptr) ? "Node heard through a repeater" : "Node heard directly");
+        route.otherVia = route.via;
+        route.otherHops = route.hops;
+        route.via = via;
+        route.hops = hops;
+        if (hops > 0 && !_links[index].atFallback())
+        {
+            _links[index].fallBack();
+        }
+    }
+
+    // Feed the node's ADR history, act on a LINK_ACK and offer a better rate if there is one.
+    // A relayed frame says nothing about the node's own link
+    void linkHeard(size_t index, const AlarmFrame& frame, int8_t snr, bool relayed)
+    {
+        LinkAdr& link = _links[index];
+        if (frame.type != FRAME_LINK_ACK && frame.linkFallback && !link.atFallback())
+        {
+            // The node lost the link and went back by itself
+            _platform.trace("Node back on the fallback rate");
+            link.fallBack();
+        }
+        // Alarms always go out at the fallback rate
+        if (!relayed)
+        {
+            link.addSample(snr, (frame.type == FRAME_ALARM) ? _config.link.fallback.txPower : link.rate().txPower);
+        }
+        if (frame.type == FRAME_LINK_ACK && link.changePending()
+            && frame.spreadingFactor == link.target().spreadingFactor && frame.txPower == link.target().txPower)
+        {
+            _platform.trace("Link rate changed");
+            link.confirm();
+        }
+
+        // Repeaters and the nodes behind them stay on the base rate
+        LinkRate next;
+        if (_config.adr && _routes[index].hops == 0 && !_routes[index].repeater && link.decide(_config.link, next))
+        {
+            if (_scheduler.node(index).checksIn)
+            {
+                // Low power nodes are never polled, only their power matters
+                next.spreadingFactor = _config.link.fallback.spreadingFactor;
+            }
+            if (next != link.rate())
+            {
+                _platform.trace("Link rate change offered");
+                link.request(next);
+            }
+        }
+    }
+
+    void linkMissed(size_t index)
+    {
+        // Low power nodes are asleep when polled, they check their link themselves
+        const NodeSlot& slot = _scheduler.node(index);
+        if (!slot.checksIn && slot.missedReplies >= _config.link.missLimit && !_links[index].atFallback())
+        {
+            _platform.trace("Link lost, polling at the fallback rate");
+            _links[index].fallBack();
+        }
+        HubRoute& route = _routes[index];
+        if (_config.link.missLimit > 0 && slot.missedReplies > 0 && slot.missedReplies % _config.link.missLimit == 0
+            && (route.otherVia != route.via || route.otherHops != route.hops))
+        {
+            _platform.trace("Node not answering, trying its other route");
+            HubRoute swapped = route;
+            route.via = swapped.otherVia;
+            route.hops = swapped.otherHops;
+            route.otherVia = swapped.via;
+            route.otherHops = swapped.hops;
+        }
+    }
+
+    void updateBuzzer(void)
+    {
+        bool anyAlarm = false;
+        for (size_t i = 0; i < _scheduler.count(); i++)
+        {
+            anyAlarm |= _scheduler.node(i).alarmActive;
+        }
+        if (anyAlarm != _alarmActive)
+        {
+            _alarmActive = anyAlarm;
+            _platform.setBuzzer(_alarmActive);
+        }
+    }
+
+    void txPacket(void)
+    {
+        AlarmFrame frame = {};
+        const LoRaPacket& wanted = _nodeCommands[_currentNode];
+        frame.type = FRAME_STATUS;
+        frame.nodeAddress = wanted.nodeAddress;
+        frame.alarmState = wanted.alarmState;
+        frame.relay1Enabled = wanted.relay1Enabled;
+        frame.relay2Enabled = wanted.relay2Enabled;
+
+        // Any poll of a node with a command in flight carries the command, otherwise any link
+        // change.  Polls go at the node's rate, replies to a check in at the base rate it came in on,
+        // both on the node's channel
+        LinkAdr& link = _links[_currentNode];
+        tune(_currentNode);
+        if (!_checkInReply)
+        {
+            _radio.setDataRate(link.rate().spreadingFactor, _config.txPower);
+        }
+        bool checkInReply = _checkInReply;
+        _checkInReply = false;
+        _commandExchange = _nodeStates[_currentNode].commandState == COMMAND_IN_FLIGHT;
+        if (!_commandExchange && link.changePending())
+        {
+            frame.type = FRAME_LINK;
+            frame.spreadingFactor = link.target().spreadingFactor;
+            frame.txPower = link.target().txPower;
+        }
+        bool slotReply = checkInReply && !_commandExchange && _slotPending[_currentNode];
+        if (slotReply)
+        {
+            // Ahead of a link change, that goes after the next check in.  Nothing comes back
+            frame.type = FRAME_SLOT;
+            frame.slot = _slotOf[_currentNode];
+            superframeClock(frame.superframe, frame.phase);
+        }
+        HubCommand& command = _commands[_currentNode];
+        uint8_t priority = AIRTIME_LOW;
+        if (_commandExchange)
+        {
+            frame.type = (wanted.configKey == CONFIG_NONE) ? FRAME_COMMAND : FRAME_CONFIG;
+            frame.sequence = command.sequence;
+            if (frame.type == FRAME_CONFIG)
+            {
+                configStep(_currentNode, frame);
+            }
+            priority = (command.priority == COMMAND_PRIORITY_ALARM) ? AIRTIME_ALARM : AIRTIME_NORMAL;
+        }
+
+        uint32_t wait = airtimeWait(_currentNode, frame.type, priority);
+        if (wait > 0)
+        {
+            // Not an attempt, the command goes again once the airtime is there
+            if (_commandExchange)
+            {
+                command.armed = false;
+                command.retryAtMs = _platform.millis() + wait;
+            }
+            _commandExchange = false;
+            holdBack(wait, priority);
+            return;
+        }
+        if (_commandExchange)
+        {
+            if (command.attempts == 0)
+            {
+                command.firstSentMs = _platform.millis();
+            }
+            if (command.attempts < UINT8_MAX)
+            {
+                command.attempts++;
+            }
+            command.armed = false;
+        }
+        if (slotReply)
+        {
+            _slotPending[_currentNode] = false;
+            _superframeStats.slotFrames++;
+            _ackInFlight = true;
+        }
+        sendFrame(_currentNode, frame, priority);
+    }
+
+    // The setting to send, an address is preceded by its key and counter floor
+    void configStep(size_t index, AlarmFrame& frame)
+    {
+        const LoRaPacket& wanted = _nodeCommands[index];
+        const HubMove& move = _moves[index];
+        uint8_t step = _commands[index].step;
+        frame.configKey = wanted.configKey;
+        frame.configValue = wanted.configValue;
+        if (wanted.configKey != CONFIG_ADDRESS)
+        {
+            return;
+        }
+        if (step < 4)
+        {
+            const uint8_t* word = &move.key[step * 4];
+            frame.configKey = (uint8_t)(CONFIG_KEY_0 + step);
+            frame.configValue = (uint32_t)word[0] | ((uint32_t)word[1] << 8) | ((uint32_t)word[2] << 16) | ((uint32_t)word[3] << 24);
+        }
+        else if (step == 4)
+        {
+            frame.configKey = CONFIG_COUNTER_FLOOR;
+            frame.configValue = move.counterFloor;
+        }
+    }
+
+    void txAck(size_t index, uint8_t sequence)
+    {
+        // Alarm ACKs always go, one that only proves the link is no more urgent than a poll
+        tune(index);
+        if (sequence == 0 && airtimeWait(index, FRAME_ACK, AIRTIME_LOW) > 0)
+        {
+            _platform.trace("Duty cycle limit, link check not answered");
+            return;
+        }
+        AlarmFrame frame = {};
+        frame.type = FRAME_ACK;
+        frame.nodeAddress = _nodeStates[index].nodeAddress;
+        frame.sequence = sequence;
+        _ackInFlight = true;
+        sendFrame(index, frame, (sequence == 0) ? AIRTIME_LOW : AIRTIME_ALARM);
+    }
+
+    // ms before a frame of this type to the node may go at the radio's current rate, 0 if it may
+    // go now.  The repeaters' airtime is their own
+    uint32_t airtimeWait(size_t index, uint8_t type, uint8_t priority)
+    {
+        size_t size = alarmFrameSize(type) + ((_routes[index].hops > 0) ? RELAY_FRAME_HEADER_SIZE : 0);
+        uint32_t airtime = _radio.timeOnAir((uint8_t)size);
+        return _airtime.wait(_platform.millis(), _frequency, airtime, priority);
+    }
+
+    // The node's channel, the hub's frames always have someone listening and keep the short preamble
+    void tune(size_t index)
+    {
+        _frequency = channelPlanFrequency(_config.channels, channel(index));
+        _radio.setChannel(_frequency, _config.channels.preambleLength);
+    }
+
+    // Between polls at the base rate.  One channel is listened to, more are scanned
+    void listen(void)
+    {
+        _radio.setDataRate(_config.link.fallback.spreadingFactor, _config.txPower);
+        _listening = true;
+        if (_config.channels.count > 1)
+        {
+            scan();
+            return;
+        }
+        _frequency = _config.channels.frequency;
+        _radio.setChannel(_frequency, _config.channels.preambleLength);
+        _radio.receive(0);
+    }
+
+    void scan(void)
+    {
+        _frequency = channelPlanFrequency(_config.channels, _scanChannel);
+        _radio.setChannel(_frequency, _config.channels.preambleLength);
+        _radio.startCad();
+    }
+
+    // A frame that was not the reply leaves the window open until it was due to close
+    void resumeReply(bool pollReply, bool commandExchange)
+    {
+        int32_t left = (int32_t)(_replyDeadline - _platform.millis());
+        if (!pollReply || left <= 0)
+        {
+            if (pollReply && commandExchange && _currentNode >= 0)
+            {
+                commandAttemptFailed(_currentNode);
+            }
+            return;
+        }
+        _awaitingReply = true;
+        _commandExchange = commandExchange;
+        _radio.receive((uint32_t)left);
+        _state = LOWPOWER;
+    }
+
+    // Only commands above priority until wait ms from now, listen meanwhile
+    void holdBack(uint32_t wait, uint8_t priority)
+    {
+        _platform.trace("Duty cycle limit, frame held back");
+        _holding = true;
+        _holdPriority = priority;
+        _holdUntil = _platform.millis() + wait;
+        _listening = false;
+        _state = IDLING;
+    }
+
+    // A command that would go on airtime the frame held back could not is waiting for its
+    // poll.  The scheduler hands out commands before polls
+    bool commandArmed(uint8_t heldPriority) const
+    {
+        for (size_t i = 0; i < _scheduler.count(); i++)
+        {
+            uint8_t priority = (_commands[i].priority == COMMAND_PRIORITY_ALARM) ? AIRTIME_ALARM : AIRTIME_NORMAL;
+            if (_nodeStates[i].commandState == COMMAND_IN_FLIGHT && _commands[i].armed
+                && priority > heldPriority && !_scheduler.node(i).checksIn)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Superframe number and ms into it now, the start is moved on by beacon()
+    void superframeClock(uint8_t& number, uint32_t& phase) const
+    {
+        uint32_t elapsed = _platform.millis() - _superframeStart;
+        number = (uint8_t)(_superframeNumber + elapsed / _config.superframe.period);
+        phase = elapsed % _config.superframe.period;
+    }
+
+    // Sends the next beacon due in this superframe, true if one went.  One that would go more than
+    // a guard late, after an exchange still in progress, is left out, the nodes listen long enough
+    // either side for that and no longer
+    bool beacon(void)
+    {
+        const SuperframePlan& plan = _config.superframe;
+        if (plan.period == 0 || _scanReceive)
+        {
+            return false;
+        }
+        uint32_t now = _platform.millis();
+        uint32_t elapsed = now - _superframeStart;
+        if (elapsed >= plan.period)
+        {
+            uint32_t frames = elapsed / plan.period;
+            _superframeStart += frames * plan.period;
+            _superframeNumber = (uint8_t)(_superframeNumber + frames);
+            _beaconChannel = 0;
+            elapsed -= frames * plan.period;
+        }
+        while (_beaconChannel < _config.channels.count)
+        {
+            uint32_t due = (uint32_t)_beaconChannel * plan.beaconSpacing;
+            if (elapsed < due)
+            {
+                return false;
+            }
+            uint8_t channel = _beaconChannel++;
+            _frequency = channelPlanFrequency(_config.channels, channel);
+            _radio.setChannel(_frequency, _config.channels.preambleLength);
+            _radio.setDataRate(_config.link.fallback.spreadingFactor, _config.txPower);
+            uint32_t airtime = _radio.timeOnAir(BEACON_FRAME_SIZE);
+            if (elapsed > due + plan.guard || _airtime.wait(now, _frequency, airtime, AIRTIME_NORMAL) > 0)
+            {
+                _superframeStats.beaconsSkipped++;
+                continue;
+            }
+            uint8_t outBuffer[BEACON_FRAME_SIZE];
+            beaconFrameWrite(_superframeNumber, elapsed, outBuffer);
+            _superframeStats.beacons++;
+            _listening = false;
+            _ackInFlight = true;    // Nothing comes back
+            _airtime.charge(now, _frequency, airtime, AIRTIME_NORMAL);
+            _radio.send(outBuffer, BEACON_FRAME_SIZE);
+            _state = LOWPOWER;
+            return true;
+        }
+        return false;
+    }
+
+    // Until beacon() has the next one to send
+    uint32_t beaconIdle(uint32_t now) const
+    {
+        const SuperframePlan& plan = _config.superframe;
+        if (plan.period == 0)
+        {
+            return HUB_IDLE_NONE;
+        }
+        uint32_t elapsed = now - _superframeStart;
+        if (elapsed >= plan.period)
+        {
+            return 0;
+        }
+        if (_beaconChannel < _config.channels.count)
+        {
+            uint32_t due = (uint32_t)_beaconChannel * plan.beaconSpacing;
+            return (elapsed < due) ? due - elapsed : 0;
+        }
+        return plan.period - elapsed;
+    }
+
+    // How long superframeBusy() stays true from now
+    uint32_t superframeBusyLeft(uint32_t now) const
+    {
+        const SuperframePlan& plan = _config.superframe;
+        uint32_t phase = (now - _superframeStart) % plan.period;
+        uint32_t slots = plan.beaconTime + (uint32_t)_slotsUsed * plan.slotLength;
+        return (phase < slots) ? slots - phase : plan.period - phase;
+    }
+
+    // The beacons, the slots given out so far, or too close to the next beacon for a poll
+    bool superframeBusy(uint32_t now) const
+    {
+        const SuperframePlan& plan = _config.superframe;
+        if (plan.period == 0)
+        {
+            return false;
+        }
+        uint32_t phase = (now - _superframeStart) % plan.period;
+        return phase < plan.beaconTime + (uint32_t)_slotsUsed * plan.slotLength || phase + _config.minSlot > plan.period;
+    }
+
+    // A low power node heard directly gets a slot, or keeps the one it has.  Outside it, the node
+    // is told it in the answer.  One heard through a repeater cannot keep to a slot and loses it
+    void slotCheckIn(size_t index, bool relayed)
+    {
+        const SuperframePlan& plan = _config.superframe;
+        if (plan.period == 0)
+        {
+            return;
+        }
+        if (relayed || _routes[index].hops > 0)
+        {
+            if (_slotOf[index] != SUPERFRAME_NO_SLOT)
+            {
+                _platform.trace("Node behind a repeater, slot released");
+                _slotOf[index] = SUPERFRAME_NO_SLOT;
+                _slotPending[index] = true;
+                countSlots();
+            }
+            return;
+        }
+        if (_slotOf[index] == SUPERFRAME_NO_SLOT && !assignSlot(index))
+        {
+            return;     // Every slot taken, the node checks in as it always has
+        }
+        uint8_t number;
+        uint32_t phase;
+        superframeClock(number, phase);
+        uint32_t due = superframeSlotOffset(plan, _slotOf[index]) + plan.statusAirtime;
+        bool inSlot = phase + plan.guard >= due && phase <= due + plan.guard;
+        if (inSlot)
+        {
+            _superframeStats.slotted++;
+        }
+        else
+        {
+            _superframeStats.unslotted++;
+        }
+        _slotPending[index] = !inSlot;
+    }
+
+    // The lowest slot free, false if there is none
+    bool assignSlot(size_t index)
+    {
+        uint16_t slots = (_config.superframe.slots < MaxNodes) ? _config.superframe.slots : (uint16_t)MaxNodes;
+        for (uint16_t slot = 0; slot < slots; slot++)
+        {
+            bool taken = false;
+            for (size_t i = 0; i < _scheduler.count() && !taken; i++)
+            {
+                taken = _slotOf[i] == slot;
+            }
+            if (!taken)
+            {
+                _slotOf[index] = slot;
+                countSlots();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Slots up to the last one given out, no poll starts in them
+    void countSlots(void)
+    {
+        _slotsUsed = 0;
+        for (size_t i = 0; i < _scheduler.count(); i++)
+        {
+            if (_slotOf[i] != SUPERFRAME_NO_SLOT && _slotOf[i] + 1u > _slotsUsed)
+            {
+                _slotsUsed = (uint16_t)(_slotOf[i] + 1);
+            }
+        }
+    }
+
+    // Sealed with the node's key and its next downlink counter, in an envelope for the first
+    // repeater if the node is heard through one.  priority is what its airtime was asked with
+    void sendFrame(size_t index, const AlarmFrame& frame, uint8_t priority)
+    {
+        uint8_t outBuffer[RELAY_FRAME_MAX_SIZE];
+        bool store;
+        uint32_t counter = frameCounterNext(_counters[index], store);
+        if (store)
+        {
+            _platform.storeCounters(frame.nodeAddress, _counters[index]);
+        }
+        const HubRoute& route = _routes[index];
+        size_t offset = (route.hops > 0) ? RELAY_FRAME_HEADER_SIZE : 0;
+        size_t len = alarmFrameEncode(frame, _ciphers[index], FRAME_DOWNLINK, counter, &outBuffer[offset], ALARM_FRAME_MAX_SIZE);
+        if (route.hops > 0)
+        {
+            RelayHeader relay = { route.via, 0, true, &outBuffer[offset], (uint8_t)len };
+            relayFrameWrap(relay, outBuffer);
+            len += offset;
+        }
+        _listening = false;
+        _scanReceive = false;
+        _airtime.charge(_platform.millis(), _frequency, _radio.timeOnAir((uint8_t)len), priority);
+        _radio.send(outBuffer, (uint8_t)len);
+        _state = LOWPOWER;
+    }
+
+    RadioPort& _radio;
+    HubPlatform& _platform;
+    HubConfig _config = {};
+    NodeScheduler<MaxNodes> _scheduler;
+    LoRaPacket _nodeStates[MaxNodes];       // Last status reported by each node, indexed as the scheduler
+    LoRaPacket _nodeCommands[MaxNodes];     // State the UI wants each node in
+    HubCommand _commands[MaxNodes];         // Delivery of _nodeCommands, state is in _nodeStates
+    HubMove _moves[MaxNodes];               // New address of each node, if it is getting one
+    CommandQueue<MaxNodes, CommandDepth> _queue;    // UI commands waiting behind each node's _commands
+    LinkAdr _links[MaxNodes];               // Data rate each node is polled at
+    HubRoute _routes[MaxNodes];             // Repeaters each node is reached through
+    AesCcm _ciphers[MaxNodes];              // Each node's key
+    DutyCycle<> _airtime;                   // Airtime sent in the last hour, per sub-band
+    FrameCounters _counters[MaxNodes];      // Downlink counter and last uplink counter accepted, per node
+    uint16_t _slotOf[MaxNodes];             // Each node's superframe slot, SUPERFRAME_NO_SLOT if none
+    bool _slotPending[MaxNodes];            // The node is to be told its slot after its next check in
+    SuperframeStats _superframeStats = {};
+    unsigned long _rejected = 0;
+    unsigned long _duplicates = 0;
+    States_t _state = IDLING;
+    int _currentNode = -1;                  // Table index of the node being polled
+    bool _listening = false;                // Radio is in continuous receive between polls
+    bool _ackInFlight = false;              // The frame being transmitted is an alarm ACK
+    bool _awaitingReply = false;            // Receive window open for the polled node
+    uint32_t _replyDeadline = 0;            // When it closes
+    bool _commandExchange = false;          // The poll in progress carried a command
+    bool _checkInReply = false;             // The next frame answers a check in, not a poll
+    bool _alarmActive = false;
+    bool _holding = false;                  // A frame was held back for airtime
+    uint8_t _holdPriority = AIRTIME_LOW;    // Its AirtimePriority_t
+    uint32_t _holdUntil = 0;                // When it would fit
+    uint32_t _frequency = 0;                // Channel the radio is on
+    uint8_t _scanChannel = 0;               // Channel the scan is at
+    bool _scanReceive = false;              // The scan found a preamble and is receiving it
+    uint32_t _superframeStart = 0;          // When the current superframe started
+    uint8_t _superframeNumber = 0;
+    uint8_t _beaconChannel = 0;             // Next channel to send this superframe's beacon on
+    uint16_t _slotsUsed = 0;                // Slots up to the last one given out
+};
+
+#endif // LORA_ALARM_HUB_PROTOCOL_H
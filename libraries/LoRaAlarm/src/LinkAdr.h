@@ -0,0 +1,159 @@
+/*
+*  Title          :  LinkAdr
+*  Desc           :  Adaptive data rate for the Hub, one LinkAdr per node.
+*                 :
+*                 :  The hub keeps the SNR of the last few frames it heard from each node,
+*                 :  normalised to full power, and works out the fastest spreading factor and
+*                 :  then the lowest TX power that still leaves the installation margin, the
+*                 :  same rule as a LoRaWAN network server.  The change is offered to the node
+*                 :  in a LINK frame and only takes effect once the node has acknowledged it.
+*                 :
+*                 :  The hub can only listen on one spreading factor, the base one.  Every node
+*                 :  can be heard there so alarms and check ins always go out at the base SF
+*                 :  and ADR only ever moves a node to a faster SF for the hub's polls, never
+*                 :  a slower one.  The base SF at full power is also the fallback rate both
+*                 :  ends return to when the link is lost.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.0
+*
+*/
+
+#ifndef LORA_ALARM_LINK_ADR_H
+#define LORA_ALARM_LINK_ADR_H
+
+#include <stdint.h>
+
+#define LINK_ADR_HISTORY_MAX                        20  // Most frames a decision looks back over
+
+typedef struct
+{
+    uint8_t spreadingFactor;    // [SF7..SF12]
+    int8_t txPower;             // dBm
+} LinkRate;
+
+inline bool operator==(const LinkRate& a, const LinkRate& b)
+{
+    return a.spreadingFactor == b.spreadingFactor && a.txPower == b.txPower;
+}
+
+inline bool operator!=(const LinkRate& a, const LinkRate& b)
+{
+    return !(a == b);
+}
+
+typedef struct
+{
+    LinkRate fallback;          // Base SF at full power, every node can be heard with it
+    uint8_t minSpreadingFactor; // Fastest SF ADR will move a node to
+    int8_t minTxPower;          // dBm
+    uint8_t powerStep;          // dB
+    int8_t margin;              // dB of SNR kept above the demodulator floor
+    uint8_t history;            // Frames heard at the current rate before a decision is made
+    uint8_t missLimit;          // Missed polls before the hub goes back to the fallback rate
+} LinkAdrConfig;
+
+// SX126x demodulator floor, SF7 -7.5 dB down to SF12 -20 dB
+inline float loraRequiredSnr(uint8_t spreadingFactor)
+{
+    return -7.5f - 2.5f * (float)(spreadingFactor - 7);
+}
+
+class LinkAdr
+{
+public:
+    void begin(const LinkRate& fallback)
+    {
+        _rate = fallback;
+        _target = fallback;
+        _fallback = fallback;
+        _pending = false;
+        _count = 0;
+        _next = 0;
+    }
+
+    const LinkRate& rate(void) const { return _rate; }
+    const LinkRate& target(void) const { return _target; }
+    bool changePending(void) const { return _pending; }
+    bool atFallback(void) const { return _rate == _fallback; }
+
+    // snr of a frame the node sent at txPower dBm
+    void addSample(int8_t snr, int8_t txPower)
+    {
+        int normalised = (int)snr + (int)(_fallback.txPower - txPower);
+        _samples[_next] = (int8_t)((normalised > INT8_MAX) ? INT8_MAX : normalised);
+        _next = (uint8_t)((_next + 1) % LINK_ADR_HISTORY_MAX);
+        if (_count < LINK_ADR_HISTORY_MAX)
+        {
+            _count++;
+        }
+    }
+
+    // True, with the rate to offer the node, once enough frames have been heard at the
+    // current rate and they support a different one
+    bool decide(const LinkAdrConfig& config, LinkRate& next) const
+    {
+        uint8_t needed = (config.history > LINK_ADR_HISTORY_MAX) ? LINK_ADR_HISTORY_MAX : config.history;
+        if (_pending || _count == 0 || _count < needed)
+        {
+            return false;
+        }
+        int8_t best = _samples[0];
+        for (uint8_t i = 1; i < _count; i++)
+        {
+            best = (_samples[i] > best) ? _samples[i] : best;
+        }
+
+        // Fastest SF with the margin at full power, then spend what is left on power
+        next.spreadingFactor = _fallback.spreadingFactor;
+        for (uint8_t sf = config.minSpreadingFactor; sf < _fallback.spreadingFactor; sf++)
+        {
+            if ((float)best - loraRequiredSnr(sf) >= (float)config.margin)
+            {
+                next.spreadingFactor = sf;
+                break;
+            }
+        }
+        float spare = (float)best - loraRequiredSnr(next.spreadingFactor) - (float)config.margin;
+        int steps = (spare > 0.0f && config.powerStep > 0) ? (int)(spare / (float)config.powerStep) : 0;
+        int power = (int)_fallback.txPower - steps * (int)config.powerStep;
+        next.txPower = (int8_t)((power < config.minTxPower) ? config.minTxPower : power);
+        return next != _rate;
+    }
+
+    void request(const LinkRate& next)
+    {
+        _target = next;
+        _pending = true;
+    }
+
+    // The node acknowledged the target, the history restarts at the new rate
+    void confirm(void)
+    {
+        _rate = _target;
+        _pending = false;
+        _count = 0;
+        _next = 0;
+    }
+
+    void fallBack(void)
+    {
+        _rate = _fallback;
+        _target = _fallback;
+        _pending = false;
+        _count = 0;
+        _next = 0;
+    }
+
+private:
+    LinkRate _rate = {};
+    LinkRate _target = {};
+    LinkRate _fallback = {};
+    bool _pending = false;
+    int8_t _samples[LINK_ADR_HISTORY_MAX] = {};
+    uint8_t _count = 0;
+    uint8_t _next = 0;
+};
+
+#endif // LORA_ALARM_LINK_ADR_H
@@ -0,0 +1,185 @@
+/*
+*  Title          :  LinkHistory
+*  Desc           :  Link quality history of one node for the UI's stats screen.  No heap.
+*                 :
+*                 :  Every frame the hub heard from the node is a sample with its RSSI and SNR,
+*                 :  every poll it missed is a sample with neither.  Samples are summed into
+*                 :  buckets of PerPoint as they arrive and the last Points buckets are kept in
+*                 :  a ring, one chart point each.  Drawing the chart or working out min, mean,
+*                 :  max and delivery ratio looks at Points buckets whatever PerPoint is, so a
+*                 :  longer history costs memory but no extra time.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.0
+*
+*/
+
+#ifndef LORA_ALARM_LINK_HISTORY_H
+#define LORA_ALARM_LINK_HISTORY_H
+
+#include <stdint.h>
+
+typedef struct
+{
+    int32_t rssiSum;
+    int16_t snrSum;
+    int16_t rssiMin;
+    int16_t rssiMax;
+    int8_t snrMin;
+    int8_t snrMax;
+    uint8_t heard;              // Samples with a frame
+    uint8_t missed;             // Samples without
+} LinkBucket;
+
+typedef struct
+{
+    int16_t rssiMin;
+    int16_t rssiMean;
+    int16_t rssiMax;
+    int8_t snrMin;
+    int8_t snrMean;
+    int8_t snrMax;
+    uint8_t deliveryPercent;    // Frames heard out of frames heard plus polls missed
+    uint32_t samples;
+} LinkSummary;
+
+template <uint16_t Points, uint8_t PerPoint>
+class LinkHistory
+{
+    static_assert(Points > 0 && PerPoint > 0, "LinkHistory needs at least one point of one sample");
+
+public:
+    void clear(void)
+    {
+        _count = 0;
+        _next = 0;
+        _current = {};
+    }
+
+    void addHeard(int16_t rssi, int8_t snr)
+    {
+        LinkBucket& bucket = _current;
+        if (bucket.heard == 0)
+        {
+            bucket.rssiMin = bucket.rssiMax = rssi;
+            bucket.snrMin = bucket.snrMax = snr;
+        }
+        bucket.rssiSum += rssi;
+        bucket.snrSum = (int16_t)(bucket.snrSum + snr);
+        bucket.rssiMin = (rssi < bucket.rssiMin) ? rssi : bucket.rssiMin;
+        bucket.rssiMax = (rssi > bucket.rssiMax) ? rssi : bucket.rssiMax;
+        bucket.snrMin = (snr < bucket.snrMin) ? snr : bucket.snrMin;
+        bucket.snrMax = (snr > bucket.snrMax) ? snr : bucket.snrMax;
+        bucket.heard++;
+        closeBucket();
+    }
+
+    void addMissed(void)
+    {
+        _current.missed++;
+        closeBucket();
+    }
+
+    // Chart points, oldest first, the bucket still filling is the last
+    uint16_t points(void) const
+    {
+        uint16_t total = (uint16_t)(_count + (filling() ? 1 : 0));
+        return (total > Points) ? Points : total;
+    }
+
+    // False if the point is out of range or had no frames, the chart leaves a gap
+    bool point(uint16_t index, int16_t& rssi, int8_t& snr) const
+    {
+        const LinkBucket* bucket = bucketAt(index);
+        if (bucket == nullptr || bucket->heard == 0)
+        {
+            return false;
+        }
+        rssi = (int16_t)(bucket->rssiSum / bucket->heard);
+        snr = (int8_t)(bucket->snrSum / bucket->heard);
+        return true;
+    }
+
+    LinkSummary summary(void) const
+    {
+        LinkSummary result = {};
+        int32_t rssiSum = 0;
+        int32_t snrSum = 0;
+        uint32_t heard = 0;
+        uint32_t missed = 0;
+        for (uint16_t i = 0; i < points(); i++)
+        {
+            const LinkBucket* bucket = bucketAt(i);
+            if (bucket->heard > 0)
+            {
+                if (heard == 0)
+                {
+                    result.rssiMin = bucket->rssiMin;
+                    result.rssiMax = bucket->rssiMax;
+                    result.snrMin = bucket->snrMin;
+                    result.snrMax = bucket->snrMax;
+                }
+                result.rssiMin = (bucket->rssiMin < result.rssiMin) ? bucket->rssiMin : result.rssiMin;
+                result.rssiMax = (bucket->rssiMax > result.rssiMax) ? bucket->rssiMax : result.rssiMax;
+                result.snrMin = (bucket->snrMin < result.snrMin) ? bucket->snrMin : result.snrMin;
+                result.snrMax = (bucket->snrMax > result.snrMax) ? bucket->snrMax : result.snrMax;
+                rssiSum += bucket->rssiSum;
+                snrSum += bucket->snrSum;
+            }
+            heard += bucket->heard;
+            missed += bucket->missed;
+        }
+        if (heard > 0)
+        {
+            result.rssiMean = (int16_t)(rssiSum / (int32_t)heard);
+            result.snrMean = (int8_t)(snrSum / (int32_t)heard);
+        }
+        result.samples = heard + missed;
+        result.deliveryPercent = (result.samples > 0) ? (uint8_t)(heard * 100 / result.samples) : 0;
+        return result;
+    }
+
+private:
+    void closeBucket(void)
+    {
+        if (_current.heard + _current.missed < PerPoint)
+        {
+            return;
+        }
+        _buckets[_next] = _current;
+        _next = (uint16_t)((_next + 1) % Points);
+        _count = (_count < Points) ? (uint16_t)(_count + 1) : Points;
+        _current = {};
+    }
+
+    bool filling(void) const
+    {
+        return _current.heard + _current.missed > 0;
+    }
+
+    // index 0 is the oldest.  With a part filled bucket the oldest full one drops off the
+    // chart so there are never more than Points
+    const LinkBucket* bucketAt(uint16_t index) const
+    {
+        uint16_t total = points();
+        if (index >= total)
+        {
+            return nullptr;
+        }
+        if (filling() && index == total - 1)
+        {
+            return &_current;
+        }
+        uint16_t full = (uint16_t)(total - (filling() ? 1 : 0));
+        uint16_t oldest = (uint16_t)((_next + Points - _count) % Points);
+        return &_buckets[(oldest + (_count - full) + index) % Points];
+    }
+
+    LinkBucket _buckets[Points] = {};
+    LinkBucket _current = {};
+    uint16_t _count = 0;            // Full buckets in the ring
+    uint16_t _next = 0;
+};
+
+#endif // LORA_ALARM_LINK_HISTORY_H
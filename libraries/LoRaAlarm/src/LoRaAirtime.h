@@ -0,0 +1,69 @@
+/*
+*  Title          :  LoRaAirtime
+*  Desc           :  LoRa time on air, Semtech AN1200.13 / SX1261-2 datasheet section 6.1.4.
+*                 :  Parameters use the same encoding as Radio.SetTxConfig() so the firmware
+*                 :  #defines can be passed straight in.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.0
+*
+*/
+
+#ifndef LORA_ALARM_AIRTIME_H
+#define LORA_ALARM_AIRTIME_H
+
+#include <stdint.h>
+
+// Bandwidth index as used by Radio.SetTxConfig(), [0: 125 kHz, 1: 250 kHz, 2: 500 kHz]
+inline uint32_t loraBandwidthHz(uint8_t bandwidth)
+{
+    switch (bandwidth)
+    {
+    case 1:  return 250000;
+    case 2:  return 500000;
+    default: return 125000;
+    }
+}
+
+// Symbol time in microseconds
+inline uint32_t loraSymbolMicros(uint8_t spreadingFactor, uint8_t bandwidth)
+{
+    return (uint32_t)(((uint64_t)1000000 << spreadingFactor) / loraBandwidthHz(bandwidth));
+}
+
+// Low data rate optimisation is mandated once the symbol time reaches 16 ms
+inline bool loraLowDataRateOptimise(uint8_t spreadingFactor, uint8_t bandwidth)
+{
+    return loraSymbolMicros(spreadingFactor, bandwidth) >= 16000;
+}
+
+// Number of payload symbols, header and CRC included
+inline uint32_t loraPayloadSymbols(uint8_t spreadingFactor, uint8_t bandwidth, uint8_t codingRate,
+    uint8_t payloadLength, bool crcOn = true, bool fixLength = false)
+{
+    int32_t de = loraLowDataRateOptimise(spreadingFactor, bandwidth) ? 1 : 0;
+    int32_t ih = fixLength ? 1 : 0;
+    int32_t numerator = 8 * (int32_t)payloadLength - 4 * (int32_t)spreadingFactor + 28 + (crcOn ? 16 : 0) - 20 * ih;
+    int32_t denominator = 4 * ((int32_t)spreadingFactor - 2 * de);
+    int32_t blocks = (numerator > 0) ? (numerator + denominator - 1) / denominator : 0;
+    return 8 + (uint32_t)blocks * ((uint32_t)codingRate + 4);
+}
+
+// Time on air in microseconds for one frame.  codingRate is 1..4 for 4/5..4/8
+inline uint32_t loraTimeOnAirMicros(uint8_t spreadingFactor, uint8_t bandwidth, uint8_t codingRate,
+    uint16_t preambleLength, uint8_t payloadLength, bool crcOn = true, bool fixLength = false)
+{
+    uint32_t symbol = loraSymbolMicros(spreadingFactor, bandwidth);
+    // Preamble is n + 4.25 symbols
+    uint32_t preamble = (uint32_t)preambleLength * symbol + (symbol * 17) / 4;
+    return preamble + loraPayloadSymbols(spreadingFactor, bandwidth, codingRate, payloadLength, crcOn, fixLength) * symbol;
+}
+
+inline uint32_t loraTimeOnAirMillis(uint8_t spreadingFactor, uint8_t bandwidth, uint8_t codingRate,
+    uint16_t preambleLength, uint8_t payloadLength, bool crcOn = true, bool fixLength = false)
+{
+    return (loraTimeOnAirMicros(spreadingFactor, bandwidth, codingRate, preambleLength, payloadLength, crcOn, fixLength) + 999) / 1000;
+}
+
+#endif // LORA_ALARM_AIRTIME_H
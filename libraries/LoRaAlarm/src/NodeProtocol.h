@@ -0,0 +1,1000 @@
+/*
+*  Title          :  NodeProtocol
+*  Desc           :  Sensor and radio state machine of the RemoteNode, free of any Arduino or
+*                 :  Heltec calls so the same code runs on the board and in the simulator.
+*                 :
+*                 :  STATE_TX  send a status frame, a poll reply or a low power check in
+*                 :  STATE_RX  continuous receive for polls, or a short window for an ACK or
+*                 :            a command after a check in
+*                 :  LOWPOWER  wait for a radio event.  Pending alarms start their CAD from here
+*                 :  IDLING    low power mode only, send any waiting alarm then deep sleep
+*                 :
+*                 :  Alarm edges are sent without waiting for a poll: listen before talk with
+*                 :  CAD, randomised binary exponential backoff, ACK and retry.  The ACK window
+*                 :  runs to a fixed deadline, frames for other nodes heard in it do not hold
+*                 :  off the retry.  With alarmUplink off the edge only changes what the next
+*                 :  poll reply or check in reports, as the firmware did before, so the two can
+*                 :  be compared.
+*                 :
+*                 :  Relay and test settings only change on a COMMAND frame.  Each command
+*                 :  number is applied once and acknowledged every time it arrives, so hub
+*                 :  retries are harmless.  Watchdog polls are answered but not applied.
+*                 :
+*                 :  The hub may move the node to a faster spreading factor and a lower TX power
+*                 :  with a LINK frame.  The node listens for polls and answers them at that
+*                 :  rate, alarms and check ins still go out at the fallback rate so the hub
+*                 :  hears them wherever it is listening.  If the hub goes quiet for linkTimeout,
+*                 :  or a low power node's link checks go unanswered linkMissLimit times, the
+*                 :  node returns to the fallback rate by itself.
+*                 :
+*                 :  Frames are sealed with the node's own key.  Anything from the hub that does
+*                 :  not authenticate, or is not newer than the last frame accepted, is dropped.
+*                 :  The frame counters are retained through deep sleep and handed to
+*                 :  NodePlatform to survive a power cut.
+*                 :
+*                 :  The alarm is set while any input is active.  Inputs come from the platform
+*                 :  already debounced, as a mask with bit n for input n, see SensorPipeline.h.
+*                 :  Every change of the mask is sent in an alarm frame.  A change while an
+*                 :  alarm is still waiting for its ACK is merged into it, the next attempt
+*                 :  carries the newest mask under a new sequence number.
+*                 :
+*                 :  Settings come from the hub in CONFIG frames, numbered like commands, and go
+*                 :  to NodePlatform::configure().  Each number is handed on once and its result
+*                 :  repeated to every retry.  When the result says the settings were committed
+*                 :  the node acknowledges, then asks NodePlatform to restart with them.
+*                 :
+*                 :  Frames are charged to the sub-band's hourly duty cycle, see DutyCycle.h.
+*                 :  A reply, check in or link frame that does not fit is dropped, the hub asks
+*                 :  again or the next check in goes.  Alarms always go.  The airtime is kept
+*                 :  with the retained state, a timed wake counts the sleep as time passed.
+*                 :
+*                 :  The node works on the channel of the channel plan its address picks, see
+*                 :  ChannelPlan.h.  Alarms, check ins and anything else unsolicited carry the
+*                 :  plan's scan preamble so a hub scanning several channels finds them.
+*                 :
+*                 :  A mains powered node can be a repeater, see Repeater.h.  Frames for other
+*                 :  nodes go to its Repeater instead of being ignored, and what it queues is
+*                 :  sent after a CAD whenever the node is only listening for polls.  It stays
+*                 :  at the base rate, LINK frames are ignored.  A frame for this node in a
+*                 :  repeater's envelope is opened and answered like any other, the node keeps
+*                 :  receive windows open for the repeaters it came through.
+*                 :
+*                 :  With a superframe, see Superframe.h, a low power node is given a slot by the
+*                 :  hub.  It then sleeps until just before its slot, or before the beacon when
+*                 :  its clock may be too far out for the slot, and checks in there once every
+*                 :  period.  The reply window after a check in in the slot is short, the hub
+*                 :  answers at once.  A beacon that does not come, or a clock too far out even
+*                 :  for the beacon, leaves the node checking in as before until the hub answers
+*                 :  with its slot again.  Alarms go as soon as they happen, slot or not.
+*                 :
+*                 :  loop() scans the sensor and runs the radio.  Firmware that scans the
+*                 :  sensor on a timer calls scanSensor() from it and service() every pass.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  2.2
+*  History        : 1.0 2026-10-17 Moved out of RemoteNode.ino
+*                 : 1.1 2026-10-17 Sequenced, idempotent commands with an ACK
+*                 : 1.2 2026-10-17 Link rate set by the hub's adaptive data rate, with fallback
+*                 : 1.3 2026-10-17 Authenticated frames and replay protection
+*                 : 1.4 2026-10-17 Sensor scan split from the radio so it can run on a timer
+*                 : 1.5 2026-10-17 Debounced mask of several inputs, changes merged into a pending alarm
+*                 : 1.6 2026-10-17 Settings over the air, restart once a commit is acknowledged
+*                 : 1.7 2026-10-17 Duty cycle governor, everything but alarms dropped when the airtime is spent
+*                 : 1.8 2026-10-17 Channel picked from the address, long preamble on unsolicited frames
+*                 : 1.9 2026-10-17 Repeater mode, frames for the hub passed on, windows wait for relayed replies
+*                 : 2.0 2026-10-17 Superframe slots for low power check ins, timed from the hub's beacons,
+*                 :                ACK window no longer restarted by other nodes' frames
+*                 : 2.1 2026-10-17 alarmUplink, edges can be left to the poll for comparison
+*                 : 2.2 2026-10-17 Airtime charged with the priority it was asked with
+*
+*/
+
+#ifndef LORA_ALARM_NODE_PROTOCOL_H
+#define LORA_ALARM_NODE_PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "AlarmTypes.h"
+#include "AlarmFrame.h"
+#include "ChannelPlan.h"
+#include "DutyCycle.h"
+#include "LinkAdr.h"
+#include "NodeSettings.h"
+#include "RadioPort.h"
+#include "Repeater.h"
+#include "Superframe.h"
+
+#define NODE_DUTY_BUCKETS                           12  // Five minute slices, it lives in RTC memory
+
+typedef enum
+{
+    WAKE_COLD_START,
+    WAKE_TIMER,
+    WAKE_SENSOR
+} NodeWake_t;
+
+typedef struct
+{
+    uint16_t address;
+    bool lowPower;              // Deep sleep between check ins instead of continuous receive
+    bool repeater;              // Pass frames on for other nodes, only while not in low power mode
+    uint32_t ackTimeout;        // ms to wait for the hub to acknowledge an alarm
+    uint32_t rxWindow;          // ms, low power receive window after a check in
+    uint32_t checkInInterval;   // ms, low power time between check ins
+    uint8_t alarmMaxAttempts;   // Give up and leave it to the next poll after this
+    uint32_t alarmBackoffSlot;  // ms, the backoff window doubles on every attempt
+    bool alarmUplink;           // Send alarm edges at once, false leaves them to the next poll or check in
+    ChannelPlan channels;       // The node's channel is picked from its address
+    RelayPlan relay;            // Repeaters on the network, see Repeater.h
+    SuperframePlan superframe;  // Check in slots given by the hub, period 0 for none
+    LinkRate fallbackRate;      // Base SF at full power, alarms and check ins always use the base SF
+    uint32_t linkTimeout;       // ms without hearing the hub before an always on node falls back
+    uint8_t linkCheckInterval;  // Low power check ins on a reduced rate between link checks
+    uint8_t linkMissLimit;      // Unanswered link checks before a low power node falls back
+    const uint8_t* key;         // FRAME_KEY_SIZE bytes, this node's key.  Only read by configure()
+} NodeConfig;
+
+// State that has to survive deep sleep, the firmware keeps it in RTC memory
+typedef struct
+{
+    LoRaPacket packetData;      // Last command from the hub
+    DeviceStates_t alarmState;
+    bool alarmActive;
+    uint8_t inputs;             // Mask last reported, bit n for input n
+    uint8_t alarmSequence;
+    uint8_t commandSequence;    // Last command or setting applied, the hub never sends 0
+    uint8_t configKey;          // Last setting from the hub and what configure() made of it
+    uint8_t configResult;
+    LinkRate linkRate;          // Set by the hub, polls are heard and answered at this rate
+    uint8_t checkInsSinceContact;
+    uint8_t linkMisses;         // Link checks in a row the hub did not answer
+    uint8_t relayHops;          // Repeaters the hub's last frame came through
+    FrameCounters counters;     // Uplink counter and last downlink counter accepted
+    DutyCycle<NODE_DUTY_BUCKETS> airtime;   // Sent in the last hour
+    uint32_t sleepMs;           // Length of the last timed deep sleep
+    SlotClock slots;            // Superframe slot and the hub's time
+} NodeRetained;
+
+class NodePlatform
+{
+public:
+    virtual ~NodePlatform() {}
+
+    virtual uint32_t millis(void) = 0;
+    // ms on a clock that keeps running through deep sleep, the superframe slots are timed on it
+    virtual uint32_t rtcMillis(void) { return millis(); }
+    virtual long random(long min, long max) = 0;    // min <= n < max
+    // Debounced mask of the active inputs, bit n for input n
+    virtual uint8_t readInputs(void) = 0;
+    // True while the mask may still change, a low power node does not sleep on a change in progress
+    virtual bool inputsSettling(void) { return false; }
+    virtual void setRelays(bool relay1, bool relay2) = 0;
+    // Low power mode.  Does not return on the hardware
+    virtual void deepSleep(uint32_t wakeAfterMs, bool wakeOnSensor, bool wakeLevel) = 0;
+    virtual void alarmAcknowledged(uint8_t sequence, uint32_t edgeToAckMs, uint8_t attempts)
+    {
+        (void)sequence; (void)edgeToAckMs; (void)attempts;
+    }
+    virtual void trace(const char* msg) { (void)msg; }
+    // The frame counters as last stored, false if there are none.  Only asked at a cold start
+    virtual bool loadCounters(FrameCounters& counters) { (void)counters; return false; }
+    // Called before the frame that needs it is sent, keep the counters in flash
+    virtual void storeCounters(const FrameCounters& counters) { (void)counters; }
+    // A setting from the hub, a NodeConfigResult_t.  See NodeSettingsStore
+    virtual uint8_t configure(uint8_t key, uint32_t value) { (void)key; (void)value; return CONFIG_REJECTED; }
+    // Committed settings were acknowledged, start again with them.  Does not return on the hardware
+    virtual void restart(void) {}
+};
+
+class NodeProtocol
+{
+public:
+    NodeProtocol(RadioPort& radio, NodePlatform& platform, const NodeConfig& config, NodeRetained& retained)
+        : _radio(radio), _platform(platform), _retained(retained)
+    {
+        configure(config);
+    }
+
+    // Settings read at run time replace the ones the node was built with.  Before begin()
+    void configure(const NodeConfig& config)
+    {
+        _config = config;
+        _cipher.setKey(config.key);
+        _config.key = nullptr;
+        _frequency = channelPlanFrequency(config.channels, channelPlanChannel(config.channels, config.address));
+    }
+
+    void begin(NodeWake_t wake)
+    {
+        if (wake == WAKE_COLD_START)
+        {
+            LoRaPacket blank = {};
+            _retained.packetData = blank;
+            _retained.packetData.relay1Enabled = ACTIVE;
+            _retained.packetData.relay2Enabled = ACTIVE;
+            _retained.alarmState = IDLE;
+            _retained.alarmActive = false;
+            _retained.inputs = 0;
+            _retained.commandSequence = 0;
+            _retained.configKey = CONFIG_NONE;
+            _retained.configResult = CONFIG_ACCEPTED;
+            _retained.linkRate = _config.fallbackRate;
+            _retained.checkInsSinceContact = 0;
+            _retained.linkMisses = 0;
+            _retained.relayHops = 0;
+            FrameCounters counters = {};
+            _retained.counters = counters;
+            if (_platform.loadCounters(_retained.counters))
+            {
+                frameCountersRestore(_retained.counters);
+            }
+            _retained.airtime.begin(_platform.millis());
+            _retained.sleepMs = _config.checkInInterval;
+            _retained.slots.begin();
+            _platform.setRelays(false, false);
+        }
+        else
+        {
+            // How long a sensor wake slept for is not known, none of it is counted
+            _retained.airtime.resume(_platform.millis(), (wake == WAKE_TIMER) ? _retained.sleepMs : 0);
+        }
+        _listening = false;
+        _alarmPending = false;
+        _awaitingAck = false;
+        _commandReply = false;
+        _configReply = false;
+        _restartAfterReply = false;
+        _reply = false;
+        _linkReply = false;
+        _linkApply = false;
+        _linkCheck = false;
+        _forwarding = false;
+        _slotWake = SLOT_WAKE_NONE;
+        _slotSent = false;
+        _alarmAttempts = 0;
+        _lastContactMs = _platform.millis();
+        _repeater.begin(_config.address, _config.relay);
+        _radio.setChannel(_frequency, _config.channels.preambleLength);
+        setRate(_config.fallbackRate.spreadingFactor, _config.fallbackRate.txPower);
+
+        // Woken by the sensor, sensorScanner() queues the alarm and IDLING sends it.  Woken for
+        // the slot or the beacon before it, wait for that
+        _state = (_config.lowPower && wake == WAKE_SENSOR) ? IDLING : STATE_TX;
+        if (_config.lowPower && wake == WAKE_TIMER)
+        {
+            planSlot();
+        }
+    }
+
+    void loop(void)
+    {
+        scanSensor();
+        service();
+    }
+
+    // Raises or clears the alarm on a sensor edge, the radio sends it on the next service()
+    void scanSensor(void)
+    {
+        sensorScanner();
+    }
+
+    void service(void)
+    {
+        if (!_config.lowPower && !atFallback() && _platform.millis() - _lastContactMs > _config.linkTimeout)
+        {
+            fallBack();
+        }
+        switch (_state)
+        {
+        case IDLING:
+            // Low power mode, nothing left to receive.  Send any alarm that is waiting then sleep
+            if (!_alarmPending)
+            {
+                if (!_platform.inputsSettling())
+                {
+                    goToSleep();
+                }
+            }
+            else if (backoffExpired())
+            {
+                _radio.standby();
+                setRate(_config.fallbackRate.spreadingFactor, _config.fallbackRate.txPower);
+                _radio.startCad();
+                _state = LOWPOWER;
+            }
+            break;
+        case STATE_TX:
+            if (!slotWaiting())
+            {
+                txPacket();
+            }
+            break;
+        case STATE_RX:
+            if (slotWaiting())
+            {
+                break;
+            }
+            _radio.setChannel(_frequency, _config.channels.preambleLength);
+            if (_slotWake == SLOT_WAKE_BEACON)
+            {
+                // Either side of when the beacon should come, for as far out as the clock may be
+                uint32_t left = _slotAt + _slotWindow - _platform.rtcMillis();
+                _listening = false;
+                setRate(_config.fallbackRate.spreadingFactor, _config.fallbackRate.txPower);
+                _radio.receive((int32_t)left > 0 ? left : 1);
+            }
+            else if (_config.lowPower)
+            {
+                // Short window for a command after a check in, or the alarm ACK.  The hub answers
+                // a check in in the slot straight away
+                uint32_t window = _awaitingAck ? ackLeft()
+                    : (_slotSent ? SUPERFRAME_TURNAROUND + _config.superframe.guard : _config.rxWindow) + replyAirtime() + relayTime();
+                _slotSent = false;
+                _listening = false;
+                _radio.receive(window);
+            }
+            else if (_awaitingAck)
+            {
+                _listening = false;
+                _radio.receive(ackLeft());
+            }
+            else
+            {
+                // Continuous receive for polls, at the rate the hub polls this node at
+                _listening = true;
+                setRate(_retained.linkRate.spreadingFactor, _retained.linkRate.txPower);
+                _radio.receive(0);
+            }
+            _state = LOWPOWER;
+            break;
+        case LOWPOWER:
+            if (_alarmPending && _slotWake == SLOT_WAKE_BEACON)
+            {
+                // The alarm goes first, the slot is planned again afterwards
+                _slotWake = SLOT_WAKE_NONE;
+                _radio.sleep();
+                _state = IDLING;
+            }
+            else if (_alarmPending && _listening && backoffExpired())
+            {
+                // Listen before talk, onCadDone() sends the alarm if the channel is clear
+                _listening = false;
+                _radio.standby();
+                setRate(_config.fallbackRate.spreadingFactor, _config.fallbackRate.txPower);
+                _radio.startCad();
+            }
+            else if (_listening && repeating() && _repeater.due(_platform.millis()) != nullptr)
+            {
+                // A frame to pass on, listen before talk like an alarm
+                _listening = false;
+                _forwarding = true;
+                _radio.standby();
+                setRate(_config.fallbackRate.spreadingFactor, _config.fallbackRate.txPower);
+                _radio.startCad();
+            }
+            _radio.service();
+            break;
+        default:
+            break;
+        }
+    }
+
+    void onTxDone(void)
+    {
+        if (_linkApply)
+        {
+            // The LINK_ACK went out at the old rate, the hub switches when it hears it
+            _platform.trace("Link rate changed");
+            _retained.linkRate = _linkTarget;
+            _linkApply = false;
+        }
+        if (_restartAfterReply)
+        {
+            _platform.trace("Settings committed, restarting");
+            _restartAfterReply = false;
+            _platform.restart();
+        }
+        if (_awaitingAck && !_forwarding)
+        {
+            _ackDeadline = _platform.millis() + _config.ackTimeout + replyAirtime() + relayTime();
+        }
+        _reply = false;
+        _forwarding = false;
+        _state = STATE_RX;
+    }
+
+    void onTxTimeout(void)
+    {
+        _platform.trace("TX timeout");
+        _radio.sleep();
+        if (_forwarding)
+        {
+            _forwarding = false;
+            _state = STATE_RX;
+            return;
+        }
+        if (_linkApply)
+        {
+            _linkApply = false;
+            _linkReply = true;
+        }
+        _state = STATE_TX;
+    }
+
+    void onRxTimeout(void)
+    {
+        _radio.sleep();
+        if (_slotWake == SLOT_WAKE_BEACON)
+        {
+            // Check in now, the hub answers with the slot and its clock
+            _platform.trace("Beacon missed");
+            _retained.slots.missed();
+            _slotWake = SLOT_WAKE_NONE;
+            _state = STATE_TX;
+        }
+        else if (_awaitingAck)
+        {
+            _platform.trace("ACK timeout");
+            if (_retained.relayHops < _config.relay.hops)
+            {
+                // The hub may only hear this node through a repeater, wait longer for the next one
+                _retained.relayHops++;
+            }
+            scheduleAlarmRetry();
+        }
+        else
+        {
+            // Receive window closed
+            if (_linkCheck)
+            {
+                _linkCheck = false;
+                if (++_retained.linkMisses >= _config.linkMissLimit)
+                {
+                    fallBack();
+                }
+            }
+            _state = idleState();
+        }
+    }
+
+    void onCadDone(bool channelActivityDetected)
+    {
+        if (_forwarding)
+        {
+            if (channelActivityDetected)
+            {
+                _repeater.defer(_platform.millis() + (uint32_t)_platform.random(0, _config.relay.spread + 1));
+                _forwarding = false;
+                _state = STATE_RX;
+            }
+            else
+            {
+                txForward();
+            }
+            return;
+        }
+        if (channelActivityDetected)
+        {
+            _platform.trace("Channel busy, backing off");
+            scheduleAlarmRetry();
+        }
+        else
+        {
+            txAlarm();
+        }
+    }
+
+    void onRxDone(const uint8_t* payload, uint16_t size, int16_t rssi, int8_t snr)
+    {
+        (void)rssi;
+        (void)snr;
+        AlarmFrame frame = {};
+        _listening = false;
+        _radio.sleep();
+        _state = _awaitingAck ? STATE_RX : idleState();   // Carry on unless the hub asked for a reply
+
+        if (beaconFramePeek(payload, size, frame) == FRAME_OK)
+        {
+            beaconHeard(frame);
+            return;
+        }
+        if (_slotWake == SLOT_WAKE_BEACON)
+        {
+            _state = STATE_RX;      // Someone else's frame, listen on for the beacon
+            return;
+        }
+
+        // A frame for this node may come in a repeater's envelope, anything else is for others
+        RelayHeader relay = {};
+        bool relayed = relayFramePeek(payload, size, relay) == FRAME_OK;
+        AlarmFrameResult_t result = relayed ? alarmFramePeek(relay.frame, relay.length, frame) : alarmFramePeek(payload, size, frame);
+        if (result == FRAME_OK && (frame.nodeAddress != _config.address || (relayed && !relay.downlink)))
+        {
+            if (repeating())
+            {
+                _repeater.heard(payload, size, _platform.millis(), (uint32_t)_platform.random(0, _config.relay.spread + 1));
+            }
+            return;     // Not for this node, and not our key to check it with
+        }
+        uint16_t received = size;
+        if (relayed)
+        {
+            payload = relay.frame;
+            size = relay.length;
+        }
+        if (result == FRAME_OK)
+        {
+            result = alarmFrameDecode(payload, size, _cipher, FRAME_DOWNLINK, _retained.counters.rx, frame);
+        }
+        if (result != FRAME_OK)
+        {
+            _platform.trace(alarmFrameResultString(result));
+            return;
+        }
+        bool store;
+        frameCounterAccept(_retained.counters, frame.counter, store);
+        if (store)
+        {
+            _platform.storeCounters(_retained.counters);
+        }
+        _retained.relayHops = relayed ? relay.hops : 0;
+
+        linkContact();
+        if (frame.type == FRAME_ACK)
+        {
+            if (_awaitingAck && frame.sequence == _retained.alarmSequence)
+            {
+                _awaitingAck = false;
+                _alarmPending = false;
+                _state = idleState();
+                _platform.alarmAcknowledged(_retained.alarmSequence, _platform.millis() - _alarmEdgeMillis, _alarmAttempts + 1);
+            }
+        }
+        else if (frame.type == FRAME_STATUS || frame.type == FRAME_COMMAND)
+        {
+            if (frame.type == FRAME_COMMAND)
+            {
+                if (frame.sequence != _retained.commandSequence)
+                {
+                    // Extract the values
+                    LoRaPacket& packetData = _retained.packetData;
+                    packetData.nodeAddress = frame.nodeAddress;
+                    packetData.alarmState = static_cast<DeviceStates_t>(frame.alarmState);
+                    packetData.relay1Enabled = static_cast<RelayStates_t>(frame.relay1Enabled);
+                    packetData.relay2Enabled = static_cast<RelayStates_t>(frame.relay2Enabled);
+                    _retained.commandSequence = frame.sequence;
+                    _platform.trace("Command applied");
+                }
+                _commandReply = true;   // A repeat means the hub missed the ACK, send it again
+            }
+            _awaitingAck = false;    // A poll instead of an ACK, the alarm is retried after the reply
+            _reply = true;
+            _state = STATE_TX;
+        }
+        else if (frame.type == FRAME_CONFIG)
+        {
+            if (frame.sequence != _retained.commandSequence)
+            {
+                _retained.commandSequence = frame.sequence;
+                _retained.configKey = frame.configKey;
+                _retained.configResult = _platform.configure(frame.configKey, frame.configValue);
+                _platform.trace(_retained.configResult == CONFIG_REJECTED ? "Setting rejected" : "Setting applied");
+            }
+            _configReply = true;    // A repeat means the hub missed the ACK, send the same result
+            _awaitingAck = false;
+            _reply = true;
+            _state = STATE_TX;
+        }
+        else if (frame.type == FRAME_LINK && !repeating())
+        {
+            // A repeater stays on the base rate, the nodes it carries are on it
+            if (frame.spreadingFactor >= 7 && frame.spreadingFactor <= _config.fallbackRate.spreadingFactor)
+            {
+                _linkTarget.spreadingFactor = frame.spreadingFactor;
+                _linkTarget.txPower = (frame.txPower > _config.fallbackRate.txPower) ? _config.fallbackRate.txPower : frame.txPower;
+                _linkReply = true;
+                _awaitingAck = false;
+                _reply = true;
+                _state = STATE_TX;
+            }
+        }
+        else if (frame.type == FRAME_SLOT && _config.lowPower && _config.superframe.period > 0)
+        {
+            // Sent as the radio read it, the frame took its airtime to arrive
+            _platform.trace(frame.slot == SUPERFRAME_NO_SLOT ? "No slot" : "Slot assigned");
+            _retained.slots.assign(frame.slot);
+            _retained.slots.sync(_config.superframe, _platform.rtcMillis() - _radio.timeOnAir((uint8_t)received),
+                frame.superframe, frame.phase);
+        }
+    }
+
+    States_t state(void) const { return _state; }
+    bool alarmPending(void) const { return _alarmPending; }
+    const NodeRetained& retained(void) const { return _retained; }
+    const RepeaterStats& relayStats(void) const { return _repeater.stats(); }
+
+private:
+    void sensorScanner(void)
+    {
+        const LoRaPacket& packetData = _retained.packetData;
+        uint8_t inputs = _platform.readInputs();
+        bool trigger = (packetData.alarmState == TEST) ? true : inputs != 0;
+
+        if (trigger && !_retained.alarmActive)
+        {
+            _retained.alarmActive = true;
+            _retained.alarmState = SET;
+            _retained.inputs = inputs;
+            queueAlarm();
+            _platform.setRelays(packetData.relay1Enabled == ACTIVE, packetData.relay2Enabled == ACTIVE);
+        }
+        else if (!trigger && _retained.alarmActive)
+        {
+            _retained.alarmActive = false;
+            _retained.alarmState = CLEAR;
+            _retained.inputs = inputs;
+            queueAlarm();
+            _platform.setRelays(false, false);
+        }
+        else if (inputs != _retained.inputs)
+        {
+            // Another input joined or left an alarm already set, the hub still hears which
+            _retained.inputs = inputs;
+            queueAlarm();
+        }
+    }
+
+    void queueAlarm(void)
+    {
+        _retained.alarmSequence++;
+        if (_retained.alarmSequence == 0)
+        {
+            _retained.alarmSequence = 1;    // An ACK numbered 0 only answers a link check
+        }
+        _alarmAttempts = 0;
+        if (!_config.alarmUplink)
+        {
+            return;
+        }
+        if (_alarmPending)
+        {
+            // Merged into the alarm already on its way.  Its next attempt carries the new state,
+            // an ACK for the old sequence no longer counts
+            return;
+        }
+        _alarmPending = true;
+        _backoffUntil = _platform.millis();
+        _alarmEdgeMillis = _backoffUntil;
+    }
+
+    bool backoffExpired(void)
+    {
+        return (int32_t)(_platform.millis() - _backoffUntil) >= 0;
+    }
+
+    void scheduleAlarmRetry(void)
+    {
+        _awaitingAck = false;
+        _alarmAttempts++;
+        if (_alarmAttempts >= _config.alarmMaxAttempts)
+        {
+            _platform.trace("Alarm uplink abandoned, the next poll will report it");
+            _alarmPending = false;
+        }
+        else
+        {
+            // Randomised binary exponential backoff so nodes that clashed do not clash again
+            _backoffUntil = _platform.millis()
+                + (uint32_t)_platform.random(_config.alarmBackoffSlot, (_config.alarmBackoffSlot << _alarmAttempts) + 1);
+        }
+        _state = idleState();
+    }
+
+    // The hub's clock from a beacon.  Woken for it, on to the slot.  Heard in a receive window
+    // opened for something else, open it again
+    void beaconHeard(const AlarmFrame& frame)
+    {
+        if (!_config.lowPower || _config.superframe.period == 0)
+        {
+            _state = idleState();
+            return;
+        }
+        if (_retained.slots.slot() != SUPERFRAME_NO_SLOT)
+        {
+            _retained.slots.sync(_config.superframe, _platform.rtcMillis() - _radio.timeOnAir(BEACON_FRAME_SIZE),
+                frame.superframe, frame.phase);
+        }
+        if (_slotWake == SLOT_WAKE_BEACON)
+        {
+            _slotWake = SLOT_WAKE_NONE;
+            _state = STATE_TX;
+            planSlot();
+        }
+        else if (!_awaitingAck)
+        {
+            _state = STATE_RX;
+        }
+    }
+
+    // What a timed wake is for.  Anything a while off is slept until, anything close waited for
+    // with the radio off.  Nothing known leaves the state as it is, a check in
+    void planSlot(void)
+    {
+        uint32_t at;
+        uint32_t window;
+        uint32_t now = _platform.rtcMillis();
+        SlotWake_t wake = _retained.slots.next(_config.superframe, channelPlanChannel(_config.channels, _config.address),
+            now, 0, at, window);
+        if (wake == SLOT_WAKE_NONE)
+        {
+            return;
+        }
+        if (at - now > 2 * SUPERFRAME_WAKE_LEAD)
+        {
+            _state = IDLING;
+            return;
+        }
+        _slotWake = wake;
+        _slotAt = at;
+        _slotWindow = window;
+        _state = (wake == SLOT_WAKE_SLOT) ? STATE_TX : STATE_RX;
+    }
+
+    // True until the slot or the beacon is due.  An alarm does not wait, the node sleeps again
+    // once it is sent and plans the slot afresh
+    bool slotWaiting(void)
+    {
+        if (_slotWake == SLOT_WAKE_NONE)
+        {
+            return false;
+        }
+        if (_alarmPending)
+        {
+            _slotWake = SLOT_WAKE_NONE;
+            _state = IDLING;
+            return true;
+        }
+        return (int32_t)(_platform.rtcMillis() - _slotAt) < 0;
+    }
+
+    bool repeating(void) const
+    {
+        return _config.repeater && !_config.lowPower;
+    }
+
+    // Where the node waits when it has nothing to send
+    States_t idleState(void) const
+    {
+        return _config.lowPower ? IDLING : STATE_RX;
+    }
+
+    void setRate(uint8_t spreadingFactor, int8_t txPower)
+    {
+        _spreadingFactor = spreadingFactor;
+        _radio.setDataRate(spreadingFactor, txPower);
+    }
+
+    // Receive windows stay open long enough for the whole reply, a setting is the longest
+    uint32_t replyAirtime(void)
+    {
+        return _radio.timeOnAir((uint8_t)alarmFrameSize(FRAME_CONFIG));
+    }
+
+    // What is left of the ACK window.  A frame for another node ends the receive early, the
+    // window opened again after it runs to the same deadline
+    uint32_t ackLeft(void)
+    {
+        uint32_t left = _ackDeadline - _platform.millis();
+        return (int32_t)left > 0 ? left : 1;
+    }
+
+    // Each repeater between here and the hub adds to a reply both ways
+    uint32_t relayTime(void) const
+    {
+        return 2 * (uint32_t)_retained.relayHops * _config.relay.hopTime;
+    }
+
+    bool atFallback(void) const
+    {
+        return _retained.linkRate == _config.fallbackRate;
+    }
+
+    // Anything addressed to this node proves the hub can still reach it
+    void linkContact(void)
+    {
+        _lastContactMs = _platform.millis();
+        _retained.checkInsSinceContact = 0;
+        _retained.linkMisses = 0;
+        _linkCheck = false;
+    }
+
+    void fallBack(void)
+    {
+        _platform.trace("Link lost, back to the fallback rate");
+        _retained.linkRate = _config.fallbackRate;
+        _retained.checkInsSinceContact = 0;
+        _retained.linkMisses = 0;
+        _lastContactMs = _platform.millis();
+        if (_listening)
+        {
+            // Start listening again at the fallback SF
+            _listening = false;
+            _state = STATE_RX;
+        }
+    }
+
+    void txPacket(void)
+    {
+        AlarmFrame frame = {};
+        frame.type = FRAME_STATUS;
+        frame.nodeAddress = _config.address;
+        frame.alarmState = _retained.alarmState;
+        frame.relay1Enabled = _retained.packetData.relay1Enabled;
+        frame.relay2Enabled = _retained.packetData.relay2Enabled;
+        frame.checkIn = _config.lowPower ? 1 : 0;   // Tells the hub the receive window is open
+        frame.linkFallback = atFallback() ? 1 : 0;
+        frame.repeater = repeating() ? 1 : 0;
+        _slotSent = _slotWake == SLOT_WAKE_SLOT;
+        _slotWake = SLOT_WAKE_NONE;
+        if (_commandReply)
+        {
+            frame.type = FRAME_COMMAND_ACK;
+            frame.checkIn = 0;
+            frame.sequence = _retained.commandSequence;
+            _commandReply = false;
+        }
+        else if (_configReply)
+        {
+            frame.type = FRAME_CONFIG_ACK;
+            frame.sequence = _retained.commandSequence;
+            frame.configKey = _retained.configKey;
+            frame.configResult = _retained.configResult;
+            _configReply = false;
+            _restartAfterReply = _retained.configResult == CONFIG_RESTARTING;
+        }
+        else if (_linkReply)
+        {
+            frame.type = FRAME_LINK_ACK;
+            frame.spreadingFactor = _linkTarget.spreadingFactor;
+            frame.txPower = _linkTarget.txPower;
+            _linkReply = false;
+            _linkApply = true;
+        }
+        else if (!_reply && _config.lowPower && !atFallback()
+            && ++_retained.checkInsSinceContact >= _config.linkCheckInterval)
+        {
+            // A reduced rate check in the hub may not be hearing, ask it to answer
+            frame.linkCheck = 1;
+            _linkCheck = true;
+        }
+
+        // Replies go out on the SF the hub asked on, anything unsolicited on the base SF with the
+        // preamble a scanning hub needs
+        setRate(_reply ? _spreadingFactor : _config.fallbackRate.spreadingFactor, _retained.linkRate.txPower);
+        _radio.setChannel(_frequency, _reply ? _config.channels.preambleLength : _config.channels.scanPreamble);
+        bool acknowledges = frame.type == FRAME_COMMAND_ACK || frame.type == FRAME_CONFIG_ACK;
+        uint32_t airtime = _radio.timeOnAir((uint8_t)alarmFrameSize(frame.type));
+        uint8_t priority = acknowledges ? AIRTIME_NORMAL : AIRTIME_LOW;
+        if (_retained.airtime.wait(_platform.millis(), _frequency, airtime, priority) > 0)
+        {
+            // The hub asks again, or the next check in goes
+            _platform.trace("Duty cycle limit, frame dropped");
+            _restartAfterReply = false;
+            _linkApply = false;
+            _linkCheck = false;
+            _reply = false;
+            _state = idleState();
+            return;
+        }
+        sendFrame(frame, priority);
+    }
+
+    void txAlarm(void)
+    {
+        AlarmFrame frame = {};
+        frame.type = FRAME_ALARM;
+        frame.nodeAddress = _config.address;
+        frame.alarmState = _retained.alarmState;
+        frame.relay1Enabled = _retained.packetData.relay1Enabled;
+        frame.relay2Enabled = _retained.packetData.relay2Enabled;
+        frame.sequence = _retained.alarmSequence;
+        frame.inputs = _retained.inputs;
+        frame.linkFallback = atFallback() ? 1 : 0;
+        _radio.setChannel(_frequency, _config.channels.scanPreamble);
+        sendFrame(frame, AIRTIME_ALARM);
+        _awaitingAck = true;
+    }
+
+    // Passed on as it came in, toward the hub with the preamble a scanning hub needs.  Nothing the
+    // duty cycle would hold back waits, the node or the hub sends it again
+    void txForward(void)
+    {
+        const RelayFrame& relay = _repeater.current();
+        uint32_t now = _platform.millis();
+        _radio.setChannel(_frequency, relay.downlink ? _config.channels.preambleLength : _config.channels.scanPreamble);
+        uint32_t airtime = _radio.timeOnAir(relay.length);
+        if (_retained.airtime.wait(now, _frequency, airtime, relay.priority) > 0)
+        {
+            _platform.trace("Duty cycle limit, relayed frame dropped");
+            _repeater.drop();
+            _forwarding = false;
+            _state = STATE_RX;
+            return;
+        }
+        _retained.airtime.charge(now, _frequency, airtime, relay.priority);
+        _radio.send(relay.data, relay.length);
+        _repeater.sent(now);
+        _state = LOWPOWER;
+    }
+
+    // Sealed with the node's key and its next uplink counter, every retry gets a new one.
+    // priority is what its airtime was asked with
+    void sendFrame(const AlarmFrame& frame, uint8_t priority)
+    {
+        uint8_t outBuffer[ALARM_FRAME_MAX_SIZE];
+        bool store;
+        uint32_t counter = frameCounterNext(_retained.counters, store);
+        if (store)
+        {
+            _platform.storeCounters(_retained.counters);
+        }
+        size_t len = alarmFrameEncode(frame, _cipher, FRAME_UPLINK, counter, outBuffer, sizeof(outBuffer));
+        _retained.airtime.charge(_platform.millis(), _frequency, _radio.timeOnAir((uint8_t)len), priority);
+        _radio.send(outBuffer, (uint8_t)len);
+        _state = LOWPOWER;
+    }
+
+    void goToSleep(void)
+    {
+        _radio.sleep();
+        // Wake as soon as input 0 leaves the state last reported, TEST holds the trigger on.
+        // The other inputs are scanned at the timed wakes
+        bool wakeOnSensor = _retained.packetData.alarmState != TEST;
+        _retained.sleepMs = _config.checkInInterval;
+        uint32_t at;
+        uint32_t window;
+        uint32_t now = _platform.rtcMillis();
+        if (_retained.slots.next(_config.superframe, channelPlanChannel(_config.channels, _config.address), now,
+            SUPERFRAME_WAKE_LEAD, at, window) != SLOT_WAKE_NONE)
+        {
+            // Up in time to have the radio ready for the slot or the beacon
+            _retained.sleepMs = at - now - SUPERFRAME_WAKE_LEAD;
+        }
+        _platform.deepSleep(_retained.sleepMs, wakeOnSensor, (_retained.inputs & 0x01) == 0);
+    }
+
+    RadioPort& _radio;
+    NodePlatform& _platform;
+    NodeConfig _config;
+    NodeRetained& _retained;
+    AesCcm _cipher;
+    States_t _state = STATE_TX;
+    bool _listening = false;        // Radio is in continuous receive waiting for a poll
+    bool _alarmPending = false;     // An alarm edge has not been acknowledged by the hub yet
+    bool _awaitingAck = false;
+    uint32_t _ackDeadline = 0;      // millis() the ACK window closes, others' frames do not extend it
+    bool _commandReply = false;     // The next reply acknowledges a command
+    bool _configReply = false;      // The next reply acknowledges a setting
+    bool _restartAfterReply = false;    // That reply says the settings were committed
+    bool _reply = false;            // The next frame answers the hub rather than checking in
+    bool _linkReply = false;        // The next reply accepts a link change
+    bool _linkApply = false;        // Switch to _linkTarget once the LINK_ACK is sent
+    bool _linkCheck = false;        // The last check in asked the hub for an answer
+    bool _forwarding = false;       // The CAD or frame in progress is the repeater's
+    SlotWake_t _slotWake = SLOT_WAKE_NONE;  // Awake for the slot or the beacon, waiting for _slotAt
+    uint32_t _slotAt = 0;           // rtcMillis() it is due
+    uint32_t _slotWindow = 0;       // ms to listen for the beacon
+    bool _slotSent = false;         // The check in just sent was in the slot
+    LinkRate _linkTarget = {};
+    uint8_t _spreadingFactor = 0;   // The radio's current SF
+    uint32_t _frequency = 0;        // This node's channel
+    uint32_t _lastContactMs = 0;
+    uint8_t _alarmAttempts = 0;
+    uint32_t _backoffUntil = 0;
+    uint32_t _alarmEdgeMillis = 0;
+    Repeater<> _repeater;
+};
+
+#endif // LORA_ALARM_NODE_PROTOCOL_H
@@ -0,0 +1,282 @@
+/*
+*  Title          :  NodeScheduler
+*  Desc           :  Node table and time slotted round robin poll scheduler for the Hub.
+*                 :  Every node is polled at least once per poll interval.  The interval is
+*                 :  split into equal slots so the radio is never asked to start a new
+*                 :  exchange before the last one could have finished.  Nodes with a pending
+*                 :  command go first, alarm commands before the rest, then nodes whose poll
+*                 :  interval is up, then nodes that recently alarmed or missed a reply
+*                 :  (polled at a quarter of the normal interval), each in order of how overdue
+*                 :  they are.  A priority node takes four slots of the interval, so the slots
+*                 :  are sized for count + 3 * priority polls and the re-polls never push
+*                 :  another node past its interval.
+*                 :
+*                 :  Worst case time to notice a silent node is
+*                 :  max(pollInterval, (count + 3 * priority) * minSlot).  A node added to the
+*                 :  table is first polled a poll interval later.
+*                 :  Nodes in low power mode check in by themselves.  They are asleep when a
+*                 :  poll would be sent so they are only polled when a check in is overdue, and
+*                 :  commands for them wait for the next check in.  The poll interval of grace
+*                 :  a new node gets lets a low power node check in before it is polled.
+*                 :
+*                 :  idle() says how long until next() will have a node, so the hub can sleep
+*                 :  until then rather than asking every few ms.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.4
+*  History        : 1.0 2026-10-17 Time slotted round robin
+*                 : 1.1 2026-10-17 Low power nodes that check in by themselves
+*                 : 1.2 2026-10-17 Urgent commands are polled for before other commands
+*                 : 1.3 2026-10-17 idle(), time until the next poll is due
+*                 : 1.4 2026-10-17 Slots sized for priority re-polls, due nodes first, a new node's grace
+*
+*/
+
+#ifndef LORA_ALARM_NODE_SCHEDULER_H
+#define LORA_ALARM_NODE_SCHEDULER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define NODE_PRIORITY_DIVISOR                       4   // Priority nodes are polled this many times faster
+#define NODE_IDLE_NONE                              0xFFFFFFFFUL    // idle() with no node to poll
+
+typedef struct
+{
+    uint16_t address;
+    uint32_t lastPollMs;
+    uint32_t lastReplyMs;
+    uint32_t lastAlarmMs;
+    uint8_t missedReplies;
+    bool alarmActive;
+    bool commandPending;
+    bool commandUrgent;         // The pending command is alarm related
+    bool checksIn;              // Low power node, reports by itself and cannot hear polls
+} NodeSlot;
+
+template <size_t MaxNodes>
+class NodeScheduler
+{
+public:
+    void begin(uint32_t pollIntervalMs, uint32_t minSlotMs)
+    {
+        _pollInterval = pollIntervalMs;
+        _minSlot = minSlotMs;
+        _count = 0;
+        _lastSlotMs = 0;
+        _slotStarted = false;
+    }
+
+    // Returns the table index of the node, -1 if the table is full.  Its first poll is a poll
+    // interval after now
+    int addNode(uint16_t address, uint32_t now)
+    {
+        int index = find(address);
+        if (index >= 0)
+        {
+            return index;
+        }
+        if (_count >= MaxNodes)
+        {
+            return -1;
+        }
+        NodeSlot& slot = _nodes[_count];
+        slot.address = address;
+        slot.lastPollMs = now;
+        slot.lastReplyMs = 0;
+        slot.lastAlarmMs = 0;
+        slot.missedReplies = 0;
+        slot.alarmActive = false;
+        slot.commandPending = false;
+        slot.commandUrgent = false;
+        slot.checksIn = false;
+        return (int)_count++;
+    }
+
+    int find(uint16_t address) const
+    {
+        for (size_t i = 0; i < _count; i++)
+        {
+            if (_nodes[i].address == address)
+            {
+                return (int)i;
+            }
+        }
+        return -1;
+    }
+
+    size_t count() const { return _count; }
+    NodeSlot& node(size_t index) { return _nodes[index]; }
+    const NodeSlot& node(size_t index) const { return _nodes[index]; }
+
+    // Length of one poll slot, the poll interval shared between all the polls due in it
+    uint32_t slotInterval(uint32_t now) const
+    {
+        uint32_t polls = 0;
+        for (size_t i = 0; i < _count; i++)
+        {
+            polls += repolled(_nodes[i], now) ? NODE_PRIORITY_DIVISOR : 1;
+        }
+        uint32_t slot = (polls > 0) ? _pollInterval / polls : _pollInterval;
+        return (slot < _minSlot) ? _minSlot : slot;
+    }
+
+    // Index of the node to poll now, -1 if nothing is due or the current slot has not expired
+    int next(uint32_t now)
+    {
+        int best = -1;
+        int command = -1;
+        uint32_t bestOverdue = 0;
+        bool bestDeadline = false;
+        bool slotFree = !_slotStarted || (now - _lastSlotMs >= slotInterval(now));
+
+        for (size_t i = 0; i < _count; i++)
+        {
+            const NodeSlot& slot = _nodes[i];
+            if (slot.commandPending && !slot.checksIn)
+            {
+                // Commands skip the slot pacing, the UI is waiting on them
+                if (command < 0 || (slot.commandUrgent && !_nodes[command].commandUrgent))
+                {
+                    command = (int)i;
+                }
+                continue;
+            }
+            if (!slotFree || command >= 0)
+            {
+                continue;
+            }
+
+            uint32_t interval = repolled(slot, now) ? _pollInterval / NODE_PRIORITY_DIVISOR : _pollInterval;
+            uint32_t elapsed = now - slot.lastPollMs;
+            if (elapsed >= interval)
+            {
+                // A node at the end of its poll interval goes before a re-poll
+                uint32_t overdue = elapsed - interval;
+                bool deadline = elapsed >= _pollInterval;
+                if (best < 0 || (deadline && !bestDeadline) || (deadline == bestDeadline && overdue > bestOverdue))
+                {
+                    best = (int)i;
+                    bestOverdue = overdue;
+                    bestDeadline = deadline;
+                }
+            }
+        }
+
+        if (command >= 0)
+        {
+            best = command;
+        }
+        if (best >= 0)
+        {
+            NodeSlot& slot = _nodes[best];
+            slot.lastPollMs = now;
+            if (!slot.checksIn)
+            {
+                slot.commandPending = false;
+                slot.commandUrgent = false;
+            }
+            _lastSlotMs = now;
+            _slotStarted = true;
+        }
+        return best;
+    }
+
+    // ms from now until next() returns a node, NODE_IDLE_NONE if there are none.  A node that
+    // stops being a priority only makes it early, next() then finds nothing and it is asked again
+    uint32_t idle(uint32_t now) const
+    {
+        uint32_t wait = NODE_IDLE_NONE;
+        for (size_t i = 0; i < _count; i++)
+        {
+            const NodeSlot& slot = _nodes[i];
+            if (slot.commandPending && !slot.checksIn)
+            {
+                return 0;
+            }
+            uint32_t interval = repolled(slot, now) ? _pollInterval / NODE_PRIORITY_DIVISOR : _pollInterval;
+            uint32_t elapsed = now - slot.lastPollMs;
+            uint32_t left = (elapsed >= interval) ? 0 : interval - elapsed;
+            wait = (left < wait) ? left : wait;
+        }
+        uint32_t slotMs = slotInterval(now);
+        if (wait != NODE_IDLE_NONE && _slotStarted && now - _lastSlotMs < slotMs)
+        {
+            uint32_t slotLeft = slotMs - (now - _lastSlotMs);
+            wait = (slotLeft > wait) ? slotLeft : wait;
+        }
+        return wait;
+    }
+
+    void onReply(size_t index, uint32_t now, bool alarmActive)
+    {
+        NodeSlot& slot = _nodes[index];
+        slot.lastReplyMs = now;
+        slot.missedReplies = 0;
+        slot.alarmActive = alarmActive;
+        if (alarmActive)
+        {
+            slot.lastAlarmMs = now;
+        }
+    }
+
+    // An unsolicited status from a node counts as a poll, sleeping nodes that check in
+    // on time are never polled
+    void onCheckIn(size_t index, uint32_t now, bool alarmActive)
+    {
+        NodeSlot& slot = _nodes[index];
+        slot.lastPollMs = now;
+        slot.checksIn = true;
+        onReply(index, now, alarmActive);
+    }
+
+    // True if a command is waiting for this node, clears the request
+    bool takeCommand(size_t index)
+    {
+        bool pending = _nodes[index].commandPending;
+        _nodes[index].commandPending = false;
+        _nodes[index].commandUrgent = false;
+        return pending;
+    }
+
+    void onMissed(size_t index)
+    {
+        NodeSlot& slot = _nodes[index];
+        if (slot.missedReplies < UINT8_MAX)
+        {
+            slot.missedReplies++;
+        }
+    }
+
+    void requestCommand(size_t index, bool urgent = false)
+    {
+        _nodes[index].commandPending = true;
+        _nodes[index].commandUrgent = urgent;
+    }
+
+private:
+    bool isPriority(const NodeSlot& slot, uint32_t now) const
+    {
+        if (slot.missedReplies > 0 || slot.alarmActive)
+        {
+            return true;
+        }
+        return slot.lastAlarmMs != 0 && now - slot.lastAlarmMs < _pollInterval;
+    }
+
+    // Polled at a quarter of the interval, low power nodes are not
+    bool repolled(const NodeSlot& slot, uint32_t now) const
+    {
+        return isPriority(slot, now) && !slot.checksIn;
+    }
+
+    NodeSlot _nodes[MaxNodes];
+    size_t _count = 0;
+    uint32_t _pollInterval = 0;
+    uint32_t _minSlot = 0;
+    uint32_t _lastSlotMs = 0;
+    bool _slotStarted = false;
+};
+
+#endif // LORA_ALARM_NODE_SCHEDULER_H
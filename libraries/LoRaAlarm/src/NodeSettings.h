@@ -0,0 +1,367 @@
+/*
+*  Title          :  NodeSettings
+*  Desc           :  The RemoteNode settings that used to be compiled in: address and key, radio,
+*                 :  intervals and pins.  Kept in flash through a SettingsPort so a node can be
+*                 :  provisioned and retuned over the air, from the hub or the UI, without a
+*                 :  build per node.
+*                 :
+*                 :  Settings are changed one at a time, each a NodeConfigKey_t and a 32 bit
+*                 :  value, into a pending copy.  Nothing changes on the node until
+*                 :  CONFIG_COMMIT, which makes the pending copy the active one and asks for
+*                 :  a restart, so an address and its key, or a frequency and its spreading
+*                 :  factor, always change together.  A value out of range is refused and the
+*                 :  pending copy left as it was.
+*                 :
+*                 :  The stored copy carries a version and its size.  Later versions only add
+*                 :  fields at the end, so a copy stored by an older firmware is read into the
+*                 :  new defaults and keeps what it had.  A copy that is missing, damaged or
+*                 :  from a newer firmware is replaced by the defaults.
+*                 :
+*                 :  A new address needs the key the hub derives for it, the hub sends that
+*                 :  with the address, and a counter floor.  The node's frame counters start
+*                 :  above the floor under the new key, so no counter is used twice with a key
+*                 :  another node had before.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.1
+*  History        : 1.0 2026-10-17 Stored, versioned settings changed one at a time over LoRa
+*                 : 1.1 2026-10-17 Radio limits shared with AlarmProfile, pins the board uses are refused
+*
+*/
+
+#ifndef LORA_ALARM_NODE_SETTINGS_H
+#define LORA_ALARM_NODE_SETTINGS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "AlarmFrame.h"
+#include "AlarmProfile.h"
+#include "FrameSecurity.h"
+
+#define NODE_SETTINGS_VERSION                       1
+#define NODE_SETTINGS_MAX_INPUTS                    8
+#define NODE_SETTINGS_HEADER_SIZE                   4   // crc, version, size
+
+typedef enum
+{
+    CONFIG_NONE,
+    CONFIG_ADDRESS,             // 1 to 65534.  The hub sends the key and counter floor before it
+    CONFIG_KEY_0,               // The node's key, 4 bytes each, little endian
+    CONFIG_KEY_1,
+    CONFIG_KEY_2,
+    CONFIG_KEY_3,
+    CONFIG_COUNTER_FLOOR,       // Frame counters under the new key start above this
+    CONFIG_FREQUENCY,           // Hz
+    CONFIG_BANDWIDTH,           // 0: 125 kHz, 1: 250 kHz, 2: 500 kHz
+    CONFIG_CODING_RATE,         // 1: 4/5 ... 4: 4/8
+    CONFIG_SPREADING_FACTOR,    // Base rate, 7 to 12
+    CONFIG_TX_POWER,            // Base rate, dBm, signed
+    CONFIG_CHECK_IN_INTERVAL,   // ms, low power mode
+    CONFIG_SCAN_INTERVAL,       // ms, input scan
+    CONFIG_ACK_TIMEOUT,         // ms
+    CONFIG_RX_WINDOW,           // ms, low power mode
+    CONFIG_RELAY_PIN_1,
+    CONFIG_RELAY_PIN_2,
+    CONFIG_INPUT_PIN,           // Input number << 8 | GPIO
+    CONFIG_COMMIT,              // Pending settings become active, the node restarts if any changed
+    CONFIG_DEFAULTS,            // Pending radio, interval and pin settings back to the built in ones,
+                                // the address, key and counter floor stay
+    CONFIG_KEY_COUNT
+} NodeConfigKey_t;
+
+typedef enum
+{
+    CONFIG_ACCEPTED,            // Staged, or a commit with nothing to change
+    CONFIG_RESTARTING,          // Committed, the node restarts once it has acknowledged
+    CONFIG_REJECTED             // Unknown setting or value out of range
+} NodeConfigResult_t;
+
+// No padding, the stored copy is the struct's bytes and is compared whole
+typedef struct
+{
+    uint8_t crc;                // CRC-8 of the bytes after it, up to size
+    uint8_t version;
+    uint16_t size;              // sizeof(NodeSettings) of the firmware that stored it
+    uint32_t counterFloor;
+    uint32_t frequency;
+    uint32_t checkInInterval;
+    uint32_t scanInterval;
+    uint32_t ackTimeout;
+    uint32_t rxWindow;
+    uint16_t address;
+    uint8_t key[FRAME_KEY_SIZE];
+    uint8_t bandwidth;
+    uint8_t codingRate;
+    uint8_t spreadingFactor;
+    int8_t txPower;
+    uint8_t relayPins[2];
+    uint8_t inputPins[NODE_SETTINGS_MAX_INPUTS];
+} NodeSettings;
+
+static_assert(sizeof(NodeSettings) == 60, "NodeSettings must not have padding");
+
+// Flash for the settings, Preferences on the board
+class SettingsPort
+{
+public:
+    virtual ~SettingsPort() {}
+
+    // Bytes read into buf, 0 if there is nothing stored under name
+    virtual size_t read(const char* name, void* buf, size_t size) = 0;
+    virtual void write(const char* name, const void* data, size_t len) = 0;
+};
+
+inline const char* nodeConfigKeyName(uint8_t key)
+{
+    switch (key)
+    {
+    case CONFIG_ADDRESS:            return "Address";
+    case CONFIG_KEY_0:
+    case CONFIG_KEY_1:
+    case CONFIG_KEY_2:
+    case CONFIG_KEY_3:              return "Key";
+    case CONFIG_COUNTER_FLOOR:      return "Counter floor";
+    case CONFIG_FREQUENCY:          return "Frequency Hz";
+    case CONFIG_BANDWIDTH:          return "Bandwidth";
+    case CONFIG_CODING_RATE:        return "Coding rate";
+    case CONFIG_SPREADING_FACTOR:   return "Spreading factor";
+    case CONFIG_TX_POWER:           return "TX power dBm";
+    case CONFIG_CHECK_IN_INTERVAL:  return "Check in ms";
+    case CONFIG_SCAN_INTERVAL:      return "Scan ms";
+    case CONFIG_ACK_TIMEOUT:        return "ACK timeout ms";
+    case CONFIG_RX_WINDOW:          return "RX window ms";
+    case CONFIG_RELAY_PIN_1:        return "Relay 1 pin";
+    case CONFIG_RELAY_PIN_2:        return "Relay 2 pin";
+    case CONFIG_INPUT_PIN:          return "Input pin";
+    case CONFIG_COMMIT:             return "Commit";
+    case CONFIG_DEFAULTS:           return "Defaults";
+    default:                        return "Unknown";
+    }
+}
+
+inline void nodeSettingsSeal(NodeSettings& settings)
+{
+    settings.version = NODE_SETTINGS_VERSION;
+    settings.size = sizeof(NodeSettings);
+    settings.crc = alarmFrameCrc8((const uint8_t*)&settings + 1, sizeof(NodeSettings) - 1);
+}
+
+// The stored bytes over the defaults.  False, and settings are the defaults, if there is no
+// usable copy
+inline bool nodeSettingsLoad(NodeSettings& settings, const NodeSettings& defaults, const uint8_t* stored, size_t len)
+{
+    settings = defaults;
+    nodeSettingsSeal(settings);
+    if (len < NODE_SETTINGS_HEADER_SIZE)
+    {
+        return false;
+    }
+    uint16_t size = (uint16_t)(stored[2] | (stored[3] << 8));
+    if (stored[1] == 0 || stored[1] > NODE_SETTINGS_VERSION || size < NODE_SETTINGS_HEADER_SIZE || size > len
+        || alarmFrameCrc8(stored + 1, size - 1) != stored[0])
+    {
+        return false;
+    }
+    memcpy(&settings, stored, (size < sizeof(NodeSettings)) ? size : sizeof(NodeSettings));
+    nodeSettingsSeal(settings);
+    return true;
+}
+
+// One value into settings.  CONFIG_ACCEPTED or CONFIG_REJECTED, settings unchanged if rejected.
+// A pin in reservedPins, bit n for GPIO n, is refused.  Commit and defaults are NodeSettingsStore's
+inline NodeConfigResult_t nodeSettingsSet(NodeSettings& settings, uint8_t key, uint32_t value, uint64_t reservedPins = 0)
+{
+    int32_t signedValue = (int32_t)value;
+    switch (key)
+    {
+    case CONFIG_ADDRESS:
+        if (value == 0 || value >= 0xFFFF)
+        {
+            return CONFIG_REJECTED;
+        }
+        settings.address = (uint16_t)value;
+        break;
+    case CONFIG_KEY_0:
+    case CONFIG_KEY_1:
+    case CONFIG_KEY_2:
+    case CONFIG_KEY_3:
+    {
+        uint8_t* word = &settings.key[(key - CONFIG_KEY_0) * 4];
+        word[0] = (uint8_t)value;
+        word[1] = (uint8_t)(value >> 8);
+        word[2] = (uint8_t)(value >> 16);
+        word[3] = (uint8_t)(value >> 24);
+        break;
+    }
+    case CONFIG_COUNTER_FLOOR:
+        settings.counterFloor = value;
+        break;
+    case CONFIG_FREQUENCY:
+        if (!radioFrequencyValid(value))
+        {
+            return CONFIG_REJECTED;
+        }
+        settings.frequency = value;
+        break;
+    case CONFIG_BANDWIDTH:
+        if (!radioBandwidthValid(value))
+        {
+            return CONFIG_REJECTED;
+        }
+        settings.bandwidth = (uint8_t)value;
+        break;
+    case CONFIG_CODING_RATE:
+        if (!radioCodingRateValid(value))
+        {
+            return CONFIG_REJECTED;
+        }
+        settings.codingRate = (uint8_t)value;
+        break;
+    case CONFIG_SPREADING_FACTOR:
+        if (!radioSpreadingFactorValid(value))
+        {
+            return CONFIG_REJECTED;
+        }
+        settings.spreadingFactor = (uint8_t)value;
+        break;
+    case CONFIG_TX_POWER:
+        if (!radioTxPowerValid(signedValue))
+        {
+            return CONFIG_REJECTED;
+        }
+        settings.txPower = (int8_t)signedValue;
+        break;
+    case CONFIG_CHECK_IN_INTERVAL:
+        if (value < 5000 || value > 86400000)
+        {
+            return CONFIG_REJECTED;
+        }
+        settings.checkInInterval = value;
+        break;
+    case CONFIG_SCAN_INTERVAL:
+        if (value < 1 || value > 1000)
+        {
+            return CONFIG_REJECTED;
+        }
+        settings.scanInterval = value;
+        break;
+    case CONFIG_ACK_TIMEOUT:
+    case CONFIG_RX_WINDOW:
+        if (value < 50 || value > 5000)
+        {
+            return CONFIG_REJECTED;
+        }
+        (key == CONFIG_ACK_TIMEOUT ? settings.ackTimeout : settings.rxWindow) = value;
+        break;
+    case CONFIG_RELAY_PIN_1:
+    case CONFIG_RELAY_PIN_2:
+        if (!boardPinFree(reservedPins, value))
+        {
+            return CONFIG_REJECTED;
+        }
+        settings.relayPins[key - CONFIG_RELAY_PIN_1] = (uint8_t)value;
+        break;
+    case CONFIG_INPUT_PIN:
+        if ((value >> 8) >= NODE_SETTINGS_MAX_INPUTS || !boardPinFree(reservedPins, value & 0xFF))
+        {
+            return CONFIG_REJECTED;
+        }
+        settings.inputPins[value >> 8] = (uint8_t)value;
+        break;
+    default:
+        return CONFIG_REJECTED;
+    }
+    nodeSettingsSeal(settings);
+    return CONFIG_ACCEPTED;
+}
+
+// The active and pending settings of a node and the flash they are kept in
+class NodeSettingsStore
+{
+public:
+    // reservedPins are the board's own, see AlarmProfile.h.  A node told to drive its radio's pins
+    // would never hear the hub again to be told otherwise
+    explicit NodeSettingsStore(SettingsPort& port, uint64_t reservedPins = 0) : _port(port), _reservedPins(reservedPins) {}
+
+    // Reads both copies, a pending copy that is missing starts as the active one.  False if the
+    // active settings are the defaults because nothing usable was stored
+    bool begin(const NodeSettings& defaults)
+    {
+        uint8_t stored[sizeof(NodeSettings) + 64];
+        _defaults = defaults;
+        nodeSettingsSeal(_defaults);
+        bool found = nodeSettingsLoad(_active, _defaults, stored, _port.read("settings", stored, sizeof(stored)));
+        if (!nodeSettingsLoad(_pending, _active, stored, _port.read("pending", stored, sizeof(stored))))
+        {
+            _pending = _active;
+        }
+        return found;
+    }
+
+    const NodeSettings& settings(void) const { return _active; }
+    const NodeSettings& pending(void) const { return _pending; }
+
+    // A setting from the hub, a NodeConfigResult_t
+    uint8_t configure(uint8_t key, uint32_t value)
+    {
+        if (key == CONFIG_COMMIT)
+        {
+            if (memcmp(&_pending, &_active, sizeof(NodeSettings)) == 0)
+            {
+                return CONFIG_ACCEPTED;     // Already applied, a repeat after the restart
+            }
+            _active = _pending;
+            _port.write("settings", &_active, sizeof(_active));
+            return CONFIG_RESTARTING;
+        }
+        NodeSettings next = _pending;
+        if (key == CONFIG_DEFAULTS)
+        {
+            next = _defaults;
+            next.address = _pending.address;
+            memcpy(next.key, _pending.key, sizeof(next.key));
+            next.counterFloor = _pending.counterFloor;
+            nodeSettingsSeal(next);
+        }
+        else if (nodeSettingsSet(next, key, value, _reservedPins) != CONFIG_ACCEPTED)
+        {
+            return CONFIG_REJECTED;
+        }
+        if (memcmp(&next, &_pending, sizeof(NodeSettings)) != 0)
+        {
+            _pending = next;
+            _port.write("pending", &_pending, sizeof(_pending));
+        }
+        return CONFIG_ACCEPTED;
+    }
+
+    // Raises counters read back from flash to the counter floor, true if they were raised.
+    // Only the stored marks need it, frameCountersRestore() starts from them
+    bool applyCounterFloor(FrameCounters& counters) const
+    {
+        bool raised = false;
+        if (counters.txReserved < _active.counterFloor)
+        {
+            counters.txReserved = _active.counterFloor;
+            raised = true;
+        }
+        if (counters.rxStored < _active.counterFloor)
+        {
+            counters.rxStored = _active.counterFloor;
+            raised = true;
+        }
+        return raised;
+    }
+
+private:
+    SettingsPort& _port;
+    uint64_t _reservedPins;
+    NodeSettings _defaults = {};
+    NodeSettings _active = {};
+    NodeSettings _pending = {};
+};
+
+#endif // LORA_ALARM_NODE_SETTINGS_H
@@ -0,0 +1,42 @@
+/*
+*  Title          :  RadioPort
+*  Desc           :  The slice of the Heltec Radio API the protocol state machines use.
+*                 :  HeltecRadio.h forwards it to the SX1262 on the board, the simulator
+*                 :  provides a software medium.  Radio events come back by calling the
+*                 :  protocol's onTxDone(), onRxDone() ... handlers, exactly as the
+*                 :  RadioEvents_t callbacks do on the hardware.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.2
+*  History        : 1.0 2026-10-17 Send, receive and CAD
+*                 : 1.1 2026-10-17 Spreading factor and TX power can change between frames
+*                 : 1.2 2026-10-17 Channel and preamble can change between frames
+*
+*/
+
+#ifndef LORA_ALARM_RADIO_PORT_H
+#define LORA_ALARM_RADIO_PORT_H
+
+#include <stdint.h>
+
+class RadioPort
+{
+public:
+    virtual ~RadioPort() {}
+
+    virtual void send(const uint8_t* data, uint8_t len) = 0;
+    virtual void receive(uint32_t timeoutMs) = 0;   // 0 receives until told otherwise
+    virtual void startCad(void) = 0;
+    virtual void standby(void) = 0;
+    virtual void sleep(void) = 0;
+    virtual void service(void) = 0;                 // Radio.IrqProcess() on the hardware
+    // Applies to the next send, receive or CAD.  Cheap when nothing changes
+    virtual void setDataRate(uint8_t spreadingFactor, int8_t txPower) = 0;
+    // Applies to the next send, receive or CAD the same way.  A receiver hears a frame with a
+    // longer preamble than its own
+    virtual void setChannel(uint32_t frequency, uint16_t preambleLength) = 0;
+    virtual uint32_t timeOnAir(uint8_t len) = 0;    // ms at the current data rate and preamble
+};
+
+#endif // LORA_ALARM_RADIO_PORT_H
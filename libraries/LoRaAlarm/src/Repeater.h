@@ -0,0 +1,524 @@
+/*
+*  Title          :  Repeater
+*  Desc           :  Store and forward for a mains powered RemoteNode, so nodes out of the
+*                 :  hub's range reach it through one that is in range.  Frames go through in a
+*                 :  RELAY envelope, see AlarmFrame.h.  A repeater cannot open them, the frame
+*                 :  inside is checked end to end by the hub or the node with its own key and
+*                 :  counter, so a repeater can lose or delay a frame but not change one.
+*                 :
+*                 :  Toward the hub a repeater passes on, after a holdoff long enough for the
+*                 :  hub to have answered first and a random spread so repeaters that heard the
+*                 :  same frame do not all go at once:
+*                 :
+*                 :    frames a node it has heard itself sends, unless it has heard the hub
+*                 :    answer that node directly in the last RELAY_DIRECT_HOLD.  Only an alarm
+*                 :    or an ACK is known to come from the node, the frames of a node become
+*                 :    worth passing on once it has sent one of those
+*                 :    envelopes from repeaters further out, up to hops repeaters in all,
+*                 :    unless they answer a frame another repeater carried out
+*                 :    the answer of a node it has just carried a frame to
+*                 :
+*                 :  A copy the hub answers, or another repeater passes on first, is dropped
+*                 :  from the queue.  Toward a node the hub names the first repeater, and each
+*                 :  repeater the next one from what it learned on the way up, the last hands
+*                 :  the frame to the node still in its envelope.
+*                 :
+*                 :  A repeater carries the nodes on its own channel of the channel plan.
+*                 :
+*                 :  The protocol gives heard() everything received that is not for itself,
+*                 :  and sends whatever due() returns when the channel is clear.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.0
+*
+*/
+
+#ifndef LORA_ALARM_REPEATER_H
+#define LORA_ALARM_REPEATER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "AlarmFrame.h"
+#include "DutyCycle.h"
+#include "LoRaAirtime.h"
+
+#define RELAY_HOPS_MAX                              3   // Repeaters a frame may pass
+#define RELAY_TURNAROUND                            20  // ms from a frame heard to the radio sending
+#define RELAY_ROUTES                                64  // Nodes a repeater keeps a route for
+#define RELAY_SEEN                                  16  // Frames remembered so a copy is not passed on twice
+#define RELAY_QUEUE                                 4   // Frames waiting to go
+#define RELAY_DIRECT_HOLD                           1800000UL   // ms a node the hub answered directly is left to it
+
+typedef struct
+{
+    uint8_t hops;               // Repeaters a frame may pass, 0 if the network has none
+    uint32_t holdoff;           // ms before a frame is passed on toward the hub, the hub answers first
+    uint32_t spread;            // ms of random delay added to the holdoff
+    uint32_t hopTime;           // ms each repeater may add to an exchange one way
+} RelayPlan;
+
+// Times at the base rate, the rate repeaters work at.  The holdoff covers the longest answer, and
+// frames toward the hub carry the scan preamble, see ChannelPlan.h
+inline RelayPlan relayPlanMake(uint8_t hops, uint8_t spreadingFactor, uint8_t bandwidth, uint8_t codingRate,
+    uint16_t preambleLength, uint16_t scanPreamble)
+{
+    RelayPlan plan;
+    plan.hops = (hops > RELAY_HOPS_MAX) ? RELAY_HOPS_MAX : hops;
+    uint32_t cad = (2 * loraSymbolMicros(spreadingFactor, bandwidth) + 999) / 1000;
+    plan.holdoff = loraTimeOnAirMillis(spreadingFactor, bandwidth, codingRate, preambleLength,
+        (uint8_t)alarmFrameSize(FRAME_CONFIG_ACK), true, false) + 2 * RELAY_TURNAROUND;
+    plan.spread = loraTimeOnAirMillis(spreadingFactor, bandwidth, codingRate, scanPreamble, RELAY_FRAME_MAX_SIZE, true, false);
+    plan.hopTime = plan.holdoff + plan.spread + cad
+        + loraTimeOnAirMillis(spreadingFactor, bandwidth, codingRate, scanPreamble, RELAY_FRAME_MAX_SIZE, true, false)
+        + RELAY_TURNAROUND;
+    return plan;
+}
+
+typedef struct
+{
+    unsigned long heard;        // Frames for other nodes received
+    unsigned long forwarded;
+    unsigned long suppressed;   // Left out, the hub or another repeater already had it
+    unsigned long duplicates;   // Copies of a frame already passed on
+    unsigned long noRoute;      // For a node this repeater has not heard
+    unsigned long dropped;      // The queue full, no airtime, or past the hop limit on the way to a node
+} RepeaterStats;
+
+// A frame waiting to be passed on
+typedef struct
+{
+    uint8_t data[RELAY_FRAME_MAX_SIZE];
+    uint8_t length;             // 0 if the entry is free
+    uint16_t address;           // Node the frame inside is about
+    uint16_t counter;
+    bool downlink;
+    uint8_t hops;
+    uint8_t priority;           // AirtimePriority_t
+    uint32_t dueMs;
+} RelayFrame;
+
+template <size_t Routes = RELAY_ROUTES>
+class Repeater
+{
+public:
+    void begin(uint16_t address, const RelayPlan& plan)
+    {
+        _address = address;
+        _plan = plan;
+        _routeCount = 0;
+        _seenHead = 0;
+        memset(_seen, 0, sizeof(_seen));
+        memset(_queue, 0, sizeof(_queue));
+        _current = -1;
+        RepeaterStats none = {};
+        _stats = none;
+    }
+
+    // A frame that was not for this node.  jitter is the random part of the holdoff, 0 to
+    // plan.spread.  Returns true if it was queued
+    bool heard(const uint8_t* payload, uint16_t size, uint32_t now, uint32_t jitter)
+    {
+        RelayHeader relay = {};
+        AlarmFrame frame = {};
+        bool wrapped = relayFramePeek(payload, size, relay) == FRAME_OK;
+        if (!wrapped)
+        {
+            relay.frame = payload;
+            relay.length = (uint8_t)((size > RELAY_FRAME_MAX_SIZE) ? RELAY_FRAME_MAX_SIZE : size);
+        }
+        if (alarmFramePeek(relay.frame, relay.length, frame) != FRAME_OK || frame.nodeAddress == _address)
+        {
+            return false;
+        }
+        _stats.heard++;
+        if (!wrapped)
+        {
+            return heardRaw(relay, frame, now, jitter);
+        }
+        return relay.downlink ? heardDown(relay, frame, now) : heardUp(relay, frame, now, jitter);
+    }
+
+    // The frame to send now, nullptr if none is due.  It stays queued until sent() or drop()
+    const RelayFrame* due(uint32_t now)
+    {
+        _current = -1;
+        for (size_t i = 0; i < RELAY_QUEUE; i++)
+        {
+            if (_queue[i].length > 0 && (int32_t)(now - _queue[i].dueMs) >= 0
+                && (_current < 0 || _queue[i].priority > _queue[_current].priority))
+            {
+                _current = (int)i;
+            }
+        }
+        return (_current < 0) ? nullptr : &_queue[_current];
+    }
+
+    const RelayFrame& current(void) const { return _queue[_current]; }
+
+    void sent(uint32_t now)
+    {
+        RelayFrame& frame = _queue[_current];
+        if (frame.downlink)
+        {
+            // The node answers through this repeater, the window for that runs from now
+            RelayRoute* route = find(frame.address);
+            if (route != nullptr)
+            {
+                route->kind = ROUTE_CARRIED;
+                route->heardMs = now;
+            }
+        }
+        frame.length = 0;
+        _stats.forwarded++;
+    }
+
+    // No airtime for it
+    void drop(void)
+    {
+        _queue[_current].length = 0;
+        _stats.dropped++;
+    }
+
+    // The channel was busy, try again at until
+    void defer(uint32_t until)
+    {
+        _queue[_current].dueMs = until;
+    }
+
+    const RepeaterStats& stats(void) const { return _stats; }
+
+private:
+    typedef enum
+    {
+        ROUTE_SEEN_RAW,         // Last heard a frame about the node straight from the node or the hub
+        ROUTE_SEEN_DOWN,        // Another repeater is carrying a frame to the node
+        ROUTE_SEEN_UP,          // Another repeater passed on a frame of the node
+        ROUTE_CARRIED           // This repeater carried a frame to the node
+    } RouteKind_t;
+
+    typedef struct
+    {
+        uint16_t address;
+        uint16_t via;           // Repeater the node's frames came through, 0 if heard directly
+        uint32_t heardMs;       // Last frame about the node
+        uint32_t directMs;      // Last time the hub was heard answering the node directly
+        bool direct;            // directMs is set
+        bool local;             // This repeater has heard the node itself
+        uint8_t kind;           // RouteKind_t of the last frame
+        uint8_t lastType;
+    } RelayRoute;
+
+    typedef struct
+    {
+        uint16_t address;
+        uint16_t counter;
+        bool downlink;
+    } RelaySeen;
+
+    // Frames only the hub sends, and ones only a node sends
+    static bool downlinkOnly(uint8_t type)
+    {
+        return type == FRAME_ACK || type == FRAME_COMMAND || type == FRAME_LINK || type == FRAME_CONFIG;
+    }
+
+    static bool uplinkOnly(uint8_t type)
+    {
+        return type == FRAME_ALARM || type == FRAME_COMMAND_ACK || type == FRAME_LINK_ACK || type == FRAME_CONFIG_ACK;
+    }
+
+    static uint8_t priorityOf(uint8_t type)
+    {
+        if (type == FRAME_ALARM || type == FRAME_ACK)
+        {
+            return AIRTIME_ALARM;
+        }
+        if (type == FRAME_COMMAND || type == FRAME_COMMAND_ACK || type == FRAME_CONFIG || type == FRAME_CONFIG_ACK)
+        {
+            return AIRTIME_NORMAL;
+        }
+        return AIRTIME_LOW;
+    }
+
+    // Straight from a node or from the hub, the clear header does not always say which
+    bool heardRaw(const RelayHeader& relay, const AlarmFrame& frame, uint32_t now, uint32_t jitter)
+    {
+        RelayRoute& route = touch(frame.nodeAddress, now);
+        bool recent = isRecent(route, now);
+        uint8_t previous = route.kind;
+        uint8_t previousType = route.lastType;
+        route.heardMs = now;
+        route.kind = ROUTE_SEEN_RAW;
+        route.lastType = frame.type;
+        if (downlinkOnly(frame.type))
+        {
+            // The hub is answering the node itself
+            directHeard(route, now);
+            return false;
+        }
+        if (uplinkOnly(frame.type))
+        {
+            route.local = true;
+            route.via = 0;
+        }
+        if (recent && previous == ROUTE_CARRIED)
+        {
+            // The answer to a frame carried to the node
+            return queue(relay, frame, now + _plan.holdoff + jitter, false, 1);
+        }
+        if (recent && previous == ROUTE_SEEN_RAW && !(uplinkOnly(previousType) && uplinkOnly(frame.type)))
+        {
+            // A poll and its reply, or a frame and its answer, the hub and the node hear each other
+            directHeard(route, now);
+            _stats.suppressed++;
+            return false;
+        }
+        if ((recent && previous == ROUTE_SEEN_DOWN) || !route.local)
+        {
+            return false;   // Another repeater has it, or it could be the hub's own poll
+        }
+        if (frame.type != FRAME_ALARM && route.direct && now - route.directMs < RELAY_DIRECT_HOLD)
+        {
+            return false;   // Alarms go anyway, the ACK heard cancels them
+        }
+        return queue(relay, frame, now + _plan.holdoff + jitter, false, 1);
+    }
+
+    // From a repeater further out
+    bool heardUp(const RelayHeader& relay, const AlarmFrame& frame, uint32_t now, uint32_t jitter)
+    {
+        RelayRoute& route = touch(frame.nodeAddress, now);
+        bool recent = isRecent(route, now);
+        uint8_t previous = route.kind;
+        route.heardMs = now;
+        route.kind = ROUTE_SEEN_UP;
+        route.lastType = frame.type;
+        RelayFrame* pending = find(frame.nodeAddress, (uint16_t)frame.counter, false);
+        if (pending != nullptr && relay.hops >= pending->hops)
+        {
+            // Another repeater went first and got at least as far
+            pending->length = 0;
+            _stats.suppressed++;
+            return false;
+        }
+        if (seen(frame.nodeAddress, (uint16_t)frame.counter, false))
+        {
+            _stats.duplicates++;
+            return false;
+        }
+        if (!route.local)
+        {
+            route.via = relay.via;
+        }
+        if (recent && previous == ROUTE_SEEN_DOWN)
+        {
+            return false;   // The answer to a frame another repeater carried, it takes it back
+        }
+        if (relay.hops >= _plan.hops)
+        {
+            return false;   // Sent by a repeater next to the hub, the hub has it
+        }
+        return queue(relay, frame, now + _plan.holdoff + jitter, false, (uint8_t)(relay.hops + 1));
+    }
+
+    // From the hub or a repeater nearer it, on its way to a node
+    bool heardDown(const RelayHeader& relay, const AlarmFrame& frame, uint32_t now)
+    {
+        RelayRoute& route = touch(frame.nodeAddress, now);
+        bool recent = isRecent(route, now);
+        route.lastType = frame.type;
+        cancel(frame.nodeAddress);     // The hub already has whatever the node sent
+        if (relay.via != _address)
+        {
+            // Unless it is the next repeater taking on what this one carried, the answer comes
+            // back through both
+            route.heardMs = now;
+            route.kind = (recent && route.kind == ROUTE_CARRIED) ? (uint8_t)ROUTE_CARRIED : (uint8_t)ROUTE_SEEN_DOWN;
+            return false;
+        }
+        if (!reaches(route))
+        {
+            _stats.noRoute++;
+            return false;
+        }
+        if (relay.hops >= _plan.hops)
+        {
+            _stats.dropped++;
+            return false;
+        }
+        if (seen(frame.nodeAddress, (uint16_t)frame.counter, true))
+        {
+            _stats.duplicates++;
+            return false;
+        }
+        RelayHeader next = relay;
+        next.via = route.local ? frame.nodeAddress : route.via;
+        return queue(next, frame, now, true, (uint8_t)(relay.hops + 1));
+    }
+
+    // The last frame about the node belongs with this one.  A frame carried out waits for the
+    // node to answer as well as for the hop back
+    bool isRecent(const RelayRoute& route, uint32_t now) const
+    {
+        return now - route.heardMs <= ((route.kind == ROUTE_CARRIED) ? 2 * _plan.hopTime : _plan.hopTime);
+    }
+
+    void directHeard(RelayRoute& route, uint32_t now)
+    {
+        route.direct = true;
+        route.directMs = now;
+        cancel(route.address);
+    }
+
+    // The node's route, added if it has none.  A new one looks long unheard
+    RelayRoute& touch(uint16_t address, uint32_t now)
+    {
+        RelayRoute* route = find(address);
+        if (route != nullptr)
+        {
+            return *route;
+        }
+        size_t slot = _routeCount;
+        if (_routeCount < Routes)
+        {
+            _routeCount++;
+        }
+        else
+        {
+            // A node only overheard makes room before one this repeater can reach, the one heard
+            // longest ago of them
+            slot = 0;
+            for (size_t i = 1; i < Routes; i++)
+            {
+                bool reachable = reaches(_routes[i]);
+                if (reachable != reaches(_routes[slot]) ? !reachable
+                    : (int32_t)(_routes[i].heardMs - _routes[slot].heardMs) < 0)
+                {
+                    slot = i;
+                }
+            }
+        }
+        RelayRoute blank = {};
+        blank.address = address;
+        blank.heardMs = now - _plan.hopTime - 1;
+        _routes[slot] = blank;
+        return _routes[slot];
+    }
+
+    static bool reaches(const RelayRoute& route)
+    {
+        return route.local || route.via != 0;
+    }
+
+    RelayRoute* find(uint16_t address)
+    {
+        for (size_t i = 0; i < _routeCount; i++)
+        {
+            if (_routes[i].address == address)
+            {
+                return &_routes[i];
+            }
+        }
+        return nullptr;
+    }
+
+    RelayFrame* find(uint16_t address, uint16_t counter, bool downlink)
+    {
+        for (size_t i = 0; i < RELAY_QUEUE; i++)
+        {
+            RelayFrame& frame = _queue[i];
+            if (frame.length > 0 && frame.address == address && frame.counter == counter && frame.downlink == downlink)
+            {
+                return &frame;
+            }
+        }
+        return nullptr;
+    }
+
+    bool seen(uint16_t address, uint16_t counter, bool downlink) const
+    {
+        for (size_t i = 0; i < RELAY_SEEN; i++)
+        {
+            const RelaySeen& entry = _seen[i];
+            if (entry.address == address && entry.counter == counter && entry.downlink == downlink)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Drops anything waiting to go toward the hub about the node
+    void cancel(uint16_t address)
+    {
+        for (size_t i = 0; i < RELAY_QUEUE; i++)
+        {
+            if (_queue[i].length > 0 && _queue[i].address == address && !_queue[i].downlink)
+            {
+                _queue[i].length = 0;
+                _stats.suppressed++;
+            }
+        }
+    }
+
+    // A newer frame toward the hub from the same node takes the place of one still waiting
+    bool queue(const RelayHeader& relay, const AlarmFrame& frame, uint32_t dueMs, bool downlink, uint8_t hops)
+    {
+        int slot = -1;
+        for (size_t i = 0; i < RELAY_QUEUE; i++)
+        {
+            RelayFrame& waiting = _queue[i];
+            if (!downlink && waiting.length > 0 && waiting.address == frame.nodeAddress && !waiting.downlink)
+            {
+                slot = (int)i;
+                dueMs = waiting.dueMs;
+                _stats.suppressed++;
+                break;
+            }
+            if (slot < 0 && waiting.length == 0)
+            {
+                slot = (int)i;
+            }
+        }
+        if (slot < 0)
+        {
+            _stats.dropped++;
+            return false;
+        }
+        RelayFrame& entry = _queue[slot];
+        RelayHeader header = relay;
+        header.via = downlink ? relay.via : _address;
+        header.hops = hops;
+        header.downlink = downlink;
+        relayFrameWrap(header, entry.data);
+        memcpy(&entry.data[RELAY_FRAME_HEADER_SIZE], relay.frame, relay.length);
+        entry.length = (uint8_t)(RELAY_FRAME_HEADER_SIZE + relay.length);
+        entry.address = frame.nodeAddress;
+        entry.counter = (uint16_t)frame.counter;
+        entry.downlink = downlink;
+        entry.hops = hops;
+        entry.priority = priorityOf(frame.type);
+        entry.dueMs = dueMs;
+
+        RelaySeen& remembered = _seen[_seenHead];
+        remembered.address = frame.nodeAddress;
+        remembered.counter = (uint16_t)frame.counter;
+        remembered.downlink = downlink;
+        _seenHead = (uint8_t)((_seenHead + 1) % RELAY_SEEN);
+        return true;
+    }
+
+    uint16_t _address = 0;
+    RelayPlan _plan = {};
+    RelayRoute _routes[Routes];
+    size_t _routeCount = 0;
+    RelaySeen _seen[RELAY_SEEN];
+    uint8_t _seenHead = 0;
+    RelayFrame _queue[RELAY_QUEUE];
+    int _current = -1;          // Entry due() returned
+    RepeaterStats _stats = {};
+};
+
+#endif // LORA_ALARM_REPEATER_H
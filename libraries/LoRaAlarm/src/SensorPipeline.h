@@ -0,0 +1,173 @@
+/*
+*  Title          :  SensorPipeline
+*  Desc           :  Turns raw readings from up to 8 inputs into one debounced bitmask of the
+*                 :  inputs that are active.  The firmware reads every input on a fixed
+*                 :  scan and hands the readings to update(), the node reports the mask.
+*                 :
+*                 :  Each input goes through four stages, all set per input in InputConfig:
+*                 :    level      digital, the pin level that means active.  Analog, active at
+*                 :               or above setLevel and inactive again at or below clearLevel,
+*                 :               the gap between them is the hysteresis
+*                 :    debounce   a new level has to hold for debounceMs before it is believed
+*                 :    hold       once active an input stays active for at least minHoldMs, so
+*                 :               a PIR dropping out for a moment does not clear the alarm
+*                 :    rate       changes of an input are reported at most once a rateLimitMs,
+*                 :               anything in between is merged into the next one
+*                 :
+*                 :  No constructor, so a node in low power mode can keep it in RTC memory.
+*                 :  millis() starts again after deep sleep, resume() restarts the timers.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.0
+*
+*/
+
+#ifndef LORA_ALARM_SENSOR_PIPELINE_H
+#define LORA_ALARM_SENSOR_PIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum
+{
+    INPUT_DIGITAL,
+    INPUT_ANALOG
+} InputKind_t;
+
+typedef struct
+{
+    uint8_t kind;               // InputKind_t
+    uint8_t pin;                // Board pin, only the firmware reads it
+    bool activeHigh;            // Digital, a high reading means active
+    uint16_t setLevel;          // Analog, active at or above this reading
+    uint16_t clearLevel;        // Analog, inactive again at or below this reading
+    uint16_t debounceMs;        // A new level holds this long before it is believed
+    uint16_t minHoldMs;         // Shortest time an input stays active
+    uint16_t rateLimitMs;       // Shortest time between reported changes of the input
+} InputConfig;
+
+typedef struct
+{
+    bool level;                 // After the level stage
+    bool stable;                // After the debounce
+    bool reported;              // After the hold and rate stages, the bit in the mask
+    uint32_t levelSinceMs;
+    uint32_t activeSinceMs;     // When reported last went active
+    uint32_t changedMs;         // When reported last changed
+} InputState;
+
+template <size_t Channels>
+class SensorPipeline
+{
+    static_assert(Channels >= 1 && Channels <= 8, "The input mask is one byte");
+
+public:
+    // Everything inactive, the first readings are debounced like any other change
+    void begin(const InputConfig* configs, uint32_t now)
+    {
+        _configs = configs;
+        for (size_t i = 0; i < Channels; i++)
+        {
+            InputState& state = _states[i];
+            state.level = false;
+            state.stable = false;
+            state.reported = false;
+            state.levelSinceMs = now;
+            state.activeSinceMs = now;
+            state.changedMs = now - _configs[i].rateLimitMs;
+        }
+        _mask = 0;
+        _settling = false;
+        _levelChanges = 0;
+        _maskChanges = 0;
+    }
+
+    // After deep sleep, millis() has started again.  The states are kept and the timers restart
+    void resume(uint32_t now)
+    {
+        for (size_t i = 0; i < Channels; i++)
+        {
+            InputState& state = _states[i];
+            state.levelSinceMs = now;
+            state.activeSinceMs = now;
+            state.changedMs = now - _configs[i].rateLimitMs;
+        }
+    }
+
+    // One reading per input, 0 or 1 for a digital input.  True if the mask changed
+    bool update(const uint16_t* readings, uint32_t now)
+    {
+        uint8_t mask = 0;
+        bool settling = false;
+        for (size_t i = 0; i < Channels; i++)
+        {
+            const InputConfig& config = _configs[i];
+            InputState& state = _states[i];
+
+            bool level;
+            if (config.kind == INPUT_ANALOG)
+            {
+                level = state.level ? readings[i] > config.clearLevel : readings[i] >= config.setLevel;
+            }
+            else
+            {
+                level = (readings[i] != 0) == config.activeHigh;
+            }
+            if (level != state.level)
+            {
+                state.level = level;
+                state.levelSinceMs = now;
+                _levelChanges++;
+            }
+            if (state.level != state.stable && now - state.levelSinceMs >= config.debounceMs)
+            {
+                state.stable = state.level;
+            }
+
+            bool wanted = state.stable || (state.reported && now - state.activeSinceMs < config.minHoldMs);
+            if (wanted != state.reported && now - state.changedMs >= config.rateLimitMs)
+            {
+                state.reported = wanted;
+                state.changedMs = now;
+                if (wanted)
+                {
+                    state.activeSinceMs = now;
+                }
+            }
+            if (state.reported)
+            {
+                mask |= (uint8_t)(1u << i);
+            }
+            // Still debouncing, or the reported bit has yet to follow the debounced level
+            settling |= state.level != state.stable || state.reported != state.stable;
+        }
+        _settling = settling;
+        if (mask == _mask)
+        {
+            return false;
+        }
+        _mask = mask;
+        _maskChanges++;
+        return true;
+    }
+
+    uint8_t mask(void) const { return _mask; }
+    // An input is being debounced, held or rate limited, the mask may still change.  A low
+    // power node stays awake until it is false
+    bool settling(void) const { return _settling; }
+    const InputState& state(size_t index) const { return _states[index]; }
+    // Raw level changes seen and mask changes reported, the difference never went on air
+    unsigned long levelChanges(void) const { return _levelChanges; }
+    unsigned long maskChanges(void) const { return _maskChanges; }
+
+private:
+    const InputConfig* _configs;
+    InputState _states[Channels];
+    uint8_t _mask;
+    bool _settling;
+    unsigned long _levelChanges;
+    unsigned long _maskChanges;
+};
+
+#endif // LORA_ALARM_SENSOR_PIPELINE_H
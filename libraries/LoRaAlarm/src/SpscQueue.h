@@ -0,0 +1,77 @@
+/*
+*  Title          :  SpscQueue
+*  Desc           :  Lock free single producer, single consumer ring buffer.
+*                 :
+*                 :  Used by the UI and the hub to hand ESP-NOW messages from the Wi-Fi task to
+*                 :  loop(), which owns LVGL on the UI.  The hub's radio task, which owns the
+*                 :  radio, also hands alarm events to loop() for the event log.  push() may
+*                 :  only be called from one task and pop() from one other.  Neither blocks.  A
+*                 :  push into a full queue is dropped and counted, the newest item is the one
+*                 :  lost.
+*                 :
+*                 :  Size must be a power of two, one slot is always left empty.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.1
+*  History        : 1.0 2026-10-17 ESP-NOW messages from the Wi-Fi task to loop()
+*                 : 1.1 2026-10-17 The hub's radio task owns the radio, alarm events to the event log
+*
+*/
+
+#ifndef LORA_ALARM_SPSC_QUEUE_H
+#define LORA_ALARM_SPSC_QUEUE_H
+
+#include <stdint.h>
+#include <atomic>
+
+template <typename T, uint16_t Size>
+class SpscQueue
+{
+    static_assert(Size >= 2 && (Size & (Size - 1)) == 0, "SpscQueue size must be a power of two");
+
+public:
+    // Producer side
+    bool push(const T& item)
+    {
+        uint16_t head = _head.load(std::memory_order_relaxed);
+        uint16_t next = (uint16_t)((head + 1) & (Size - 1));
+        if (next == _tail.load(std::memory_order_acquire))
+        {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        _items[head] = item;
+        _head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side
+    bool pop(T& item)
+    {
+        uint16_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        item = _items[tail];
+        _tail.store((uint16_t)((tail + 1) & (Size - 1)), std::memory_order_release);
+        return true;
+    }
+
+    bool empty(void) const
+    {
+        return _tail.load(std::memory_order_acquire) == _head.load(std::memory_order_acquire);
+    }
+
+    uint16_t capacity(void) const { return Size - 1; }
+    uint32_t dropped(void) const { return _dropped.load(std::memory_order_relaxed); }
+
+private:
+    T _items[Size];
+    std::atomic<uint16_t> _head{0};     // Written by the producer only
+    std::atomic<uint16_t> _tail{0};     // Written by the consumer only
+    std::atomic<uint32_t> _dropped{0};
+};
+
+#endif // LORA_ALARM_SPSC_QUEUE_H
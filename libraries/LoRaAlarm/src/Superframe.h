@@ -0,0 +1,287 @@
+/*
+*  Title          :  Superframe
+*  Desc           :  Beacon timed slots for the nodes that report by themselves.  The hub
+*                 :  starts a superframe every period with a BEACON on each channel, see
+*                 :  AlarmFrame.h, then gives each low power node a slot of its own after them.
+*                 :  A node with a slot wakes for it, sends its check in and sleeps again, so
+*                 :  check ins no longer land on top of each other at random.  Polls, commands
+*                 :  and anything unsolicited use the rest of the period.  Alarms still go at
+*                 :  once, they do not wait for a slot.
+*                 :
+*                 :    | beacons | slot 0 | slot 1 | ... | slot n |     open     |
+*                 :
+*                 :  A slot holds the check in, the hub's answer and the node's reply to that,
+*                 :  with a guard at either end for the node's clock being out.
+*                 :
+*                 :  The hub gives a node its slot in a SLOT frame, sealed with the node's key,
+*                 :  in answer to a check in that was not in it.  The SLOT frame carries the
+*                 :  hub's clock as well, so the node can use the slot straight away.  A node
+*                 :  keeps time through deep sleep on its RTC slow clock, which is well out.
+*                 :  SlotClock measures how far from two syncs with the hub and works its
+*                 :  wakes out with it.  Whatever the measurement may still be out by grows
+*                 :  with the time since the last sync, and when it would take the node past
+*                 :  the guard it wakes for the beacon before its slot first.
+*                 :
+*                 :  Nothing is set up by a constructor so the node can keep SlotClock in RTC
+*                 :  memory through deep sleep, begin() does that.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.0
+*
+*/
+
+#ifndef LORA_ALARM_SUPERFRAME_H
+#define LORA_ALARM_SUPERFRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "AlarmFrame.h"
+#include "LoRaAirtime.h"
+
+#define SUPERFRAME_NO_SLOT                          0xFFFF
+#define SUPERFRAME_GUARD                            16      // ms either side of a check in
+#define SUPERFRAME_TURNAROUND                       20      // ms from a frame heard to the answer going
+#define SUPERFRAME_OPEN_SHARE                       20      // % of the period always left open
+#define SUPERFRAME_WAKE_LEAD                        100     // ms from a timed wake to the radio ready
+#define SUPERFRAME_SYNC_ERROR                       2       // ms a sync may be out by, the clock's resolution
+#define SUPERFRAME_DRIFT_MAX                        10000   // ppm the slow clock may be out before it is measured
+#define SUPERFRAME_DRIFT_RESIDUAL                   100     // ppm it may still be out once it is
+#define SUPERFRAME_DRIFT_WEIGHT                     4       // Each measurement moves the estimate a quarter of the way
+#define SUPERFRAME_WINDOW_SHARE                     8       // A beacon window wider than period / 8 is not worth it
+
+typedef struct
+{
+    uint32_t period;            // ms from one beacon to the next, 0 for no superframe
+    uint16_t slots;             // Slots after the beacons
+    uint32_t beaconSpacing;     // ms from one channel's beacon to the next
+    uint32_t beaconTime;        // ms from the start of the superframe to slot 0
+    uint32_t slotLength;        // ms
+    uint32_t guard;             // ms either side of a check in, what a node's clock may be out by
+    uint32_t statusAirtime;     // ms, a check in, the hub times it against the slot
+    uint32_t beaconAirtime;     // ms
+} SuperframePlan;
+
+typedef struct
+{
+    unsigned long beacons;
+    unsigned long beaconsSkipped;   // Too late after an exchange, or no airtime
+    unsigned long slotted;          // Check ins heard in their slot
+    unsigned long unslotted;        // Heard anywhere else
+    unsigned long slotFrames;       // SLOT frames sent
+} SuperframeStats;
+
+// Times at the base rate, the rate check ins and beacons go at.  A check in carries the scan
+// preamble, see ChannelPlan.h, everything else the short one.  Slots are cut to what fits in the
+// period with SUPERFRAME_OPEN_SHARE left over
+inline SuperframePlan superframePlanMake(uint32_t period, uint16_t slots, uint8_t channels, uint8_t spreadingFactor,
+    uint8_t bandwidth, uint8_t codingRate, uint16_t preambleLength, uint16_t scanPreamble)
+{
+    SuperframePlan plan;
+    plan.period = period;
+    plan.guard = SUPERFRAME_GUARD;
+    plan.statusAirtime = loraTimeOnAirMillis(spreadingFactor, bandwidth, codingRate, scanPreamble,
+        (uint8_t)alarmFrameSize(FRAME_STATUS), true, false);
+    plan.beaconAirtime = loraTimeOnAirMillis(spreadingFactor, bandwidth, codingRate, preambleLength,
+        BEACON_FRAME_SIZE, true, false);
+    plan.beaconSpacing = plan.beaconAirtime + SUPERFRAME_TURNAROUND;
+    plan.beaconTime = (uint32_t)(channels < 1 ? 1 : channels) * plan.beaconSpacing + plan.guard;
+    plan.slotLength = 2 * plan.guard + plan.statusAirtime + 2 * SUPERFRAME_TURNAROUND
+        + loraTimeOnAirMillis(spreadingFactor, bandwidth, codingRate, preambleLength, ALARM_FRAME_MAX_SIZE, true, false)
+        + loraTimeOnAirMillis(spreadingFactor, bandwidth, codingRate, preambleLength,
+            (uint8_t)alarmFrameSize(FRAME_CONFIG_ACK), true, false);
+    uint32_t room = period / 100 * (100 - SUPERFRAME_OPEN_SHARE);
+    uint32_t fit = (room > plan.beaconTime) ? (room - plan.beaconTime) / plan.slotLength : 0;
+    plan.slots = (period == 0) ? 0 : (slots > fit) ? (uint16_t)fit : slots;
+    return plan;
+}
+
+// ms into the superframe a node sends in its slot, a guard after the slot starts
+inline uint32_t superframeSlotOffset(const SuperframePlan& plan, uint16_t slot)
+{
+    return plan.beaconTime + (uint32_t)slot * plan.slotLength + plan.guard;
+}
+
+typedef enum
+{
+    SLOT_WAKE_NONE,             // No slot, or the clock is too far out to find it, check in as before
+    SLOT_WAKE_BEACON,           // Listen for the beacon first
+    SLOT_WAKE_SLOT              // Send the check in
+} SlotWake_t;
+
+typedef struct
+{
+    unsigned long syncs;        // Beacons and SLOT frames the clock was set from
+    unsigned long misses;       // Beacons listened for and not heard
+} SlotClockStats;
+
+// A node's slot and its idea of the hub's time, on its own slow clock
+class SlotClock
+{
+public:
+    void begin(void)
+    {
+        _slot = SUPERFRAME_NO_SLOT;
+        _synced = false;
+        _driftKnown = false;
+        _drift = 0;
+        _syncLocal = 0;
+        _syncNumber = 0;
+        _syncPhase = 0;
+        _measureLocal = 0;
+        _measureNumber = 0;
+        _measurePhase = 0;
+        _stats.syncs = 0;
+        _stats.misses = 0;
+    }
+
+    void assign(uint16_t slot) { _slot = slot; }
+
+    // The hub was phase ms into superframe number when the clock read local.  Two syncs far enough
+    // apart measure the clock against the hub's
+    void sync(const SuperframePlan& plan, uint32_t local, uint8_t number, uint32_t phase)
+    {
+        _stats.syncs++;
+        if (!_synced)
+        {
+            startMeasure(local, number, phase);
+        }
+        else
+        {
+            int32_t localElapsed = (int32_t)(local - _measureLocal);
+            int64_t hubElapsed = hubBetween(plan, localElapsed, _measureNumber, _measurePhase, number, phase);
+            if (hubElapsed >= (int64_t)plan.period)
+            {
+                int32_t measured = (int32_t)(((int64_t)localElapsed - hubElapsed) * 1000000 / hubElapsed);
+                if (measured > 2 * SUPERFRAME_DRIFT_MAX || measured < -2 * SUPERFRAME_DRIFT_MAX)
+                {
+                    // Not the same hub clock, it restarted
+                    _driftKnown = false;
+                    _drift = 0;
+                }
+                else if (!_driftKnown)
+                {
+                    _drift = measured;
+                    _driftKnown = true;
+                }
+                else
+                {
+                    _drift += (measured - _drift) / SUPERFRAME_DRIFT_WEIGHT;
+                }
+                startMeasure(local, number, phase);
+            }
+        }
+        _syncLocal = local;
+        _syncNumber = number;
+        _syncPhase = phase;
+        _synced = true;
+    }
+
+    // A beacon that did not come, the slot is left until the hub gives the time again
+    void missed(void)
+    {
+        _stats.misses++;
+        _synced = false;
+    }
+
+    // The next thing to wake for at least lead ms after local, at is when.  A beacon is listened
+    // for from at for window ms
+    SlotWake_t next(const SuperframePlan& plan, uint8_t channel, uint32_t local, uint32_t lead,
+        uint32_t& at, uint32_t& window) const
+    {
+        if (!slotted() || plan.period == 0)
+        {
+            return SLOT_WAKE_NONE;
+        }
+        int64_t hubNow = (int64_t)_syncPhase + toHub((int32_t)(local - _syncLocal));
+        int64_t frame = (hubNow >= 0) ? hubNow / plan.period : 0;
+        for (int tries = 0; tries < 3; tries++, frame++)
+        {
+            uint32_t slotAt = toLocal(frame * plan.period + superframeSlotOffset(plan, _slot));
+            if ((int32_t)(slotAt - local) < (int32_t)lead)
+            {
+                continue;
+            }
+            if (error(slotAt) <= plan.guard)
+            {
+                at = slotAt;
+                window = 0;
+                return SLOT_WAKE_SLOT;
+            }
+            uint32_t beaconAt = toLocal(frame * plan.period + (uint32_t)channel * plan.beaconSpacing);
+            uint32_t beaconError = error(beaconAt);
+            if (beaconError > plan.period / SUPERFRAME_WINDOW_SHARE)
+            {
+                return SLOT_WAKE_NONE;
+            }
+            if ((int32_t)(beaconAt - beaconError - local) >= (int32_t)lead)
+            {
+                at = beaconAt - beaconError;
+                window = 2 * beaconError + plan.beaconAirtime;
+                return SLOT_WAKE_BEACON;
+            }
+        }
+        return SLOT_WAKE_NONE;
+    }
+
+    // ms the clock may be out by at local
+    uint32_t error(uint32_t local) const
+    {
+        uint32_t elapsed = local - _syncLocal;
+        uint32_t ppm = _driftKnown ? SUPERFRAME_DRIFT_RESIDUAL : SUPERFRAME_DRIFT_MAX;
+        return SUPERFRAME_SYNC_ERROR + (uint32_t)((uint64_t)elapsed * ppm / 1000000);
+    }
+
+    bool slotted(void) const { return _slot != SUPERFRAME_NO_SLOT && _synced; }
+    uint16_t slot(void) const { return _slot; }
+    bool driftKnown(void) const { return _driftKnown; }
+    int32_t drift(void) const { return _drift; }    // ppm the slow clock runs fast
+    const SlotClockStats& stats(void) const { return _stats; }
+
+private:
+    void startMeasure(uint32_t local, uint8_t number, uint32_t phase)
+    {
+        _measureLocal = local;
+        _measureNumber = number;
+        _measurePhase = phase;
+    }
+
+    // Hub ms from one sync to another.  The superframe number is only 8 bits, the slow clock says
+    // roughly how many went by and the number settles it
+    int64_t hubBetween(const SuperframePlan& plan, int32_t localElapsed, uint8_t fromNumber, uint32_t fromPhase,
+        uint8_t toNumber, uint32_t toPhase) const
+    {
+        int64_t guess = toHub(localElapsed) + (int64_t)fromPhase - (int64_t)toPhase;
+        int64_t frames = (guess + (int64_t)plan.period / 2) / (int64_t)plan.period;
+        frames += (int8_t)(uint8_t)(toNumber - (uint8_t)(fromNumber + frames));
+        return frames * (int64_t)plan.period + (int64_t)toPhase - (int64_t)fromPhase;
+    }
+
+    // Slow clock ms to hub ms and back, with the drift measured
+    int64_t toHub(int32_t local) const
+    {
+        return (int64_t)local * 1000000 / (1000000 + _drift);
+    }
+
+    // Local ms the hub reaches hub ms into superframe _syncNumber
+    uint32_t toLocal(int64_t hub) const
+    {
+        int64_t elapsed = hub - (int64_t)_syncPhase;
+        return _syncLocal + (uint32_t)(elapsed + elapsed * _drift / 1000000);
+    }
+
+    uint16_t _slot;
+    bool _synced;
+    bool _driftKnown;
+    int32_t _drift;
+    uint32_t _syncLocal;        // Last sync, slots are timed from it
+    uint8_t _syncNumber;
+    uint32_t _syncPhase;
+    uint32_t _measureLocal;     // Sync the next drift measurement runs from
+    uint8_t _measureNumber;
+    uint32_t _measurePhase;
+    SlotClockStats _stats;
+};
+
+#endif // LORA_ALARM_SUPERFRAME_H
@@ -0,0 +1,472 @@
+/*
+*  Title          :  Telemetry
+*  Desc           :  Binary stream of node events and link statistics from the hub to a host over
+*                 :  its USB serial port.  The hub writes it with TelemetryWriter, the gateway
+*                 :  daemon reads it with TelemetryDecoder.
+*                 :
+*                 :  Records are batched.  A batch is a header and the records, followed by a
+*                 :  CRC-16/CCITT of both, COBS encoded so the only 0x00 on the wire ends each
+*                 :  batch.  A reader that joins mid stream, or loses bytes, starts again at the
+*                 :  next 0x00.
+*                 :
+*                 :  header   version 1, batch sequence 2, hub millis() 4, record count 1
+*                 :  record   type 1, body length 1, ms after the header's millis() 2, body
+*                 :
+*                 :  Little endian throughout.  A batch goes out when it is full, when it holds
+*                 :  an urgent record such as an alarm, after maxAge ms, or empty after
+*                 :  heartbeat ms of silence so the host can tell the hub is alive.  A batch the
+*                 :  port has no room for is dropped whole and counted.  Its sequence number is
+*                 :  still used, so the reader sees the gap.
+*                 :
+*                 :  Readers skip record types they do not know, new types need no new version.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.0
+*
+*/
+
+#ifndef LORA_ALARM_TELEMETRY_H
+#define LORA_ALARM_TELEMETRY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define TELEMETRY_VERSION                           1
+#define TELEMETRY_HEADER_SIZE                       8
+#define TELEMETRY_RECORD_HEADER_SIZE                4
+#define TELEMETRY_CRC_SIZE                          2
+#define TELEMETRY_MAX_PAYLOAD                       250  // Header and records, before the CRC and COBS
+// COBS adds a byte per 254 and the delimiter
+#define TELEMETRY_MAX_FRAME                         (TELEMETRY_MAX_PAYLOAD + TELEMETRY_CRC_SIZE + (TELEMETRY_MAX_PAYLOAD + TELEMETRY_CRC_SIZE) / 254 + 2)
+
+typedef enum
+{
+    TELEMETRY_NODE = 1,         // A node reported, its state and link
+    TELEMETRY_COMMAND = 2,      // A UI command changed state
+    TELEMETRY_HUB = 3           // Hub counters, sent periodically
+} TelemetryType_t;
+
+typedef struct
+{
+    uint16_t address;
+    uint8_t alarmState;         // DeviceStates_t
+    uint8_t relays;             // Bit 0 relay 1, bit 1 relay 2
+    uint8_t inputs;             // Bit n for input n
+    int16_t rssi;
+    int8_t snr;
+    uint32_t rxCount;           // Frames heard from the node
+    uint32_t missedPolls;
+    uint8_t spreadingFactor;    // Rate the node is polled at
+    int8_t txPower;
+} TelemetryNode;
+
+typedef struct
+{
+    uint16_t address;
+    uint8_t sequence;           // The UI's number for the command
+    uint8_t state;              // CommandStates_t
+    uint16_t latencyMs;         // First transmission to the node's ACK
+} TelemetryCommand;
+
+typedef struct
+{
+    uint16_t nodes;
+    uint32_t rejectedFrames;    // Forged, damaged or replayed LoRa frames
+    uint32_t commandsQueued;
+    uint32_t commandsDropped;
+    uint32_t uiDropped;         // UI requests lost to a full handoff queue
+    uint32_t telemetryDropped;  // Batches the serial port had no room for
+} TelemetryHub;
+
+typedef struct
+{
+    uint16_t sequence;
+    uint32_t ms;                // Hub millis() the record offsets count from
+    uint8_t count;
+} TelemetryBatch;
+
+typedef struct
+{
+    uint8_t type;               // TelemetryType_t
+    uint32_t ms;                // Hub millis() of the event
+    TelemetryNode node;         // The one that matches type is filled in
+    TelemetryCommand command;
+    TelemetryHub hub;
+} TelemetryRecord;
+
+// Where the encoded batches go, the USB serial port on the hub
+class TelemetryPort
+{
+public:
+    virtual ~TelemetryPort() {}
+
+    virtual size_t writable(void) = 0;      // Bytes write() takes without blocking
+    virtual size_t write(const uint8_t* data, size_t len) = 0;
+};
+
+// CRC-16/CCITT-FALSE, polynomial 0x1021, initial value 0xFFFF
+inline uint16_t telemetryCrc(const uint8_t* data, size_t len)
+{
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= (uint16_t)data[i] << 8;
+        for (uint8_t bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+// COBS, out holds len + len / 254 + 1 bytes.  The 0x00 delimiter is not added
+inline size_t cobsEncode(const uint8_t* in, size_t len, uint8_t* out)
+{
+    size_t code = 0;
+    size_t o = 1;
+    uint8_t run = 1;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (in[i] == 0)
+        {
+            out[code] = run;
+            code = o++;
+            run = 1;
+            continue;
+        }
+        out[o++] = in[i];
+        if (++run == 0xFF)
+        {
+            out[code] = run;
+            code = o++;
+            run = 1;
+        }
+    }
+    out[code] = run;
+    return o;
+}
+
+// Decodes in place, in and out may be the same buffer.  Returns the decoded length, 0 if malformed
+inline size_t cobsDecode(const uint8_t* in, size_t len, uint8_t* out)
+{
+    size_t i = 0;
+    size_t o = 0;
+    while (i < len)
+    {
+        uint8_t code = in[i++];
+        if (code == 0 || i + code - 1 > len)
+        {
+            return 0;
+        }
+        for (uint8_t n = 1; n < code; n++)
+        {
+            out[o++] = in[i++];
+        }
+        if (code != 0xFF && i < len)
+        {
+            out[o++] = 0;
+        }
+    }
+    return o;
+}
+
+inline void telemetryPut16(uint8_t* p, uint16_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); }
+inline void telemetryPut32(uint8_t* p, uint32_t v) { telemetryPut16(p, (uint16_t)v); telemetryPut16(p + 2, (uint16_t)(v >> 16)); }
+inline uint16_t telemetryGet16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+inline uint32_t telemetryGet32(const uint8_t* p) { return telemetryGet16(p) | ((uint32_t)telemetryGet16(p + 2) << 16); }
+
+#define TELEMETRY_NODE_SIZE                         18
+#define TELEMETRY_COMMAND_SIZE                      6
+#define TELEMETRY_HUB_SIZE                          22
+
+class TelemetryWriter
+{
+public:
+    explicit TelemetryWriter(TelemetryPort& port) : _port(port) {}
+
+    void begin(uint32_t maxAgeMs, uint32_t heartbeatMs, uint32_t now)
+    {
+        _maxAge = maxAgeMs;
+        _heartbeat = heartbeatMs;
+        _sentMs = now;
+        _count = 0;
+        _length = TELEMETRY_HEADER_SIZE;
+    }
+
+    // Urgent records go out straight away, the rest wait for the batch to fill or age
+    void node(uint32_t now, const TelemetryNode& node, bool urgent)
+    {
+        uint8_t* p = record(now, TELEMETRY_NODE, TELEMETRY_NODE_SIZE);
+        telemetryPut16(p, node.address);
+        p[2] = node.alarmState;
+        p[3] = node.relays;
+        p[4] = node.inputs;
+        telemetryPut16(p + 5, (uint16_t)node.rssi);
+        p[7] = (uint8_t)node.snr;
+        telemetryPut32(p + 8, node.rxCount);
+        telemetryPut32(p + 12, node.missedPolls);
+        p[16] = node.spreadingFactor;
+        p[17] = (uint8_t)node.txPower;
+        if (urgent)
+        {
+            flush(now);
+        }
+    }
+
+    void command(uint32_t now, const TelemetryCommand& command)
+    {
+        uint8_t* p = record(now, TELEMETRY_COMMAND, TELEMETRY_COMMAND_SIZE);
+        telemetryPut16(p, command.address);
+        p[2] = command.sequence;
+        p[3] = command.state;
+        telemetryPut16(p + 4, command.latencyMs);
+    }
+
+    void hub(uint32_t now, const TelemetryHub& hub)
+    {
+        uint8_t* p = record(now, TELEMETRY_HUB, TELEMETRY_HUB_SIZE);
+        telemetryPut16(p, hub.nodes);
+        telemetryPut32(p + 2, hub.rejectedFrames);
+        telemetryPut32(p + 6, hub.commandsQueued);
+        telemetryPut32(p + 10, hub.commandsDropped);
+        telemetryPut32(p + 14, hub.uiDropped);
+        telemetryPut32(p + 18, hub.telemetryDropped);
+    }
+
+    // Sends a batch that is old enough, or a heartbeat
+    void service(uint32_t now)
+    {
+        if ((_count > 0 && now - _firstMs >= _maxAge) || now - _sentMs >= _heartbeat)
+        {
+            flush(now);
+        }
+    }
+
+    void flush(uint32_t now)
+    {
+        uint32_t base = (_count > 0) ? _firstMs : now;
+        _payload[0] = TELEMETRY_VERSION;
+        telemetryPut16(&_payload[1], _sequence++);
+        telemetryPut32(&_payload[3], base);
+        _payload[7] = _count;
+        telemetryPut16(&_payload[_length], telemetryCrc(_payload, _length));
+
+        uint8_t frame[TELEMETRY_MAX_FRAME];
+        size_t len = cobsEncode(_payload, _length + TELEMETRY_CRC_SIZE, frame);
+        frame[len++] = 0;
+        if (_port.writable() >= len)
+        {
+            _port.write(frame, len);
+            _batches++;
+            _bytes += len;
+        }
+        else
+        {
+            _dropped++;
+        }
+        _sentMs = now;
+        _count = 0;
+        _length = TELEMETRY_HEADER_SIZE;
+    }
+
+    unsigned long batches(void) const { return _batches; }
+    unsigned long dropped(void) const { return _dropped; }      // Batches the port had no room for
+    unsigned long bytes(void) const { return _bytes; }
+
+private:
+    // Room for the record's body, the batch is sent first if it would not fit
+    uint8_t* record(uint32_t now, uint8_t type, uint8_t size)
+    {
+        if (_length + TELEMETRY_RECORD_HEADER_SIZE + size > TELEMETRY_MAX_PAYLOAD || _count == UINT8_MAX
+            || (_count > 0 && now - _firstMs > UINT16_MAX))
+        {
+            flush(now);
+        }
+        if (_count == 0)
+        {
+            _firstMs = now;
+        }
+        uint8_t* p = &_payload[_length];
+        p[0] = type;
+        p[1] = size;
+        telemetryPut16(p + 2, (uint16_t)(now - _firstMs));
+        _length += TELEMETRY_RECORD_HEADER_SIZE + size;
+        _count++;
+        return p + TELEMETRY_RECORD_HEADER_SIZE;
+    }
+
+    TelemetryPort& _port;
+    uint8_t _payload[TELEMETRY_MAX_PAYLOAD + TELEMETRY_CRC_SIZE];
+    size_t _length = TELEMETRY_HEADER_SIZE;
+    uint8_t _count = 0;
+    uint16_t _sequence = 0;
+    uint32_t _firstMs = 0;
+    uint32_t _sentMs = 0;
+    uint32_t _maxAge = 0;
+    uint32_t _heartbeat = 0;
+    unsigned long _batches = 0;
+    unsigned long _dropped = 0;
+    unsigned long _bytes = 0;
+};
+
+// Gets each batch and record the decoder finds
+class TelemetryHandler
+{
+public:
+    virtual ~TelemetryHandler() {}
+
+    virtual void onBatch(const TelemetryBatch& batch, uint16_t lost) { (void)batch; (void)lost; }
+    virtual void onRecord(const TelemetryBatch& batch, const TelemetryRecord& record) = 0;
+};
+
+class TelemetryDecoder
+{
+public:
+    explicit TelemetryDecoder(TelemetryHandler& handler) : _handler(handler) {}
+
+    // Any number of bytes, as they come off the port
+    void feed(const uint8_t* data, size_t len)
+    {
+        _bytes += len;
+        for (size_t i = 0; i < len; i++)
+        {
+            if (data[i] != 0)
+            {
+                if (_length < sizeof(_frame))
+                {
+                    _frame[_length] = data[i];
+                }
+                _length++;      // An overlong frame is counted as bad at its delimiter
+                continue;
+            }
+            if (_length > 0)
+            {
+                frame();
+            }
+            _length = 0;
+        }
+    }
+
+    unsigned long bytes(void) const { return _bytes; }
+    unsigned long batches(void) const { return _batches; }
+    unsigned long records(void) const { return _records; }
+    unsigned long badFrames(void) const { return _bad; }        // Failed COBS, CRC or layout
+    unsigned long lostBatches(void) const { return _lost; }     // Gaps in the batch sequence
+
+private:
+    void frame(void)
+    {
+        size_t len = (_length <= sizeof(_frame)) ? cobsDecode(_frame, _length, _frame) : 0;
+        if (len < TELEMETRY_HEADER_SIZE + TELEMETRY_CRC_SIZE
+            || telemetryCrc(_frame, len - TELEMETRY_CRC_SIZE) != telemetryGet16(&_frame[len - TELEMETRY_CRC_SIZE])
+            || _frame[0] != TELEMETRY_VERSION)
+        {
+            _bad++;
+            return;
+        }
+        len -= TELEMETRY_CRC_SIZE;
+
+        TelemetryBatch batch;
+        batch.sequence = telemetryGet16(&_frame[1]);
+        batch.ms = telemetryGet32(&_frame[3]);
+        batch.count = _frame[7];
+
+        // Check the layout before handing anything on, a batch is taken whole or not at all
+        size_t at = TELEMETRY_HEADER_SIZE;
+        for (uint8_t n = 0; n < batch.count; n++)
+        {
+            if (at + TELEMETRY_RECORD_HEADER_SIZE > len || at + TELEMETRY_RECORD_HEADER_SIZE + _frame[at + 1] > len)
+            {
+                _bad++;
+                return;
+            }
+            at += TELEMETRY_RECORD_HEADER_SIZE + _frame[at + 1];
+        }
+
+        uint16_t lost = _synced ? (uint16_t)(batch.sequence - _nextSequence) : 0;
+        _lost += lost;
+        _nextSequence = (uint16_t)(batch.sequence + 1);
+        _synced = true;
+        _batches++;
+        _handler.onBatch(batch, lost);
+
+        at = TELEMETRY_HEADER_SIZE;
+        for (uint8_t n = 0; n < batch.count; n++)
+        {
+            const uint8_t* p = &_frame[at];
+            uint8_t size = p[1];
+            TelemetryRecord record = {};
+            record.type = p[0];
+            record.ms = batch.ms + telemetryGet16(p + 2);
+            if (parse(record, p + TELEMETRY_RECORD_HEADER_SIZE, size))
+            {
+                _records++;
+                _handler.onRecord(batch, record);
+            }
+            at += TELEMETRY_RECORD_HEADER_SIZE + size;
+        }
+    }
+
+    // False for a type this reader does not know, or a body too short for it
+    static bool parse(TelemetryRecord& record, const uint8_t* p, uint8_t size)
+    {
+        switch (record.type)
+        {
+        case TELEMETRY_NODE:
+            if (size < TELEMETRY_NODE_SIZE)
+            {
+                return false;
+            }
+            record.node.address = telemetryGet16(p);
+            record.node.alarmState = p[2];
+            record.node.relays = p[3];
+            record.node.inputs = p[4];
+            record.node.rssi = (int16_t)telemetryGet16(p + 5);
+            record.node.snr = (int8_t)p[7];
+            record.node.rxCount = telemetryGet32(p + 8);
+            record.node.missedPolls = telemetryGet32(p + 12);
+            record.node.spreadingFactor = p[16];
+            record.node.txPower = (int8_t)p[17];
+            return true;
+        case TELEMETRY_COMMAND:
+            if (size < TELEMETRY_COMMAND_SIZE)
+            {
+                return false;
+            }
+            record.command.address = telemetryGet16(p);
+            record.command.sequence = p[2];
+            record.command.state = p[3];
+            record.command.latencyMs = telemetryGet16(p + 4);
+            return true;
+        case TELEMETRY_HUB:
+            if (size < TELEMETRY_HUB_SIZE)
+            {
+                return false;
+            }
+            record.hub.nodes = telemetryGet16(p);
+            record.hub.rejectedFrames = telemetryGet32(p + 2);
+            record.hub.commandsQueued = telemetryGet32(p + 6);
+            record.hub.commandsDropped = telemetryGet32(p + 10);
+            record.hub.uiDropped = telemetryGet32(p + 14);
+            record.hub.telemetryDropped = telemetryGet32(p + 18);
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    TelemetryHandler& _handler;
+    uint8_t _frame[TELEMETRY_MAX_FRAME];
+    size_t _length = 0;
+    uint16_t _nextSequence = 0;
+    bool _synced = false;
+    unsigned long _bytes = 0;
+    unsigned long _batches = 0;
+    unsigned long _records = 0;
+    unsigned long _bad = 0;
+    unsigned long _lost = 0;
+};
+
+#endif // LORA_ALARM_TELEMETRY_H
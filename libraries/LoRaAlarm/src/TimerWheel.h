@@ -0,0 +1,324 @@
+/*
+*  Title          :  TimerWheel
+*  Desc           :  Cooperative scheduler for the periodic work in loop().  Tasks are plain
+*                 :  functions run every interval ms, or once after a delay, from run().
+*                 :  Nothing is preempted, a task runs to completion and the next one waits.
+*                 :
+*                 :  Tasks sit on a hashed timing wheel of Slots 1 ms slots, each a doubly
+*                 :  linked list through a fixed pool of MaxTasks, so adding, cancelling and
+*                 :  expiring a task is O(1) and there is no heap.  A deadline more than Slots
+*                 :  ms away waits in its slot for later laps.  run() only visits the slots
+*                 :  between the last call and now, all Slots at most after a long stall.
+*                 :
+*                 :  Periodic deadlines advance by the interval, not from when the task ran,
+*                 :  so they do not drift.  A task that runs a whole interval or more late
+*                 :  skips the periods it missed and counts them as overruns.  Every task keeps
+*                 :  its run count, overruns and worst lateness past its deadline.
+*                 :
+*                 :  Slots must be a power of two.  Times are millis() and may wrap.
+*                 :
+*  Author         :  Shaun Stewart
+*  Created        :  2026-10-17
+*  Version        :  1.0
+*
+*/
+
+#ifndef LORA_ALARM_TIMER_WHEEL_H
+#define LORA_ALARM_TIMER_WHEEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TIMER_NONE                                  0xFFFF  // No task, the end of a slot list
+
+typedef void (*TimerTaskFn)(void* context, uint32_t now);
+
+typedef struct
+{
+    TimerTaskFn fn;             // NULL while the pool entry is free
+    void* context;
+    uint32_t interval;          // ms, 0 for a one shot
+    uint32_t deadline;          // ms, next time it is due
+    unsigned long runs;
+    unsigned long overruns;     // Periods skipped because it ran an interval or more late
+    uint32_t maxLate;           // ms, worst time past the deadline it ran at
+    uint16_t next;              // Slot list links
+    uint16_t prev;
+    uint16_t slot;              // Wheel slot it is linked into
+    bool queued;                // On the wheel, false for a one shot that has run or a cancelled task
+} TimerTask;
+
+template <size_t Slots, size_t MaxTasks>
+class TimerWheel
+{
+    static_assert(Slots >= 2 && (Slots & (Slots - 1)) == 0, "TimerWheel slots must be a power of two");
+    static_assert(MaxTasks > 0 && MaxTasks < TIMER_NONE, "TimerWheel holds at most 65534 tasks");
+
+public:
+    TimerWheel()
+    {
+        for (size_t i = 0; i < Slots; i++)
+        {
+            _heads[i] = TIMER_NONE;
+        }
+        for (size_t i = 0; i < MaxTasks; i++)
+        {
+            _tasks[i].fn = NULL;
+            _tasks[i].queued = false;
+        }
+    }
+
+    // Call before adding tasks, with the time the first run() is due
+    void begin(uint32_t now)
+    {
+        _cursor = now;
+        _now = now;
+    }
+
+    // Runs fn every interval ms, first after delay ms.  Returns the task id, -1 if the pool is full.
+    // Delays count from the now of the last run()
+    int every(uint32_t interval, TimerTaskFn fn, void* context = NULL, uint32_t delay = 0)
+    {
+        return add(interval, delay, fn, context);
+    }
+
+    // Runs fn once after delay ms.  The id stays valid for reschedule() until the task is removed
+    int after(uint32_t delay, TimerTaskFn fn, void* context = NULL)
+    {
+        return add(0, delay, fn, context);
+    }
+
+    // Next run delay ms after now, for a periodic task the interval carries on from there
+    bool reschedule(int id, uint32_t now, uint32_t delay)
+    {
+        if (!valid(id))
+        {
+            return false;
+        }
+        unlink((uint16_t)id);
+        _tasks[id].deadline = now + delay;
+        link((uint16_t)id);
+        return true;
+    }
+
+    // Stops the task but keeps its id and counters, reschedule() starts it again
+    bool cancel(int id)
+    {
+        if (!valid(id))
+        {
+            return false;
+        }
+        unlink((uint16_t)id);
+        return true;
+    }
+
+    // Frees the pool entry
+    bool remove(int id)
+    {
+        if (!cancel(id))
+        {
+            return false;
+        }
+        _tasks[id].fn = NULL;
+        _count--;
+        return true;
+    }
+
+    // Runs every task due by now.  Tasks may add, cancel or reschedule any task, including
+    // themselves.  Returns the number of tasks run
+    unsigned int run(uint32_t now)
+    {
+        unsigned int ran = 0;
+        if ((int32_t)(now - _cursor) < 0)
+        {
+            return 0;
+        }
+        uint32_t ticks = now - _cursor + 1;
+        if (ticks > Slots)
+        {
+            ticks = Slots;     // Every slot once, deadlines are checked against now
+        }
+        _now = now;
+        _inRun = true;
+        for (uint32_t t = 0; t < ticks; t++)
+        {
+            uint16_t slot = (uint16_t)((_cursor + t) & (Slots - 1));
+            uint16_t index = _heads[slot];
+            while (index != TIMER_NONE)
+            {
+                // Anything the task unlinks that this walk was about to visit moves _walkNext on
+                _walkNext = _tasks[index].next;
+                TimerTask& task = _tasks[index];
+                if ((int32_t)(now - task.deadline) >= 0)
+                {
+                    fire(index, now);
+                    ran++;
+                }
+                index = _walkNext;
+            }
+        }
+        _walkNext = TIMER_NONE;
+        _inRun = false;
+        _cursor = now + 1;
+        return ran;
+    }
+
+    // ms until the next task is due after a run() at now, Slots if nothing is due sooner.
+    // The caller can sleep this long
+    uint32_t idle(uint32_t now) const
+    {
+        uint32_t from = ((int32_t)(now + 1 - _cursor) > 0) ? now + 1 : _cursor;
+        for (uint32_t t = 0; t < Slots; t++)
+        {
+            uint32_t tick = from + t;
+            for (uint16_t index = _heads[tick & (Slots - 1)]; index != TIMER_NONE; index = _tasks[index].next)
+            {
+                if ((int32_t)(tick - _tasks[index].deadline) >= 0)
+                {
+                    return tick - now;
+                }
+            }
+        }
+        return (uint32_t)Slots;
+    }
+
+    const TimerTask& task(int id) const { return _tasks[id]; }
+    size_t count(void) const { return _count; }
+    unsigned long runs(void) const { return _runs; }
+    unsigned long overruns(void) const { return _overruns; }
+    uint32_t maxLate(void) const { return _maxLate; }
+
+    // Zeroes the run counts, overruns and lateness of every task and of the wheel
+    void resetStats(void)
+    {
+        for (size_t i = 0; i < MaxTasks; i++)
+        {
+            _tasks[i].runs = 0;
+            _tasks[i].overruns = 0;
+            _tasks[i].maxLate = 0;
+        }
+        _runs = 0;
+        _overruns = 0;
+        _maxLate = 0;
+    }
+
+private:
+    bool valid(int id) const
+    {
+        return id >= 0 && (size_t)id < MaxTasks && _tasks[id].fn != NULL;
+    }
+
+    int add(uint32_t interval, uint32_t delay, TimerTaskFn fn, void* context)
+    {
+        if (fn == NULL)
+        {
+            return -1;
+        }
+        // Scan on from the last entry handed out, a fixed set of tasks never scans at all
+        for (size_t n = 0; n < MaxTasks; n++)
+        {
+            uint16_t index = (uint16_t)((_free + n) % MaxTasks);
+            TimerTask& task = _tasks[index];
+            if (task.fn == NULL)
+            {
+                task.fn = fn;
+                task.context = context;
+                task.interval = interval;
+                task.deadline = _now + delay;
+                task.runs = 0;
+                task.overruns = 0;
+                task.maxLate = 0;
+                link(index);
+                _free = (uint16_t)((index + 1) % MaxTasks);
+                _count++;
+                return index;
+            }
+        }
+        return -1;
+    }
+
+    void fire(uint16_t index, uint32_t now)
+    {
+        TimerTask& task = _tasks[index];
+        uint32_t late = now - task.deadline;
+        unlink(index);
+        if (late > task.maxLate)
+        {
+            task.maxLate = late;
+        }
+        if (late > _maxLate)
+        {
+            _maxLate = late;
+        }
+        task.runs++;
+        _runs++;
+        if (task.interval > 0)
+        {
+            uint32_t missed = late / task.interval;
+            task.overruns += missed;
+            _overruns += missed;
+            task.deadline += (missed + 1) * task.interval;
+            link(index);
+        }
+        task.fn(task.context, now);
+    }
+
+    // A deadline already passed goes in the next slot run() visits, which inside a run() is
+    // the tick after its now
+    void link(uint16_t index)
+    {
+        TimerTask& task = _tasks[index];
+        uint32_t earliest = _inRun ? _now + 1 : _cursor;
+        uint32_t at = ((int32_t)(task.deadline - earliest) < 0) ? earliest : task.deadline;
+        uint16_t slot = (uint16_t)(at & (Slots - 1));
+        task.slot = slot;
+        task.prev = TIMER_NONE;
+        task.next = _heads[slot];
+        if (task.next != TIMER_NONE)
+        {
+            _tasks[task.next].prev = index;
+        }
+        _heads[slot] = index;
+        task.queued = true;
+    }
+
+    void unlink(uint16_t index)
+    {
+        TimerTask& task = _tasks[index];
+        if (!task.queued)
+        {
+            return;
+        }
+        if (index == _walkNext)
+        {
+            _walkNext = task.next;
+        }
+        if (task.prev != TIMER_NONE)
+        {
+            _tasks[task.prev].next = task.next;
+        }
+        else
+        {
+            _heads[task.slot] = task.next;
+        }
+        if (task.next != TIMER_NONE)
+        {
+            _tasks[task.next].prev = task.prev;
+        }
+        task.queued = false;
+    }
+
+    uint16_t _heads[Slots];
+    TimerTask _tasks[MaxTasks];
+    uint32_t _cursor = 0;       // Next tick run() visits
+    uint32_t _now = 0;          // now of the last run()
+    uint16_t _walkNext = TIMER_NONE;
+    uint16_t _free = 0;
+    bool _inRun = false;
+    size_t _count = 0;
+    unsigned long _runs = 0;
+    unsigned long _overruns = 0;
+    uint32_t _maxLate = 0;
+};
+
+#endif // LORA_ALARM_TIMER_WHEEL_H